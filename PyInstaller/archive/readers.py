@@ -30,32 +30,57 @@ class CTOCReader:
 
     When written to disk, it is easily read from C.
     """
-    # (structlen, dpos, dlen, ulen, flag, typcd) followed by name
-    ENTRYSTRUCT = '!iIIIBB'
+    # (structlen, flag, typcd, entry flags, padding, dpos, dlen, ulen, checksum) followed by name, and by the SHA-256
+    # digest of the data if the entry has one
+    ENTRYSTRUCT = '!IBBBxQQQI'
     ENTRYLEN = struct.calcsize(ENTRYSTRUCT)
+    # (structlen, dpos, dlen, ulen, flag, typcd) followed by name; v5 format
+    ENTRYSTRUCT_V5 = '!iIIIBB'
+    ENTRYLEN_V5 = struct.calcsize(ENTRYSTRUCT_V5)
 
     def __init__(self):
         self.data = []
+        # CRC-32 checksums of the entries' uncompressed data (None if the entry has none), parallel to self.data.
+        self.checksums = []
+        # SHA-256 digests of the entries' uncompressed data (None if the entry has none), parallel to self.data.
+        self.digests = []
 
-    def frombinary(self, s):
+    def frombinary(self, s, version=6):
         """
         Decode the binary string into an in memory list.
 
         S is a binary string.
+        VERSION is the version of the archive format.
         """
         p = 0
 
         while p < len(s):
-            slen, dpos, dlen, ulen, flag, typcd = struct.unpack(self.ENTRYSTRUCT, s[p:p + self.ENTRYLEN])
-            nmlen = slen - self.ENTRYLEN
-            p = p + self.ENTRYLEN
+            if version >= 6:
+                slen, flag, typcd, entry_flags, dpos, dlen, ulen, checksum = \
+                    struct.unpack(self.ENTRYSTRUCT, s[p:p + self.ENTRYLEN])
+                if not entry_flags & 1:  # ENTRY_FLAG_CHECKSUM
+                    checksum = None
+                nmlen = slen - self.ENTRYLEN
+                p = p + self.ENTRYLEN
+                digest = None
+                if entry_flags & 2:  # ENTRY_FLAG_DIGEST
+                    nmlen -= 32
+                    digest = s[p + nmlen:p + nmlen + 32]
+            else:
+                slen, dpos, dlen, ulen, flag, typcd = struct.unpack(self.ENTRYSTRUCT_V5, s[p:p + self.ENTRYLEN_V5])
+                checksum = None
+                digest = None
+                nmlen = slen - self.ENTRYLEN_V5
+                p = p + self.ENTRYLEN_V5
             nm, = struct.unpack('%is' % nmlen, s[p:p + nmlen])
-            p = p + nmlen
+            p = p + nmlen + (32 if digest is not None else 0)
             # nm may have up to 15 bytes of padding
             nm = nm.rstrip(b'\0')
             nm = nm.decode('utf-8')
             typcd = chr(typcd)
             self.data.append((dpos, dlen, ulen, flag, typcd, nm))
+            self.checksums.append(checksum)
+            self.digests.append(digest)
 
     def get(self, ndx):
         """
@@ -87,8 +112,10 @@ class CArchiveReader(ArchiveReader):
 
     Easily handled from C or from Python.
     """
-    # MAGIC is useful to verify that conversion of Python data types to C structure and back works properly.
-    MAGIC = b'MEI\014\013\012\013\016'
+    # MAGIC is useful to verify that conversion of Python data types to C structure and back works properly. Its last
+    # byte identifies the version of the archive format; both v6 and v5 archives can be read.
+    MAGIC = b'MEI\014\013\012\013\017'
+    MAGIC_V5 = b'MEI\014\013\012\013\016'
     HDRLEN = 0
     LEVEL = 9
 
@@ -96,16 +123,20 @@ class CArchiveReader(ArchiveReader):
     # byte order. C struct looks like:
     #
     #   typedef struct _cookie {
-    #       char magic[8]; /* 'MEI\014\013\012\013\016' */
-    #       uint32_t len;  /* len of entire package */
-    #       uint32_t TOC;  /* pos (rel to start) of TableOfContents */
-    #       int  TOClen;   /* length of TableOfContents */
+    #       char magic[8]; /* 'MEI\014\013\012\013\017' */
+    #       uint64_t len;  /* len of entire package */
+    #       uint64_t TOC;  /* pos (rel to start) of TableOfContents */
+    #       uint64_t TOClen;   /* length of TableOfContents */
     #       int  pyvers;   /* new in v4 */
+    #       int  reserved;
     #       char pylibname[64];    /* Filename of Python dynamic library. */
     #   } COOKIE;
     #
-    _cookie_format = '!8sIIii64s'
+    # In v5, the len, TOC and TOClen fields were 32-bit, and there was no reserved field.
+    _cookie_format = '!8sQQQii64s'
     _cookie_size = struct.calcsize(_cookie_format)
+    _cookie_format_v5 = '!8sIIii64s'
+    _cookie_size_v5 = struct.calcsize(_cookie_format_v5)
 
     def __init__(self, archive_path=None, start=0, length=0, pylib_name=''):
         """
@@ -121,6 +152,7 @@ def __init__(self, archive_path=None, start=0, length=0, pylib_name=''):
 
         # A CArchive created from scratch starts at 0, no leading bootloader.
         self.pkg_start = 0
+        self.version = 6
         super().__init__(archive_path, start)
 
     def checkmagic(self):
@@ -138,6 +170,8 @@ def checkmagic(self):
             self.lib.seek(0, os.SEEK_END)
         end_pos = self.lib.tell()
 
+        # Search for the part of the magic that is common to all versions.
+        magic_prefix = self.MAGIC[:-1]
         SEARCH_CHUNK_SIZE = 8192
         magic_offset = -1
         while end_pos >= len(self.MAGIC):
@@ -149,7 +183,7 @@ def checkmagic(self):
             # Read and scan the chunk
             self.lib.seek(start_pos, os.SEEK_SET)
             buf = self.lib.read(chunk_size)
-            pos = buf.rfind(self.MAGIC)
+            pos = buf.rfind(magic_prefix)
             if pos != -1:
                 magic_offset = start_pos + pos
                 break
@@ -157,12 +191,25 @@ def checkmagic(self):
             end_pos = start_pos + len(self.MAGIC) - 1
         if magic_offset == -1:
             raise RuntimeError("%s is not a valid %s archive file" % (self.path, self.__class__.__name__))
-        filelen = magic_offset + self._cookie_size
         # Read the whole cookie
         self.lib.seek(magic_offset, os.SEEK_SET)
-        buf = self.lib.read(self._cookie_size)
-        magic, totallen, tocpos, toclen, pyvers, pylib_name = struct.unpack(self._cookie_format, buf)
-        if magic != self.MAGIC:
+        magic = self.lib.read(len(self.MAGIC))
+        self.lib.seek(magic_offset, os.SEEK_SET)
+        if magic == self.MAGIC:
+            self.version = 6
+            filelen = magic_offset + self._cookie_size
+            buf = self.lib.read(self._cookie_size)
+            if len(buf) < self._cookie_size:
+                raise RuntimeError("%s is not a valid %s archive file" % (self.path, self.__class__.__name__))
+            magic, totallen, tocpos, toclen, pyvers, _, pylib_name = struct.unpack(self._cookie_format, buf)
+        elif magic == self.MAGIC_V5:
+            self.version = 5
+            filelen = magic_offset + self._cookie_size_v5
+            buf = self.lib.read(self._cookie_size_v5)
+            if len(buf) < self._cookie_size_v5:
+                raise RuntimeError("%s is not a valid %s archive file" % (self.path, self.__class__.__name__))
+            magic, totallen, tocpos, toclen, pyvers, pylib_name = struct.unpack(self._cookie_format_v5, buf)
+        else:
             raise RuntimeError("%s is not a valid %s archive file" % (self.path, self.__class__.__name__))
 
         self.pkg_start = filelen - totallen
@@ -181,7 +228,7 @@ def loadtoc(self):
         self.toc = CTOCReader()
         self.lib.seek(self.pkg_start + self.tocpos)
         tocstr = self.lib.read(self.toclen)
-        self.toc.frombinary(tocstr)
+        self.toc.frombinary(tocstr, self.version)
 
     def extract(self, name):
         """
@@ -208,6 +255,22 @@ def extract(self, name):
         if flag == 1:
             import zlib
             rslt = zlib.decompress(rslt)
+        elif flag == 2:
+            import zstandard
+            rslt = zstandard.ZstdDecompressor().decompress(rslt, max_output_size=ulen)
+        elif flag == 3:
+            import lz4.frame
+            rslt = lz4.frame.decompress(rslt)
+        checksum = self.toc.checksums[ndx]
+        if checksum is not None:
+            import zlib
+            if zlib.crc32(rslt) != checksum:
+                raise ValueError("Checksum mismatch of entry %r; the archive is corrupted." % nm)
+        digest = self.toc.digests[ndx]
+        if digest is not None:
+            import hashlib
+            if hashlib.sha256(rslt).digest() != digest:
+                raise ValueError("Digest mismatch of entry %r; the archive is corrupted." % nm)
         if typcd == 'M':
             return 1, rslt
 
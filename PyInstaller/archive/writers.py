@@ -17,17 +17,25 @@
 #
 # See pyi_carchive.py for a more general archive (contains anything) that can be understood by a C program.
 
+import collections
+import concurrent.futures
+import hashlib
+import heapq
 import marshal
 import os
 import shutil
 import struct
 import sys
+import tempfile
 import zlib
 from types import CodeType
 
 from PyInstaller.building.utils import fake_pyc_timestamp, get_code_object, strip_paths_in_code
 from PyInstaller.compat import BYTECODE_MAGIC, is_win
-from PyInstaller.loader.pyimod02_archive import PYZ_TYPE_DATA, PYZ_TYPE_MODULE, PYZ_TYPE_NSPKG, PYZ_TYPE_PKG
+from PyInstaller.loader.pyimod02_archive import (
+    PYZ_INDEX_ENTRY, PYZ_INDEX_FLAG_PREFETCH, PYZ_INDEX_HEADER, PYZ_INDEX_MAGIC, PYZ_TYPE_DATA, PYZ_TYPE_MODULE,
+    PYZ_TYPE_NSPKG, PYZ_TYPE_PKG
+)
 
 
 class ArchiveWriter:
@@ -39,6 +47,8 @@ class ArchiveWriter:
     MAGIC = b'PYL\0'
     HDRLEN = 12  # default is MAGIC followed by python's magic, int pos of toc
     TOCPOS = 8
+    # Number of threads that compress the entries; subclasses set it from their compression_workers argument.
+    _compression_workers = 1
 
     def __init__(self, archive_path, logical_toc):
         """
@@ -46,6 +56,7 @@ def __init__(self, archive_path, logical_toc):
         where name is the internal name (e.g., 'a') and path is a file to get the object from (e.g., './a.pyc').
         """
         self.start = 0
+        self._executor = None
 
         self._start_add_entries(archive_path)
         self._add_from_table_of_contents(logical_toc)
@@ -71,8 +82,50 @@ def _add_from_table_of_contents(self, toc):
           entry[2] is a flag for its storage format (True or 1 if compressed).
           entry[3] is the entry's type code.
         """
-        for toc_entry in toc:
-            self.add(toc_entry)  # The guts of the archive.
+        if self._compression_workers <= 1:
+            for toc_entry in toc:
+                self.add(toc_entry)  # The guts of the archive.
+            return
+
+        # zlib (as well as zstandard and lz4) releases the GIL while compressing, so the entries can be compressed by
+        # a pool of threads. The entries are still written in the order of the TOC, so that the archive is the same
+        # regardless of the number of workers.
+        self._pending = collections.deque()
+        with concurrent.futures.ThreadPoolExecutor(self._compression_workers) as executor:
+            self._executor = executor
+            try:
+                for toc_entry in toc:
+                    self.add(toc_entry)
+                while self._pending:
+                    self._write_pending()
+            finally:
+                for future, _ in self._pending:
+                    if future:
+                        future.cancel()
+                self._executor = None
+
+    def _schedule(self, write, compute=None):
+        """
+        Schedule writing of an entry. The callable `compute` (if given), e.g., the compression of the entry's data, is
+        run by the pool of compression workers, if there is one, and `write` is then called with its result (or None),
+        in the order in which the entries were scheduled.
+        """
+        if self._executor is None:
+            write(compute() if compute else None)
+            return
+        self._pending.append((self._executor.submit(compute) if compute else None, write))
+        # Write out the entries that are ready, and limit the number of compressed entries that are held back.
+        while self._pending and (
+            len(self._pending) > 2 * self._compression_workers or not self._pending[0][0] or self._pending[0][0].done()
+        ):
+            self._write_pending()
+
+    def _write_pending(self):
+        """
+        Write the oldest scheduled entry, waiting for its compression to finish.
+        """
+        future, write = self._pending.popleft()
+        write(future.result() if future else None)
 
     def _finalize(self):
         """
@@ -145,6 +198,61 @@ def update_headers(self, tocpos):
         self.lib.write(struct.pack('!i', tocpos))
 
 
+def train_compression_dictionary(samples, size=32 * 1024, kmer_size=8, segment_size=64, max_sample_size=2 << 20):
+    """
+    Train a zlib preset dictionary of at most `size` bytes over the given samples (bytes objects, e.g., marshalled code
+    objects), in the spirit of the COVER algorithm of zstd: the dictionary consists of the segments of the samples that
+    cover the most k-mers (the byte strings of length `kmer_size`) that occur in several samples, weighted by the number
+    of samples they occur in. Only about `max_sample_size` bytes of the samples, evenly picked, are used for training.
+    Returns b'' if there is nothing worth putting into a dictionary.
+    """
+    samples = [sample for sample in samples if len(sample) >= segment_size]
+    total_size = sum(len(sample) for sample in samples)
+    if total_size > max_sample_size:
+        step = total_size / max_sample_size
+        samples = [samples[int(i * step)] for i in range(int(len(samples) / step))]
+
+    def kmers(data):
+        return {data[i:i + kmer_size] for i in range(len(data) - kmer_size + 1)}
+
+    # Number of samples in which each k-mer occurs, for those that occur in more than one.
+    frequencies = {}
+    for sample in samples:
+        for kmer in kmers(sample):
+            frequencies[kmer] = frequencies.get(kmer, 0) + 1
+    frequencies = {kmer: count for kmer, count in frequencies.items() if count > 1}
+
+    def score(segment):
+        return sum(frequencies.get(kmer, 0) for kmer in kmers(segment))
+
+    # Lazy greedy selection of the segments with the highest scores. The score of a segment only decreases as the k-mers
+    # it covers are covered by the selected segments, so a popped segment whose score is still at least that of the
+    # next one is the best.
+    heap = []
+    for sample in samples:
+        for pos in range(0, len(sample) - segment_size + 1, segment_size):
+            segment = sample[pos:pos + segment_size]
+            heap.append((-score(segment), len(heap), segment))
+    heapq.heapify(heap)
+    selected = []
+    selected_size = 0
+    while heap and selected_size < size:
+        _, order, segment = heapq.heappop(heap)
+        current = score(segment)
+        if current == 0:
+            continue
+        if heap and current < -heap[0][0]:
+            heapq.heappush(heap, (-current, order, segment))
+            continue
+        selected.append(segment)
+        selected_size += len(segment)
+        for kmer in kmers(segment):
+            frequencies.pop(kmer, None)
+
+    # zlib encodes matches at shorter distances with fewer bits, so put the most valuable segments at the end.
+    return b''.join(reversed(selected))[-size:]
+
+
 class ZlibArchiveWriter(ArchiveWriter):
     """
     ZlibArchive - an archive with compressed entries. Archive is read from the executable created by PyInstaller.
@@ -158,16 +266,46 @@ class ZlibArchiveWriter(ArchiveWriter):
     HDRLEN = ArchiveWriter.HDRLEN + 5
     COMPRESSION_LEVEL = 6  # Default level of the 'zlib' module from Python.
 
-    def __init__(self, archive_path, logical_toc, code_dict=None, cipher=None):
-        """
-        code_dict      dict containing module code objects from ModuleGraph.
+    def __init__(
+        self,
+        archive_path,
+        logical_toc,
+        code_dict=None,
+        cipher=None,
+        prefetch_modules=None,
+        shared_dictionary=False,
+        compression_workers=None
+    ):
+        """
+        code_dict          dict containing module code objects from ModuleGraph.
+        prefetch_modules   names of the modules to flag for prefetching by the bootloader.
+        shared_dictionary  train a compression dictionary over the code objects of the modules, store it once in the
+                           archive, and use it as zlib preset dictionary for all modules.
+        compression_workers
+                           number of threads that compress (and encrypt) the modules; the archive does not depend on it.
         """
         # Keep references to module code objects constructed by ModuleGraph to avoid writing .pyc/pyo files to hdd.
         self.code_dict = code_dict or {}
+        self._compression_workers = compression_workers or 1
         self.cipher = cipher or None
+        self.prefetch_modules = set(prefetch_modules or ())
+        self.zdict = b''
+        self.zdict_pos = 0
+        if shared_dictionary:
+            self.zdict = train_compression_dictionary([
+                marshal.dumps(self.code_dict[name]) for name, path, typ in logical_toc if typ == 'PYMODULE'
+            ])
 
         super().__init__(archive_path, logical_toc)
 
+    def _start_add_entries(self, archive_path):
+        """
+        Open an empty archive, and write the shared compression dictionary, if any, right after the header.
+        """
+        super()._start_add_entries(archive_path)
+        self.zdict_pos = self.lib.tell()
+        self.lib.write(self.zdict)
+
     def add(self, entry):
         name, path, typ = entry
         if typ == 'PYMODULE':
@@ -189,14 +327,38 @@ def add(self, entry):
             # No need to use forward slash as path-separator here since pkg_resources on Windows back slash as
             # path-separator.
 
-        obj = zlib.compress(data, self.COMPRESSION_LEVEL)
+        def compress():
+            if self.zdict and typ != PYZ_TYPE_DATA:
+                compressor = zlib.compressobj(self.COMPRESSION_LEVEL, zdict=self.zdict)
+                obj = compressor.compress(data) + compressor.flush()
+            else:
+                obj = zlib.compress(data, self.COMPRESSION_LEVEL)
+            # First compress then encrypt.
+            if self.cipher:
+                obj = self.cipher.encrypt(obj)
+            return obj
 
-        # First compress then encrypt.
-        if self.cipher:
-            obj = self.cipher.encrypt(obj)
+        def write(obj):
+            self.toc.append((name, (typ, self.lib.tell(), len(obj))))
+            self.lib.write(obj)
 
-        self.toc.append((name, (typ, self.lib.tell(), len(obj))))
-        self.lib.write(obj)
+        self._schedule(write, compress)
+
+    def save_trailer(self, tocpos):
+        """
+        Write the TOC as an index sorted by name, which the bootloader and ZlibArchiveReader binary-search in place
+        (see PYZ_INDEX_MAGIC in pyimod02_archive).
+        """
+        # For duplicate names, the last entry takes precedence, as with the TOC loaded into a dict.
+        entries = sorted((name.encode('utf-8'), entry) for name, entry in dict(self.toc).items())
+        name_offset = struct.calcsize(PYZ_INDEX_HEADER) + len(entries) * struct.calcsize(PYZ_INDEX_ENTRY)
+        index = [struct.pack(PYZ_INDEX_HEADER, PYZ_INDEX_MAGIC, len(entries), self.zdict_pos, len(self.zdict))]
+        for name, (typ, pos, length) in entries:
+            flags = PYZ_INDEX_FLAG_PREFETCH if name.decode('utf-8') in self.prefetch_modules else 0
+            index.append(struct.pack(PYZ_INDEX_ENTRY, name_offset, pos, length, len(name), typ, flags))
+            name_offset += len(name)
+        index.extend(name for name, _ in entries)
+        self.lib.write(b''.join(index))
 
     def update_headers(self, tocpos):
         """
@@ -212,19 +374,25 @@ class CTOC:
 
     When written to disk, it is easily read from C.
     """
-    # (structlen, dpos, dlen, ulen, flag, typcd) followed by name
-    ENTRYSTRUCT = '!iIIIBB'
+    # (structlen, flag, typcd, entry flags, padding, dpos, dlen, ulen, checksum) followed by name; the v6 layout, in
+    # which all fields are naturally aligned, so that the bootloader can access them in place. If the entry has a
+    # SHA-256 digest, it takes the last DIGEST_SIZE bytes of the entry, after the padded name.
+    ENTRYSTRUCT = '!IBBBxQQQI'
     ENTRYLEN = struct.calcsize(ENTRYSTRUCT)
 
     def __init__(self):
         self.data = []
+        # CRC-32 checksums of the entries' uncompressed data (None if the entry has none), parallel to self.data.
+        self.checksums = []
+        # SHA-256 digests of the entries' uncompressed data (None if the entry has none), parallel to self.data.
+        self.digests = []
 
     def tobinary(self):
         """
         Return self as a binary string.
         """
         rslt = []
-        for (dpos, dlen, ulen, flag, typcd, nm) in self.data:
+        for (dpos, dlen, ulen, flag, typcd, nm), checksum, digest in zip(self.data, self.checksums, self.digests):
             # Encode all names using UTF-8. This should be safe as standard python modules only contain ascii-characters
             # (and standard shared libraries should have the same), and thus the C-code still can handle this correctly.
             nm = nm.encode('utf-8')
@@ -237,16 +405,22 @@ def tobinary(self):
                 padlen = 16 - (toclen % 16)
                 pad = b'\0' * padlen
                 nmlen = nmlen + padlen
+            nm = (nm + pad).ljust(nmlen, b'\0')
+            entry_flags = ENTRY_FLAG_CHECKSUM if checksum is not None else 0
+            if digest is not None:
+                entry_flags |= ENTRY_FLAG_DIGEST
+                nm += digest
+                nmlen += DIGEST_SIZE
             rslt.append(
                 struct.pack(
-                    self.ENTRYSTRUCT + '%is' % nmlen, nmlen + self.ENTRYLEN, dpos, dlen, ulen, flag, ord(typcd),
-                    nm + pad
+                    self.ENTRYSTRUCT + '%is' % nmlen, nmlen + self.ENTRYLEN, flag, ord(typcd), entry_flags, dpos, dlen,
+                    ulen, checksum or 0, nm
                 )
             )
 
         return b''.join(rslt)
 
-    def add(self, dpos, dlen, ulen, flag, typcd, nm):
+    def add(self, dpos, dlen, ulen, flag, typcd, nm, checksum=None, digest=None):
         """
         Add an entry to the table of contents.
 
@@ -256,6 +430,8 @@ def add(self, dpos, dlen, ulen, flag, typcd, nm):
         FLAG says if the data is compressed.
         TYPCD is the "type" of the entry (used by the C code)
         NM is the entry's name.
+        CHECKSUM is the CRC-32 of the uncompressed data, which the bootloader verifies when extracting the entry.
+        DIGEST is the SHA-256 digest of the uncompressed data, the key of the entry in the content-addressed store.
 
         This function is used only while creating an executable.
         """
@@ -267,6 +443,42 @@ def add(self, dpos, dlen, ulen, flag, typcd, nm):
             # manually.
             nm = nm.replace(os.path.sep, '\\')
         self.data.append((dpos, dlen, ulen, flag, typcd, nm))
+        self.checksums.append(checksum)
+        self.digests.append(digest)
+
+
+# Compression methods of CArchive entries; keep in sync with ARCHIVE_COMPRESSION_* in bootloader/src/pyi_archive.h.
+COMPRESSION_NONE = 0
+COMPRESSION_ZLIB = 1
+COMPRESSION_ZSTD = 2
+COMPRESSION_LZ4 = 3
+
+# Flags of CArchive entries; keep in sync with ARCHIVE_FLAG_* in bootloader/src/pyi_archive.h.
+ENTRY_FLAG_CHECKSUM = 1
+ENTRY_FLAG_DIGEST = 2
+
+# Size of the SHA-256 digests of CArchive entries; keep in sync with ARCHIVE_DIGEST_SIZE.
+DIGEST_SIZE = 32
+
+
+class _LZ4FrameCompressor:
+    """
+    Wrapper that gives lz4.frame.LZ4FrameCompressor the interface of zlib's compression objects.
+    """
+    def __init__(self, level):
+        import lz4.frame
+        self._compressor = lz4.frame.LZ4FrameCompressor(compression_level=level, content_checksum=True)
+        self._header = self._compressor.begin()
+
+    def _take_header(self):
+        header, self._header = self._header, b''
+        return header
+
+    def compress(self, data):
+        return self._take_header() + self._compressor.compress(data)
+
+    def flush(self):
+        return self._take_header() + self._compressor.flush()
 
 
 class CArchiveWriter(ArchiveWriter):
@@ -278,27 +490,44 @@ class CArchiveWriter(ArchiveWriter):
 
     Easily handled from C or from Python.
     """
-    # MAGIC is useful to verify that conversion of Python data types to C structure and back works properly.
-    MAGIC = b'MEI\014\013\012\013\016'
+    # MAGIC is useful to verify that conversion of Python data types to C structure and back works properly. It also
+    # identifies the version of the archive format; this is v6 (v5 used b'MEI\014\013\012\013\016').
+    MAGIC = b'MEI\014\013\012\013\017'
     HDRLEN = 0
     LEVEL = 9
+    # Compression levels for zstd and LZ4; the decompression speed does not depend on them.
+    ZSTD_LEVEL = 19
+    LZ4_LEVEL = 9
+    # Compressed files up to this size are held in memory until written into the archive, larger ones are spooled to
+    # temporary files.
+    _SPOOL_SIZE = 16 * 1024 * 1024
 
     # Cookie - holds some information for the bootloader. C struct format definition. '!' at the beginning means network
     # byte order. C struct looks like:
     #
     #   typedef struct _cookie {
-    #       char magic[8]; /* 'MEI\014\013\012\013\016' */
-    #       uint32_t len;  /* len of entire package */
-    #       uint32_t TOC;  /* pos (rel to start) of TableOfContents */
-    #       int  TOClen;   /* length of TableOfContents */
+    #       char magic[8]; /* 'MEI\014\013\012\013\017' */
+    #       uint64_t len;  /* len of entire package */
+    #       uint64_t TOC;  /* pos (rel to start) of TableOfContents */
+    #       uint64_t TOClen;   /* length of TableOfContents */
     #       int  pyvers;   /* new in v4 */
+    #       int  reserved;
     #       char pylibname[64];    /* Filename of Python dynamic library. */
     #   } COOKIE;
     #
-    _cookie_format = '!8sIIii64s'
+    _cookie_format = '!8sQQQii64s'
     _cookie_size = struct.calcsize(_cookie_format)
 
-    def __init__(self, archive_path, logical_toc, pylib_name):
+    def __init__(
+        self,
+        archive_path,
+        logical_toc,
+        pylib_name,
+        entry_alignment=None,
+        entry_checksums=False,
+        entry_digests=False,
+        compression_workers=None
+    ):
         """
         Constructor.
 
@@ -306,8 +535,28 @@ def __init__(self, archive_path, logical_toc, pylib_name):
         start        is the seekposition within PATH.
         len          is the length of the CArchive (if 0, then read till EOF).
         pylib_name   name of Python DLL which bootloader will use.
+        entry_alignment
+                     if given, the data of uncompressed binaries and data files is aligned to a multiple of this many
+                     bytes (a power of two) from the start of the archive, so that they can be memory-mapped directly
+                     from the archive, provided that the archive itself is aligned within the executable.
+        entry_checksums
+                     if true, the CRC-32 of the data of each entry is stored in the table of contents, and verified by
+                     the bootloader while the entry is extracted.
+        entry_digests
+                     if true, the SHA-256 digest of the data of each entry is stored in the table of contents; it is the
+                     key of the entry in the content-addressed store of the bootloader (pyi-runtime-store).
+        compression_workers
+                     number of threads that compress the entries; the compressed entries are written in the order of
+                     the TOC, so the archive does not depend on it.
         """
         self._pylib_name = pylib_name
+        self._compression_workers = compression_workers or 1
+        if entry_alignment is not None:
+            assert entry_alignment > 0 and entry_alignment & (entry_alignment - 1) == 0, \
+                f"Entry alignment must be a power of two: {entry_alignment}"
+        self._entry_alignment = entry_alignment
+        self._entry_checksums = entry_checksums
+        self._entry_digests = entry_digests
 
         # A CArchive created from scratch starts at 0, no leading bootloader.
         super().__init__(archive_path, logical_toc)
@@ -327,7 +576,7 @@ def add(self, entry):
         ENTRY must have:
           entry[0] is name (under which it will be saved).
           entry[1] is fullpathname of the file.
-          entry[2] is a flag for it's storage format (0==uncompressed, 1==compressed)
+          entry[2] is its compression method (0==uncompressed, 1==zlib, 2==zstd, 3==LZ4); True means zlib.
           entry[3] is the entry's type code.
             If the type code is 'o':
               entry[0] is the runtime option
@@ -378,37 +627,125 @@ def add(self, entry):
             print("Cannot find ('%s', '%s', %s, '%s')" % (dest, source, compress, type))
             raise
 
+    def _get_compressor(self, method, size=-1):
+        """
+        Return a compression object (with compress() and flush() methods) for the given compression method. zstd and
+        LZ4 require the `zstandard` and `lz4` packages, respectively, and a bootloader that was built with support for
+        them.
+        """
+        if method == COMPRESSION_ZLIB:
+            return zlib.compressobj(self.LEVEL)
+        elif method == COMPRESSION_ZSTD:
+            try:
+                import zstandard
+            except ImportError:
+                raise SystemExit("Error: zstd compression of CArchive entries requires the 'zstandard' package.")
+            return zstandard.ZstdCompressor(level=self.ZSTD_LEVEL).compressobj(size=size)
+        elif method == COMPRESSION_LZ4:
+            try:
+                import lz4.frame  # noqa: F401
+            except ImportError:
+                raise SystemExit("Error: LZ4 compression of CArchive entries requires the 'lz4' package.")
+            return _LZ4FrameCompressor(self.LZ4_LEVEL)
+        raise ValueError("Unsupported compression method %r" % method)
+
+    def _align_entry(self, type, method):
+        """
+        Pad the archive so that the data of an uncompressed binary or data file entry starts at the entry alignment.
+        """
+        if self._entry_alignment and method == COMPRESSION_NONE and type in ('b', 'x'):
+            padding = -self.lib.tell() % self._entry_alignment
+            if padding:
+                self.lib.write(b'\0' * padding)
+
     def _write_blob(self, blob: bytes, dest, type, compress=False):
         """
         Write the binary contents (**blob**) of a small file to both the archive and its table of contents.
         """
-        start = self.lib.tell()
         length = len(blob)
-        if compress:
-            blob = zlib.compress(blob, level=self.LEVEL)
-        self.lib.write(blob)
-        self.toc.add(start, len(blob), length, int(compress), type, dest)
+        method = int(compress)
+        checksum = zlib.crc32(blob) if self._entry_checksums and type not in ('o', 'd') else None
+        digest = hashlib.sha256(blob).digest() if self._entry_digests and type not in ('o', 'd') else None
+
+        def compress_blob():
+            compressor = self._get_compressor(method, length)
+            return compressor.compress(blob) + compressor.flush()
+
+        def write(data):
+            self._align_entry(type, method)
+            start = self.lib.tell()
+            self.lib.write(blob if data is None else data)
+            self.toc.add(start, self.lib.tell() - start, length, method, type, dest, checksum, digest)
+
+        self._schedule(write, compress_blob if method else None)
 
     def _write_file(self, source, dest, type, compress=False):
         """
         Stream copy a large file into the archive and update the table of contents.
         """
-        start = self.lib.tell()
         length = os.stat(source).st_size
+        method = int(compress)
+        if method and self._executor is not None:
+            # Compress the file into a temporary file in the pool of compression workers, and copy that into the
+            # archive once all preceding entries are written.
+            def compress_file():
+                spool = tempfile.SpooledTemporaryFile(max_size=self._SPOOL_SIZE)
+                try:
+                    checksum, digest = self._copy_data(source, spool, method, length)
+                except BaseException:
+                    spool.close()
+                    raise
+                spool.seek(0)
+                return spool, checksum, digest
+
+            def write(result):
+                spool, checksum, digest = result
+                with spool:
+                    self._align_entry(type, method)
+                    start = self.lib.tell()
+                    shutil.copyfileobj(spool, self.lib)
+                self.toc.add(start, self.lib.tell() - start, length, method, type, dest, checksum, digest)
+
+            self._schedule(write, compress_file)
+            return
+
+        def write(_):
+            self._align_entry(type, method)
+            start = self.lib.tell()
+            checksum, digest = self._copy_data(source, self.lib, method, length)
+            self.toc.add(start, self.lib.tell() - start, length, method, type, dest, checksum, digest)
+
+        self._schedule(write)
+
+    def _copy_data(self, source, target, method, length):
+        """
+        Copy the contents of file `source` into file object `target`, compressing them with the given method. Return
+        their CRC-32 if entry checksums are enabled (None otherwise) and their SHA-256 digest if entry digests are
+        enabled (None otherwise).
+        """
+        checksum = 0 if self._entry_checksums else None
+        sha256 = hashlib.sha256() if self._entry_digests else None
         with open(source, 'rb') as f:
-            if compress:
+            if method or checksum is not None or sha256 is not None:
+                # The checksum and digest are computed while the data is copied, so that the file is read only once.
                 buffer = bytearray(16 * 1024)
-                compressor = zlib.compressobj(self.LEVEL)
+                compressor = self._get_compressor(method, length) if method else None
                 while 1:
                     read = f.readinto(buffer)
                     if not read:
                         break
-                    self.lib.write(compressor.compress(buffer[:read]))
-                self.lib.write(compressor.flush())
+                    chunk = memoryview(buffer)[:read]
+                    if checksum is not None:
+                        checksum = zlib.crc32(chunk, checksum)
+                    if sha256 is not None:
+                        sha256.update(chunk)
+                    target.write(compressor.compress(chunk) if compressor else chunk)
+                if compressor:
+                    target.write(compressor.flush())
 
             else:
-                shutil.copyfileobj(f, self.lib)
-        self.toc.add(start, self.lib.tell() - start, length, int(compress), type, dest)
+                shutil.copyfileobj(f, target)
+        return checksum, sha256.digest() if sha256 is not None else None
 
     def save_trailer(self, tocpos):
         """
@@ -425,7 +762,7 @@ def save_trailer(self, tocpos):
         pyvers = sys.version_info[0] * 100 + sys.version_info[1]
         # Before saving cookie we need to convert it to corresponding C representation.
         cookie = struct.pack(
-            self._cookie_format, self.MAGIC, total_len, tocpos, toclen, pyvers, self._pylib_name.encode('ascii')
+            self._cookie_format, self.MAGIC, total_len, tocpos, toclen, pyvers, 0, self._pylib_name.encode('ascii')
         )
         self.lib.write(cookie)
 
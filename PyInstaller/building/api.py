@@ -28,7 +28,7 @@
 from PyInstaller.building.datastruct import TOC, Target, _check_guts_eq
 from PyInstaller.building.utils import (
     _check_guts_toc, _make_clean_directory, _rmtree, add_suffix_to_extension, checkCache, get_code_object,
-    strip_paths_in_code
+    load_layout_profile, sort_by_layout_profile, strip_paths_in_code
 )
 from PyInstaller.compat import (is_cygwin, is_darwin, is_linux, is_win)
 from PyInstaller.depend import bindepend
@@ -57,7 +57,8 @@ def __init__(self, *tocs, **kwargs):
                 One or more TOCs (Tables of Contents), normally an Analysis.pure.
 
                 If this TOC has an attribute `_code_cache`, this is expected to be a dict of module code objects
-                from ModuleGraph.
+                from ModuleGraph. If it has an attribute `_prefetch_modules`, this is expected to be a set of the
+                names of the modules that are likely to be imported at startup.
 
         kwargs
             Possible keyword arguments:
@@ -66,24 +67,39 @@ def __init__(self, *tocs, **kwargs):
                 A filename for the .pyz. Normally not needed, as the generated name will do fine.
             cipher
                 The block cipher that will be used to encrypt Python bytecode.
+            layout_profile
+                Path to a profile of archive accesses, recorded by running the program with the PYI_LAYOUT_PROFILE
+                environment variable set to this path. The modules and data files imported at run time are placed
+                first in the archive, in the order of their first access, and flagged for prefetching.
+            shared_dictionary
+                If True, train a compression dictionary over the code objects of the modules, and compress all modules
+                with it as zlib preset dictionary. This compresses small modules notably better.
         """
 
         from PyInstaller.config import CONF
         Target.__init__(self)
         name = kwargs.get('name', None)
         cipher = kwargs.get('cipher', None)
+        layout_profile = kwargs.get('layout_profile', None)
+        self.shared_dictionary = kwargs.get('shared_dictionary', False)
         self.toc = TOC()
         # If available, use code objects directly from ModuleGraph to speed up PyInstaller.
         self.code_dict = {}
+        self.prefetch_modules = set()
         for t in tocs:
             self.toc.extend(t)
             self.code_dict.update(getattr(t, '_code_cache', {}))
+            self.prefetch_modules.update(getattr(t, '_prefetch_modules', ()))
 
         self.name = name
         if name is None:
             self.name = os.path.splitext(self.tocfilename)[0] + '.pyz'
         # PyInstaller bootstrapping modules.
         self.dependencies = get_bootstrap_modules()
+        # Names of the entries in the order of their first access at run time, if profiled.
+        self.layout_order = []
+        if layout_profile:
+            self.layout_order = load_layout_profile(os.path.join(CONF['specpath'], layout_profile))['pyz']
         # Bundle the crypto key.
         self.cipher = cipher
         if cipher:
@@ -98,6 +114,8 @@ def __init__(self, *tocs, **kwargs):
     _GUTS = (  # input parameters
         ('name', _check_guts_eq),
         ('toc', _check_guts_toc),  # todo: pyc=1
+        ('layout_order', _check_guts_eq),
+        ('shared_dictionary', _check_guts_eq),
         # no calculated/analysed values
     )
 
@@ -107,6 +125,7 @@ def _check_guts(self, data, last_build):
         return False
 
     def assemble(self):
+        from PyInstaller.config import CONF
         logger.info("Building PYZ (ZlibArchive) %s", self.name)
         # Do not bundle PyInstaller bootstrap modules into PYZ archive.
         toc = self.toc - self.dependencies
@@ -120,11 +139,25 @@ def assemble(self):
                     toc.remove(entry)
         # Sort content alphabetically to support reproducible builds.
         toc.sort()
+        # Place the entries accessed at run time first and contiguous, in the order of their first access, so that they
+        # are read sequentially.
+        prefetch_modules = self.prefetch_modules
+        if self.layout_order:
+            sort_by_layout_profile(toc, self.layout_order)
+            prefetch_modules = prefetch_modules | set(self.layout_order)
 
         # Remove leading parts of paths in code objects.
         self.code_dict = {key: strip_paths_in_code(code) for key, code in self.code_dict.items()}
 
-        ZlibArchiveWriter(self.name, toc, code_dict=self.code_dict, cipher=self.cipher)
+        ZlibArchiveWriter(
+            self.name,
+            toc,
+            code_dict=self.code_dict,
+            cipher=self.cipher,
+            prefetch_modules=prefetch_modules,
+            shared_dictionary=self.shared_dictionary,
+            compression_workers=CONF.get('compression_workers'),
+        )
         logger.info("Building PYZ (ZlibArchive) %s completed successfully.", self.name)
 
 
@@ -145,7 +178,9 @@ class PKG(Target):
         'ZIPFILE': 'Z',
         'EXECUTABLE': 'b',
         'DEPENDENCY': 'd',
-        'SPLASH': 'l'
+        'SPLASH': 'l',
+        'FROZEN_MODULE': 'f',
+        'FROZEN_PACKAGE': 'F'
     }
 
     def __init__(
@@ -159,7 +194,11 @@ def __init__(
         upx_exclude=None,
         target_arch=None,
         codesign_identity=None,
-        entitlements_file=None
+        entitlements_file=None,
+        entry_alignment=None,
+        entry_checksums=False,
+        entry_digests=False,
+        layout_order=None
     ):
         """
         toc
@@ -169,13 +208,27 @@ def __init__(
         cdict
                 Dictionary that specifies compression by typecode. For Example, PYZ is left uncompressed so that it
                 can be accessed inside the PKG. The default uses sensible values. If zlib is not available, no
-                compression is used.
+                compression is used. Besides UNCOMPRESSED and COMPRESSED (zlib), the values COMPRESSED_ZSTD and
+                COMPRESSED_LZ4 select faster-to-decompress methods that require support in the bootloader.
         exclude_binaries
                 If True, EXTENSIONs and BINARYs will be left out of the PKG, and forwarded to its container (usually
                 a COLLECT).
         strip_binaries
                 If True, use 'strip' command to reduce the size of binary files.
         upx_binaries
+        entry_alignment
+                If given, the data of the uncompressed binaries and data files is aligned to this many bytes (4096
+                or 65536) within the PKG, so that it can be memory-mapped directly. Data files are then stored
+                uncompressed by default.
+        entry_checksums
+                If True, store the CRC-32 of the data of each entry in the PKG, so that the bootloader verifies the
+                entries while it extracts them.
+        entry_digests
+                If True, store the SHA-256 digest of the data of each entry in the PKG; it is the key of the entry in
+                the content-addressed store of the bootloader (see EXE's runtime_store).
+        layout_order
+                If given, the names of the entries to place first in the PKG, in this order (the order of their first
+                access at run time, see load_layout_profile()).
         """
         Target.__init__(self)
         self.toc = toc
@@ -190,6 +243,10 @@ def __init__(
         self.target_arch = target_arch
         self.codesign_identity = codesign_identity
         self.entitlements_file = entitlements_file
+        self.entry_alignment = entry_alignment
+        self.entry_checksums = entry_checksums
+        self.entry_digests = entry_digests
+        self.layout_order = layout_order or []
         # This dict tells PyInstaller what items embedded in the executable should be compressed.
         if self.cdict is None:
             self.cdict = {
@@ -198,11 +255,18 @@ def __init__(
                 'BINARY': COMPRESSED,
                 'EXECUTABLE': COMPRESSED,
                 'PYSOURCE': COMPRESSED,
-                'PYMODULE': COMPRESSED,
+                # Bootstrap modules are left uncompressed, so that the bootloader can unmarshal them directly from the
+                # memory-mapped executable.
+                'PYMODULE': UNCOMPRESSED,
+                'FROZEN_MODULE': UNCOMPRESSED,
+                'FROZEN_PACKAGE': UNCOMPRESSED,
                 'SPLASH': COMPRESSED,
                 # Do not compress PYZ as a whole. Single modules are compressed when creating PYZ archive.
                 'PYZ': UNCOMPRESSED
             }
+            if self.entry_alignment:
+                # Aligned data files are meant to be mapped directly, which requires them to be stored as they are.
+                self.cdict['DATA'] = UNCOMPRESSED
         self.__postinit__()
 
     _GUTS = (  # input parameters
@@ -216,6 +280,10 @@ def __init__(
         ('target_arch', _check_guts_eq),
         ('codesign_identity', _check_guts_eq),
         ('entitlements_file', _check_guts_eq),
+        ('entry_alignment', _check_guts_eq),
+        ('entry_checksums', _check_guts_eq),
+        ('entry_digests', _check_guts_eq),
+        ('layout_order', _check_guts_eq),
         # no calculated/analysed values
     )
 
@@ -225,6 +293,7 @@ def _check_guts(self, data, last_build):
         return False
 
     def assemble(self):
+        from PyInstaller.config import CONF
         logger.info("Building PKG (CArchive) %s", os.path.basename(self.name))
         trash = []
         mytoc = []
@@ -292,9 +361,20 @@ def assemble(self):
 
         # Sort content alphabetically by type and name to support reproducible builds.
         mytoc.sort(key=itemgetter(3, 0))
+        # Place the entries accessed at run time first and contiguous, in the order of their first access.
+        if self.layout_order:
+            sort_by_layout_profile(mytoc, self.layout_order)
         # Do *not* sort modules and scripts, as their order is important.
         # TODO: Think about having all modules first and then all scripts.
-        CArchiveWriter(self.name, srctoc + mytoc, pylib_name=pylib_name)
+        CArchiveWriter(
+            self.name,
+            srctoc + mytoc,
+            pylib_name=pylib_name,
+            entry_alignment=self.entry_alignment,
+            entry_checksums=self.entry_checksums,
+            entry_digests=self.entry_digests,
+            compression_workers=CONF.get('compression_workers'),
+        )
 
         for item in trash:
             os.remove(item)
@@ -351,6 +431,13 @@ def __init__(self, *args, **kwargs):
             argv_emulation
                 macOS only. Enables argv emulation in macOS .app bundles (i.e., windowed bootloader). If enabled, the
                 initial open document/URL Apple Events are intercepted by bootloader and converted into sys.argv.
+            argv_emulation_timeout
+                macOS only. The maximum time (in milliseconds) that argv emulation waits for the initial Apple Event.
+                The bootloader continues as soon as the event has been handled. If not specified, 250 ms is used.
+            argv_emulation_async
+                macOS only. Do not wait for the initial Apple Event; only the events that are already queued at
+                startup are converted into sys.argv, and the later open document/URL events are passed to the program
+                as Apple Events (forwarded to the child process in onefile mode).
             target_arch
                 macOS only. Used to explicitly specify the target architecture; either single-arch ('x86_64' or 'arm64')
                 or 'universal2'. Used in checks that the collected binaries contain the requires arch slice(s) and/or
@@ -362,6 +449,41 @@ def __init__(self, *args, **kwargs):
             entitlements_file
                 macOS only. Optional path to entitlements file to use with code signing of collected binaries
                 (--entitlements option to codesign utility).
+            onedir_no_restart
+                Linux and onedir mode only. If True, the bootloader does not set LD_LIBRARY_PATH and restart itself,
+                but runs the program in the first process, and loads the bundled shared libraries that the Python
+                library and the extension modules depend on by their full path.
+            memfd_extensions
+                Linux and onefile mode only. If True, the extension modules are not extracted into the temporary
+                directory, but into anonymous memory files (memfd_create), from which they are loaded when imported.
+            pipelined_extract
+                Onefile mode only. If True, the bootloader extracts only the files that lazy extraction extracts at
+                start, starts the program, and extracts the other files in the background while the program runs; the
+                program extracts the ones it needs before they are extracted in the background (see lazy_extract).
+            zygote
+                Not available on Windows. If True, or a list of module names, the program can run as a zygote server
+                (with the PYI_ZYGOTE_SERVE environment variable set to the path of a UNIX socket) that imports the
+                listed modules once, and then forks a process for each launch of the program with PYI_ZYGOTE_SOCKET
+                set to the same path.
+            worker_relaunch
+                If True, the copies of the program that it launches itself (e.g., multiprocessing workers) start as
+                workers, which use the files extracted by the program and skip the search for the archive.
+            entry_alignment
+                Onefile mode only. Align the data of the uncompressed binaries and data files in the executable to
+                this many bytes (4096 or 65536), and store the data files uncompressed, so that the program can
+                memory-map them directly from the executable (see the _pyi_archive module of the bootloader).
+            entry_checksums
+                If True, store the CRC-32 of each file in the executable, and have the bootloader verify the files
+                while it extracts them, failing if one of them is corrupted.
+            runtime_store
+                Onefile mode only, not available on Windows. Directory of a content-addressed store, shared by all
+                programs of the user, from which the extracted files are cloned or hard-linked when their contents are
+                already there; the other files are extracted and added to it. The files are identified by the SHA-256
+                digests of their contents, which are stored in the executable.
+            layout_profile
+                Path to a profile of archive accesses, recorded by running the program with the PYI_LAYOUT_PROFILE
+                environment variable set to this path. The files accessed at run time are placed first in the
+                executable, in the order of their first access.
         """
         from PyInstaller.config import CONF
         Target.__init__(self)
@@ -381,6 +503,20 @@ def __init__(self, *args, **kwargs):
         self.strip = kwargs.get('strip', False)
         self.upx_exclude = kwargs.get("upx_exclude", [])
         self.runtime_tmpdir = kwargs.get('runtime_tmpdir', None)
+        self.runtime_cachedir = kwargs.get('runtime_cachedir', None)
+        self.runtime_store = kwargs.get('runtime_store', None)
+        self.lazy_extract = kwargs.get('lazy_extract', False)
+        self.pipelined_extract = kwargs.get('pipelined_extract', False)
+        self.prefetch = kwargs.get('prefetch', False)
+        self.memfd_extensions = kwargs.get('memfd_extensions', False)
+        self.onedir_no_restart = kwargs.get('onedir_no_restart', False)
+        self.zygote = kwargs.get('zygote', False)
+        self.worker_relaunch = kwargs.get('worker_relaunch', False)
+        self.entry_alignment = kwargs.get('entry_alignment', None)
+        if self.entry_alignment not in (None, 4096, 65536):
+            raise ValueError(f"Unsupported entry alignment: {self.entry_alignment!r}; must be 4096 or 65536.")
+        self.entry_checksums = kwargs.get('entry_checksums', False)
+        self.layout_profile = kwargs.get('layout_profile', None)
         # If ``append_pkg`` is false, the archive will not be appended to the exe, but copied beside it.
         self.append_pkg = kwargs.get('append_pkg', True)
 
@@ -390,6 +526,8 @@ def __init__(self, *args, **kwargs):
 
         # macOS argv emulation
         self.argv_emulation = kwargs.get('argv_emulation', False)
+        self.argv_emulation_timeout = kwargs.get('argv_emulation_timeout', None)
+        self.argv_emulation_async = kwargs.get('argv_emulation_async', False)
 
         # Target architecture (macOS only)
         self.target_arch = kwargs.get('target_arch', None)
@@ -456,6 +594,43 @@ def __init__(self, *args, **kwargs):
         if self.runtime_tmpdir is not None:
             self.toc.append(("pyi-runtime-tmpdir " + self.runtime_tmpdir, "", "OPTION"))
 
+        if self.runtime_cachedir is not None:
+            self.toc.append(("pyi-runtime-cachedir " + self.runtime_cachedir, "", "OPTION"))
+
+        if self.runtime_store is not None:
+            self.toc.append(("pyi-runtime-store " + self.runtime_store, "", "OPTION"))
+
+        if self.lazy_extract:
+            # no value; presence means "true"
+            self.toc.append(("pyi-lazy-extract", "", "OPTION"))
+
+        if self.pipelined_extract:
+            # no value; presence means "true"
+            self.toc.append(("pyi-pipelined-extract", "", "OPTION"))
+
+        if self.prefetch:
+            # no value; presence means "true"
+            self.toc.append(("pyi-prefetch", "", "OPTION"))
+
+        if self.memfd_extensions:
+            # no value; presence means "true"
+            self.toc.append(("pyi-memfd-extensions", "", "OPTION"))
+
+        if self.onedir_no_restart:
+            # no value; presence means "true"
+            self.toc.append(("pyi-onedir-no-restart", "", "OPTION"))
+
+        if self.zygote:
+            # optional value: comma-separated list of the modules to import in the zygote server
+            if self.zygote is True:
+                self.toc.append(("pyi-zygote", "", "OPTION"))
+            else:
+                self.toc.append(("pyi-zygote " + ",".join(self.zygote), "", "OPTION"))
+
+        if self.worker_relaunch:
+            # no value; presence means "true"
+            self.toc.append(("pyi-worker-relaunch", "", "OPTION"))
+
         if self.bootloader_ignore_signals:
             # no value; presence means "true"
             self.toc.append(("pyi-bootloader-ignore-signals", "", "OPTION"))
@@ -467,6 +642,11 @@ def __init__(self, *args, **kwargs):
         if self.argv_emulation:
             # no value; presence means "true"
             self.toc.append(("pyi-macos-argv-emulation", "", "OPTION"))
+            if self.argv_emulation_timeout is not None:
+                self.toc.append(("pyi-macos-event-timeout %d" % int(self.argv_emulation_timeout), "", "OPTION"))
+            if self.argv_emulation_async:
+                # no value; presence means "true"
+                self.toc.append(("pyi-macos-async-events", "", "OPTION"))
 
         # If the icon path is relative, make it relative to the .spec file.
         if self.icon and self.icon != "NONE" and not os.path.isabs(self.icon):
@@ -503,6 +683,10 @@ def __init__(self, *args, **kwargs):
                     # relative version-info path is relative to spec file
                     self.versrsrc = os.path.join(CONF['specpath'], self.versrsrc)
 
+        layout_order = None
+        if self.layout_profile:
+            layout_order = load_layout_profile(os.path.join(CONF['specpath'], self.layout_profile))['pkg']
+
         self.pkg = PKG(
             self.toc,
             name=self.pkgname,
@@ -513,7 +697,13 @@ def __init__(self, *args, **kwargs):
             upx_exclude=self.upx_exclude,
             target_arch=self.target_arch,
             codesign_identity=self.codesign_identity,
-            entitlements_file=self.entitlements_file
+            entitlements_file=self.entitlements_file,
+            entry_alignment=self.entry_alignment,
+            entry_checksums=self.entry_checksums,
+            # The persistent extraction cache and the zygote server identify the program by the TOC, which covers
+            # the contents of the files through their digests.
+            entry_digests=self.runtime_store is not None or self.runtime_cachedir is not None or bool(self.zygote),
+            layout_order=layout_order
         )
         self.dependencies = self.pkg.dependencies
 
@@ -535,7 +725,11 @@ def __init__(self, *args, **kwargs):
         ('manifest', _check_guts_eq),
         ('embed_manifest', _check_guts_eq),
         ('append_pkg', _check_guts_eq),
+        ('entry_alignment', _check_guts_eq),
+        ('entry_checksums', _check_guts_eq),
         ('argv_emulation', _check_guts_eq),
+        ('argv_emulation_timeout', _check_guts_eq),
+        ('argv_emulation_async', _check_guts_eq),
         ('target_arch', _check_guts_eq),
         ('codesign_identity', _check_guts_eq),
         ('entitlements_file', _check_guts_eq),
@@ -730,6 +924,13 @@ def assemble(self):
             p = subprocess.run(cmd, stderr=subprocess.STDOUT, stdout=subprocess.PIPE, universal_newlines=True)
             if p.returncode:
                 raise SystemError(f"objcopy Failure: {p.returncode} {p.stdout}")
+            if self.append_pkg and self.entry_alignment:
+                # Move the section (and thus the aligned entries) to an aligned file offset. objcopy does not apply
+                # the alignment to a section that is added in the same run.
+                cmd = ['objcopy', '--set-section-alignment', f'pydata={self.entry_alignment}', build_name]
+                p = subprocess.run(cmd, stderr=subprocess.STDOUT, stdout=subprocess.PIPE, universal_newlines=True)
+                if p.returncode:
+                    raise SystemError(f"objcopy Failure: {p.returncode} {p.stdout}")
 
         elif is_darwin:
             # macOS: remove signature, append data, and fix-up headers so that the appended data appears to be part of
@@ -747,6 +948,7 @@ def assemble(self):
             # Append the data
             logger.info("Appending %s to EXE", append_type)
             with open(build_name, 'ab') as outf:
+                self._pad_for_pkg(outf)
                 with open(append_file, 'rb') as inf:
                     shutil.copyfileobj(inf, outf, length=64 * 1024)
 
@@ -757,6 +959,7 @@ def assemble(self):
             # Fall back to just appending data at the end of the file
             logger.info("Appending %s to EXE", append_type)
             with open(build_name, 'ab') as outf:
+                self._pad_for_pkg(outf)
                 with open(append_file, 'rb') as inf:
                     shutil.copyfileobj(inf, outf, length=64 * 1024)
 
@@ -801,6 +1004,13 @@ def assemble(self):
             os.rename(build_name, self.name)
         logger.info("Building EXE from %s completed successfully.", self.tocbasename)
 
+    def _pad_for_pkg(self, outf):
+        """
+        Pad the executable so that the appended PKG, and thus its aligned entries, start at the entry alignment.
+        """
+        if self.append_pkg and self.entry_alignment:
+            outf.write(b'\0' * (-outf.tell() % self.entry_alignment))
+
     def _copyfile(self, infile, outfile):
         with open(infile, 'rb') as infh:
             with open(outfile, 'wb') as outfh:
@@ -1023,7 +1233,11 @@ def _get_relative_path(self, startpath, topath):
 
 
 UNCOMPRESSED = 0
-COMPRESSED = 1
+COMPRESSED = 1  # zlib
+# Alternative compression methods; these require a bootloader built with the corresponding --with-zstd or --with-lz4
+# option, and the zstandard or lz4 package at build time.
+COMPRESSED_ZSTD = 2
+COMPRESSED_LZ4 = 3
 
 _MISSING_BOOTLOADER_ERRORMSG = """Fatal error: PyInstaller does not include a pre-compiled bootloader for your
 platform. For more details and instructions how to build the bootloader see
@@ -33,7 +33,7 @@
 from PyInstaller.compat import PYDYLIB_NAMES, is_win
 from PyInstaller.depend import bindepend
 from PyInstaller.depend.analysis import initialize_modgraph
-from PyInstaller.depend.utils import (create_py3_base_library, scan_code_for_ctypes)
+from PyInstaller.depend.utils import (create_py3_base_frozen_modules, create_py3_base_library, scan_code_for_ctypes)
 from PyInstaller import isolated
 from PyInstaller.utils.misc import (
     absnormpath, compile_py_files, get_path_to_toplevel_modules, get_unicode_modules, mtime
@@ -522,6 +522,9 @@ def assemble(self):
 
         # Initialize the scripts list with priority scripts in the proper order.
         self.scripts = self.graph.nodes_to_toc(priority_scripts)
+        # The modules needed by the initialization of Python go with the scripts, into the PKG of the executable; the
+        # bootloader registers them as frozen modules.
+        self.scripts += create_py3_base_frozen_modules(os.path.join(CONF['workpath'], 'base_frozen'), self.graph)
 
         # Extend the binaries list with all the Extensions modulegraph has found.
         self.binaries = self.graph.make_binaries_toc(self.binaries)
@@ -530,6 +533,8 @@ def assemble(self):
         self.pure = self.graph.make_pure_toc()
         # And get references to module code objects constructed by ModuleGraph to avoid writing .pyc/pyo files to hdd.
         self.pure._code_cache = self.graph.get_code_objects()
+        # And the names of the modules likely to be imported at startup, for the pyi-prefetch option.
+        self.pure._prefetch_modules = self.graph.get_startup_modules(priority_scripts)
 
         # Add remaining binary dependencies - analyze Python C-extensions and what DLLs they depend on.
         #
@@ -802,6 +807,14 @@ def __add_options(parser):
         default=False,
         help="Clean PyInstaller cache and remove temporary files before building.",
     )
+    parser.add_argument(
+        '--compression-workers',
+        metavar='N',
+        type=int,
+        default=1,
+        help="Number of threads that compress the entries of the archives; 0 uses one per CPU. The archives do not "
+        "depend on the number of threads. (default: 1)",
+    )
 
 
 def main(
@@ -813,10 +826,12 @@ def main(
     workpath=DEFAULT_WORKPATH,
     upx_dir=None,
     clean_build=False,
+    compression_workers=1,
     **kw
 ):
     from PyInstaller.config import CONF
     CONF['noconfirm'] = noconfirm
+    CONF['compression_workers'] = compression_workers or os.cpu_count() or 1
 
     # Some modules are included if they are detected at build-time or if a command-line argument is specified
     # (e.g., --ascii).
@@ -52,6 +52,8 @@ class TOC(list):
     BINARY      Runtime name.          Full path name in build.    Shared library.
     DATA        Runtime name.          Full path name in build.    Arbitrary files.
     OPTION      The option.            Unused.                     Python runtime option (frozen into executable).
+    FROZEN_MODULE Python internal name.  Full path name in build.  Stdlib module, frozen by the bootloader.
+    FROZEN_PACKAGE Python internal name. Full path name in build.  Stdlib package, frozen by the bootloader.
 
     A TOC contains various types of files. A TOC contains no duplicates and preserves order.
     PyInstaller uses TOC data type to collect necessary files bundle them into an executable.
@@ -544,6 +544,23 @@ def __add_options(parser):
         help="Enable argv emulation for macOS app bundles. If enabled, the initial open document/URL event is "
         "processed by the bootloader and the passed file paths or URLs are appended to sys.argv.",
     )
+    g.add_argument(
+        "--argv-emulation-timeout",
+        dest="argv_emulation_timeout",
+        metavar="MILLISECONDS",
+        type=int,
+        default=None,
+        help="The maximum time that argv emulation waits for the initial open document/URL event. The bootloader "
+        "continues as soon as the event has been handled. (default: 250)",
+    )
+    g.add_argument(
+        "--argv-emulation-async",
+        dest="argv_emulation_async",
+        action="store_true",
+        default=False,
+        help="Do not wait for the initial open document/URL event in argv emulation; the events that arrive later "
+        "are passed to the program as Apple Events.",
+    )
 
     g.add_argument(
         '--osx-bundle-identifier',
@@ -590,6 +607,135 @@ def __add_options(parser):
         "will ignore any temp-folder location defined by the run-time OS. The ``_MEIxxxxxx``-folder will be created "
         "here. Please use this option only if you know what you are doing.",
     )
+    g.add_argument(
+        "--runtime-cachedir",
+        dest="runtime_cachedir",
+        metavar="PATH",
+        help="Keep the files extracted in `onefile`-mode in a persistent cache under this directory, instead of "
+        "extracting them into a new temporary folder on every launch. The cache is keyed on the contents of the "
+        "executable, and is populated on the first launch. Files in the cache are not removed by the bootloader. "
+        "The directory must only be writable by the user running the executable.",
+    )
+    g.add_argument(
+        "--runtime-store",
+        dest="runtime_store",
+        metavar="PATH",
+        help="Share the files extracted in `onefile`-mode with other programs and other versions of the program, via "
+        "a content-addressed store in this directory (a leading ``~`` stands for the home directory). Files whose "
+        "contents are already in the store are cloned or hard-linked from it instead of extracted. Unused files are "
+        "removed from the store after a week. Not available on Windows.",
+    )
+    g.add_argument(
+        "--lazy-extract",
+        dest="lazy_extract",
+        action="store_true",
+        default=False,
+        help="In `onefile`-mode, extract the extension modules in packages and the data files in subdirectories when "
+        "they are first needed, instead of before the program starts. The data files of a top-level package are "
+        "extracted when the package is imported. Data files accessed without importing the package they belong to "
+        "are not found.",
+    )
+    g.add_argument(
+        "--pipelined-extract",
+        dest="pipelined_extract",
+        action="store_true",
+        default=False,
+        help="In `onefile`-mode, start the program as soon as the shared libraries and the files at the top level "
+        "are extracted, and extract the other files in the background while the program runs. The program extracts "
+        "the files it needs earlier itself, as with --lazy-extract.",
+    )
+    g.add_argument(
+        "--prefetch",
+        dest="prefetch",
+        action="store_true",
+        default=False,
+        help="Tell the bootloader to read ahead the bundled Python modules and decompress the modules imported at "
+        "startup in a background thread, while the Python interpreter is being initialized.",
+    )
+    g.add_argument(
+        "--memfd-extensions",
+        dest="memfd_extensions",
+        action="store_true",
+        default=False,
+        help="In `onefile`-mode on Linux, extract the extension modules into anonymous memory files when they are "
+        "first imported, instead of into the temporary folder. Useful when the temporary folder is small or "
+        "memory-backed. Extension modules that locate other files relative to their own path (e.g., via ``$ORIGIN``) "
+        "may not work.",
+    )
+    g.add_argument(
+        "--onedir-no-restart",
+        dest="onedir_no_restart",
+        action="store_true",
+        default=False,
+        help="In `onedir`-mode on Linux, run the program without the bootloader setting LD_LIBRARY_PATH and restarting "
+        "itself. The bundled shared libraries are loaded by their full path before the libraries that need them. "
+        "Bundled libraries that are opened by name from native code (instead of being linked) are not found.",
+    )
+    g.add_argument(
+        "--zygote",
+        dest="zygote",
+        action="store_true",
+        default=False,
+        help="Allow the program to run as a zygote server, which starts up once and then forks a process for each "
+        "launch of the program. The server is started with the PYI_ZYGOTE_SERVE environment variable set to the "
+        "path of a UNIX socket, and the program is launched through it by setting PYI_ZYGOTE_SOCKET to the same "
+        "path. Not available on Windows.",
+    )
+    g.add_argument(
+        "--zygote-preload",
+        dest="zygote_preload",
+        metavar="MODULENAME",
+        action="append",
+        default=[],
+        help="Module to import in the zygote server before it starts serving launches (implies --zygote). "
+        "This option can be used multiple times.",
+    )
+    g.add_argument(
+        "--worker-relaunch",
+        dest="worker_relaunch",
+        action="store_true",
+        default=False,
+        help="Start the copies of the program that it launches itself (e.g., multiprocessing workers, or "
+        "sys.executable run with subprocess) as workers, which use the files extracted by the program in "
+        "`onefile`-mode, and do not extract them again nor search the executable for the archive. The workers must "
+        "not outlive the program.",
+    )
+    g.add_argument(
+        "--entry-alignment",
+        dest="entry_alignment",
+        metavar="SIZE",
+        type=int,
+        choices=(4096, 65536),
+        default=None,
+        help="In `onefile`-mode, store the data files uncompressed, and align the uncompressed data files and binaries "
+        "to SIZE (4096 or 65536) bytes in the executable, so that the program can memory-map them directly from the "
+        "executable via the bootloader's ``_pyi_archive`` module.",
+    )
+    g.add_argument(
+        "--entry-checksums",
+        dest="entry_checksums",
+        action="store_true",
+        default=False,
+        help="Store the CRC-32 of each bundled file in the executable, and have the bootloader verify the files while "
+        "it extracts them, so that a corrupted executable fails to start instead of running with damaged files.",
+    )
+    g.add_argument(
+        "--layout-profile",
+        dest="layout_profile",
+        metavar="FILE",
+        default=None,
+        help="Place the modules and files that the program accesses at run time first in its archives, in the order "
+        "of their first access, so that they are read sequentially. The FILE is recorded by running the program with "
+        "the PYI_LAYOUT_PROFILE environment variable set to its path.",
+    )
+    g.add_argument(
+        "--shared-dictionary",
+        dest="shared_dictionary",
+        action="store_true",
+        default=False,
+        help="Train a compression dictionary over the bundled Python modules, store it once in their archive, and "
+        "compress all modules with it, which makes small modules notably smaller.",
+    )
     g.add_argument(
         "--bootloader-ignore-signals",
         action="store_true",
@@ -611,6 +757,20 @@ def main(
     noupx=False,
     upx_exclude=None,
     runtime_tmpdir=None,
+    runtime_cachedir=None,
+    runtime_store=None,
+    lazy_extract=False,
+    pipelined_extract=False,
+    prefetch=False,
+    memfd_extensions=False,
+    onedir_no_restart=False,
+    zygote=False,
+    zygote_preload=[],
+    worker_relaunch=False,
+    entry_alignment=None,
+    entry_checksums=False,
+    layout_profile=None,
+    shared_dictionary=False,
     pathex=[],
     version_file=None,
     specpath=None,
@@ -643,6 +803,8 @@ def main(
     codesign_identity=None,
     entitlements_file=None,
     argv_emulation=False,
+    argv_emulation_timeout=None,
+    argv_emulation_async=False,
     **_kwargs
 ):
     # Default values for onefile and console when not explicitly specified on command-line (indicated by None)
@@ -773,6 +935,19 @@ def main(
         'upx': not noupx,
         'upx_exclude': upx_exclude,
         'runtime_tmpdir': runtime_tmpdir,
+        'runtime_cachedir': runtime_cachedir,
+        'runtime_store': runtime_store,
+        'lazy_extract': lazy_extract,
+        'pipelined_extract': pipelined_extract,
+        'prefetch': prefetch,
+        'memfd_extensions': memfd_extensions,
+        'onedir_no_restart': onedir_no_restart,
+        'zygote': zygote_preload or zygote,
+        'worker_relaunch': worker_relaunch,
+        'entry_alignment': entry_alignment,
+        'entry_checksums': entry_checksums,
+        'layout_profile': os.path.abspath(layout_profile) if layout_profile else None,
+        'shared_dictionary': shared_dictionary,
         'exe_options': exe_options,
         'cipher_init': cipher_init,
         # Directory with additional custom import hooks.
@@ -790,6 +965,8 @@ def main(
         'bundle_identifier': bundle_identifier,
         # argv emulation (macOS only)
         'argv_emulation': argv_emulation,
+        'argv_emulation_timeout': argv_emulation_timeout,
+        'argv_emulation_async': argv_emulation_async,
         # Target architecture (macOS only)
         'target_arch': target_arch,
         # Code signing identity (macOS only)
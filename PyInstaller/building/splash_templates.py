@@ -81,6 +81,10 @@
     upvar $_var var
     $canvas itemconfigure $tag -text $var
 }
+
+# The percentage of the files unpacked by the bootloader in onefile mode.
+# Like status_text, it is updated via C and can be traced to show progress.
+set status_progress 0
 """
 
 splash_canvas_setup = r"""
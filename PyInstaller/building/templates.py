@@ -31,7 +31,13 @@
     cipher=block_cipher,
     noarchive=%(noarchive)s,
 )
-pyz = PYZ(a.pure, a.zipped_data, cipher=block_cipher)
+pyz = PYZ(
+    a.pure,
+    a.zipped_data,
+    cipher=block_cipher,
+    layout_profile=%(layout_profile)r,
+    shared_dictionary=%(shared_dictionary)s,
+)
 %(splash_init)s
 exe = EXE(
     pyz,
@@ -47,9 +53,22 @@
     upx=%(upx)s,
     upx_exclude=%(upx_exclude)s,
     runtime_tmpdir=%(runtime_tmpdir)r,
+    runtime_cachedir=%(runtime_cachedir)r,
+    runtime_store=%(runtime_store)r,
+    lazy_extract=%(lazy_extract)s,
+    pipelined_extract=%(pipelined_extract)s,
+    prefetch=%(prefetch)s,
+    memfd_extensions=%(memfd_extensions)s,
+    zygote=%(zygote)r,
+    worker_relaunch=%(worker_relaunch)s,
+    entry_alignment=%(entry_alignment)r,
+    entry_checksums=%(entry_checksums)s,
+    layout_profile=%(layout_profile)r,
     console=%(console)s,
     disable_windowed_traceback=%(disable_windowed_traceback)s,
     argv_emulation=%(argv_emulation)r,
+    argv_emulation_timeout=%(argv_emulation_timeout)r,
+    argv_emulation_async=%(argv_emulation_async)s,
     target_arch=%(target_arch)r,
     codesign_identity=%(codesign_identity)r,
     entitlements_file=%(entitlements_file)r,%(exe_options)s
@@ -75,7 +94,13 @@
     cipher=block_cipher,
     noarchive=%(noarchive)s,
 )
-pyz = PYZ(a.pure, a.zipped_data, cipher=block_cipher)
+pyz = PYZ(
+    a.pure,
+    a.zipped_data,
+    cipher=block_cipher,
+    layout_profile=%(layout_profile)r,
+    shared_dictionary=%(shared_dictionary)s,
+)
 %(splash_init)s
 exe = EXE(
     pyz,
@@ -85,11 +110,18 @@
     name='%(name)s',
     debug=%(debug_bootloader)s,
     bootloader_ignore_signals=%(bootloader_ignore_signals)s,
+    onedir_no_restart=%(onedir_no_restart)s,
+    zygote=%(zygote)r,
+    worker_relaunch=%(worker_relaunch)s,
+    entry_checksums=%(entry_checksums)s,
+    layout_profile=%(layout_profile)r,
     strip=%(strip)s,
     upx=%(upx)s,
     console=%(console)s,
     disable_windowed_traceback=%(disable_windowed_traceback)s,
     argv_emulation=%(argv_emulation)r,
+    argv_emulation_timeout=%(argv_emulation_timeout)r,
+    argv_emulation_async=%(argv_emulation_async)s,
     target_arch=%(target_arch)r,
     codesign_identity=%(codesign_identity)r,
     entitlements_file=%(entitlements_file)r,%(exe_options)s
@@ -676,6 +676,36 @@ def fake_pyc_timestamp(buf):
     return buf[:start] + ts + buf[end:]
 
 
+def load_layout_profile(filename):
+    """
+    Load a profile of archive accesses, as recorded by the bootloader when the program runs with the PYI_LAYOUT_PROFILE
+    environment variable set to its path (see pyi_layout.c in the bootloader). Each line has the name of the archive
+    ('pkg' for the CArchive, 'pyz' for the PYZ archive), a tab, and the name of the entry.
+
+    Return a dict mapping the names of the archives to the lists of the names of the accessed entries, in the order of
+    their first access.
+    """
+    profile = {'pkg': [], 'pyz': []}
+    seen = set()
+    with open(filename, 'r', encoding='utf-8', errors='surrogateescape') as fp:
+        for line in fp:
+            archive, sep, name = line.rstrip('\n').partition('\t')
+            if not sep or archive not in profile or (archive, name) in seen:
+                continue
+            seen.add((archive, name))
+            profile[archive].append(name)
+    return profile
+
+
+def sort_by_layout_profile(toc, names):
+    """
+    Sort the TOC (list of tuples starting with the name) in place, so that the entries with the given names come first,
+    in the order of the names. The order of the other entries is preserved.
+    """
+    rank = {name: i for i, name in enumerate(names)}
+    toc.sort(key=lambda entry: rank.get(entry[0], len(rank)))
+
+
 def _should_include_system_binary(binary_tuple, exceptions):
     """
     Return True if the given binary_tuple describes a system binary that should be included.
@@ -655,6 +655,23 @@ def importlib_load_source(name, pathname):
 if not is_py310:
     PY3_BASE_MODULES.add('_bootlocale')
 
+# Modules of base_library.zip that are imported during the initialization of Python. The bootloader registers them as
+# frozen modules, so that Python does not need zipimport to start. All of them must be frozen (a frozen package has
+# no __path__ until the bootloader sets it). Python 3.7 is not supported: its zipimport decodes the file names in the
+# archive with the cp437 codec once the codecs are initialized, which requires importing encodings.cp437 from the
+# archive.
+PY3_STARTUP_MODULES = set()
+if is_py38:
+    PY3_STARTUP_MODULES = {
+        'abc',
+        'codecs',
+        'encodings',
+        'encodings.aliases',
+        'encodings.latin_1',
+        'encodings.utf_8',
+        'io',
+    }
+
 # Object types of Pure Python modules in modulegraph dependency graph.
 # Pure Python modules have code object (attribute co_code).
 PURE_PYTHON_MODULE_TYPES = {
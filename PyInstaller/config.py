@@ -34,6 +34,7 @@
 This is the list of known variables. (Please update it if necessary.)
 
 cachedir
+compression_workers
 hasUPX
 hiddenimports
 noconfirm
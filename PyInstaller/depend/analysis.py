@@ -448,6 +448,37 @@ def get_code_objects(self):
                     code_dict[node.identifier] = node.code
         return code_dict
 
+    def get_startup_modules(self, script_nodes, depth=2):
+        """
+        Get the names of the pure Python modules that are likely to be imported at startup: the modules imported by the
+        given script nodes (the run-time hooks and the entry-point scripts), and the modules imported by those, up to the
+        given depth, together with their parent packages.
+
+        :return: Set of module names.
+        """
+        names = set()
+        seen = set(script_nodes)
+        nodes = list(script_nodes)
+        for _ in range(depth):
+            next_nodes = []
+            for node in nodes:
+                imported, _ = self.get_edges(node)
+                for imported_node in imported:
+                    if imported_node is None or imported_node in seen:
+                        continue
+                    seen.add(imported_node)
+                    if type(imported_node).__name__ not in PURE_PYTHON_MODULE_TYPES:
+                        continue
+                    names.add(imported_node.identifier)
+                    next_nodes.append(imported_node)
+            nodes = next_nodes
+        # Importing a submodule imports its parent packages first.
+        for name in list(names):
+            while '.' in name:
+                name = name.rpartition('.')[0]
+                names.add(name)
+        return names
+
     def _make_toc(self, typecode=None, existing_TOC=None):
         """
         Return the name, path and type of selected nodes as a TOC, or appended to a TOC. The selection is via a list
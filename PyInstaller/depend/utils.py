@@ -97,6 +97,32 @@ def create_py3_base_library(libzip_filename, graph):
         raise
 
 
+def create_py3_base_frozen_modules(frozen_dir, graph):
+    """
+    Write the code of the modules imported during the initialization of Python (compat.PY3_STARTUP_MODULES) into
+    frozen_dir, as marshalled code objects without .pyc header. Return the TOC entries of these files, which the
+    bootloader registers as frozen modules. base_library.zip still contains these modules.
+    """
+    from PyInstaller.building.utils import strip_paths_in_code
+
+    os.makedirs(frozen_dir, exist_ok=True)
+    toc = []
+    for name in sorted(compat.PY3_STARTUP_MODULES):
+        mod = graph.find_node(name)
+        if type(mod) not in (modulegraph.SourceModule, modulegraph.Package, modulegraph.CompiledModule):
+            # Python would fail to import the submodules of a frozen package that are not frozen, so either all
+            # startup modules are frozen, or none.
+            logger.debug('Not freezing startup modules: %s is not a pure Python module', name)
+            return []
+        filename = os.path.join(frozen_dir, name)
+        with open(filename, 'wb') as fc:
+            marshal.dump(strip_paths_in_code(mod.code), fc)
+        typecode = 'FROZEN_PACKAGE' if type(mod) is modulegraph.Package else 'FROZEN_MODULE'
+        toc.append((name, filename, typecode))
+    logger.debug('Freezing startup modules: %s', ', '.join(entry[0] for entry in toc))
+    return toc
+
+
 def scan_code_for_ctypes(co):
     binaries = __recursively_scan_code_objects_for_ctypes(co)
 
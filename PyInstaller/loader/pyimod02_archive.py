@@ -37,6 +37,16 @@
 PYZ_TYPE_DATA = 2
 PYZ_TYPE_NSPKG = 3  # PEP-420 namespace package
 
+# Indexed PYZ TOC: the magic, the number of entries, and the position and length of the shared compression dictionary,
+# followed by the entries sorted by their UTF-8 encoded names, and by the names. Each entry gives the offset of its name
+# (relative to the start of the TOC), the position and length of its data, the length of its name, its type, and flags.
+# If the dictionary length is not zero, the entries may be compressed with the dictionary as zlib preset dictionary.
+PYZ_INDEX_MAGIC = b'PYZI'
+PYZ_INDEX_HEADER = '!4sIII'
+PYZ_INDEX_ENTRY = '!IIIHBB'
+# The entry is likely needed at startup; with the pyi-prefetch option, the bootloader inflates it in the background.
+PYZ_INDEX_FLAG_PREFETCH = 0x01
+
 
 class FilePos:
     """
@@ -105,6 +115,114 @@ class ArchiveReadError(RuntimeError):
     pass
 
 
+class ZlibArchiveIndex:
+    """
+    Read-only mapping of the entry names of a PYZ archive to (type, position, length) tuples, backed by the indexed TOC
+    (see PYZ_INDEX_MAGIC). The entries are binary-searched in place and only decoded when they are looked up.
+
+    `data` is a bytes-like object with the TOC. If given, `lookup` is a function that looks up an entry by name and
+    returns its tuple or None, used instead of the binary search in Python (see pyi_pyz.c in the bootloader).
+    """
+    _header_size = struct.calcsize(PYZ_INDEX_HEADER)
+    _entry_size = struct.calcsize(PYZ_INDEX_ENTRY)
+
+    def __init__(self, data, lookup=None):
+        magic, self._count, dict_pos, dict_len = struct.unpack_from(PYZ_INDEX_HEADER, data, 0)
+        if magic != PYZ_INDEX_MAGIC or len(data) < self._header_size + self._count * self._entry_size:
+            raise ArchiveReadError("Invalid PYZ archive index")
+        # Position and length of the shared compression dictionary within the archive, or None.
+        self.dictionary = (dict_pos, dict_len) if dict_len else None
+        self._data = data
+        self._lookup = lookup
+        self._cache = {}
+
+    def _get_name(self, index):
+        name_pos, _, _, name_len, _, _ = struct.unpack_from(
+            PYZ_INDEX_ENTRY, self._data, self._header_size + index * self._entry_size
+        )
+        return bytes(self._data[name_pos:name_pos + name_len])
+
+    def _get_entry(self, index):
+        _, pos, length, _, typ, _ = struct.unpack_from(
+            PYZ_INDEX_ENTRY, self._data, self._header_size + index * self._entry_size
+        )
+        return (typ, pos, length)
+
+    def _lower_bound(self, key, lo=0):
+        """
+        Return the index of the first entry whose name is not less than the UTF-8 encoded `key`.
+        """
+        hi = self._count
+        while lo < hi:
+            mid = (lo + hi) // 2
+            if self._get_name(mid) < key:
+                lo = mid + 1
+            else:
+                hi = mid
+        return lo
+
+    def _search(self, name):
+        try:
+            key = name.encode('utf-8')
+        except (AttributeError, UnicodeError):
+            return None
+        index = self._lower_bound(key)
+        if index < self._count and self._get_name(index) == key:
+            return self._get_entry(index)
+        return None
+
+    def submodules(self, name):
+        """
+        Return the (name, (type, position, length)) pairs of the direct submodules of the package `name`, in index
+        order. The entries of a package are contiguous in the index; the entries of its subpackages are skipped.
+        """
+        prefix = name.encode('utf-8') + b'.'
+        result = []
+        index = self._lower_bound(prefix)
+        while index < self._count:
+            key = self._get_name(index)
+            if not key.startswith(prefix):
+                break
+            dot = key.find(b'.', len(prefix))
+            if dot < 0:
+                result.append((key.decode('utf-8'), self._get_entry(index)))
+                index += 1
+            else:
+                # Jump past the entries of the subpackage ('/' sorts right after '.').
+                index = self._lower_bound(key[:dot] + b'/', index)
+        return result
+
+    def get(self, name, default=None):
+        try:
+            entry = self._cache[name]
+        except KeyError:
+            entry = self._lookup(name) if self._lookup else self._search(name)
+            self._cache[name] = entry
+        return default if entry is None else entry
+
+    def __getitem__(self, name):
+        entry = self.get(name)
+        if entry is None:
+            raise KeyError(name)
+        return entry
+
+    def __contains__(self, name):
+        return self.get(name) is not None
+
+    def __len__(self):
+        return self._count
+
+    def __iter__(self):
+        for index in range(self._count):
+            yield self._get_name(index).decode('utf-8')
+
+    def keys(self):
+        return list(self)
+
+    def items(self):
+        return [(name, self[name]) for name in self]
+
+
 class ArchiveReader:
     """
     A base class for a repository of python code objects. The extract method is used by imputil.ArchiveImporter to
@@ -234,6 +352,56 @@ def decrypt(self, data):
         return cipher.CTR_xcrypt_buffer(data[CRYPT_BLOCK_SIZE:])
 
 
+class ZlibArchiveCache:
+    """
+    Bounded cache of the decompressed data of PYZ entries that were read ahead together with their package (see
+    ZlibArchiveReader.extract). An entry is removed from the cache when it is taken; when the cache is full, the entries
+    that were read ahead the longest time ago are evicted first.
+
+    `hits` and `misses` count the extractions of submodules that were and were not found in the cache, and `evictions`
+    the entries that were evicted before being used. Many evictions, and few hits, suggest a larger `max_size` (in
+    bytes).
+    """
+    def __init__(self, max_size):
+        self.max_size = max_size
+        self.size = 0
+        self.hits = 0
+        self.misses = 0
+        self.evictions = 0
+        self._entries = {}  # Insertion-ordered: the oldest entry comes first.
+        self._lock = thread.allocate_lock()
+
+    def __contains__(self, name):
+        return name in self._entries
+
+    def put(self, name, data):
+        if len(data) > self.max_size:
+            return
+        with self._lock:
+            old = self._entries.pop(name, None)
+            if old is not None:
+                self.size -= len(old)
+            while self._entries and self.size + len(data) > self.max_size:
+                oldest = next(iter(self._entries))
+                self.size -= len(self._entries.pop(oldest))
+                self.evictions += 1
+            self._entries[name] = data
+            self.size += len(data)
+
+    def take(self, name):
+        """
+        Remove the data of the entry from the cache and return it, or return None if it is not in the cache.
+        """
+        with self._lock:
+            data = self._entries.pop(name, None)
+            if data is None:
+                self.misses += 1
+            else:
+                self.size -= len(data)
+                self.hits += 1
+        return data
+
+
 class ZlibArchiveReader(ArchiveReader):
     """
     ZlibArchive - an archive with compressed entries. Archive is read from the executable created by PyInstaller.
@@ -245,8 +413,12 @@ class ZlibArchiveReader(ArchiveReader):
     MAGIC = b'PYZ\0'
     TOCPOS = 8
     HDRLEN = ArchiveReader.HDRLEN + 5
+    # Default size of the cache of the submodules read ahead with their package, in bytes of decompressed data.
+    CACHE_SIZE = 4 * 1024 * 1024
+    # Entries that are at most this many bytes apart in the archive are read together.
+    _READ_GAP = 4096
 
-    def __init__(self, path=None, offset=None):
+    def __init__(self, path=None, offset=None, cache_size=None):
         if path is None:
             offset = 0
         elif offset is None:
@@ -262,7 +434,36 @@ def __init__(self, path=None, offset=None):
             else:
                 offset = 0
 
-        super().__init__(path, offset)
+        # If the bootloader has exposed this archive from its memory-mapped view of the executable (see pyi_pyz.c in
+        # the bootloader), use the already loaded TOC and extract the entries natively, instead of re-opening the file.
+        native = sys.modules.get('_pyi_pyz')
+        if native is not None and path is not None and native.path == path and native.offset == offset:
+            super().__init__(None, offset)
+            self.path = path
+            self.lib = ArchiveFile(self.path, 'rb')
+            if native.data[:len(self.MAGIC)] != self.MAGIC:
+                raise ArchiveReadError("%s is not a valid %s archive file" % (self.path, self.__class__.__name__))
+            if native.data[len(self.MAGIC):len(self.MAGIC) + len(self.pymagic)] != self.pymagic:
+                raise ArchiveReadError("%s has version mismatch to dll" % self.path)
+            self.zdict = None
+            if native.toc is not None:
+                self.toc = native.toc
+            else:
+                (toc_offset,) = struct.unpack_from('!i', native.data, self.TOCPOS)
+                self.toc = ZlibArchiveIndex(native.data[toc_offset:], native.lookup)
+                if self.toc.dictionary:
+                    dict_pos, dict_len = self.toc.dictionary
+                    self.zdict = bytes(native.data[dict_pos:dict_pos + dict_len])
+            self._native_data = native.data
+            self._native_extract = native.extract
+        else:
+            super().__init__(path, offset)
+            self._native_data = None
+            self._native_extract = None
+
+        if cache_size is None:
+            cache_size = self.CACHE_SIZE
+        self.cache = ZlibArchiveCache(cache_size) if cache_size > 0 else None
 
         # Try to import the key module. Its lack of availability indicates that the encryption is disabled.
         try:
@@ -271,6 +472,24 @@ def __init__(self, path=None, offset=None):
         except ImportError:
             self.cipher = None
 
+    def loadtoc(self):
+        """
+        Load the indexed TOC, or the TOC as a marshalled list (written by older versions of PyInstaller).
+        """
+        self.lib.seek(self.start + self.TOCPOS)
+        (offset,) = struct.unpack('!i', self.lib.read(4))
+        self.lib.seek(self.start + offset)
+        data = self.lib.read()
+        self.zdict = None
+        if data[:len(PYZ_INDEX_MAGIC)] == PYZ_INDEX_MAGIC:
+            self.toc = ZlibArchiveIndex(data)
+            if self.toc.dictionary:
+                dict_pos, dict_len = self.toc.dictionary
+                self.lib.seek(self.start + dict_pos)
+                self.zdict = self.lib.read(dict_len)
+        else:
+            self.toc = dict(marshal.loads(data))
+
     def is_package(self, name):
         (typ, pos, length) = self.toc.get(name, (0, None, 0))
         if pos is None:
@@ -284,18 +503,93 @@ def is_pep420_namespace_package(self, name):
         return typ == PYZ_TYPE_NSPKG
 
     def extract(self, name):
+        if self._native_extract is not None and not self.cipher:
+            try:
+                return self._native_extract(name)
+            except EOFError as e:
+                raise ImportError("PYZ entry '%s' failed to unmarshal" % name) from e
         (typ, pos, length) = self.toc.get(name, (0, None, 0))
         if pos is None:
             return None
-        with self.lib:
-            self.lib.seek(self.start + pos)
-            obj = self.lib.read(length)
+        obj = None
+        if self.cache is not None and '.' in name and typ != PYZ_TYPE_DATA:
+            obj = self.cache.take(name)
         try:
-            if self.cipher:
-                obj = self.cipher.decrypt(obj)
-            obj = zlib.decompress(obj)
+            if (
+                self.cache is not None and typ in (PYZ_TYPE_PKG, PYZ_TYPE_NSPKG)
+                and isinstance(self.toc, ZlibArchiveIndex)
+            ):
+                obj = self._read_package(name, pos, length, obj)
+            elif obj is None:
+                obj = self._decode(self._read(pos, length))
             if typ in (PYZ_TYPE_MODULE, PYZ_TYPE_PKG, PYZ_TYPE_NSPKG):
                 obj = marshal.loads(obj)
         except EOFError as e:
             raise ImportError("PYZ entry '%s' failed to unmarshal" % name) from e
         return typ, obj
+
+    def _read(self, pos, length):
+        """
+        Read the given range of the archive, from the memory-mapped executable if the bootloader exposed it.
+        """
+        if self._native_data is not None:
+            return bytes(self._native_data[pos:pos + length])
+        with self.lib:
+            self.lib.seek(self.start + pos)
+            return self.lib.read(length)
+
+    def _decode(self, data):
+        """
+        Decrypt and decompress the data of an entry.
+        """
+        if self.cipher:
+            data = self.cipher.decrypt(data)
+        return self.decompress(data)
+
+    def _read_package(self, name, pos, length, data=None):
+        """
+        Read the entry of a package together with the entries of its modules and subpackages that are not cached yet,
+        with one read per run of entries that are stored next to each other, and decompress them in one go. The data
+        of the submodules is put into the cache, to be taken when they are imported. Returns the decompressed data of
+        the package; if it is given as `data` (taken from the cache), only the submodules are read.
+        """
+        batch = [] if data is not None else [(pos, length, name)]
+        # The compressed data read ahead is limited to a fraction of the cache size; code objects typically compress
+        # to a third or a quarter of their size.
+        budget = self.cache.max_size // 4
+        for sub_name, (sub_typ, sub_pos, sub_length) in self.toc.submodules(name):
+            if sub_typ == PYZ_TYPE_DATA or sub_name in self.cache:
+                continue
+            budget -= sub_length
+            if budget < 0:
+                break
+            batch.append((sub_pos, sub_length, sub_name))
+        batch.sort()
+
+        result = data
+        index = 0
+        while index < len(batch):
+            # Extend the run while the next entry starts close enough to the end of the previous one.
+            run_start = batch[index][0]
+            run_end = run_start + batch[index][1]
+            end_index = index + 1
+            while end_index < len(batch) and batch[end_index][0] - run_end <= self._READ_GAP:
+                run_end = max(run_end, batch[end_index][0] + batch[end_index][1])
+                end_index += 1
+            data = self._read(run_start, run_end - run_start)
+            for entry_pos, entry_length, entry_name in batch[index:end_index]:
+                obj = self._decode(data[entry_pos - run_start:entry_pos - run_start + entry_length])
+                if entry_name == name:
+                    result = obj
+                else:
+                    self.cache.put(entry_name, obj)
+            index = end_index
+        return result
+
+    def decompress(self, data):
+        """
+        Decompress the (decrypted) data of an entry, using the shared compression dictionary of the archive, if any.
+        """
+        if self.zdict:
+            return zlib.decompressobj(zdict=self.zdict).decompress(data)
+        return zlib.decompress(data)
@@ -19,12 +19,44 @@
 import sys
 
 import _frozen_importlib
+import _frozen_importlib_external
 import pyimod01_os_path as pyi_os_path
-from pyimod02_archive import ArchiveReadError, ZlibArchiveReader
+from pyimod02_archive import ArchiveReadError, ZlibArchiveIndex, ZlibArchiveReader
 
 SYS_PREFIX = sys._MEIPASS + pyi_os_path.os_sep
 SYS_PREFIXLEN = len(SYS_PREFIX)
 
+# Function provided by the bootloader when lazy extraction (the ``pyi-lazy-extract`` runtime option) is enabled in
+# onefile mode; it extracts the given file (or, if the name ends with the path separator, the data files in the given
+# directory), unless already extracted. The name is relative to sys._MEIPASS. Returns 1 if the file (or directory)
+# was found in the archive, 0 if not, and -1 on error.
+_pyi_lazy_extract = getattr(sys, '_pyi_lazy_extract', None)
+
+# Function provided by the bootloader when in-memory extraction of extension modules (the ``pyi-memfd-extensions``
+# runtime option) is enabled in onefile mode on Linux; it returns the path that the given extension module can be loaded
+# from (``/proc/self/fd/N``, for the anonymous memory file it was extracted into), or None if there is no such
+# extension module in the archive. The name is relative to sys._MEIPASS.
+_pyi_memfd_open = getattr(sys, '_pyi_memfd_open', None)
+
+# Function provided by the bootloader when a onedir program runs without the bootloader restarting itself (the
+# ``pyi-onedir-no-restart`` runtime option) on Linux, i.e., without LD_LIBRARY_PATH pointing to sys._MEIPASS; it loads
+# the bundled shared libraries that the given extension module depends on, so that the dynamic linker uses them.
+_pyi_preload_deps = getattr(sys, '_pyi_preload_deps', None)
+
+# Function provided by the bootloader when recording the order of archive accesses (the ``PYI_LAYOUT_PROFILE``
+# environment variable); it records an access to the given entry of the PYZ archive, for the ``--layout-profile``
+# build option.
+_pyi_layout_record = getattr(sys, '_pyi_layout_record', None)
+
+# Size of the cache of the PYZ archive reader for the submodules read ahead with their package, in bytes, from the
+# ``PYI_PYZ_CACHE_SIZE`` environment variable (0 disables reading ahead); None for the default size. On POSIX systems,
+# the keys of the environment are bytes.
+_pyz_cache_size = pyi_os_path.os_environ.get('PYI_PYZ_CACHE_SIZE', pyi_os_path.os_environ.get(b'PYI_PYZ_CACHE_SIZE'))
+try:
+    _pyz_cache_size = int(_pyz_cache_size)
+except (TypeError, ValueError):
+    _pyz_cache_size = None
+
 # In Python 3, it is recommended to use class 'types.ModuleType' to create a new module. However, 'types' module is
 # not a built-in module. The 'types' module uses this trick with using type() function:
 imp_new_module = type(sys)
@@ -104,7 +136,7 @@ def __init__(self):
         for pyz_filepath in sys.path:
             try:
                 # Unzip zip archive bundled with the executable.
-                self._pyz_archive = ZlibArchiveReader(pyz_filepath)
+                self._pyz_archive = ZlibArchiveReader(pyz_filepath, cache_size=_pyz_cache_size)
                 # Verify the integrity of the zip archive with Python modules.
                 # This is already done when creating the ZlibArchiveReader instance.
                 #self._pyz_archive.checkmagic()
@@ -113,8 +145,12 @@ def __init__(self):
                 # Let's remove 'pyz_filepath' from sys.path.
                 sys.path.remove(pyz_filepath)
                 # Some runtime hook might need access to the list of available frozen modules. Let's make them
-                # accessible as a set().
-                self.toc = set(self._pyz_archive.toc.keys())
+                # accessible as a set(), unless the archive has an indexed TOC, whose entries are decoded lazily.
+                toc = self._pyz_archive.toc
+                self.toc = toc if isinstance(toc, ZlibArchiveIndex) else set(toc.keys())
+                # The cache of the submodules read ahead with their package, with its hit and miss counters; None if
+                # disabled.
+                self.pyz_cache = self._pyz_archive.cache
                 # Return - no error was raised.
                 trace("# PyInstaller: FrozenImporter(%s)", pyz_filepath)
                 return
@@ -127,6 +163,12 @@ def __init__(self):
         # sys.path does not contain the filename of the executable with the bundled zip archive. Raise import error.
         raise ImportError("Cannot load frozen modules.")
 
+    # Private helper
+    def _extract(self, name):
+        if _pyi_layout_record is not None:
+            _pyi_layout_record(name)
+        return self._pyz_archive.extract(name)
+
     # Private helper
     def _is_pep420_namespace_package(self, fullname):
         if fullname in self.toc:
@@ -203,7 +245,7 @@ def load_module(self, fullname, entry_name=None):
             # Module not in sys.modules - load it and add it to sys.modules.
             if module is None:
                 # Load code object from the bundled ZIP archive.
-                is_pkg, bytecode = self._pyz_archive.extract(entry_name)
+                is_pkg, bytecode = self._extract(entry_name)
                 # Create new empty 'module' object.
                 module = imp_new_module(fullname)
 
@@ -295,7 +337,7 @@ def get_code(self, fullname):
 
             # extract() returns None if fullname is not in the archive, and the subsequent subscription attempt raises
             # exception, which is turned into ImportError.
-            return self._pyz_archive.extract(fullname)[1]
+            return self._extract(fullname)[1]
         except Exception as e:
             raise ImportError('Loader FrozenImporter cannot handle module ' + fullname) from e
 
@@ -337,7 +379,7 @@ def get_data(self, path):
         fullname = path[SYS_PREFIXLEN:]
         if fullname in self.toc:
             # If the file is in the archive, return this
-            return self._pyz_archive.extract(fullname)[1]
+            return self._extract(fullname)[1]
         else:
             # Otherwise try to fetch it from the filesystem. Since __file__ attribute works properly, just try to open
             # and read it.
@@ -411,6 +453,11 @@ def find_spec(self, fullname, path=None, target=None):
             trace("# %s not found in PYZ", fullname)
             return None
 
+        # With lazy extraction, the data files of a top-level module or package are extracted when it is imported.
+        if _pyi_lazy_extract is not None and '.' not in entry_name:
+            if _pyi_lazy_extract(entry_name + pyi_os_path.os_sep) < 0:
+                raise ImportError('Failed to extract data files of %s' % entry_name, name=fullname)
+
         if self._is_pep420_namespace_package(entry_name):
             # PEP-420 namespace package; as per PEP 451, we need to return a spec with "loader" set to None
             # (a.k.a. not set)
@@ -554,6 +601,111 @@ def files(self):
         return self.path
 
 
+class LazyExtensionFinder:
+    """
+    PEP-451 finder for the extension modules whose extraction is deferred by the bootloader (lazy extraction in
+    onefile mode). The extension module is extracted when it is first imported, and loaded with the standard extension
+    module loader. Top-level extension modules are never deferred.
+    """
+    def find_spec(self, fullname, path=None, target=None):
+        if path is None:
+            return None
+        modname = fullname.rpartition('.')[2]
+        for entry in path:
+            if not isinstance(entry, str) or not entry.startswith(SYS_PREFIX):
+                continue
+            for suffix in _frozen_importlib_external.EXTENSION_SUFFIXES:
+                name = pyi_os_path.os_path_join(entry[SYS_PREFIXLEN:], modname + suffix)
+                rc = _pyi_lazy_extract(name)
+                if rc < 0:
+                    raise ImportError('Failed to extract ' + name, name=fullname)
+                if rc > 0:
+                    trace("import %s # PyInstaller lazily extracted %s", fullname, name)
+                    filename = SYS_PREFIX + name
+                    loader = _frozen_importlib_external.ExtensionFileLoader(fullname, filename)
+                    return _frozen_importlib_external.spec_from_file_location(fullname, filename, loader=loader)
+        return None
+
+
+class MemfdExtensionLoader(_frozen_importlib_external.ExtensionFileLoader):
+    """
+    Loader for the extension modules extracted into anonymous memory files. The module is loaded from the memory file,
+    but its ``__file__`` is set to the path it would have been extracted to, so that files next to it are found.
+    """
+    def __init__(self, fullname, path, filename):
+        super().__init__(fullname, path)
+        self._filename = filename
+
+    def create_module(self, spec):
+        module = super().create_module(spec)
+        module.__file__ = self._filename
+        return module
+
+
+class MemfdExtensionFinder:
+    """
+    PEP-451 finder for the extension modules that the bootloader extracts into anonymous memory files (in-memory
+    extraction in onefile mode on Linux). The extension module is extracted when it is first imported.
+    """
+    def find_spec(self, fullname, path=None, target=None):
+        if path is None:
+            path = [sys._MEIPASS]
+        modname = fullname.rpartition('.')[2]
+        for entry in path:
+            if not isinstance(entry, str):
+                continue
+            if entry == sys._MEIPASS:
+                prefix = ''
+            elif entry.startswith(SYS_PREFIX):
+                prefix = entry[SYS_PREFIXLEN:]
+            else:
+                continue
+            for suffix in _frozen_importlib_external.EXTENSION_SUFFIXES:
+                name = pyi_os_path.os_path_join(prefix, modname + suffix) if prefix else modname + suffix
+                memfd_path = _pyi_memfd_open(name)
+                if memfd_path is not None:
+                    trace("import %s # PyInstaller extracted %s into %s", fullname, name, memfd_path)
+                    loader = MemfdExtensionLoader(fullname, memfd_path, SYS_PREFIX + name)
+                    return _frozen_importlib_external.spec_from_file_location(fullname, memfd_path, loader=loader)
+        return None
+
+
+class PreloadingExtensionFileLoader(_frozen_importlib_external.ExtensionFileLoader):
+    """
+    Extension module loader that first loads the bundled shared libraries the extension module depends on (onedir
+    programs that run without LD_LIBRARY_PATH).
+    """
+    def create_module(self, spec):
+        _pyi_preload_deps(self.path)
+        return super().create_module(spec)
+
+
+def _install_preloading_path_hook():
+    """
+    Replace the standard extension module loader of the path-based finder with PreloadingExtensionFileLoader.
+    """
+    loaders = []
+    for loader, suffixes in _frozen_importlib_external._get_supported_file_loaders():
+        if loader is _frozen_importlib_external.ExtensionFileLoader:
+            loader = PreloadingExtensionFileLoader
+        loaders.append((loader, suffixes))
+    sys.path_hooks.insert(0, _frozen_importlib_external.FileFinder.path_hook(*loaders))
+    sys.path_importer_cache.clear()
+
+
+def _install_lazy_extraction(fimp):
+    """
+    Set up lazy extraction: install the finder for deferred extension modules, and extract the data files in
+    top-level directories that do not belong to any module or package in the PYZ archive (and are therefore not
+    extracted on import).
+    """
+    sys.meta_path.append(LazyExtensionFinder())
+    for dirname in getattr(sys, '_pyi_lazy_data_dirs', []):
+        if dirname not in fimp.toc:
+            if _pyi_lazy_extract(dirname + pyi_os_path.os_sep) < 0:
+                raise ImportError('Failed to extract data files in ' + dirname)
+
+
 def install():
     """
     Install FrozenImporter class and other classes into the import machinery.
@@ -573,6 +725,19 @@ def install():
     fimp = FrozenImporter()
     sys.meta_path.append(fimp)
 
+    # With in-memory extraction in onefile mode, look for the extension modules extracted into memory files before
+    # PathFinder (and the lazy extraction finder) does.
+    if _pyi_memfd_open is not None:
+        sys.meta_path.append(MemfdExtensionFinder())
+
+    # With lazy extraction in onefile mode, look for the deferred extension modules before PathFinder does.
+    if _pyi_lazy_extract is not None:
+        _install_lazy_extraction(fimp)
+
+    # Without LD_LIBRARY_PATH in onedir mode, load the bundled dependencies of extension modules found by PathFinder.
+    if _pyi_preload_deps is not None:
+        _install_preloading_path_hook()
+
     # On Windows there is importer _frozen_importlib.WindowsRegistryFinder that looks for Python modules in Windows
     # registry. The frozen executable should not look for anything in the Windows registry. Remove this importer
     # from sys.meta_path.
@@ -17,7 +17,6 @@
 import pprint
 import sys
 import tempfile
-import zlib
 
 import PyInstaller.log
 from PyInstaller.archive.readers import CArchiveReader, NotAnArchiveError
@@ -143,13 +142,13 @@ def get_archive(name):
 
 
 def get_data(name, arch):
-    if isinstance(arch.toc, dict):
+    if isinstance(arch, ZlibArchive):
         (ispkg, pos, length) = arch.toc.get(name, (0, None, 0))
         if pos is None:
             return None
         with arch.lib:
             arch.lib.seek(arch.start + pos)
-            return zlib.decompress(arch.lib.read(length))
+            return arch.decompress(arch.lib.read(length))
     ndx = arch.toc.find(name)
     dpos, dlen, ulen, flag, typcd, name = arch.toc[ndx]
     x, data = arch.extract(ndx)
@@ -157,9 +156,9 @@ def get_data(name, arch):
 
 
 def show(name, arch):
-    if isinstance(arch.toc, dict):
+    if isinstance(arch, ZlibArchive):
         print(" Name: (ispkg, pos, len)")
-        toc = arch.toc
+        toc = dict(arch.toc.items())
     else:
         print(" pos, length, uncompressed, iscompressed, type, name")
         toc = arch.toc.data
@@ -167,8 +166,8 @@ def show(name, arch):
 
 
 def get_content(arch, recursive, brief, output):
-    if isinstance(arch.toc, dict):
-        toc = arch.toc
+    if isinstance(arch, ZlibArchive):
+        toc = dict(arch.toc.items())
         if brief:
             for name, _ in toc.items():
                 output.append(name)
@@ -21,8 +21,11 @@
 
 #include <Carbon/Carbon.h>  /* AppleEventsT */
 #include <ApplicationServices/ApplicationServices.h> /* GetProcessForPID, etc */
+#include <errno.h>
+#include <stdlib.h>  /* strtol */
 
 #include "pyi_global.h"
+#include "pyi_archive.h"
 #include "pyi_utils.h"
 #include "pyi_apple_events.h"
 
@@ -54,6 +57,9 @@ static struct AppleEventHandlerContext
     Boolean has_pending_event;  /* Flag indicating that pending_event is valid */
     unsigned int retry_count;  /* Retry count for send attempts */
     AppleEvent pending_event;  /* Copy of the event */
+
+    /* Argv emulation */
+    Boolean activated;  /* Was the initial activation event (oapp, odoc, GURL) handled? */
 } _ae_ctx = {
     false,  /* installed */
     NULL,  /* handler */
@@ -62,6 +68,7 @@ static struct AppleEventHandlerContext
     false,  /* has_pending_event */
     0,  /* retry count */
     {typeNull, nil},  /* pending event */
+    false,  /* activated */
 };
 
 /* Event types list: used to register handler and to listen for events */
@@ -364,9 +371,15 @@ static pascal OSErr handle_apple_event(const AppleEvent *theAppleEvent, AppleEve
     switch(evtID) {
     case kAEOpenApplication:
         /* Nothing to do here, just make sure we report event as handled. */
+        if (!pyi_utils_get_child_pid()) {
+            _ae_ctx.activated = true;
+        }
         return noErr;
     case kAEOpenDocuments:
     case kAEGetURL:
+        if (!pyi_utils_get_child_pid()) {
+            _ae_ctx.activated = true;
+        }
         return handle_odoc_GURL_events(theAppleEvent, evtID);
     case kAEReopenApplication:
         return handle_rapp_event(theAppleEvent, evtID);
@@ -585,6 +598,104 @@ void pyi_apple_process_events(float timeout)
 }
 
 
+/*
+ * Argv emulation; process Apple Events until the initial activation
+ * event (oapp, or odoc/GURL if the application is launched to open a
+ * file/URL) has been handled, or until the timeout (in seconds) is
+ * reached. macOS usually delivers the activation event within a few
+ * milliseconds, so the timeout is an upper bound that is hit only if
+ * the event never comes (e.g., when launched from a terminal). With
+ * a timeout of 0, only the events that are already queued are
+ * processed.
+ *
+ * Returns 1 if the activation event was handled, 0 otherwise.
+ */
+int pyi_apple_process_initial_events(float timeout)
+{
+    EventTime deadline;
+
+    /* No-op if we failed to install event handlers */
+    if (!_ae_ctx.installed) {
+        return 0;
+    }
+
+    VS("LOADER [AppleEvent ARGV_EMU]: Waiting up to %f second(s) for the activation event...\n", timeout);
+
+    _ae_ctx.activated = false;
+    deadline = GetCurrentEventTime() + timeout;
+
+    for (;;) {
+        OSStatus status;
+        EventRef event_ref;
+        EventTime remaining;
+
+        /* Each event restarts the wait only for the time remaining. */
+        remaining = deadline - GetCurrentEventTime();
+        if (remaining < 0) {
+            remaining = kEventDurationNoWait;
+        }
+
+        status = ReceiveNextEvent(1, event_types_ae, remaining, kEventRemoveFromQueue, &event_ref);
+        if (status == eventLoopTimedOutErr) {
+            VS("LOADER [AppleEvent ARGV_EMU]: Timed out waiting for the activation event\n");
+            break;
+        } else if (status != 0) {
+            VS("LOADER [AppleEvent ARGV_EMU]: ReceiveNextEvent fetching events failed\n");
+            break;
+        }
+
+        status = SendEventToEventTarget(event_ref, GetEventDispatcherTarget());
+        ReleaseEvent(event_ref);
+        if (status != 0) {
+            VS("LOADER [AppleEvent ARGV_EMU]: processing events failed\n");
+            break;
+        }
+
+        if (_ae_ctx.activated) {
+            VS("LOADER [AppleEvent ARGV_EMU]: Activation event handled after %f second(s)\n",
+               timeout - (float)(deadline - GetCurrentEventTime()));
+            break;
+        }
+    }
+
+    return _ae_ctx.activated ? 1 : 0;
+}
+
+
+/*
+ * Return the argv emulation timeout (in seconds), as set by the
+ * pyi-macos-event-timeout runtime option (in milliseconds). With the
+ * pyi-macos-async-events runtime option, the timeout is 0; the events
+ * that arrive later are left to the program: forwarded to the child
+ * process in onefile mode, and left in the event queue for the UI
+ * framework in onedir mode.
+ */
+float pyi_apple_get_argv_emulation_timeout(const ARCHIVE_STATUS *status)
+{
+    const char *value;
+    char *end = NULL;
+    long timeout_ms;
+
+    if (pyi_arch_get_option(status, "pyi-macos-async-events") != NULL) {
+        return 0.0f;
+    }
+
+    value = pyi_arch_get_option(status, "pyi-macos-event-timeout");
+    if (value == NULL) {
+        return PYI_APPLE_ARGV_EMU_TIMEOUT;
+    }
+
+    errno = 0;
+    timeout_ms = strtol(value, &end, 10);
+    if (errno != 0 || end == value || *end != '\0' || timeout_ms < 0) {
+        OTHERERROR("LOADER [AppleEvent]: Invalid pyi-macos-event-timeout value: %s\n", value);
+        return PYI_APPLE_ARGV_EMU_TIMEOUT;
+    }
+
+    return (float)timeout_ms / 1000.0f;
+}
+
+
 /*
  * Submit oapp (open application) event to ourselves. This is an attempt
  * to mitigate the issues with some UI frameworks (Tcl/Tk, in particular)
@@ -25,6 +25,11 @@
 
 #if defined(__APPLE__) && defined(WINDOWED)
 
+#include "pyi_archive.h"
+
+/* Default upper bound for the wait for the initial activation event (in seconds). */
+#define PYI_APPLE_ARGV_EMU_TIMEOUT 0.25f
+
 /* Install Apple Event handlers */
 int pyi_apple_install_event_handlers();
 
@@ -38,6 +43,16 @@ int pyi_apple_uninstall_event_handlers();
  */
 void pyi_apple_process_events(float timeout);
 
+/*
+ * Argv emulation: process Apple Events until the initial activation
+ * event has been handled, or until the timeout is reached. Returns 1
+ * if the activation event was handled, 0 otherwise.
+ */
+int pyi_apple_process_initial_events(float timeout);
+
+/* Return the argv emulation timeout set by the runtime options. */
+float pyi_apple_get_argv_emulation_timeout(const ARCHIVE_STATUS *status);
+
 /*
  * Attempt to submit oapp event to ourselves in order to mitigate
  * issues with UI frameworks when argv-emu is used in onedir mode.
@@ -21,13 +21,34 @@
 #include <string.h>  /* strncmp, strcpy, strcat */
 #include <sys/stat.h>  /* fchmod */
 
+#ifdef _WIN32
+    #include <windows.h>  /* CreateFileMappingW, MapViewOfFile */
+    #include <io.h>  /* _get_osfhandle */
+#else
+    #include <errno.h>
+    #include <fcntl.h>  /* open */
+    #include <sys/mman.h>  /* mmap, munmap */
+    #include <unistd.h>  /* getpid, unlink, pread */
+#endif
+
 /* PyInstaller headers. */
 #include "zlib.h"
+#ifdef HAVE_ZSTD
+    #include <zstd.h>
+#endif
+#ifdef HAVE_LZ4
+    #include <lz4frame.h>
+#endif
 #include "pyi_global.h"
 #include "pyi_path.h"
 #include "pyi_archive.h"
+#include "pyi_arena.h"
+#include "pyi_layout.h"
 #include "pyi_utils.h"
 #include "pyi_python.h"
+#include "pyi_sha256.h"
+#include "pyi_trace.h"
+#include "pyi_win32_utils.h"
 
 int pyvers = 0;
 
@@ -76,304 +97,1888 @@ pyi_arch_close_fp(ARCHIVE_STATUS *status)
 }
 
 /*
- * Helper for pyi_arch_extract/pyi_arch_extract2fs that extracts a
- * compressed file from the archive, and writes it into the provided
- * file handle or data buffer. Exactly one of out_fp or out_ptr needs
- * to be valid.
+ * Map the whole archive file into memory. The mapping remains valid
+ * after the file handle is closed. Failure to map the file is not fatal;
+ * in that case, the archive is accessed by reading from the file.
  */
 static int
-_pyi_arch_extract_compressed(ARCHIVE_STATUS *status, TOC *ptoc, FILE *out_fp, unsigned char *out_ptr)
+_pyi_arch_map_file(ARCHIVE_STATUS *status, uint64_t map_size)
 {
-    const size_t CHUNK_SIZE = 8192;
-    unsigned char *buffer_in = NULL;
-    unsigned char *buffer_out = NULL;
-    uint64_t remaining_size;
-    z_stream zstream;
-    int rc = -1;
-
-    /* Allocate and initialize inflate state */
-    zstream.zalloc = Z_NULL;
-    zstream.zfree = Z_NULL;
-    zstream.opaque = Z_NULL;
-    zstream.avail_in = 0;
-    zstream.next_in = Z_NULL;
-    rc = inflateInit(&zstream);
-    if (rc != Z_OK) {
-        FATALERROR("Failed to extract %s: inflateInit() failed with return code %d!\n", ptoc->name, rc);
+    void *data;
+#ifdef _WIN32
+    HANDLE file_handle;
+    HANDLE mapping_handle;
+#endif
+
+    /* Make sure the whole archive fits into address space */
+    if (map_size == 0 || (uint64_t)(size_t)map_size != map_size) {
         return -1;
     }
 
-    /* Allocate I/O buffers */
-    buffer_in = (unsigned char *)malloc(CHUNK_SIZE);
-    if (buffer_in == NULL) {
-        FATAL_PERROR("malloc", "Failed to extract %s: failed to allocate temporary input buffer!\n", ptoc->name);
-        goto cleanup;
+#ifdef _WIN32
+    file_handle = (HANDLE)_get_osfhandle(_fileno(status->fp));
+    if (file_handle == INVALID_HANDLE_VALUE) {
+        return -1;
     }
-    buffer_out = (unsigned char *)malloc(CHUNK_SIZE);
-    if (buffer_out == NULL) {
-        FATAL_PERROR("malloc", "Failed to extract %s: failed to allocate temporary output buffer!\n", ptoc->name);
-        goto cleanup;
+    mapping_handle = CreateFileMappingW(file_handle, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (mapping_handle == NULL) {
+        return -1;
     }
+    data = MapViewOfFile(mapping_handle, FILE_MAP_READ, 0, 0, (SIZE_T)map_size);
+    /* The view keeps its own reference to the mapping object */
+    CloseHandle(mapping_handle);
+    if (data == NULL) {
+        return -1;
+    }
+#else
+    data = mmap(NULL, (size_t)map_size, PROT_READ, MAP_PRIVATE, fileno(status->fp), 0);
+    if (data == MAP_FAILED) {
+        return -1;
+    }
+#endif
 
-    /* Decompress until deflate stream ends or end of file is reached */
-    remaining_size = ptoc->len;
-    do {
+    status->mapped_data = (const unsigned char *)data;
+    status->mapped_size = map_size;
+    return 0;
+}
+
+/*
+ * Release the memory-mapped view of the archive file, if any.
+ */
+static void
+_pyi_arch_unmap_file(ARCHIVE_STATUS *status)
+{
+    if (status->mapped_data == NULL) {
+        return;
+    }
+#ifdef _WIN32
+    UnmapViewOfFile((LPCVOID)status->mapped_data);
+#else
+    munmap((void *)status->mapped_data, (size_t)status->mapped_size);
+#endif
+    status->mapped_data = NULL;
+    status->mapped_size = 0;
+}
+
+/*
+ * Return pointer to the entry's data within the memory-mapped archive,
+ * provided that the archive is mapped and that the given number of bytes
+ * at the entry's offset lies within the mapped region. Returns NULL
+ * otherwise.
+ */
+static const unsigned char *
+_pyi_arch_get_mapped_data(const ARCHIVE_STATUS *status, const TOC *ptoc, uint64_t size)
+{
+    uint64_t offset;
+
+    if (status->mapped_data == NULL) {
+        return NULL;
+    }
+    offset = status->pkgstart + ptoc->pos;
+    if (offset > status->mapped_size || size > status->mapped_size - offset) {
+        return NULL;
+    }
+    return status->mapped_data + offset;
+}
+
+const unsigned char *
+pyi_arch_get_entry_data(const ARCHIVE_STATUS *status, const TOC *ptoc)
+{
+    if (ptoc->cflag != ARCHIVE_COMPRESSION_NONE) {
+        return NULL;
+    }
+    pyi_layout_record(PYI_LAYOUT_ARCHIVE_PKG, ptoc->name);
+    return _pyi_arch_get_mapped_data(status, ptoc, ptoc->ulen);
+}
+
+#ifdef _WIN32
+/* PrefetchVirtualMemory() is available on Windows 8 and later only; it is
+ * looked up at run time, with its own declarations of its types. */
+typedef struct _pyi_memory_range_entry {
+    PVOID VirtualAddress;
+    SIZE_T NumberOfBytes;
+} PYI_MEMORY_RANGE_ENTRY;
+typedef BOOL (WINAPI *PYI_PREFETCH_VIRTUAL_MEMORY)(HANDLE, ULONG_PTR, PYI_MEMORY_RANGE_ENTRY *, ULONG);
+#endif
+
+void
+pyi_arch_prefetch(const ARCHIVE_STATUS *status, const TOC *ptoc)
+{
+    const unsigned char *data = _pyi_arch_get_mapped_data(status, ptoc, ptoc->len);
+    uintptr_t page_mask;
+    uintptr_t start;
+#ifdef _WIN32
+    static PYI_PREFETCH_VIRTUAL_MEMORY prefetch_virtual_memory = NULL;
+    static bool prefetch_virtual_memory_resolved = false;
+    PYI_MEMORY_RANGE_ENTRY range;
+    SYSTEM_INFO system_info;
+#endif
+
+    if (data == NULL || ptoc->len == 0) {
+        return;
+    }
+#ifdef _WIN32
+    if (!prefetch_virtual_memory_resolved) {
+        HMODULE kernel32 = GetModuleHandleW(L"kernel32.dll");
+        if (kernel32 != NULL) {
+            prefetch_virtual_memory = (PYI_PREFETCH_VIRTUAL_MEMORY)GetProcAddress(kernel32, "PrefetchVirtualMemory");
+        }
+        prefetch_virtual_memory_resolved = true;
+    }
+    if (prefetch_virtual_memory == NULL) {
+        return;
+    }
+    GetSystemInfo(&system_info);
+    page_mask = (uintptr_t)system_info.dwPageSize - 1;
+    start = (uintptr_t)data & ~page_mask;
+    range.VirtualAddress = (PVOID)start;
+    range.NumberOfBytes = (SIZE_T)((uintptr_t)data + ptoc->len - start);
+    prefetch_virtual_memory(GetCurrentProcess(), 1, &range, 0);
+#else
+    /* madvise() requires a page-aligned address */
+    page_mask = (uintptr_t)sysconf(_SC_PAGESIZE) - 1;
+    start = (uintptr_t)data & ~page_mask;
+    madvise((void *)start, (size_t)((uintptr_t)data + ptoc->len - start), MADV_WILLNEED);
+#endif
+}
+
+/* Max. size of the chunks of data passed to zlib, whose length fields
+ * are 32-bit. */
+#define _MAX_CHUNK_SIZE (1024 * 1024 * 1024)
+
+/* Size of the chunks in which compressed data is read with positional
+ * reads of the shared handle (pyi_arch_read_entry()). */
+#define _PYI_ARCH_READ_CHUNK_SIZE (256 * 1024)
+
+/*
+ * Source of the compressed data of an archive entry: the entry's data in
+ * the memory-mapped archive; or the archive file, positioned at the
+ * entry's data; or, if fp is NULL, the shared handle of the archive
+ * (pyi_arch_open_shared_handle()), read at the given offset. Data that is
+ * not mapped is read in chunks into the buffer.
+ */
+typedef struct _compressed_input {
+    const ARCHIVE_STATUS *status;
+    const unsigned char *mapped;
+    FILE *fp;
+    uint64_t offset;
+    unsigned char *buffer;
+    size_t buffer_size;
+    uint64_t remaining;
+#ifdef _WIN32
+    HANDLE event;  /* Completion event of the overlapped reads */
+#endif
+} COMPRESSED_INPUT;
+
+/*
+ * Read size bytes at the given offset of the shared handle. Returns 0 on
+ * success, -1 on error or at the end of the file.
+ */
+static int
+_pyi_arch_pread(COMPRESSED_INPUT *input, unsigned char *buffer, uint64_t size, uint64_t offset)
+{
+    while (size > 0) {
+        size_t chunk = (size < _MAX_CHUNK_SIZE) ? (size_t)size : _MAX_CHUNK_SIZE;
+#ifdef _WIN32
+        HANDLE handle = (HANDLE)input->status->shared_handle;
+        OVERLAPPED overlapped;
+        DWORD count = 0;
+
+        memset(&overlapped, 0, sizeof(overlapped));
+        overlapped.Offset = (DWORD)offset;
+        overlapped.OffsetHigh = (DWORD)(offset >> 32);
+        overlapped.hEvent = input->event;
+        if (!ReadFile(handle, buffer, (DWORD)chunk, NULL, &overlapped) && GetLastError() != ERROR_IO_PENDING) {
+            return -1;
+        }
+        if (!GetOverlappedResult(handle, &overlapped, &count, TRUE) || count == 0) {
+            return -1;
+        }
+#else
+        ssize_t count = pread((int)input->status->shared_handle, buffer, chunk, (off_t)offset);
+
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+        if (count <= 0) {
+            return -1;
+        }
+#endif
+        buffer += count;
+        size -= (uint64_t)count;
+        offset += (uint64_t)count;
+    }
+    return 0;
+}
+
+/*
+ * Get the next chunk of compressed data. Returns 0 on success (with
+ * chunk_size set to 0 once all data was consumed), -1 on read error.
+ */
+static int
+_pyi_arch_read_compressed(COMPRESSED_INPUT *input, const unsigned char **chunk, size_t *chunk_size)
+{
+    if (input->remaining == 0) {
+        *chunk = NULL;
+        *chunk_size = 0;
+        return 0;
+    }
+    if (input->mapped != NULL) {
+        /* Compressed entry is available in the mapped archive; it is
+         * passed to the decompressor in chunks that fit its 32-bit
+         * length fields */
+        *chunk = input->mapped;
+        *chunk_size = (input->remaining < _MAX_CHUNK_SIZE) ? (size_t)input->remaining : _MAX_CHUNK_SIZE;
+        input->mapped += *chunk_size;
+    } else {
         /* Read chunk to input buffer */
-        size_t chunk_size = (CHUNK_SIZE < remaining_size) ? CHUNK_SIZE : (size_t)remaining_size;
-        if (fread(buffer_in, 1, chunk_size, status->fp) != chunk_size || ferror(status->fp)) {
-            rc = -1;
-            goto cleanup;
+        *chunk_size = (input->buffer_size < input->remaining) ? input->buffer_size : (size_t)input->remaining;
+        if (input->fp != NULL) {
+            if (fread(input->buffer, 1, *chunk_size, input->fp) != *chunk_size || ferror(input->fp)) {
+                return -1;
+            }
+        } else if (_pyi_arch_pread(input, input->buffer, *chunk_size, input->offset) != 0) {
+            return -1;
         }
-        remaining_size -= chunk_size;
+        input->offset += *chunk_size;
+        *chunk = input->buffer;
+    }
+    input->remaining -= *chunk_size;
+    return 0;
+}
+
+/*
+ * Destination of the decompressed data of an archive entry: the output
+ * file, to which the data is written from the buffer; or, if fp is NULL,
+ * the memory at ptr, into which the data is decompressed directly. In
+ * both cases, exactly ptoc->ulen bytes are expected. If crc is valid, the
+ * CRC-32 of the data is accumulated into it while the data is still in the
+ * cache. If decompress_time is valid, the time spent in the decompressor
+ * is added to it.
+ */
+typedef struct _decompressed_output {
+    FILE *fp;
+    unsigned char *buffer;
+    size_t buffer_size;
+    unsigned char *ptr;
+    uint64_t remaining;
+    uint32_t *crc;
+    uint64_t *decompress_time;
+} DECOMPRESSED_OUTPUT;
+
+/*
+ * Get the space into which the decompressor writes the next part of the
+ * data.
+ */
+static void
+_pyi_arch_output_window(const DECOMPRESSED_OUTPUT *output, unsigned char **dst, size_t *dst_size)
+{
+    if (output->fp != NULL) {
+        *dst = output->buffer;
+        *dst_size = output->buffer_size;
+    } else {
+        *dst = output->ptr;
+        *dst_size = (output->remaining < _MAX_CHUNK_SIZE) ? (size_t)output->remaining : _MAX_CHUNK_SIZE;
+    }
+}
+
+/*
+ * Take the len bytes that the decompressor wrote into the window: write
+ * them to the output file or advance the pointer. Returns 0 on success,
+ * or one of the ARCHIVE_READ_ERROR_* codes.
+ */
+static int
+_pyi_arch_output_commit(DECOMPRESSED_OUTPUT *output, const unsigned char *data, size_t len)
+{
+    if (len > output->remaining) {
+        return ARCHIVE_READ_ERROR_DATA;  /* Larger than the entry */
+    }
+    if (output->crc) {
+        *output->crc = (uint32_t)crc32(*output->crc, data, (uInt)len);
+    }
+    if (output->fp != NULL) {
+        if (len > 0 && (fwrite(data, 1, len, output->fp) != len || ferror(output->fp))) {
+            return ARCHIVE_READ_ERROR_WRITE;
+        }
+    } else {
+        output->ptr += len;
+    }
+    output->remaining -= len;
+    return 0;
+}
+
+/* Run the decompressor call, adding the time spent in it to the output's
+ * decompress_time, if valid. */
+#define _PYI_ARCH_TIMED(output, call) \
+    do { \
+        if ((output)->decompress_time) { \
+            uint64_t _start_time = pyi_utils_get_monotonic_time(); \
+            call; \
+            *(output)->decompress_time += pyi_utils_get_monotonic_time() - _start_time; \
+        } else { \
+            call; \
+        } \
+    } while (0)
+
+/*
+ * State of the decompressors, reused for the entries extracted via the
+ * same ARCHIVE_STATUS (see EXTRACTION_CONTEXT), or local to a single
+ * pyi_arch_read_entry() call. Zero-initialized before first use.
+ */
+typedef struct _decompressor {
+    z_stream zstream;
+    bool zstream_initialized;
+#ifdef HAVE_ZSTD
+    ZSTD_DCtx *zstd_dctx;
+#endif
+#ifdef HAVE_LZ4
+    LZ4F_dctx *lz4_dctx;
+#endif
+} DECOMPRESSOR;
+
+static void
+_pyi_arch_decompressor_free(DECOMPRESSOR *decompressor)
+{
+    if (decompressor->zstream_initialized) {
+        inflateEnd(&decompressor->zstream);
+        decompressor->zstream_initialized = false;
+    }
+#ifdef HAVE_ZSTD
+    ZSTD_freeDCtx(decompressor->zstd_dctx);
+    decompressor->zstd_dctx = NULL;
+#endif
+#ifdef HAVE_LZ4
+    if (decompressor->lz4_dctx != NULL) {
+        LZ4F_freeDecompressionContext(decompressor->lz4_dctx);
+        decompressor->lz4_dctx = NULL;
+    }
+#endif
+}
+
+/*
+ * Decompress an entry compressed with zlib.
+ */
+static int
+_pyi_arch_decompress_zlib(DECOMPRESSOR *decompressor, COMPRESSED_INPUT *input, DECOMPRESSED_OUTPUT *output)
+{
+    z_stream *zstream = &decompressor->zstream;
+    int rc;
+    int error;
+
+    /* Initialize inflate state, or reset the one used for the previous
+     * entry */
+    if (decompressor->zstream_initialized) {
+        rc = inflateReset(zstream);
+    } else {
+        memset(zstream, 0, sizeof(*zstream));
+        rc = inflateInit(zstream);
+        decompressor->zstream_initialized = (rc == Z_OK);
+    }
+    if (rc != Z_OK) {
+        return ARCHIVE_READ_ERROR_MEMORY;
+    }
 
-        /* Run inflate() on input until output buffer is not full. */
-        zstream.avail_in = (uInt)chunk_size;
-        zstream.next_in = buffer_in;
-        do {
-            size_t out_len;
-            zstream.avail_out = (uInt)CHUNK_SIZE;
-            zstream.next_out = buffer_out;
-            rc = inflate(&zstream, Z_NO_FLUSH);
-            switch (rc) {
-                case Z_NEED_DICT:
-                    rc = Z_DATA_ERROR; /* and fall through */
-                case Z_DATA_ERROR:
-                case Z_MEM_ERROR:
-                case Z_STREAM_ERROR:
-                    goto decompress_end;
+    /* Decompress until the deflate stream ends */
+    zstream->avail_in = 0;
+    do {
+        unsigned char *dst;
+        size_t dst_size;
+
+        if (zstream->avail_in == 0) {
+            const unsigned char *chunk;
+            size_t chunk_size;
+
+            if (_pyi_arch_read_compressed(input, &chunk, &chunk_size) != 0) {
+                return ARCHIVE_READ_ERROR_IO;
             }
-            /* Copy the extracted data */
-            out_len = CHUNK_SIZE - zstream.avail_out;
-            if (out_fp) {
-                /* Write to output file */
-                if (fwrite(buffer_out, 1, out_len, out_fp) != out_len || ferror(out_fp)) {
-                    rc = Z_ERRNO;
-                    goto decompress_end;
-                }
-            } else if (out_ptr) {
-                /* Copy to output data buffer */
-                memcpy(out_ptr, buffer_out, out_len);
-                out_ptr += out_len;
+            if (chunk_size == 0) {
+                return ARCHIVE_READ_ERROR_DATA;  /* Truncated stream */
             }
-        } while (zstream.avail_out == 0);
-        /* Done when inflate() says it's done */
-    } while (rc != Z_STREAM_END && remaining_size > 0);
+            zstream->next_in = (Bytef *)chunk;
+            zstream->avail_in = (uInt)chunk_size;
+        }
+        _pyi_arch_output_window(output, &dst, &dst_size);
+        zstream->next_out = dst;
+        zstream->avail_out = (uInt)dst_size;
+        _PYI_ARCH_TIMED(output, rc = inflate(zstream, Z_NO_FLUSH));
+        if (rc != Z_OK && rc != Z_STREAM_END) {
+            /* Including Z_NEED_DICT, and Z_BUF_ERROR if the data is
+             * larger than the entry */
+            return (rc == Z_MEM_ERROR) ? ARCHIVE_READ_ERROR_MEMORY : ARCHIVE_READ_ERROR_DATA;
+        }
+        error = _pyi_arch_output_commit(output, dst, dst_size - zstream->avail_out);
+        if (error != 0) {
+            return error;
+        }
+    } while (rc != Z_STREAM_END);
+    return 0;
+}
 
-decompress_end:
-    if (rc == Z_STREAM_END) {
-        rc = 0; /* Success */
+#ifdef HAVE_ZSTD
+/*
+ * Decompress an entry compressed with zstd.
+ */
+static int
+_pyi_arch_decompress_zstd(DECOMPRESSOR *decompressor, COMPRESSED_INPUT *input, DECOMPRESSED_OUTPUT *output)
+{
+    ZSTD_inBuffer in = { NULL, 0, 0 };
+    size_t ret;
+    int error;
+
+    /* Create decompression context, or reset the one used for the
+     * previous entry */
+    if (decompressor->zstd_dctx == NULL) {
+        decompressor->zstd_dctx = ZSTD_createDCtx();
+        if (decompressor->zstd_dctx == NULL) {
+            return ARCHIVE_READ_ERROR_MEMORY;
+        }
     } else {
-        FATALERROR("Failed to extract %s: decompression resulted in return code %d!\n", ptoc->name, rc);
-        rc = -1;
+        ZSTD_DCtx_reset(decompressor->zstd_dctx, ZSTD_reset_session_only);
+    }
+
+    /* Decompress until the frame ends */
+    do {
+        ZSTD_outBuffer out;
+        size_t in_pos;
+
+        if (in.pos == in.size) {
+            const unsigned char *chunk;
+            size_t chunk_size;
+
+            if (_pyi_arch_read_compressed(input, &chunk, &chunk_size) != 0) {
+                return ARCHIVE_READ_ERROR_IO;
+            }
+            if (chunk_size == 0) {
+                return ARCHIVE_READ_ERROR_DATA;  /* Truncated frame */
+            }
+            in.src = chunk;
+            in.size = chunk_size;
+            in.pos = 0;
+        }
+        _pyi_arch_output_window(output, (unsigned char **)&out.dst, &out.size);
+        out.pos = 0;
+        in_pos = in.pos;
+        _PYI_ARCH_TIMED(output, ret = ZSTD_decompressStream(decompressor->zstd_dctx, &out, &in));
+        if (ZSTD_isError(ret) || (ret != 0 && out.pos == 0 && in.pos == in_pos)) {
+            /* Corrupted, or larger than the entry */
+            return ARCHIVE_READ_ERROR_DATA;
+        }
+        error = _pyi_arch_output_commit(output, (const unsigned char *)out.dst, out.pos);
+        if (error != 0) {
+            return error;
+        }
+    } while (ret != 0);
+    return 0;
+}
+#endif  /* HAVE_ZSTD */
+
+#ifdef HAVE_LZ4
+/*
+ * Decompress an entry compressed with LZ4 (frame format).
+ */
+static int
+_pyi_arch_decompress_lz4(DECOMPRESSOR *decompressor, COMPRESSED_INPUT *input, DECOMPRESSED_OUTPUT *output)
+{
+    const unsigned char *chunk = NULL;
+    size_t chunk_size = 0;
+    size_t ret;
+    int error;
+
+    /* Create decompression context; it is reset automatically at the end
+     * of each frame, and explicitly after an error. */
+    if (decompressor->lz4_dctx == NULL) {
+        if (LZ4F_isError(LZ4F_createDecompressionContext(&decompressor->lz4_dctx, LZ4F_VERSION))) {
+            decompressor->lz4_dctx = NULL;
+            return ARCHIVE_READ_ERROR_MEMORY;
+        }
+    }
+
+    /* Decompress until the frame ends */
+    do {
+        unsigned char *dst;
+        size_t dst_size;
+        size_t src_size;
+
+        if (chunk_size == 0) {
+            if (_pyi_arch_read_compressed(input, &chunk, &chunk_size) != 0) {
+                error = ARCHIVE_READ_ERROR_IO;
+                goto error;
+            }
+            if (chunk_size == 0) {
+                error = ARCHIVE_READ_ERROR_DATA;  /* Truncated frame */
+                goto error;
+            }
+        }
+        _pyi_arch_output_window(output, &dst, &dst_size);
+        src_size = chunk_size;
+        _PYI_ARCH_TIMED(output, ret = LZ4F_decompress(decompressor->lz4_dctx, dst, &dst_size, chunk, &src_size, NULL));
+        if (LZ4F_isError(ret) || (src_size == 0 && dst_size == 0)) {
+            /* Corrupted, or larger than the entry */
+            error = ARCHIVE_READ_ERROR_DATA;
+            goto error;
+        }
+        chunk += src_size;
+        chunk_size -= src_size;
+        error = _pyi_arch_output_commit(output, dst, dst_size);
+        if (error != 0) {
+            goto error;
+        }
+    } while (ret != 0);
+    return 0;
+
+error:
+    LZ4F_resetDecompressionContext(decompressor->lz4_dctx);
+    return error;
+}
+#endif  /* HAVE_LZ4 */
+
+/*
+ * Decompress the data of a compressed entry from input to output, with the
+ * decompressor for its compression method. The single place that knows
+ * the compression methods; used both for extraction and by
+ * pyi_arch_read_entry(). Errors are not reported; returns 0 on success, or
+ * one of the ARCHIVE_READ_ERROR_* codes.
+ */
+static int
+_pyi_arch_decompress(DECOMPRESSOR *decompressor, const TOC *ptoc, COMPRESSED_INPUT *input,
+                     DECOMPRESSED_OUTPUT *output)
+{
+    int rc;
+
+    switch (ptoc->cflag) {
+        case ARCHIVE_COMPRESSION_ZLIB:
+            rc = _pyi_arch_decompress_zlib(decompressor, input, output);
+            break;
+#ifdef HAVE_ZSTD
+        case ARCHIVE_COMPRESSION_ZSTD:
+            rc = _pyi_arch_decompress_zstd(decompressor, input, output);
+            break;
+#endif
+#ifdef HAVE_LZ4
+        case ARCHIVE_COMPRESSION_LZ4:
+            rc = _pyi_arch_decompress_lz4(decompressor, input, output);
+            break;
+#endif
+        default:
+            return ARCHIVE_READ_ERROR_UNSUPPORTED;
+    }
+    if (rc == 0 && output->remaining != 0) {
+        rc = ARCHIVE_READ_ERROR_DATA;  /* Smaller than the entry */
+    }
+    return rc;
+}
+
+/*
+ * CRC-32 of the data, which may be larger than zlib's 32-bit length
+ * fields.
+ */
+static uint32_t
+_pyi_arch_crc32(uint32_t crc, const unsigned char *data, uint64_t size)
+{
+    uint64_t offset;
+
+    for (offset = 0; offset < size; offset += _MAX_CHUNK_SIZE) {
+        uint64_t remaining = size - offset;
+        crc = (uint32_t)crc32(crc, data + offset,
+                              (uInt)(remaining < _MAX_CHUNK_SIZE ? remaining : _MAX_CHUNK_SIZE));
+    }
+    return crc;
+}
+
+/*
+ * Compare the CRC-32 of the extracted data of the entry with the one in
+ * its TOC entry. Returns 0 if they match, -1 otherwise.
+ */
+static int
+_pyi_arch_verify_checksum(const TOC *ptoc, uint32_t crc)
+{
+    if (crc != ptoc->checksum) {
+        FATALERROR("Failed to extract %s: checksum mismatch (%08x, expected %08x); "
+                   "the executable is corrupted!\n", ptoc->name, crc, ptoc->checksum);
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Extraction context; buffers and decompression state that are reused
+ * for all entries extracted via the given ARCHIVE_STATUS. Created on the
+ * first extraction and freed in pyi_arch_status_free().
+ */
+struct _extraction_context {
+    size_t buffer_size;
+    unsigned char *buffer_in;
+    unsigned char *buffer_out;
+    DECOMPRESSOR decompressor;
+};
+
+/* Bounds for the size of (each of) the I/O buffers. */
+#define _MIN_EXTRACTION_BUFFER_SIZE (256 * 1024)
+#define _MAX_EXTRACTION_BUFFER_SIZE (1024 * 1024)
+
+/* Minimal size of the uncompressed entries that are copied by the kernel
+ * rather than written from the memory-mapped archive. */
+#define _PYI_ARCH_KERNEL_COPY_MIN_SIZE (256 * 1024)
+
+/*
+ * Get the extraction context of the archive for extraction of the given
+ * entry, creating it if necessary. The buffers grow with the size of the
+ * extracted entries, within the bounds given above, so that most entries
+ * are read and written in a single chunk. Returns NULL on allocation
+ * failure.
+ */
+static EXTRACTION_CONTEXT *
+_pyi_arch_get_extraction_context(ARCHIVE_STATUS *status, const TOC *ptoc)
+{
+    EXTRACTION_CONTEXT *context = status->extraction_context;
+    uint64_t entry_size = (ptoc->ulen > ptoc->len) ? ptoc->ulen : ptoc->len;
+    size_t buffer_size = _MIN_EXTRACTION_BUFFER_SIZE;
+    unsigned char *buffer;
+
+    if (context == NULL) {
+        context = (EXTRACTION_CONTEXT *)calloc(1, sizeof(EXTRACTION_CONTEXT));
+        if (context == NULL) {
+            FATAL_PERROR("calloc", "Failed to allocate extraction context!\n");
+            return NULL;
+        }
+        status->extraction_context = context;
+    }
+
+    while (buffer_size < entry_size && buffer_size < _MAX_EXTRACTION_BUFFER_SIZE) {
+        buffer_size *= 2;
+    }
+    if (buffer_size <= context->buffer_size) {
+        return context;
+    }
+
+    /* (Re)allocate the buffers; the old contents need not be preserved */
+    VS("LOADER: Allocating %lu-byte extraction buffers\n", (unsigned long)buffer_size);
+    buffer = (unsigned char *)realloc(context->buffer_in, buffer_size);
+    if (buffer == NULL) {
+        FATAL_PERROR("realloc", "Failed to allocate extraction buffers!\n");
+        return NULL;
+    }
+    context->buffer_in = buffer;
+    buffer = (unsigned char *)realloc(context->buffer_out, buffer_size);
+    if (buffer == NULL) {
+        FATAL_PERROR("realloc", "Failed to allocate extraction buffers!\n");
+        return NULL;
+    }
+    context->buffer_out = buffer;
+    context->buffer_size = buffer_size;
+    return context;
+}
+
+void
+pyi_arch_free_extraction_context(ARCHIVE_STATUS *status)
+{
+    EXTRACTION_CONTEXT *context = status->extraction_context;
+
+    if (context == NULL) {
+        return;
+    }
+    _pyi_arch_decompressor_free(&context->decompressor);
+    free(context->buffer_in);
+    free(context->buffer_out);
+    free(context);
+    status->extraction_context = NULL;
+}
+
+/*
+ * Helper for pyi_arch_extract/pyi_arch_extract2fs that extracts a
+ * compressed file from the archive, and writes it into the provided
+ * file handle or data buffer. Exactly one of out_fp or out_ptr needs
+ * to be valid. If in_data is valid, it points to the entry's compressed
+ * data in the memory-mapped archive; otherwise, the data is read from
+ * the archive file, which must be positioned at the entry's data.
+ * If decompress_time is valid, the time spent in the decompressor is
+ * added to it.
+ */
+static int
+_pyi_arch_extract_compressed(ARCHIVE_STATUS *status, TOC *ptoc, const unsigned char *in_data, FILE *out_fp, unsigned char *out_ptr,
+                             uint64_t *decompress_time)
+{
+    EXTRACTION_CONTEXT *context;
+    COMPRESSED_INPUT input;
+    DECOMPRESSED_OUTPUT output;
+    uint32_t crc = (uint32_t)crc32(0L, Z_NULL, 0);
+    int rc;
+
+    context = _pyi_arch_get_extraction_context(status, ptoc);
+    if (context == NULL) {
+        return -1;
+    }
+
+    /* Input buffer is used only when not reading from the mapped
+     * archive, and output buffer only when writing to a file */
+    memset(&input, 0, sizeof(input));
+    input.status = status;
+    input.mapped = in_data;
+    input.fp = status->fp;
+    input.buffer = context->buffer_in;
+    input.buffer_size = context->buffer_size;
+    input.remaining = ptoc->len;
+    memset(&output, 0, sizeof(output));
+    output.fp = out_fp;
+    output.buffer = context->buffer_out;
+    output.buffer_size = context->buffer_size;
+    output.ptr = out_ptr;
+    output.remaining = ptoc->ulen;
+    output.crc = (ptoc->flags & ARCHIVE_FLAG_CHECKSUM) ? &crc : NULL;
+    output.decompress_time = decompress_time;
+
+    rc = _pyi_arch_decompress(&context->decompressor, ptoc, &input, &output);
+    switch (rc) {
+        case 0:
+            break;
+        case ARCHIVE_READ_ERROR_IO:
+            FATAL_PERROR("fread", "Failed to extract %s: failed to read compressed data!\n", ptoc->name);
+            return -1;
+        case ARCHIVE_READ_ERROR_WRITE:
+            FATAL_PERROR("fwrite", "Failed to extract %s: failed to write data!\n", ptoc->name);
+            return -1;
+        case ARCHIVE_READ_ERROR_MEMORY:
+            FATALERROR("Failed to extract %s: failed to allocate decompression state!\n", ptoc->name);
+            return -1;
+        case ARCHIVE_READ_ERROR_UNSUPPORTED:
+            FATALERROR("Failed to extract %s: unsupported compression method %d! "
+                       "The bootloader needs to be built with support for it.\n", ptoc->name, (int)ptoc->cflag);
+            return -1;
+        default:
+            FATALERROR("Failed to extract %s: decompression failed; the executable is corrupted!\n", ptoc->name);
+            return -1;
+    }
+    if (output.crc != NULL) {
+        return _pyi_arch_verify_checksum(ptoc, crc);
+    }
+    return 0;
+}
+
+/*
+ * Helper for pyi_arch_extract2fs that extracts an uncompressed file from
+ * the archive into the provided file handle. On POSIX systems, the data
+ * is copied by the kernel where possible (see pyi_utils_copy_fd_range),
+ * unless its checksum needs to be verified.
+ */
+static int
+_pyi_arch_extract2fs_uncompressed(ARCHIVE_STATUS *status, TOC *ptoc, FILE *out)
+{
+    EXTRACTION_CONTEXT *context;
+    uint64_t remaining_size;
+    uint32_t crc = (uint32_t)crc32(0L, Z_NULL, 0);
+
+#ifndef _WIN32
+    if (!(ptoc->flags & ARCHIVE_FLAG_CHECKSUM)) {
+        if (fflush(out) != 0 ||
+            pyi_utils_copy_fd_range(fileno(status->fp), status->pkgstart + ptoc->pos, fileno(out),
+                                    ptoc->ulen) != 0) {
+            FATAL_PERROR("write", "Failed to extract %s: failed to copy data!\n", ptoc->name);
+            return -1;
+        }
+        return 0;
+    }
+#endif
+
+    context = _pyi_arch_get_extraction_context(status, ptoc);
+    if (context == NULL) {
+        return -1;
+    }
+
+    /* Copy the data, chunk by chunk */
+    remaining_size = ptoc->ulen;
+    while (remaining_size > 0) {
+        size_t chunk_size = (context->buffer_size < remaining_size) ? context->buffer_size : (size_t)remaining_size;
+        if (fread(context->buffer_in, chunk_size, 1, status->fp) < 1) {
+            FATAL_PERROR("fread", "Failed to extract %s: failed to read data chunk!\n", ptoc->name);
+            return -1;
+        }
+        if (fwrite(context->buffer_in, chunk_size, 1, out) < 1) {
+            FATAL_PERROR("fwrite", "Failed to extract %s: failed to write data chunk!\n", ptoc->name);
+            return -1;
+        }
+        crc = (uint32_t)crc32(crc, context->buffer_in, (uInt)chunk_size);
+        remaining_size -= chunk_size;
+    }
+    if (ptoc->flags & ARCHIVE_FLAG_CHECKSUM) {
+        return _pyi_arch_verify_checksum(ptoc, crc);
+    }
+    return 0;
+}
+
+/*
+ * Helper for pyi_arch_extract that extracts an uncompressed file from
+ * the archive into the provided (pre-allocated) buffer.
+ */
+static int
+_pyi_arch_extract_uncompressed(ARCHIVE_STATUS *status, TOC *ptoc, unsigned char *out)
+{
+    /* Read the whole file directly into the buffer */
+    if (ptoc->ulen > 0 && fread(out, ptoc->ulen, 1, status->fp) < 1) {
+        FATAL_PERROR("fread", "Failed to extract %s: failed to read data!\n", ptoc->name);
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Extract an archive entry into data buffer.
+ * Returns pointer to the data (must be freed).
+ */
+unsigned char *
+pyi_arch_extract(ARCHIVE_STATUS *status, TOC *ptoc)
+{
+    const unsigned char *mapped;
+    unsigned char *data = NULL;
+    int rc = 0;
+
+    pyi_layout_record(PYI_LAYOUT_ARCHIVE_PKG, ptoc->name);
+
+    /* Use the memory-mapped archive if available; otherwise, open
+     * archive (source) file and seek to the beginning of entry's data */
+    mapped = _pyi_arch_get_mapped_data(status, ptoc, ptoc->len);
+    if (mapped == NULL) {
+        if (pyi_arch_open_fp(status) != 0) {
+            FATALERROR("Failed to extract %s: failed to open archive file!\n", ptoc->name);
+            return NULL;
+        }
+        if (pyi_fseek(status->fp, status->pkgstart + ptoc->pos, SEEK_SET) < 0) {
+            FATAL_PERROR("fseek", "Failed to extract %s: failed to seek to the entry's data!\n", ptoc->name);
+            goto cleanup;
+        }
+    }
+
+    /* Allocate the data buffer */
+    if ((uint64_t)(size_t)ptoc->ulen == ptoc->ulen) {
+        data = (unsigned char *)malloc((size_t)ptoc->ulen);
+    }
+    if (data == NULL) {
+        FATAL_PERROR("malloc", "Failed to extract %s: failed to allocate data buffer (%" PRIu64 " bytes)!\n",
+                     ptoc->name, ptoc->ulen);
+        goto cleanup;
+    }
+
+    /* Extract */
+    if (ptoc->cflag != ARCHIVE_COMPRESSION_NONE) {
+        rc = _pyi_arch_extract_compressed(status, ptoc, mapped, NULL, data, NULL);
+    } else {
+        if (mapped != NULL) {
+            memcpy(data, mapped, ptoc->ulen);
+        } else {
+            rc = _pyi_arch_extract_uncompressed(status, ptoc, data);
+        }
+        if (rc == 0 && (ptoc->flags & ARCHIVE_FLAG_CHECKSUM)) {
+            rc = _pyi_arch_verify_checksum(ptoc, _pyi_arch_crc32((uint32_t)crc32(0L, Z_NULL, 0), data, ptoc->ulen));
+        }
+    }
+    if (rc != 0) {
+        free(data);
+        data = NULL;
+    }
+
+cleanup:
+    pyi_arch_close_fp(status);
+
+    return data;
+}
+
+/*
+ * Extract an archive entry into the given (newly created) file.
+ */
+static int
+_pyi_arch_extract2fs_to(ARCHIVE_STATUS *status, TOC *ptoc, FILE *out, uint64_t *decompress_time)
+{
+    const unsigned char *mapped;
+    int rc = 0;
+
+    pyi_layout_record(PYI_LAYOUT_ARCHIVE_PKG, ptoc->name);
+
+    /* Use the memory-mapped archive if available; otherwise, open
+     * archive (source) file and seek to the beginning of entry's data */
+    mapped = _pyi_arch_get_mapped_data(status, ptoc, ptoc->len);
+#ifdef __linux__
+    /* Large uncompressed entries are copied by the kernel from the archive
+     * file, which avoids faulting in the mapped pages and copying them
+     * through user space, and may share the data blocks instead. */
+    if (ptoc->cflag == ARCHIVE_COMPRESSION_NONE && ptoc->ulen >= _PYI_ARCH_KERNEL_COPY_MIN_SIZE &&
+        !(ptoc->flags & ARCHIVE_FLAG_CHECKSUM)) {
+        mapped = NULL;
+    }
+#endif
+    if (mapped == NULL) {
+        if (pyi_arch_open_fp(status) != 0) {
+            FATALERROR("Failed to extract %s: failed to open archive file!\n", ptoc->name);
+            rc = -1;
+            goto cleanup;
+        }
+        if (pyi_fseek(status->fp, status->pkgstart + ptoc->pos, SEEK_SET) < 0) {
+            FATAL_PERROR("fseek", "Failed to extract %s: failed to seek to the entry's data!\n", ptoc->name);
+            rc = -1;
+            goto cleanup;
+        }
+    }
+
+    /* Extract */
+    if (ptoc->cflag != ARCHIVE_COMPRESSION_NONE) {
+        rc = _pyi_arch_extract_compressed(status, ptoc, mapped, out, NULL, decompress_time);
+    } else if (mapped != NULL) {
+        /* Write directly from the mapped archive */
+        if (ptoc->ulen > 0 && fwrite(mapped, ptoc->ulen, 1, out) < 1) {
+            FATAL_PERROR("fwrite", "Failed to extract %s: failed to write data!\n", ptoc->name);
+            rc = -1;
+        } else if (ptoc->flags & ARCHIVE_FLAG_CHECKSUM) {
+            rc = _pyi_arch_verify_checksum(ptoc, _pyi_arch_crc32((uint32_t)crc32(0L, Z_NULL, 0), mapped, ptoc->ulen));
+        }
+    } else {
+        rc = _pyi_arch_extract2fs_uncompressed(status, ptoc, out);
+    }
+#ifndef WIN32
+    fchmod(fileno(out), S_IRUSR | S_IWUSR | S_IXUSR);
+#endif
+
+cleanup:
+    pyi_arch_close_fp(status);
+
+    return rc;
+}
+
+/*
+ * Extract an archive entry into the given file, which is left open.
+ */
+int
+pyi_arch_extract2fp(ARCHIVE_STATUS *status, TOC *ptoc, FILE *out)
+{
+    return _pyi_arch_extract2fs_to(status, ptoc, out, NULL);
+}
+
+/*
+ * Extract an archive entry into file on the filesystem.
+ * The path is relative to the directory the archive is in.
+ */
+int
+pyi_arch_extract2fs(ARCHIVE_STATUS *status, TOC *ptoc)
+{
+    FILE *out = NULL;
+    int rc = 0;
+    bool trace = pyi_trace_is_enabled();
+    uint64_t start_time = trace ? pyi_utils_get_monotonic_time() : 0;
+    uint64_t decompress_time = 0;
+
+    /* Ensure that tmp dir _MEIPASSxxx exists... */
+    if (pyi_create_temp_path(status) == -1) {
+        return -1;
+    }
+    /* ... and open target file */
+    if (status->target_dirs != NULL) {
+        out = pyi_target_dirs_open(status->target_dirs, ptoc->name);
+    } else {
+        out = pyi_open_target(status->temppath, ptoc->name, pyi_arch_has_temporary_files(status));
+    }
+    if (out == NULL) {
+        FATAL_PERROR("fopen", "Failed to extract %s: failed to open target file!\n", ptoc->name);
+        return -1;
+    }
+    pyi_utils_prepare_target(out, ptoc->ulen);
+
+    rc = _pyi_arch_extract2fs_to(status, ptoc, out, trace ? &decompress_time : NULL);
+    fclose(out);
+
+    if (trace && rc == 0) {
+        pyi_trace_add_event("extract", start_time, pyi_utils_get_monotonic_time() - start_time,
+                            ptoc->name, ptoc->ulen, decompress_time);
+    }
+
+    return rc;
+}
+
+/*
+ * Extract an archive entry into the existing temporary directory, unless
+ * the file already exists there. The entry is written into a temporary
+ * file that is then renamed, so that other processes using the same
+ * directory (e.g., multiprocessing workers, which may extract the same
+ * entry at the same time) never see a partially written file.
+ */
+int
+pyi_arch_extract2fs_once(ARCHIVE_STATUS *status, TOC *ptoc)
+{
+    char path[PATH_MAX];
+    char partial_path[PATH_MAX];
+    const char *partial_name;
+    size_t path_len;
+    unsigned long pid;
+    FILE *out;
+    int rc;
+#ifdef _WIN32
+    wchar_t wpath[PATH_MAX];
+    wchar_t wpartial_path[PATH_MAX];
+
+    pid = (unsigned long)GetCurrentProcessId();
+#else
+    pid = (unsigned long)getpid();
+#endif
+
+    /* The temporary file is the target file with a suffix; its name
+     * relative to temppath is the tail of its path. */
+    path_len = (size_t)snprintf(path, PATH_MAX, "%s%s%s", status->temppath, PYI_SEPSTR, ptoc->name);
+    if (path_len >= PATH_MAX ||
+        path_len + (size_t)snprintf(partial_path + path_len, PATH_MAX - path_len, ".%lu.partial", pid) >= PATH_MAX) {
+        FATALERROR("Failed to extract %s: path exceeds PATH_MAX!\n", ptoc->name);
+        return -1;
+    }
+    memcpy(partial_path, path, path_len);
+    partial_name = partial_path + strlen(status->temppath) + strlen(PYI_SEPSTR);
+    if (pyi_path_exists(path)) {
+        return 0;
+    }
+
+    out = pyi_open_target(status->temppath, partial_name, pyi_arch_has_temporary_files(status));
+    if (out == NULL) {
+        FATAL_PERROR("fopen", "Failed to extract %s: failed to open target file!\n", ptoc->name);
+        return -1;
+    }
+    pyi_utils_prepare_target(out, ptoc->ulen);
+    rc = _pyi_arch_extract2fs_to(status, ptoc, out, NULL);
+    if (fclose(out) != 0) {
+        rc = -1;
+    }
+
+    if (rc == 0) {
+#ifdef _WIN32
+        if (pyi_win32_utils_from_utf8(wpath, path, PATH_MAX) != NULL &&
+            pyi_win32_utils_from_utf8(wpartial_path, partial_path, PATH_MAX) != NULL &&
+            MoveFileExW(wpartial_path, wpath, 0)) {
+            return 0;
+        }
+#else
+        if (rename(partial_path, path) == 0) {
+            return 0;
+        }
+#endif
+        /* Somebody else may have extracted the same entry meanwhile. */
+        if (!pyi_path_exists(path)) {
+            FATAL_PERROR("rename", "Failed to extract %s: failed to rename temporary file!\n", ptoc->name);
+            rc = -1;
+        }
+    }
+
+    /* Remove the temporary file */
+#ifdef _WIN32
+    if (pyi_win32_utils_from_utf8(wpartial_path, partial_path, PATH_MAX) != NULL) {
+        _wremove(wpartial_path);
+    }
+#else
+    unlink(partial_path);
+#endif
+    return rc;
+}
+
+/*
+ * Thread-safe reading of entries (pyi_arch_read_entry()).
+ */
+
+int
+pyi_arch_open_shared_handle(ARCHIVE_STATUS *status)
+{
+#ifdef _WIN32
+    wchar_t archive_path[PATH_MAX];
+    HANDLE handle;
+#else
+    int fd;
+#endif
+
+    if (status->mapped_data != NULL || status->has_shared_handle) {
+        return 0;
+    }
+#ifdef _WIN32
+    if (pyi_win32_utils_from_utf8(archive_path, status->archivename, PATH_MAX) == NULL) {
+        return -1;
+    }
+    handle = CreateFileW(archive_path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL, OPEN_EXISTING,
+                         FILE_ATTRIBUTE_NORMAL | FILE_FLAG_OVERLAPPED, NULL);
+    if (handle == INVALID_HANDLE_VALUE) {
+        return -1;
+    }
+    status->shared_handle = (intptr_t)handle;
+#else
+    fd = open(status->archivename, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+    status->shared_handle = (intptr_t)fd;
+#endif
+    status->has_shared_handle = true;
+    return 0;
+}
+
+static void
+_pyi_arch_close_shared_handle(ARCHIVE_STATUS *status)
+{
+    if (!status->has_shared_handle) {
+        return;
+    }
+#ifdef _WIN32
+    CloseHandle((HANDLE)status->shared_handle);
+#else
+    close((int)status->shared_handle);
+#endif
+    status->has_shared_handle = false;
+}
+
+int
+pyi_arch_read_entry(const ARCHIVE_STATUS *status, const TOC *ptoc, unsigned char *buffer)
+{
+    COMPRESSED_INPUT input;
+    DECOMPRESSED_OUTPUT output;
+    DECOMPRESSOR decompressor;
+    uint32_t crc = (uint32_t)crc32(0L, Z_NULL, 0);
+    int rc;
+
+    pyi_layout_record(PYI_LAYOUT_ARCHIVE_PKG, ptoc->name);
+
+    /* The shared handle is read at the entry's offset; fp is not used. */
+    memset(&input, 0, sizeof(input));
+    input.status = status;
+    input.mapped = _pyi_arch_get_mapped_data(status, ptoc, ptoc->len);
+    input.offset = status->pkgstart + ptoc->pos;
+    input.remaining = ptoc->len;
+    if (input.mapped == NULL) {
+        if (!status->has_shared_handle) {
+            return ARCHIVE_READ_ERROR_IO;
+        }
+#ifdef _WIN32
+        input.event = CreateEventW(NULL, TRUE, FALSE, NULL);
+        if (input.event == NULL) {
+            return ARCHIVE_READ_ERROR_IO;
+        }
+#endif
+    }
+
+    if (ptoc->cflag == ARCHIVE_COMPRESSION_NONE) {
+        if (ptoc->len != ptoc->ulen) {
+            rc = ARCHIVE_READ_ERROR_DATA;
+        } else if (input.mapped != NULL) {
+            memcpy(buffer, input.mapped, (size_t)ptoc->ulen);
+            rc = 0;
+        } else {
+            rc = _pyi_arch_pread(&input, buffer, ptoc->ulen, input.offset) == 0 ? 0 : ARCHIVE_READ_ERROR_IO;
+        }
+        if (rc == 0 && (ptoc->flags & ARCHIVE_FLAG_CHECKSUM)) {
+            crc = _pyi_arch_crc32(crc, buffer, ptoc->ulen);
+        }
+    } else {
+        if (input.mapped == NULL) {
+            input.buffer = (unsigned char *)malloc(_PYI_ARCH_READ_CHUNK_SIZE);
+            input.buffer_size = _PYI_ARCH_READ_CHUNK_SIZE;
+        }
+        if (input.mapped == NULL && input.buffer == NULL) {
+            rc = ARCHIVE_READ_ERROR_MEMORY;
+        } else {
+            /* The data is decompressed straight into the buffer, with a
+             * decompression state that is local to this call. */
+            memset(&output, 0, sizeof(output));
+            output.ptr = buffer;
+            output.remaining = ptoc->ulen;
+            output.crc = (ptoc->flags & ARCHIVE_FLAG_CHECKSUM) ? &crc : NULL;
+            memset(&decompressor, 0, sizeof(decompressor));
+            rc = _pyi_arch_decompress(&decompressor, ptoc, &input, &output);
+            _pyi_arch_decompressor_free(&decompressor);
+        }
+        free(input.buffer);
+    }
+#ifdef _WIN32
+    if (input.event != NULL) {
+        CloseHandle(input.event);
+    }
+#endif
+
+    if (rc == 0 && (ptoc->flags & ARCHIVE_FLAG_CHECKSUM) && crc != ptoc->checksum) {
+        rc = ARCHIVE_READ_ERROR_DATA;
+    }
+    return rc;
+}
+
+
+/*
+ * Read data at the given offset from the memory-mapped archive or, if it
+ * is not mapped, from the archive file.
+ */
+static int
+_pyi_arch_read_at(ARCHIVE_STATUS *status, uint64_t offset, void *buffer, size_t size)
+{
+    if (status->mapped_data != NULL) {
+        if (offset > status->mapped_size || size > status->mapped_size - offset) {
+            return -1;
+        }
+        memcpy(buffer, status->mapped_data + offset, size);
+        return 0;
+    }
+    if (pyi_fseek(status->fp, offset, SEEK_SET) < 0) {
+        return -1;
+    }
+    if (fread(buffer, 1, size, status->fp) != size) {
+        return -1;
+    }
+    return 0;
+}
+
+static uint32_t
+_pyi_arch_le16(const unsigned char *ptr)
+{
+    return (uint32_t)ptr[0] | ((uint32_t)ptr[1] << 8);
+}
+
+static uint32_t
+_pyi_arch_le32(const unsigned char *ptr)
+{
+    return (uint32_t)ptr[0] | ((uint32_t)ptr[1] << 8) |
+           ((uint32_t)ptr[2] << 16) | ((uint32_t)ptr[3] << 24);
+}
+
+/*
+ * In signed executables, the embedded archive is followed by the code
+ * signature. Return the file offset of the signature, i.e., the offset of
+ * the certificate table of a PE file (Windows), or the offset of the data
+ * referenced by the LC_CODE_SIGNATURE load command of a thin little-endian
+ * Mach-O file (macOS). Returns 0 if the file has no signature or is not
+ * in either of these formats.
+ */
+static uint64_t
+_pyi_arch_get_signature_offset(ARCHIVE_STATUS *status, uint64_t file_size)
+{
+    unsigned char header[64];
+    uint32_t magic;
+
+    if (_pyi_arch_read_at(status, 0, header, sizeof(header)) != 0) {
+        return 0;
+    }
+
+    if (header[0] == 'M' && header[1] == 'Z') {
+        /* PE signature (4 bytes), COFF header (20 bytes) and optional
+         * header up to and including the security data directory entry */
+        unsigned char pe_header[24 + 152];
+        const unsigned char *optional_header = pe_header + 24;
+        const unsigned char *data_dirs;
+        uint32_t pe_offset = _pyi_arch_le32(header + 0x3C);
+        uint32_t optional_header_size;
+        uint32_t num_data_dirs;
+        uint32_t security_offset;
+
+        if (_pyi_arch_read_at(status, pe_offset, pe_header, sizeof(pe_header)) != 0 ||
+            memcmp(pe_header, "PE\0\0", 4) != 0) {
+            return 0;
+        }
+        optional_header_size = _pyi_arch_le16(pe_header + 4 + 16);
+        switch (_pyi_arch_le16(optional_header)) {
+            case 0x10B:  /* PE32 */
+                num_data_dirs = _pyi_arch_le32(optional_header + 92);
+                data_dirs = optional_header + 96;
+                break;
+            case 0x20B:  /* PE32+ */
+                num_data_dirs = _pyi_arch_le32(optional_header + 108);
+                data_dirs = optional_header + 112;
+                break;
+            default:
+                return 0;
+        }
+        /* IMAGE_DIRECTORY_ENTRY_SECURITY is the 5th entry; its address
+         * is a file offset rather than RVA */
+        if (num_data_dirs < 5 || optional_header_size < (uint32_t)(data_dirs - optional_header) + 5 * 8) {
+            return 0;
+        }
+        security_offset = _pyi_arch_le32(data_dirs + 4 * 8);
+        if (_pyi_arch_le32(data_dirs + 4 * 8 + 4) == 0 || security_offset > file_size) {
+            return 0;
+        }
+        return security_offset;
+    }
+
+    magic = _pyi_arch_le32(header);
+    if (magic == 0xFEEDFACE || magic == 0xFEEDFACF) {
+        /* 32-bit or 64-bit Mach-O header, followed by load commands */
+        size_t header_size = (magic == 0xFEEDFACF) ? 32 : 28;
+        uint32_t num_commands = _pyi_arch_le32(header + 16);
+        uint32_t commands_size = _pyi_arch_le32(header + 20);
+        unsigned char *commands;
+        uint64_t signature_offset = 0;
+        uint32_t pos = 0;
+        uint32_t i;
+
+        if (commands_size > 1024 * 1024) {
+            return 0;
+        }
+        commands = (unsigned char *)malloc(commands_size);
+        if (commands == NULL) {
+            return 0;
+        }
+        if (_pyi_arch_read_at(status, header_size, commands, commands_size) == 0) {
+            for (i = 0; i < num_commands && pos + 8 <= commands_size; i++) {
+                uint32_t command = _pyi_arch_le32(commands + pos);
+                uint32_t command_size = _pyi_arch_le32(commands + pos + 4);
+                if (command_size < 8 || command_size > commands_size - pos) {
+                    break;
+                }
+                /* LC_CODE_SIGNATURE: linkedit_data_command with dataoff */
+                if (command == 0x1D && command_size >= 16) {
+                    signature_offset = _pyi_arch_le32(commands + pos + 8);
+                    break;
+                }
+                pos += command_size;
+            }
+        }
+        free(commands);
+        return (signature_offset <= file_size) ? signature_offset : 0;
+    }
+
+    return 0;
+}
+
+/*
+ * Prepare the MAGIC pattern of the COOKIE of the given archive format
+ * version; we need to do this programmatically to prevent the pattern
+ * itself being stored in the code and matched when we scan the
+ * executable. The patterns of v5 and v6 differ only in the last byte.
+ */
+static void
+_pyi_arch_get_cookie_magic(unsigned char *magic, int version)
+{
+    memcpy(magic, MAGIC_BASE, 8);
+    magic[3] += 0x0C; /* 0x00 -> 0x0C */
+    if (version >= 6) {
+        magic[7] += 1; /* 0x0E -> 0x0F */
+    }
+}
+
+/*
+ * Return the version of the archive format whose COOKIE starts at the
+ * given pointer, or 0 if there is no COOKIE.
+ */
+static int
+_pyi_arch_get_cookie_version(const unsigned char *ptr)
+{
+    unsigned char magic[8];
+    int version;
+
+    for (version = 6; version >= 5; version--) {
+        _pyi_arch_get_cookie_magic(magic, version);
+        if (memcmp(ptr, magic, sizeof(magic)) == 0) {
+            return version;
+        }
+    }
+    return 0;
+}
+
+static size_t
+_pyi_arch_get_cookie_size(int version)
+{
+    return (version >= 6) ? sizeof(COOKIE) : ARCHIVE_V5_COOKIE_SIZE;
+}
+
+/*
+ * Return the offset of the COOKIE exported by the parent process (see
+ * pyi_arch_export_cookie()), if it was exported for this archive file and
+ * its size, and the MAGIC pattern is found there; 0 otherwise.
+ */
+static uint64_t
+_pyi_arch_get_exported_cookie(ARCHIVE_STATUS *status, uint64_t file_size, int *version)
+{
+    char *value = pyi_getenv(ARCHIVE_COOKIE_ENV);
+    unsigned char magic[8];
+    uint64_t offset = 0;
+    uint64_t exported_offset;
+    uint64_t exported_size;
+    int exported_version;
+    int path_start = 0;
+
+    if (value == NULL) {
+        return 0;
+    }
+    if (sscanf(value, "%" SCNu64 ":%" SCNu64 ":%d:%n", &exported_offset, &exported_size, &exported_version,
+               &path_start) == 3 && path_start > 0 &&
+        strcmp(value + path_start, status->archivename) == 0 && exported_size == file_size &&
+        (exported_version == 5 || exported_version == 6) &&
+        exported_offset + _pyi_arch_get_cookie_size(exported_version) <= file_size &&
+        _pyi_arch_read_at(status, exported_offset, magic, sizeof(magic)) == 0 &&
+        _pyi_arch_get_cookie_version(magic) == exported_version) {
+        *version = exported_version;
+        offset = exported_offset;
+    }
+    free(value);
+    return offset;
+}
+
+int
+pyi_arch_export_cookie(const ARCHIVE_STATUS *status)
+{
+    char value[PATH_MAX + 64];
+
+    if (snprintf(value, sizeof(value), "%" PRIu64 ":%" PRIu64 ":%d:%s", status->cookie_pos, status->file_size,
+                 status->version, status->archivename) >= (int)sizeof(value)) {
+        return -1;
+    }
+    return pyi_setenv(ARCHIVE_COOKIE_ENV, value);
+}
+
+/*
+ * Locate the MAGIC pattern of the embedded archive's COOKIE header. The
+ * cheap checks are tried first: the COOKIE at the very end of the file,
+ * and the COOKIE right before the code signature of a signed executable
+ * (allowing for alignment padding). If those fail, a full back-to-front
+ * scan of the file is performed. The scans look for the part of the
+ * pattern that is common to all format versions.
+ *
+ * Returns offset within the file if MAGIC pattern is found, 0 otherwise;
+ * version is set to the version of the archive format.
+ */
+static uint64_t
+_pyi_find_pkg_cookie_offset(ARCHIVE_STATUS *status, uint64_t file_size, int *version)
+{
+    /* Max. padding between the archive and the code signature; Mach-O
+     * signature is 16-byte aligned, and PE certificate table 8-byte. */
+    const size_t MAX_SIGNATURE_PADDING = 16;
+    /* Length of the common part of the MAGIC patterns */
+    const size_t MAGIC_PREFIX_LEN = 7;
+    unsigned char window[sizeof(COOKIE) + 16];
+    const unsigned char *match;
+    uint64_t signature_offset;
+    uint64_t offset = 0;
+    unsigned char magic[8];
+    int v;
+#ifdef LAUNCH_DEBUG
+    uint64_t start_time = pyi_utils_get_monotonic_time();
+#endif
+
+    _pyi_arch_get_cookie_magic(magic, 6);
+    *version = 0;
+
+    /* Fast path: COOKIE at the end of the file */
+    for (v = 6; v >= 5; v--) {
+        size_t cookie_size = _pyi_arch_get_cookie_size(v);
+        if (file_size >= cookie_size &&
+            _pyi_arch_read_at(status, file_size - cookie_size, window, sizeof(magic)) == 0 &&
+            _pyi_arch_get_cookie_version(window) == v) {
+            *version = v;
+            offset = file_size - cookie_size;
+            VS("LOADER: Cookie found at the end of file (%" PRIu64 " us)\n",
+               pyi_utils_get_monotonic_time() - start_time);
+            return offset;
+        }
+    }
+
+    /* Fast path: COOKIE followed by code signature */
+    signature_offset = _pyi_arch_get_signature_offset(status, file_size);
+    if (signature_offset >= ARCHIVE_V5_COOKIE_SIZE) {
+        uint64_t window_start = (signature_offset > sizeof(COOKIE)) ? signature_offset - sizeof(COOKIE) : 0;
+        window_start = (window_start > MAX_SIGNATURE_PADDING) ? window_start - MAX_SIGNATURE_PADDING : 0;
+        if (_pyi_arch_read_at(status, window_start, window, (size_t)(signature_offset - window_start)) == 0) {
+            match = pyi_utils_find_magic_pattern_in_buffer(window, (size_t)(signature_offset - window_start),
+                                                           magic, MAGIC_PREFIX_LEN);
+            if (match != NULL && (size_t)(signature_offset - window_start) - (match - window) >= sizeof(magic)) {
+                v = _pyi_arch_get_cookie_version(match);
+                offset = window_start + (uint64_t)(match - window);
+                if (v != 0 && offset + _pyi_arch_get_cookie_size(v) <= signature_offset) {
+                    *version = v;
+                    VS("LOADER: Cookie found before code signature (%" PRIu64 " us)\n",
+                       pyi_utils_get_monotonic_time() - start_time);
+                    return offset;
+                }
+            }
+        }
+    }
+
+    /* Slow path: full back-to-front scan */
+    if (status->mapped_data != NULL) {
+        match = pyi_utils_find_magic_pattern_in_buffer(status->mapped_data, (size_t)status->mapped_size,
+                                                       magic, MAGIC_PREFIX_LEN);
+        offset = (match != NULL) ? (uint64_t)(match - status->mapped_data) : 0;
+    } else {
+        offset = pyi_utils_find_magic_pattern(status->fp, magic, MAGIC_PREFIX_LEN);
+    }
+    if (offset != 0 && offset + sizeof(magic) <= file_size &&
+        _pyi_arch_read_at(status, offset, window, sizeof(magic)) == 0) {
+        *version = _pyi_arch_get_cookie_version(window);
+    }
+    VS("LOADER: Cookie search by full file scan (%" PRIu64 " us)\n",
+       pyi_utils_get_monotonic_time() - start_time);
+    return (*version != 0) ? offset : 0;
+}
+
+static uint32_t
+_pyi_arch_be32(const unsigned char *ptr)
+{
+    return ((uint32_t)ptr[0] << 24) | ((uint32_t)ptr[1] << 16) |
+           ((uint32_t)ptr[2] << 8) | (uint32_t)ptr[3];
+}
+
+static uint64_t
+_pyi_arch_be64(const unsigned char *ptr)
+{
+    return ((uint64_t)_pyi_arch_be32(ptr) << 32) | _pyi_arch_be32(ptr + 4);
+}
+
+/*
+ * Read the COOKIE of the given format version at the given offset, and
+ * convert its fields to host byte order. Returns 0 on success, -1 on
+ * error.
+ */
+static int
+_pyi_arch_read_cookie(ARCHIVE_STATUS *status, uint64_t offset, int version)
+{
+    unsigned char buffer[sizeof(COOKIE)];
+    COOKIE *cookie = &status->cookie;
+
+    if (_pyi_arch_read_at(status, offset, buffer, _pyi_arch_get_cookie_size(version)) != 0) {
+        return -1;
+    }
+    memset(cookie, 0, sizeof(COOKIE));
+    memcpy(cookie->magic, buffer, sizeof(cookie->magic));
+    if (version >= 6) {
+        cookie->len = _pyi_arch_be64(buffer + 8);
+        cookie->TOC = _pyi_arch_be64(buffer + 16);
+        cookie->TOClen = _pyi_arch_be64(buffer + 24);
+        cookie->pyvers = (int)_pyi_arch_be32(buffer + 32);
+        memcpy(cookie->pylibname, buffer + 40, sizeof(cookie->pylibname));
+    } else {
+        cookie->len = _pyi_arch_be32(buffer + 8);
+        cookie->TOC = _pyi_arch_be32(buffer + 12);
+        cookie->TOClen = _pyi_arch_be32(buffer + 16);
+        cookie->pyvers = (int)_pyi_arch_be32(buffer + 20);
+        memcpy(cookie->pylibname, buffer + 24, sizeof(cookie->pylibname));
+    }
+    cookie->pylibname[sizeof(cookie->pylibname) - 1] = 0;
+    return 0;
+}
+
+/*
+ * Size of the in-memory TOC entry for a name of the given length.
+ */
+static size_t
+_pyi_arch_get_toc_entry_size(size_t name_len)
+{
+    return (ARCHIVE_TOC_HEADER_SIZE + name_len + 1 + 15) & ~(size_t)15;
+}
+
+/*
+ * Load the TOC of a v6 archive, whose layout matches the in-memory one,
+ * and fix the endianness of the fields in its entries. Returns 0 on
+ * success, -1 on error.
+ */
+static int
+_pyi_arch_load_toc(ARCHIVE_STATUS *status)
+{
+    const unsigned char *end;
+    unsigned char *ptr;
+    size_t digest_size;
+    TOC *ptoc;
+
+    status->tocbuff = (TOC *)malloc((size_t)status->cookie.TOClen);
+    if (status->tocbuff == NULL) {
+        FATAL_PERROR("malloc", "Could not allocate buffer for TOC!\n");
+        return -1;
+    }
+    if (_pyi_arch_read_at(status, status->pkgstart + status->cookie.TOC,
+                          status->tocbuff, (size_t)status->cookie.TOClen) != 0) {
+        FATAL_PERROR("fread", "Could not read full TOC!\n");
+        return -1;
+    }
+    status->tocend = (TOC *)(((char *)status->tocbuff) + status->cookie.TOClen);
+
+    ptr = (unsigned char *)status->tocbuff;
+    end = (const unsigned char *)status->tocend;
+    while (ptr < end) {
+        ptoc = (TOC *)ptr;
+        if ((size_t)(end - ptr) < ARCHIVE_TOC_HEADER_SIZE) {
+            break;
+        }
+        /* Fixup the current entry */
+        ptoc->structlen = _pyi_arch_be32(ptr);
+        ptoc->pos = _pyi_arch_be64(ptr + 8);
+        ptoc->len = _pyi_arch_be64(ptr + 16);
+        ptoc->ulen = _pyi_arch_be64(ptr + 24);
+        ptoc->checksum = _pyi_arch_be32(ptr + 32);
+        digest_size = (ptoc->flags & ARCHIVE_FLAG_DIGEST) ? ARCHIVE_DIGEST_SIZE : 0;
+        if (ptoc->structlen <= ARCHIVE_TOC_HEADER_SIZE + digest_size || ptoc->structlen % 16 != 0 ||
+            ptoc->structlen > (size_t)(end - ptr)) {
+            break;
+        }
+        ptoc->name[ptoc->structlen - ARCHIVE_TOC_HEADER_SIZE - digest_size - 1] = 0;
+        ptr += ptoc->structlen;
     }
-
-cleanup:
-    inflateEnd(&zstream);
-    free(buffer_in);
-    free(buffer_out);
-
-    return rc;
+    if (ptr != end) {
+        FATALERROR("Cannot read Table of Contents.\n");
+        return -1;
+    }
+    return 0;
 }
 
 /*
- * Helper for pyi_arch_extract2fs that extracts an uncompressed file from
- * the archive into the provided file handle.
+ * Load the TOC of a v5 archive, and convert its entries, with 32-bit
+ * fields in network byte order, to the in-memory layout. Returns 0 on
+ * success, -1 on error.
  */
 static int
-_pyi_arch_extract2fs_uncompressed(ARCHIVE_STATUS *status, TOC *ptoc, FILE *out)
+_pyi_arch_load_toc_v5(ARCHIVE_STATUS *status)
 {
-    const size_t CHUNK_SIZE = 8192;
-    unsigned char *buffer;
-    uint64_t remaining_size;
-    int rc = 0;
+    unsigned char *data;
+    const unsigned char *ptr;
+    const unsigned char *end;
+    size_t toc_size = 0;
+    char *out;
 
-    /* Allocate temporary buffer for a single chunk */
-    buffer = (unsigned char *)malloc(CHUNK_SIZE);
-    if (buffer == NULL) {
-        FATAL_PERROR("malloc", "Failed to extract %s: failed to allocate temporary buffer!\n", ptoc->name);
+    data = (unsigned char *)malloc((size_t)status->cookie.TOClen);
+    if (data == NULL) {
+        FATAL_PERROR("malloc", "Could not allocate buffer for TOC!\n");
+        return -1;
+    }
+    if (_pyi_arch_read_at(status, status->pkgstart + status->cookie.TOC,
+                          data, (size_t)status->cookie.TOClen) != 0) {
+        FATAL_PERROR("fread", "Could not read full TOC!\n");
+        free(data);
         return -1;
     }
+    end = data + status->cookie.TOClen;
 
-    /* ... and copy it, chunk by chunk */
-    remaining_size = ptoc->ulen;
-    while (remaining_size > 0) {
-        size_t chunk_size = (CHUNK_SIZE < remaining_size) ? CHUNK_SIZE : (size_t)remaining_size;
-        if (fread(buffer, chunk_size, 1, status->fp) < 1) {
-            FATAL_PERROR("fread", "Failed to extract %s: failed to read data chunk!\n", ptoc->name);
-            rc = -1;
+    /* Validate the entries, and compute the size of the converted TOC */
+    for (ptr = data; ptr < end; ptr += _pyi_arch_be32(ptr)) {
+        uint32_t structlen;
+
+        if ((size_t)(end - ptr) < ARCHIVE_V5_TOC_HEADER_SIZE) {
             break;
         }
-        if (fwrite(buffer, chunk_size, 1, out) < 1) {
-            FATAL_PERROR("fwrite", "Failed to extract %s: failed to write data chunk!\n", ptoc->name);
-            rc = -1;
+        structlen = _pyi_arch_be32(ptr);
+        if (structlen <= ARCHIVE_V5_TOC_HEADER_SIZE || structlen > (size_t)(end - ptr)) {
             break;
         }
-        remaining_size -= chunk_size;
+        toc_size += _pyi_arch_get_toc_entry_size(strnlen((const char *)ptr + ARCHIVE_V5_TOC_HEADER_SIZE,
+                                                         structlen - ARCHIVE_V5_TOC_HEADER_SIZE));
     }
-    free(buffer);
-    return rc;
+    if (ptr != end) {
+        FATALERROR("Cannot read Table of Contents.\n");
+        free(data);
+        return -1;
+    }
+
+    status->tocbuff = (TOC *)calloc(1, toc_size ? toc_size : 1);
+    if (status->tocbuff == NULL) {
+        FATAL_PERROR("calloc", "Could not allocate buffer for TOC!\n");
+        free(data);
+        return -1;
+    }
+    status->tocend = (TOC *)(((char *)status->tocbuff) + toc_size);
+
+    out = (char *)status->tocbuff;
+    for (ptr = data; ptr < end; ptr += _pyi_arch_be32(ptr)) {
+        TOC *ptoc = (TOC *)out;
+        const char *name = (const char *)ptr + ARCHIVE_V5_TOC_HEADER_SIZE;
+        size_t name_len = strnlen(name, _pyi_arch_be32(ptr) - ARCHIVE_V5_TOC_HEADER_SIZE);
+
+        ptoc->structlen = (uint32_t)_pyi_arch_get_toc_entry_size(name_len);
+        ptoc->pos = _pyi_arch_be32(ptr + 4);
+        ptoc->len = _pyi_arch_be32(ptr + 8);
+        ptoc->ulen = _pyi_arch_be32(ptr + 12);
+        ptoc->cflag = (char)ptr[16];
+        ptoc->typcd = (char)ptr[17];
+        memcpy(ptoc->name, name, name_len);
+        out += ptoc->structlen;
+    }
+    free(data);
+    return 0;
 }
 
 /*
- * Helper for pyi_arch_extract that extracts an uncompressed file from
- * the archive into the provided (pre-allocated) buffer.
+ * FNV-1a hash of the first len characters of the string.
  */
-static int
-_pyi_arch_extract_uncompressed(ARCHIVE_STATUS *status, TOC *ptoc, unsigned char *out)
+uint32_t
+pyi_arch_hash(const char *str, size_t len)
 {
-    const size_t CHUNK_SIZE = 8192;
-    unsigned char *buffer;
-    uint64_t remaining_size;
+    uint32_t hash = 2166136261u;
+    size_t i;
 
-    /* Read the file into buffer, chunk by chunk */
-    buffer = out;
-    remaining_size = ptoc->ulen;
-    while (remaining_size > 0) {
-        size_t chunk_size = (CHUNK_SIZE < remaining_size) ? CHUNK_SIZE : (size_t)remaining_size;
-        if (fread(buffer, chunk_size, 1, status->fp) < 1) {
-            FATAL_PERROR("fread", "Failed to extract %s: failed to read data chunk!\n", ptoc->name);
-            return -1;
-        }
-        remaining_size -= chunk_size;
-        buffer += chunk_size;
+    for (i = 0; i < len; i++) {
+        hash ^= (unsigned char)str[i];
+        hash *= 16777619u;
     }
-    return 0;
+    return hash;
 }
 
 /*
- * Extract an archive entry into data buffer.
- * Returns pointer to the data (must be freed).
+ * Return the length of runtime option's name, i.e., the part of the TOC
+ * entry name before the space that separates the name from the value.
  */
-unsigned char *
-pyi_arch_extract(ARCHIVE_STATUS *status, TOC *ptoc)
+static size_t
+_pyi_arch_option_name_len(const char *name)
 {
-    unsigned char *data = NULL;
-    int rc = 0;
+    const char *sep = strchr(name, ' ');
+    return sep ? (size_t)(sep - name) : strlen(name);
+}
 
-    /* Open archive (source) file... */
-    if (pyi_arch_open_fp(status) != 0) {
-        FATALERROR("Failed to extract %s: failed to open archive file!\n", ptoc->name);
-        return NULL;
-    }
-    /* ... and seek to the beginning of entry's data */
-    if (pyi_fseek(status->fp, status->pkgstart + ptoc->pos, SEEK_SET) < 0) {
-        FATAL_PERROR("fseek", "Failed to extract %s: failed to seek to the entry's data!\n", ptoc->name);
-        return NULL;
+/*
+ * Check if the key matches the name of the TOC entry or, if is_option
+ * is set, the name of the runtime option stored in the TOC entry.
+ */
+static bool
+_pyi_arch_key_matches(const TOC *ptoc, const char *key, size_t key_len, bool is_option)
+{
+    if (strncmp(ptoc->name, key, key_len) != 0) {
+        return false;
     }
+    return ptoc->name[key_len] == '\0' || (is_option && ptoc->name[key_len] == ' ');
+}
 
-    /* Allocate the data buffer */
-    data = (unsigned char *)malloc(ptoc->ulen);
-    if (data == NULL) {
-        FATAL_PERROR("malloc", "Failed to extract %s: failed to allocate data buffer (%u bytes)!\n", ptoc->name, ptoc->ulen);
-        goto cleanup;
-    }
+/*
+ * Look up the entry with the given key in the index. Returns NULL if
+ * there is no such entry.
+ */
+static TOC *
+_pyi_arch_index_lookup(TOC * const *index, size_t index_size, const char *key, size_t key_len, bool is_option)
+{
+    size_t mask = index_size - 1;
+    size_t slot = pyi_arch_hash(key, key_len) & mask;
 
-    /* Extract */
-    if (ptoc->cflag == '\1') {
-        rc = _pyi_arch_extract_compressed(status, ptoc, NULL, data);
-    } else {
-        rc = _pyi_arch_extract_uncompressed(status, ptoc, data);
-    }
-    if (rc != 0) {
-        free(data);
-        data = NULL;
+    while (index[slot] != NULL) {
+        if (_pyi_arch_key_matches(index[slot], key, key_len, is_option)) {
+            return index[slot];
+        }
+        slot = (slot + 1) & mask;
     }
+    return NULL;
+}
 
-cleanup:
-    pyi_arch_close_fp(status);
+/*
+ * Insert the entry into the index under the given key. If an entry with
+ * the same key is already present, the index is left unchanged, so that
+ * lookups return the first matching entry in the TOC, same as the scan.
+ */
+static void
+_pyi_arch_index_insert(TOC **index, size_t index_size, TOC *ptoc, size_t key_len, bool is_option)
+{
+    size_t mask = index_size - 1;
+    size_t slot = pyi_arch_hash(ptoc->name, key_len) & mask;
 
-    return data;
+    while (index[slot] != NULL) {
+        if (_pyi_arch_key_matches(index[slot], ptoc->name, key_len, is_option)) {
+            return;
+        }
+        slot = (slot + 1) & mask;
+    }
+    index[slot] = ptoc;
+}
+
+static ARCHIVE_CLASS
+_pyi_arch_get_class(const TOC *ptoc)
+{
+    switch (ptoc->typcd) {
+        case ARCHIVE_ITEM_BINARY:
+            return ARCHIVE_CLASS_BINARY;
+        case ARCHIVE_ITEM_DATA:
+            return ARCHIVE_CLASS_DATA;
+        case ARCHIVE_ITEM_ZIPFILE:
+            return ARCHIVE_CLASS_ZIPFILE;
+        case ARCHIVE_ITEM_DEPENDENCY:
+            return ARCHIVE_CLASS_DEPENDENCY;
+        case ARCHIVE_ITEM_PYMODULE:
+        case ARCHIVE_ITEM_PYPACKAGE:
+            return ARCHIVE_CLASS_MODULE;
+        case ARCHIVE_ITEM_PYZ:
+            return ARCHIVE_CLASS_PYZ;
+        case ARCHIVE_ITEM_PYSOURCE:
+            return ARCHIVE_CLASS_SCRIPT;
+        case ARCHIVE_ITEM_RUNTIME_OPTION:
+            return ARCHIVE_CLASS_RUNTIME_OPTION;
+        case ARCHIVE_ITEM_SPLASH:
+            return ARCHIVE_CLASS_SPLASH;
+        case ARCHIVE_ITEM_FROZENMODULE:
+        case ARCHIVE_ITEM_FROZENPACKAGE:
+            return ARCHIVE_CLASS_FROZEN;
+        default:
+            return ARCHIVE_CLASS_OTHER;
+    }
 }
 
 /*
- * Extract an archive entry into file on the filesystem.
- * The path is relative to the directory the archive is in.
+ * Group the entries of the loaded TOC by class, and build the name and
+ * option indices. Failure to allocate the indices is not fatal; failure
+ * to group the entries is. Returns 0 on success, -1 on error.
  */
-int
-pyi_arch_extract2fs(ARCHIVE_STATUS *status, TOC *ptoc)
+static int
+_pyi_arch_build_index(ARCHIVE_STATUS *status)
 {
-    FILE *out = NULL;
-    int rc = 0;
+    TOC *ptoc;
+    size_t num_entries = 0;
+    size_t num_options;
+    size_t next[ARCHIVE_CLASS_COUNT];
+    size_t size;
+    int i;
+
+    memset(status->class_offsets, 0, sizeof(status->class_offsets));
+    for (ptoc = status->tocbuff; ptoc < status->tocend; ptoc = pyi_arch_increment_toc_ptr(status, ptoc)) {
+        num_entries++;
+        status->class_offsets[_pyi_arch_get_class(ptoc) + 1]++;
+    }
+    for (i = 0; i < ARCHIVE_CLASS_COUNT; i++) {
+        status->class_offsets[i + 1] += status->class_offsets[i];
+        next[i] = status->class_offsets[i];
+    }
+    num_options = status->class_offsets[ARCHIVE_CLASS_RUNTIME_OPTION + 1] -
+                  status->class_offsets[ARCHIVE_CLASS_RUNTIME_OPTION];
 
-    /* Ensure that tmp dir _MEIPASSxxx exists... */
-    if (pyi_create_temp_path(status) == -1) {
+    status->class_entries = (TOC **)malloc((num_entries ? num_entries : 1) * sizeof(TOC *));
+    if (status->class_entries == NULL) {
+        FATAL_PERROR("malloc", "Could not allocate memory for TOC index.\n");
         return -1;
     }
-    /* ... and open target file */
-    out = pyi_open_target(status->temppath, ptoc->name);
-    if (out == NULL) {
-        FATAL_PERROR("fopen", "Failed to extract %s: failed to open target file!\n", ptoc->name);
-        return -1;
+    for (ptoc = status->tocbuff; ptoc < status->tocend; ptoc = pyi_arch_increment_toc_ptr(status, ptoc)) {
+        status->class_entries[next[_pyi_arch_get_class(ptoc)]++] = ptoc;
     }
 
-    /* Open archive (source) file... */
-    if (pyi_arch_open_fp(status) != 0) {
-        FATALERROR("Failed to extract %s: failed to open archive file!\n", ptoc->name);
-        rc = -1;
-        goto cleanup;
+    /* Keep the load factor at or below 50% */
+    size = 16;
+    while (size < 2 * num_entries) {
+        size *= 2;
     }
-    /* ... and seek to the beginning of entry's data */
-    if (pyi_fseek(status->fp, status->pkgstart + ptoc->pos, SEEK_SET) < 0) {
-        FATAL_PERROR("fseek", "Failed to extract %s: failed to seek to the entry's data!\n", ptoc->name);
-        rc = -1;
-        goto cleanup;
+    status->name_index = (TOC **)calloc(size, sizeof(TOC *));
+    if (status->name_index == NULL) {
+        return 0;
     }
+    status->name_index_size = size;
 
-    /* Extract */
-    if (ptoc->cflag == '\1') {
-        rc = _pyi_arch_extract_compressed(status, ptoc, out, NULL);
-    } else {
-        rc = _pyi_arch_extract2fs_uncompressed(status, ptoc, out);
+    size = 16;
+    while (size < 2 * num_options) {
+        size *= 2;
     }
-#ifndef WIN32
-    fchmod(fileno(out), S_IRUSR | S_IWUSR | S_IXUSR);
-#endif
-
-cleanup:
-    pyi_arch_close_fp(status);
-    fclose(out);
-
-    return rc;
-}
-
-
-/*
- * Perform full back-to-front scan of the file to search for the
- * MAGIC pattern of the embedded archive's COOKIE header.
- *
- * Returns offset within the file if MAGIC pattern is found, 0 otherwise.
- */
-static uint64_t
-_pyi_find_pkg_cookie_offset(FILE *fp)
-{
-    /* Prepare MAGIC pattern; we need to do this programmatically to
-     * prevent the pattern itself being stored in the code and matched
-     * when we scan the executable */
-    unsigned char magic[8];
-    memcpy(magic, MAGIC_BASE, sizeof(magic));
-    magic[3] += 0x0C; /* 0x00 -> 0x0C */
+    status->option_index = (TOC **)calloc(size, sizeof(TOC *));
+    if (status->option_index == NULL) {
+        free(status->name_index);
+        status->name_index = NULL;
+        status->name_index_size = 0;
+        return 0;
+    }
+    status->option_index_size = size;
 
-    /* Search using the helper */
-    return pyi_utils_find_magic_pattern(fp, magic, sizeof(magic));
+    for (ptoc = status->tocbuff; ptoc < status->tocend; ptoc = pyi_arch_increment_toc_ptr(status, ptoc)) {
+        _pyi_arch_index_insert(status->name_index, status->name_index_size,
+                               ptoc, strlen(ptoc->name), false);
+        if (ptoc->typcd == ARCHIVE_ITEM_RUNTIME_OPTION) {
+            _pyi_arch_index_insert(status->option_index, status->option_index_size,
+                                   ptoc, _pyi_arch_option_name_len(ptoc->name), true);
+        }
+    }
+    return 0;
 }
 
 /*
- * Fix the endianness of fields in the TOC entries.
+ * Free the grouped entries, and the name and option indices.
  */
 static void
-_pyi_arch_fix_toc_endianess(ARCHIVE_STATUS *status)
+_pyi_arch_free_index(ARCHIVE_STATUS *status)
 {
-    TOC *ptoc = status->tocbuff;
-    while (ptoc < status->tocend) {
-        /* Fixup the current entry */
-        ptoc->structlen = pyi_be32toh(ptoc->structlen);
-        ptoc->pos = pyi_be32toh(ptoc->pos);
-        ptoc->len = pyi_be32toh(ptoc->len);
-        ptoc->ulen = pyi_be32toh(ptoc->ulen);
-        /* Jump to next entry; with the current entry fixed up, we can
-         * use pyi_arch_increment_toc_ptr() */
-        ptoc = pyi_arch_increment_toc_ptr(status, ptoc);
-    }
+    free(status->class_entries);
+    status->class_entries = NULL;
+    memset(status->class_offsets, 0, sizeof(status->class_offsets));
+    free(status->name_index);
+    status->name_index = NULL;
+    status->name_index_size = 0;
+    free(status->option_index);
+    status->option_index = NULL;
+    status->option_index_size = 0;
 }
 
 /*
@@ -384,6 +1989,9 @@ int
 pyi_arch_open(ARCHIVE_STATUS *status)
 {
     uint64_t cookie_pos = 0;
+    uint64_t cookie_end;
+    uint64_t file_size;
+    int rc;
     VS("LOADER: archivename is %s\n", status->archivename);
 
     /* Physically open the file */
@@ -392,32 +2000,58 @@ pyi_arch_open(ARCHIVE_STATUS *status)
         return -1;
     }
 
-    /* Search for the embedded archive's cookie */
-    cookie_pos = _pyi_find_pkg_cookie_offset(status->fp);
+    /* Determine file size */
+    if (pyi_fseek(status->fp, 0, SEEK_END) < 0) {
+        FATAL_PERROR("fseek", "Failed to seek to the end of the file!\n");
+        return -1;
+    }
+    file_size = pyi_ftell(status->fp);
+
+    /* Map the archive into memory, so that the cookie and the TOC can be
+     * read, and the entries extracted, without re-opening the file. */
+    _pyi_arch_unmap_file(status);
+    if (_pyi_arch_map_file(status, file_size) == 0) {
+        VS("LOADER: Mapped archive into memory (%" PRIu64 " bytes)\n", status->mapped_size);
+    } else {
+        VS("LOADER: Could not map archive into memory; using file I/O\n");
+    }
+
+    /* Use the location of the cookie passed by the parent process, or
+     * search for the embedded archive's cookie */
+    cookie_pos = _pyi_arch_get_exported_cookie(status, file_size, &status->version);
+    status->cookie_passed = (cookie_pos != 0);
+    if (cookie_pos != 0) {
+        VS("LOADER: Using cookie location passed by parent process\n");
+    } else {
+        cookie_pos = _pyi_find_pkg_cookie_offset(status, file_size, &status->version);
+    }
     if (cookie_pos == 0) {
         VS("LOADER: Cannot find cookie!\n");
+        _pyi_arch_unmap_file(status);
         return -1;
     }
-    VS("LOADER: Cookie found at offset 0x%" PRIX64 "\n", cookie_pos);
+    VS("LOADER: Cookie found at offset 0x%" PRIX64 " (archive format v%d)\n", cookie_pos, status->version);
+    status->cookie_pos = cookie_pos;
+    status->file_size = file_size;
 
-    /* Read the cookie */
-    if (pyi_fseek(status->fp, cookie_pos, SEEK_SET) < 0) {
-        FATAL_PERROR("fseek", "Failed to seek to cookie position!\n");
+    /* Read the cookie, and fix endianness of its fields */
+    if (_pyi_arch_read_cookie(status, cookie_pos, status->version) != 0) {
+        FATAL_PERROR("fread", "Failed to read cookie!\n");
+        _pyi_arch_unmap_file(status);
         return -1;
     }
-    if (fread(&status->cookie, sizeof(COOKIE), 1, status->fp) < 1) {
-        FATAL_PERROR("fread", "Failed to read cookie!\n");
+    cookie_end = cookie_pos + _pyi_arch_get_cookie_size(status->version);
+    if (status->cookie.len > cookie_end || status->cookie.TOC > status->cookie.len ||
+        status->cookie.TOClen > status->cookie.len - status->cookie.TOC ||
+        (uint64_t)(size_t)status->cookie.TOClen != status->cookie.TOClen) {
+        FATALERROR("Invalid cookie!\n");
+        _pyi_arch_unmap_file(status);
         return -1;
     }
-    /* Fix endianness of COOKIE fields */
-    status->cookie.len = pyi_be32toh(status->cookie.len);
-    status->cookie.TOC = pyi_be32toh(status->cookie.TOC);
-    status->cookie.TOClen = pyi_be32toh(status->cookie.TOClen);
-    status->cookie.pyvers = pyi_be32toh(status->cookie.pyvers);
 
     /* From the cookie position and declared archive size, calculate
      * the archive start position */
-    status->pkgstart = cookie_pos + sizeof(COOKIE) - status->cookie.len;
+    status->pkgstart = cookie_end - status->cookie.len;
 
     /* Set the flag that Python library was not loaded yet. */
     status->is_pylib_loaded = false;
@@ -425,29 +2059,32 @@ pyi_arch_open(ARCHIVE_STATUS *status)
     /* Set the the Python version used. */
     pyvers = pyi_arch_get_pyversion(status);
 
-    /* Read in in the table of contents */
-    pyi_fseek(status->fp, status->pkgstart + status->cookie.TOC, SEEK_SET);
-    status->tocbuff = (TOC *) malloc(status->cookie.TOClen);
-
-    if (status->tocbuff == NULL) {
-        FATAL_PERROR("malloc", "Could not allocate buffer for TOC!\n");
-        return -1;
+    /* Read in in the table of contents, converting it to the in-memory
+     * layout */
+    if (status->version >= 6) {
+        rc = _pyi_arch_load_toc(status);
+    } else {
+        rc = _pyi_arch_load_toc_v5(status);
     }
-
-    if (fread(status->tocbuff, status->cookie.TOClen, 1, status->fp) < 1) {
-        FATAL_PERROR("fread", "Could not read full TOC!\n");
+    if (rc != 0) {
+        _pyi_arch_unmap_file(status);
         return -1;
     }
-    status->tocend = (TOC *) (((char *)status->tocbuff) + status->cookie.TOClen);
 
     /* Check input file is still ok (should be). */
     if (ferror(status->fp)) {
         FATALERROR("Error on file.\n");
+        _pyi_arch_unmap_file(status);
         return -1;
     }
 
-    /* Fix the endianness of the fields in the TOC entries */
-    _pyi_arch_fix_toc_endianess(status);
+    /* Group the TOC entries by class, and index them for fast look-up
+     * by name */
+    _pyi_arch_free_index(status);
+    if (_pyi_arch_build_index(status) != 0) {
+        _pyi_arch_unmap_file(status);
+        return -1;
+    }
 
     /* Close file handler
      * if file not close here it will be close in pyi_arch_status_free */
@@ -462,21 +2099,32 @@ pyi_arch_open(ARCHIVE_STATUS *status)
 bool
 pyi_arch_setup(ARCHIVE_STATUS *status, char const * archive_path, char const * executable_path)
 {
+    char homepath[PATH_MAX];
+
     /* Copy archive path and executable path */
-    if (snprintf(status->archivename, PATH_MAX, "%s", archive_path) >= PATH_MAX) {
+    if (strlen(archive_path) >= PATH_MAX || strlen(executable_path) >= PATH_MAX) {
+        return false;
+    }
+    if (pyi_arch_set_path(&status->archivename, archive_path) != 0) {
         return false;
     }
-    if (snprintf(status->executablename, PATH_MAX, "%s", executable_path) >= PATH_MAX) {
+    /* The executable is usually the archive itself */
+    if (strcmp(executable_path, archive_path) == 0) {
+        status->executablename = status->archivename;
+    } else if (pyi_arch_set_path(&status->executablename, executable_path) != 0) {
         return false;
     }
     /* Set homepath to where the archive is */
-    pyi_path_dirname(status->homepath, archive_path);
+    pyi_path_dirname(homepath, archive_path);
+    if (pyi_arch_set_path(&status->homepath, homepath) != 0) {
+        return false;
+    }
     /*
      * Initial value of mainpath is homepath. It might be overridden
      * by temppath if it is available.
      */
     status->has_temp_directory = false;
-    strcpy(status->mainpath, status->homepath);
+    status->mainpath = status->homepath;
 
     /* Open the archive */
     if (pyi_arch_open(status)) {
@@ -508,6 +2156,35 @@ getNextTocEntry(ARCHIVE_STATUS *status, TOC *entry)
     return rslt;
 }
 
+int
+pyi_arch_mark_extracted(ARCHIVE_STATUS *status, const TOC *ptoc)
+{
+    size_t index = (size_t)((const char *)ptoc - (const char *)status->tocbuff) / 16;
+
+    if (status->extracted_entries == NULL) {
+        size_t count = (size_t)((const char *)status->tocend - (const char *)status->tocbuff) / 16;
+
+        status->extracted_entries = (unsigned char *)calloc(count / 8 + 1, 1);
+        if (status->extracted_entries == NULL) {
+            return -1;
+        }
+    }
+    status->extracted_entries[index / 8] |= (unsigned char)(1 << (index % 8));
+    return 0;
+}
+
+bool
+pyi_arch_is_extracted(const ARCHIVE_STATUS *status, const TOC *ptoc)
+{
+    size_t index;
+
+    if (status->extracted_entries == NULL) {
+        return false;
+    }
+    index = (size_t)((const char *)ptoc - (const char *)status->tocbuff) / 16;
+    return (status->extracted_entries[index / 8] & (1 << (index % 8))) != 0;
+}
+
 /*
  * Helpers for embedders.
  */
@@ -526,10 +2203,36 @@ pyi_arch_status_new() {
     archive_status = (ARCHIVE_STATUS *) calloc(1, sizeof(ARCHIVE_STATUS));
     if (archive_status == NULL) {
         FATAL_PERROR("calloc", "Cannot allocate memory for ARCHIVE_STATUS\n");
+        return NULL;
     }
+    archive_status->archivename = "";
+    archive_status->executablename = "";
+    archive_status->homepath = "";
+    archive_status->temppath = "";
+    archive_status->mainpath = "";
+    archive_status->cachepath = "";
+    archive_status->storepath = "";
     return archive_status;
 }
 
+int
+pyi_arch_set_path(const char **field, const char *path)
+{
+    const char *copy;
+
+    if (path[0] == PYI_NULLCHAR) {
+        *field = "";
+        return 0;
+    }
+    copy = pyi_arena_strdup(path);
+    if (copy == NULL) {
+        FATALERROR("Cannot allocate memory for path %s\n", path);
+        return -1;
+    }
+    *field = copy;
+    return 0;
+}
+
 /*
  * Free memory allocated for archive status.
  */
@@ -539,16 +2242,35 @@ pyi_arch_status_free(ARCHIVE_STATUS *archive_status)
     if (archive_status != NULL) {
         VS("LOADER: Freeing archive status for %s\n", archive_status->archivename);
 
-        /* Free the TOC memory from the archive status first. */
-        if (archive_status->tocbuff != NULL) {
-            free(archive_status->tocbuff);
-        }
-        /* Close file handler */
-        pyi_arch_close_fp(archive_status);
+        pyi_arch_release_contents(archive_status);
         free(archive_status);
     }
 }
 
+/*
+ * Release the TOC, its indices, the extraction buffers, the mapped view
+ * and the file handle, keeping only the paths and flags of the archive
+ * status. Afterwards, the archive status has no entries and no options.
+ */
+void
+pyi_arch_release_contents(ARCHIVE_STATUS *status)
+{
+    /* Free the TOC memory from the archive status first. */
+    free(status->tocbuff);
+    status->tocbuff = NULL;
+    status->tocend = NULL;
+    /* Free the TOC indices */
+    _pyi_arch_free_index(status);
+    free(status->extracted_entries);
+    status->extracted_entries = NULL;
+    /* Free the extraction buffers and decompression state */
+    pyi_arch_free_extraction_context(status);
+    /* Release the mapped view and close file handler */
+    _pyi_arch_unmap_file(status);
+    pyi_arch_close_fp(status);
+    _pyi_arch_close_shared_handle(status);
+}
+
 /*
  * Returns the value of the pyi bootloader option given by optname. Returns
  * NULL if the option is not present. Returns an empty string if the option is present,
@@ -560,30 +2282,125 @@ pyi_arch_status_free(ARCHIVE_STATUS *archive_status)
 char *
 pyi_arch_get_option(const ARCHIVE_STATUS * status, char * optname)
 {
-    /* TODO: option-cache? */
     size_t optlen;
-    TOC *ptoc = status->tocbuff;
+    TOC **options;
+    size_t count;
+    size_t i;
+    TOC *ptoc;
 
     optlen = strlen(optname);
 
-    for (; ptoc < status->tocend; ptoc = pyi_arch_increment_toc_ptr(status, ptoc)) {
-        if (ptoc->typcd == ARCHIVE_ITEM_RUNTIME_OPTION) {
-            if (0 == strncmp(ptoc->name, optname, optlen)) {
-                if (0 != ptoc->name[optlen]) {
-                    /* Space separates option name from option value, so add 1. */
-                    return ptoc->name + optlen + 1;
-                }
-                else {
-                    /* No option value, just return the empty string. */
-                    return ptoc->name + optlen;
-                }
+    /* Use the option index, if available */
+    if (status->option_index != NULL) {
+        ptoc = _pyi_arch_index_lookup(status->option_index, status->option_index_size,
+                                      optname, optlen, true);
+        if (ptoc == NULL) {
+            return NULL;
+        }
+        if (0 != ptoc->name[optlen]) {
+            /* Space separates option name from option value, so add 1. */
+            return ptoc->name + optlen + 1;
+        }
+        /* No option value, just return the empty string. */
+        return ptoc->name + optlen;
+    }
 
+    options = pyi_arch_get_entries(status, ARCHIVE_CLASS_RUNTIME_OPTION, &count);
+    for (i = 0; i < count; i++) {
+        ptoc = options[i];
+        if (0 == strncmp(ptoc->name, optname, optlen)) {
+            if (0 != ptoc->name[optlen]) {
+                /* Space separates option name from option value, so add 1. */
+                return ptoc->name + optlen + 1;
+            }
+            else {
+                /* No option value, just return the empty string. */
+                return ptoc->name + optlen;
             }
         }
     }
     return NULL;
 }
 
+TOC **
+pyi_arch_get_entries(const ARCHIVE_STATUS *status, ARCHIVE_CLASS entry_class, size_t *count)
+{
+    if (status->class_entries == NULL) {
+        *count = 0;
+        return NULL;
+    }
+    *count = status->class_offsets[entry_class + 1] - status->class_offsets[entry_class];
+    return status->class_entries + status->class_offsets[entry_class];
+}
+
+/*
+ * Check if the files extracted from the archive are removed when the
+ * program exits, i.e., if the persistent extraction cache is not used.
+ * The option is checked instead of cachepath, which is not set in the
+ * child process.
+ */
+bool
+pyi_arch_has_temporary_files(const ARCHIVE_STATUS *status)
+{
+    return pyi_arch_get_option(status, "pyi-runtime-cachedir") == NULL;
+}
+
+/*
+ * Compute the SHA-256 digest that identifies the contents of the archive;
+ * used as the key of the persistent extraction cache and to match zygote
+ * clients with their server. The digest covers only the COOKIE and the
+ * TOC, so the data of the entries is not read; the TOC identifies their
+ * contents through the CRC-32 checksum or the SHA-256 digest stored with
+ * each entry.
+ *
+ * Returns 0 on success, -1 if the digest cannot be computed; this is the
+ * case if an entry that is extracted to the filesystem has neither a
+ * checksum nor a digest, or if the archive has dependencies in other
+ * archives (multipackage mode), which the digest would not cover.
+ */
+int
+pyi_arch_get_digest(const ARCHIVE_STATUS *status, unsigned char digest[ARCHIVE_DIGEST_SIZE])
+{
+    PYI_SHA256 sha256;
+    const TOC *ptoc;
+
+    for (ptoc = status->tocbuff; ptoc < status->tocend; ptoc = pyi_arch_increment_toc_ptr(status, ptoc)) {
+        if (ptoc->typcd == ARCHIVE_ITEM_DEPENDENCY) {
+            return -1;
+        }
+        if ((ptoc->typcd == ARCHIVE_ITEM_BINARY || ptoc->typcd == ARCHIVE_ITEM_DATA ||
+             ptoc->typcd == ARCHIVE_ITEM_ZIPFILE) &&
+            !(ptoc->flags & (ARCHIVE_FLAG_CHECKSUM | ARCHIVE_FLAG_DIGEST))) {
+            return -1;
+        }
+    }
+
+    pyi_sha256_init(&sha256);
+    pyi_sha256_update(&sha256, &status->cookie, sizeof(COOKIE));
+    pyi_sha256_update(&sha256, status->tocbuff, (size_t)((char *)status->tocend - (char *)status->tocbuff));
+#ifdef PYI_STATIC_PYTHON
+    /* The Python library is not extracted, so the cache directory cannot
+     * be shared with the bootloaders that load it. */
+    pyi_sha256_update(&sha256, "static-python", 13);
+#endif
+    pyi_sha256_final(&sha256, digest);
+    return 0;
+}
+
+/*
+ * Get the SHA-256 digest of the uncompressed data of the entry, stored at
+ * the end of its TOC entry; used as the key of the entry in the
+ * content-addressed store. Returns NULL if the entry has no digest.
+ */
+const unsigned char *
+pyi_arch_get_entry_digest(const TOC *ptoc)
+{
+    if (!(ptoc->flags & ARCHIVE_FLAG_DIGEST)) {
+        return NULL;
+    }
+    return (const unsigned char *)ptoc + ptoc->structlen - ARCHIVE_DIGEST_SIZE;
+}
+
 /*
  * Find a TOC entry by its name and return it.
  */
@@ -592,6 +2409,12 @@ pyi_arch_find_by_name(ARCHIVE_STATUS *status, const char *name)
 {
     TOC *ptoc = status->tocbuff;
 
+    /* Use the name index, if available */
+    if (status->name_index != NULL) {
+        return _pyi_arch_index_lookup(status->name_index, status->name_index_size,
+                                      name, strlen(name), false);
+    }
+
     while (ptoc < status->tocend) {
         if (strcmp(ptoc->name, name) == 0) {
             return ptoc;
@@ -33,36 +33,163 @@
 #define ARCHIVE_ITEM_DATA             'x'  /* data */
 #define ARCHIVE_ITEM_RUNTIME_OPTION   'o'  /* runtime option */
 #define ARCHIVE_ITEM_SPLASH           'l'  /* splash resources */
+#define ARCHIVE_ITEM_FROZENMODULE     'f'  /* stdlib module, frozen by the bootloader */
+#define ARCHIVE_ITEM_FROZENPACKAGE    'F'  /* stdlib package, frozen by the bootloader */
 
-/* TOC entry for a CArchive */
+/*
+ * Classes of CArchive items. The entries of the TOC are grouped by class
+ * when the archive is opened, so that each consumer only iterates over
+ * the entries it is interested in (see pyi_arch_get_entries()). Within a
+ * class, the entries are in TOC order.
+ */
+typedef enum {
+    ARCHIVE_CLASS_BINARY,          /* 'b' */
+    ARCHIVE_CLASS_DATA,            /* 'x' */
+    ARCHIVE_CLASS_ZIPFILE,         /* 'Z' */
+    ARCHIVE_CLASS_DEPENDENCY,      /* 'd' */
+    ARCHIVE_CLASS_MODULE,          /* 'm' and 'M', interleaved */
+    ARCHIVE_CLASS_PYZ,             /* 'z' */
+    ARCHIVE_CLASS_SCRIPT,          /* 's' */
+    ARCHIVE_CLASS_RUNTIME_OPTION,  /* 'o' */
+    ARCHIVE_CLASS_SPLASH,          /* 'l' */
+    ARCHIVE_CLASS_FROZEN,          /* 'f' and 'F', interleaved */
+    ARCHIVE_CLASS_OTHER,           /* Unknown types */
+    ARCHIVE_CLASS_COUNT
+} ARCHIVE_CLASS;
+
+/* Compression methods of CArchive items (cflag). zstd and LZ4 are
+ * available only if the bootloader is built with support for them. */
+#define ARCHIVE_COMPRESSION_NONE      0
+#define ARCHIVE_COMPRESSION_ZLIB      1
+#define ARCHIVE_COMPRESSION_ZSTD      2
+#define ARCHIVE_COMPRESSION_LZ4       3
+
+/* Flags of CArchive items (v6). */
+#define ARCHIVE_FLAG_CHECKSUM         0x01  /* checksum holds the CRC-32 of the uncompressed data */
+#define ARCHIVE_FLAG_DIGEST           0x02  /* the entry ends with the SHA-256 digest of the uncompressed data */
+
+/* Size of the SHA-256 digest that ends the TOC entries with ARCHIVE_FLAG_DIGEST. */
+#define ARCHIVE_DIGEST_SIZE           32
+
+/*
+ * TOC entry for a CArchive, as kept in memory. This is the layout of the
+ * TOC entries of the v6 archive format, in which the offsets and lengths
+ * are 64-bit and all fields are naturally aligned (entries are padded to
+ * a multiple of 16 bytes). The TOC of a v5 archive, with 32-bit fields in
+ * an 18-byte header, is converted to this layout when it is loaded.
+ */
 typedef struct _toc {
-    int  structlen;  /*len of this one - including full len of name */
-    uint32_t pos;    /* pos rel to start of concatenation */
-    uint32_t len;    /* len of the data (compressed) */
-    uint32_t ulen;   /* len of data (uncompressed) */
-    char cflag;      /* is it compressed (really a byte) */
-    char typcd;      /* type code -'b' binary, 'z' zlib, 'm' module,
-                      * 's' script (v3),'x' data, 'o' runtime option  */
-    char name[1];    /* the name to save it as */
-    /* starting in v5, we stretch this out to a mult of 16 */
+    uint32_t structlen;  /* len of this one - including full len of name */
+    char cflag;          /* compression method (really a byte) */
+    char typcd;          /* type code -'b' binary, 'z' zlib, 'm' module,
+                          * 's' script (v3),'x' data, 'o' runtime option  */
+    uint8_t flags;       /* ARCHIVE_FLAG_* */
+    char reserved;
+    uint64_t pos;        /* pos rel to start of concatenation */
+    uint64_t len;        /* len of the data (compressed) */
+    uint64_t ulen;       /* len of data (uncompressed) */
+    uint32_t checksum;   /* CRC-32 of the data, verified on extraction */
+    char name[1];        /* the name to save it as; followed by the
+                          * digest of the data, if ARCHIVE_FLAG_DIGEST */
 } TOC;
 
-/* The CArchive Cookie, from end of the archive. */
+/* Size of the fixed part of a TOC entry; v6 and in memory, and v5. */
+#define ARCHIVE_TOC_HEADER_SIZE       36
+#define ARCHIVE_V5_TOC_HEADER_SIZE    18
+
+/*
+ * The CArchive Cookie, from end of the archive, as kept in memory. This
+ * is the layout of the v6 cookie; the v5 cookie, with 32-bit fields, is
+ * converted to it when the archive is opened.
+ */
 typedef struct _cookie {
-    char magic[8];      /* 'MEI\014\013\012\013\016' */
-    uint32_t len;       /* len of entire package */
-    uint32_t TOC;       /* pos (rel to start) of TableOfContents */
-    int  TOClen;        /* length of TableOfContents */
+    char magic[8];      /* 'MEI\014\013\012\013\017' (v6), 'MEI\014\013\012\013\016' (v5) */
+    uint64_t len;       /* len of entire package */
+    uint64_t TOC;       /* pos (rel to start) of TableOfContents */
+    uint64_t TOClen;    /* length of TableOfContents */
     int  pyvers;        /* new in v4 */
+    int  reserved;
     char pylibname[64]; /* Filename of Python dynamic library e.g. python2.7.dll. */
 } COOKIE;
 
+/* Size of the cookie of a v5 archive. */
+#define ARCHIVE_V5_COOKIE_SIZE        88
+
+/* Environment variable that passes the location of the COOKIE to the
+ * child process; see pyi_arch_export_cookie(). */
+#define ARCHIVE_COOKIE_ENV            "_PYI_ARCHIVE_COOKIE"
+
+/* Extraction buffers and decompression state; private to pyi_archive.c. */
+typedef struct _extraction_context EXTRACTION_CONTEXT;
+
 typedef struct _archive_status {
     FILE * fp;
     uint64_t pkgstart;
     TOC *  tocbuff;
     TOC *  tocend;
     COOKIE cookie;
+    int version;  /* Version of the archive format; 5 or 6 */
+    /* Offset of the COOKIE, and size of the archive file; see
+     * pyi_arch_export_cookie(). */
+    uint64_t cookie_pos;
+    uint64_t file_size;
+    /* The location of the COOKIE was passed by the parent process, which
+     * thus runs the same archive file. */
+    bool cookie_passed;
+    /*
+     * Read-only memory-mapped view of the whole archive file. NULL if the
+     * file could not be mapped; in that case, entries are extracted by
+     * reading from the (re-opened) file. The file handle is not kept open while
+     * the view exists.
+     */
+    const unsigned char *mapped_data;
+    uint64_t mapped_size;
+    /*
+     * Hash indices of TOC entries, built when the TOC is loaded. The
+     * name index maps entry names to entries; the option index maps
+     * runtime option names (without the value) to 'o' entries. Both
+     * use open addressing with linear probing and have power-of-two
+     * sizes. NULL if the index could not be allocated; lookups then
+     * fall back to scanning the TOC.
+     */
+    TOC ** name_index;
+    size_t name_index_size;
+    TOC ** option_index;
+    size_t option_index_size;
+    /*
+     * The TOC entries grouped by class; the entries of class c are
+     * class_entries[class_offsets[c]] to class_entries[class_offsets[c + 1] - 1].
+     */
+    TOC ** class_entries;
+    size_t class_offsets[ARCHIVE_CLASS_COUNT + 1];
+    /*
+     * Buffers and decompression state reused for all entries extracted
+     * via this archive status; created on first extraction. Must not be
+     * shared between threads.
+     */
+    EXTRACTION_CONTEXT *extraction_context;
+    /*
+     * Read-only handle of the archive file (a file descriptor, or a HANDLE
+     * opened for overlapped I/O on Windows), shared by the threads that
+     * read entries with pyi_arch_read_entry(); only opened by
+     * pyi_arch_open_shared_handle() if the archive is not mapped.
+     */
+    intptr_t shared_handle;
+    bool has_shared_handle;
+    /*
+     * Parent directories of the files being extracted, created in advance
+     * by pyi_launch_extract_binaries(); NULL if not available. Not owned
+     * by the archive status.
+     */
+    struct _target_dirs *target_dirs;
+    /*
+     * Bitmap of the entries that were already extracted into temppath
+     * ahead of pyi_launch_extract_binaries() (e.g., the requirements of
+     * the splash screen), which skips them. Indexed by the offset of the
+     * entry within the TOC, in units of 16 bytes (the size TOC entries are
+     * padded to). NULL if no entry was marked.
+     */
+    unsigned char *extracted_entries;
     /*
      * On Windows:
      *    These strings are UTF-8 encoded (via pyi_win32_utils_to_utf8). On Python 2,
@@ -73,18 +200,40 @@ typedef struct _archive_status {
      *    These strings are system-provided. On Python 2, they are passed as-is to Python.
      *    On Python 3, they are decoded to wchar_t using Py_DecodeLocale
      *    (formerly called _Py_char2wchar) first.
+     *
+     * The strings are allocated from the arena (see pyi_arena.c) and sized
+     * to their content; they are never modified in place, but replaced via
+     * pyi_arch_set_path(). Strings that are not set are empty ("").
+     * Several fields (also of different archive statuses) may point to the
+     * same string.
      */
-    char archivename[PATH_MAX];
-    char executablename[PATH_MAX];
-    char homepath[PATH_MAX];
-    char temppath[PATH_MAX];
+    const char *archivename;
+    const char *executablename;
+    const char *homepath;
+    const char *temppath;
     /*
      * Main path could be homepath or temppath. It will be temppath
      * if temppath is available. Sometimes we do not need to know if temppath
      * or homepath should be used. We only need to know the path. This variable
      * is used for example to set sys.path, sys.prefix, and sys._MEIPASS.
      */
-    char mainpath[PATH_MAX];
+    const char *mainpath;
+    /*
+     * Persistent extraction cache (pyi-runtime-cachedir option). If the
+     * cache is used, cachepath is the cache directory of this archive.
+     * When that directory already exists, temppath points to it and
+     * is_cached is set. Otherwise, temppath is a staging directory that
+     * is moved to cachepath once all files are extracted.
+     */
+    const char *cachepath;
+    bool is_cached;
+    /*
+     * Content-addressed store of extracted files (pyi-runtime-store
+     * option), shared by all programs of the user; see pyi_store.c. Empty
+     * if the store is not used. Kept after the contents of the archive are
+     * released, for the garbage collection at exit.
+     */
+    const char *storepath;
     /*
      * Flag if temporary directory is available. This usually means running
      * executable in onefile mode. Bootloader has to behave differently
@@ -111,6 +260,73 @@ TOC *pyi_arch_increment_toc_ptr(const ARCHIVE_STATUS *status, const TOC* ptoc);
 
 unsigned char *pyi_arch_extract(ARCHIVE_STATUS *status, TOC *ptoc);
 int pyi_arch_extract2fs(ARCHIVE_STATUS *status, TOC *ptoc);
+int pyi_arch_extract2fs_once(ARCHIVE_STATUS *status, TOC *ptoc);
+int pyi_arch_extract2fp(ARCHIVE_STATUS *status, TOC *ptoc, FILE *out);
+
+/*
+ * Return a pointer to the data of an uncompressed entry within the
+ * memory-mapped archive. Returns NULL if the archive is not mapped or
+ * the entry is compressed. The data is owned by the ARCHIVE_STATUS and
+ * remains valid until it is freed; the caller must not modify or free it.
+ */
+const unsigned char *pyi_arch_get_entry_data(const ARCHIVE_STATUS *status, const TOC *ptoc);
+
+/* Errors of pyi_arch_read_entry(). */
+#define ARCHIVE_READ_ERROR_IO          1  /* Failed to read the archive file */
+#define ARCHIVE_READ_ERROR_MEMORY      2  /* Out of memory */
+#define ARCHIVE_READ_ERROR_DATA        3  /* Corrupted data, or checksum mismatch */
+#define ARCHIVE_READ_ERROR_UNSUPPORTED 4  /* Compression method not supported by the bootloader */
+#define ARCHIVE_READ_ERROR_WRITE       5  /* Failed to write the extracted file (extraction only) */
+
+/*
+ * Open the read-only file handle shared by pyi_arch_read_entry(), unless
+ * the archive is memory-mapped. Must be called before any thread uses
+ * pyi_arch_read_entry(). Returns 0 on success, -1 on error.
+ */
+int pyi_arch_open_shared_handle(ARCHIVE_STATUS *status);
+
+/*
+ * Read the (decompressed) data of an entry into buffer, which must be
+ * ptoc->ulen bytes long, and verify its checksum, if any. Unlike the other
+ * extraction functions, this may be called from several threads at the
+ * same time: the data is taken from the memory-mapped archive or read
+ * with positional reads of the shared handle, and the decompression state
+ * is local to the call. Errors are not reported; returns 0 on success,
+ * or one of the ARCHIVE_READ_ERROR_* codes.
+ */
+int pyi_arch_read_entry(const ARCHIVE_STATUS *status, const TOC *ptoc, unsigned char *buffer);
+
+/*
+ * Ask the operating system to read ahead the data of the entry within the
+ * memory-mapped archive, so that it is in memory when it is accessed.
+ * Does nothing if the archive is not mapped, or the platform does not
+ * support it.
+ */
+void pyi_arch_prefetch(const ARCHIVE_STATUS *status, const TOC *ptoc);
+
+/*
+ * Return the entries of the given class, and store their number in count.
+ * The array is owned by the ARCHIVE_STATUS.
+ */
+TOC **pyi_arch_get_entries(const ARCHIVE_STATUS *status, ARCHIVE_CLASS entry_class, size_t *count);
+
+/*
+ * Record that the entry was extracted into temppath, so that it is not
+ * extracted again. Returns 0 on success, -1 if the bitmap could not be
+ * allocated (the entry is then just extracted again).
+ */
+int pyi_arch_mark_extracted(ARCHIVE_STATUS *status, const TOC *ptoc);
+
+/*
+ * Return true if the entry was marked by pyi_arch_mark_extracted().
+ */
+bool pyi_arch_is_extracted(const ARCHIVE_STATUS *status, const TOC *ptoc);
+
+/*
+ * Free the extraction buffers and decompression state of the archive
+ * status (also done by pyi_arch_status_free()).
+ */
+void pyi_arch_free_extraction_context(ARCHIVE_STATUS *status);
 
 /**
  * Helpers for embedders
@@ -129,6 +345,25 @@ int pyi_arch_open(ARCHIVE_STATUS *status);
 ARCHIVE_STATUS *pyi_arch_status_new();
 void pyi_arch_status_free(ARCHIVE_STATUS *status);
 
+/*
+ * FNV-1a hash of the first len characters of the string, as used by the
+ * TOC indices.
+ */
+uint32_t pyi_arch_hash(const char *str, size_t len);
+
+/*
+ * Set one of the path fields of the archive status to a copy of the given
+ * path. Returns 0 on success, -1 if out of memory (the field is then left
+ * unchanged).
+ */
+int pyi_arch_set_path(const char **field, const char *path);
+
+/*
+ * Release everything but the paths and flags of the archive status; used
+ * by the onefile parent process while it waits for the child process.
+ */
+void pyi_arch_release_contents(ARCHIVE_STATUS *status);
+
 /*
  * Setup the paths and open the archive
  *
@@ -143,6 +378,18 @@ TOC *getFirstTocEntry(ARCHIVE_STATUS *status);
 TOC *getNextTocEntry(ARCHIVE_STATUS *status, TOC *entry);
 
 char * pyi_arch_get_option(const ARCHIVE_STATUS * status, char * optname);
+
+/*
+ * Pass the location of the COOKIE of the opened archive to the child
+ * process, via the _PYI_ARCHIVE_COOKIE environment variable, so that
+ * pyi_arch_open() in the child does not need to search for it. The child
+ * verifies the location before using it, and must remove the variable
+ * from its environment once the archive is opened.
+ */
+int pyi_arch_export_cookie(const ARCHIVE_STATUS *status);
+bool pyi_arch_has_temporary_files(const ARCHIVE_STATUS *status);
+int pyi_arch_get_digest(const ARCHIVE_STATUS *status, unsigned char digest[ARCHIVE_DIGEST_SIZE]);
+const unsigned char *pyi_arch_get_entry_digest(const TOC *ptoc);
 TOC *pyi_arch_find_by_name(ARCHIVE_STATUS *status, const char *name);
 
 #endif  /* PYI_ARCHIVE_H */
@@ -0,0 +1,104 @@
+/*
+ * ****************************************************************************
+ * Copyright (c) 2013-2022, PyInstaller Development Team.
+ *
+ * Distributed under the terms of the GNU General Public License (version 2
+ * or later) with exception for distributing the bootloader.
+ *
+ * The full license is in the file COPYING.txt, distributed with this software.
+ *
+ * SPDX-License-Identifier: (GPL-2.0-or-later WITH Bootloader-exception)
+ * ****************************************************************************
+ */
+
+/*
+ * Arena allocator for the data that lives for the whole startup of the
+ * bootloader.
+ *
+ * The allocations are carved out of chunks, which are released all at
+ * once at the end. The data allocated this way (e.g., the paths of the
+ * archive statuses, which are sized to their content instead of PATH_MAX)
+ * needs no individual bookkeeping, and amounts to a few kilobytes in
+ * total, so a single chunk usually suffices.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+/* PyInstaller headers */
+#include "pyi_arena.h"
+
+/* Size of the chunks; larger allocations get a chunk of their own. */
+#define _ARENA_CHUNK_SIZE 4096
+
+/* Alignment of the allocations */
+#define _ARENA_ALIGNMENT 16
+
+typedef struct _arena_chunk {
+    struct _arena_chunk *next;
+    size_t size;  /* Usable size, after the header */
+    size_t used;
+} ARENA_CHUNK;
+
+/* Size of the chunk header, rounded up to the alignment */
+#define _ARENA_HEADER_SIZE ((sizeof(ARENA_CHUNK) + _ARENA_ALIGNMENT - 1) & ~(size_t)(_ARENA_ALIGNMENT - 1))
+
+/* The most recently allocated chunk, which the allocations are carved out
+ * of; the previous ones are linked via next. */
+static ARENA_CHUNK *_arena_chunks = NULL;
+
+void *
+pyi_arena_alloc(size_t size)
+{
+    ARENA_CHUNK *chunk = _arena_chunks;
+    void *ptr;
+
+    size = (size + _ARENA_ALIGNMENT - 1) & ~(size_t)(_ARENA_ALIGNMENT - 1);
+
+    if (chunk == NULL || chunk->size - chunk->used < size) {
+        size_t chunk_size = size > _ARENA_CHUNK_SIZE - _ARENA_HEADER_SIZE ?
+                            size : _ARENA_CHUNK_SIZE - _ARENA_HEADER_SIZE;
+
+        chunk = (ARENA_CHUNK *)malloc(_ARENA_HEADER_SIZE + chunk_size);
+        if (chunk == NULL) {
+            return NULL;
+        }
+        chunk->size = chunk_size;
+        chunk->used = 0;
+        if (_arena_chunks != NULL && size == chunk_size &&
+            _arena_chunks->size - _arena_chunks->used > 0) {
+            /* Keep allocating from the current chunk, which still has
+             * space left; link the dedicated chunk behind it. */
+            chunk->next = _arena_chunks->next;
+            _arena_chunks->next = chunk;
+        } else {
+            chunk->next = _arena_chunks;
+            _arena_chunks = chunk;
+        }
+    }
+    ptr = (char *)chunk + _ARENA_HEADER_SIZE + chunk->used;
+    chunk->used += size;
+    return ptr;
+}
+
+char *
+pyi_arena_strdup(const char *str)
+{
+    size_t len = strlen(str) + 1;
+    char *copy = (char *)pyi_arena_alloc(len);
+
+    if (copy != NULL) {
+        memcpy(copy, str, len);
+    }
+    return copy;
+}
+
+void
+pyi_arena_free(void)
+{
+    while (_arena_chunks != NULL) {
+        ARENA_CHUNK *next = _arena_chunks->next;
+        free(_arena_chunks);
+        _arena_chunks = next;
+    }
+}
@@ -0,0 +1,41 @@
+/*
+ * ****************************************************************************
+ * Copyright (c) 2013-2022, PyInstaller Development Team.
+ *
+ * Distributed under the terms of the GNU General Public License (version 2
+ * or later) with exception for distributing the bootloader.
+ *
+ * The full license is in the file COPYING.txt, distributed with this software.
+ *
+ * SPDX-License-Identifier: (GPL-2.0-or-later WITH Bootloader-exception)
+ * ****************************************************************************
+ */
+
+/*
+ * Arena allocator for the data that lives for the whole startup of the
+ * bootloader, e.g., the paths of the archive status.
+ */
+
+#ifndef PYI_ARENA_H
+#define PYI_ARENA_H
+
+#include <stddef.h>  /* size_t */
+
+/*
+ * Allocate memory from the arena. The memory is not zeroed, and is only
+ * released by pyi_arena_free(). Returns NULL if out of memory. Must only
+ * be called from the main thread.
+ */
+void *pyi_arena_alloc(size_t size);
+
+/*
+ * Copy the string into the arena. Returns NULL if out of memory.
+ */
+char *pyi_arena_strdup(const char *str);
+
+/*
+ * Release all memory allocated from the arena.
+ */
+void pyi_arena_free(void);
+
+#endif  /* PYI_ARENA_H */
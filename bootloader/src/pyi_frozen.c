@@ -0,0 +1,257 @@
+/*
+ * ****************************************************************************
+ * Copyright (c) 2013-2022, PyInstaller Development Team.
+ *
+ * Distributed under the terms of the GNU General Public License (version 2
+ * or later) with exception for distributing the bootloader.
+ *
+ * The full license is in the file COPYING.txt, distributed with this software.
+ *
+ * SPDX-License-Identifier: (GPL-2.0-or-later WITH Bootloader-exception)
+ * ****************************************************************************
+ */
+
+/*
+ * Stdlib modules needed by the initialization of Python, as frozen modules.
+ *
+ * Py_Initialize() imports a few pure-Python modules of the standard
+ * library (encodings, codecs, io, abc, ...). Without help, they are
+ * imported from base_library.zip, through zipimport, which needs to read
+ * the central directory of the zip file first. Instead, the build stores
+ * the marshalled code of these modules as 'f' (module) and 'F' (package)
+ * entries of the archive, and the bootloader registers them as frozen
+ * modules (PyImport_FrozenModules), after the modules that are already
+ * frozen into the Python library (e.g., importlib._bootstrap). The entries
+ * are uncompressed by default, so that the code is used in place from the
+ * memory-mapped executable.
+ *
+ * Frozen modules have no __file__, and frozen packages have an empty
+ * __path__. After the initialization, both are set to their location
+ * within base_library.zip, which still holds all the base modules, so that
+ * the submodules that are not frozen (e.g., the other codecs of
+ * encodings) are imported from there.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+/* PyInstaller headers */
+#include "pyi_global.h"
+#include "pyi_archive.h"
+#include "pyi_frozen.h"
+#include "pyi_python.h"
+
+/* struct _frozen of Python <= 3.10; packages have a negative size */
+typedef struct _frozen_v37 {
+    const char *name;
+    const unsigned char *code;
+    int size;
+} FROZEN_V37;
+
+/* struct _frozen of Python 3.11 */
+typedef struct _frozen_v311 {
+    const char *name;
+    const unsigned char *code;
+    int size;
+    int is_package;
+    PyObject *(*get_code)(void);
+} FROZEN_V311;
+
+/* Table installed as PyImport_FrozenModules: the original entries, then
+ * ours, then the terminating (zeroed) entry. */
+static void *_frozen_table = NULL;
+/* Archive entries registered as frozen modules. */
+static TOC **_frozen_entries = NULL;
+static size_t _frozen_count = 0;
+/* Inflated code of the compressed entries (or NULL). */
+static unsigned char **_frozen_buffers = NULL;
+
+int
+pyi_frozen_install(ARCHIVE_STATUS *status)
+{
+    const bool v311 = (pyvers >= 311);
+    const size_t entry_size = v311 ? sizeof(FROZEN_V311) : sizeof(FROZEN_V37);
+    const unsigned char *orig_table;
+    const unsigned char *code;
+    TOC **entries;
+    size_t num_orig = 0;
+    size_t count;
+    size_t i;
+
+    /* The table has only pointers to the entries of the 'f' class */
+    entries = pyi_arch_get_entries(status, ARCHIVE_CLASS_FROZEN, &count);
+    if (count == 0 || PI_PyImport_FrozenModules == NULL) {
+        return 0;
+    }
+
+    orig_table = (const unsigned char *)*PI_PyImport_FrozenModules;
+    if (orig_table != NULL) {
+        while (((const FROZEN_V37 *)(orig_table + num_orig * entry_size))->name != NULL) {
+            num_orig++;
+        }
+    }
+
+    _frozen_table = calloc(num_orig + count + 1, entry_size);
+    _frozen_buffers = (unsigned char **)calloc(count, sizeof(unsigned char *));
+    if (_frozen_table == NULL || _frozen_buffers == NULL) {
+        FATALERROR("Failed to allocate frozen modules table.\n");
+        return -1;
+    }
+    if (num_orig > 0) {
+        memcpy(_frozen_table, orig_table, num_orig * entry_size);
+    }
+
+    for (i = 0; i < count; i++) {
+        unsigned char *entry = (unsigned char *)_frozen_table + (num_orig + i) * entry_size;
+        const bool is_package = (entries[i]->typcd == ARCHIVE_ITEM_FROZENPACKAGE);
+        const int size = (int)entries[i]->ulen;
+
+        code = pyi_arch_get_entry_data(status, entries[i]);
+        if (code == NULL) {
+            _frozen_buffers[i] = pyi_arch_extract(status, entries[i]);
+            code = _frozen_buffers[i];
+        }
+        if (code == NULL) {
+            FATALERROR("Failed to extract frozen module %s.\n", entries[i]->name);
+            return -1;
+        }
+        if (v311) {
+            FROZEN_V311 *frozen = (FROZEN_V311 *)entry;
+            frozen->name = entries[i]->name;
+            frozen->code = code;
+            frozen->size = size;
+            frozen->is_package = is_package;
+        } else {
+            FROZEN_V37 *frozen = (FROZEN_V37 *)entry;
+            frozen->name = entries[i]->name;
+            frozen->code = code;
+            frozen->size = is_package ? -size : size;
+        }
+        VS("LOADER: Frozen module %s\n", entries[i]->name);
+    }
+
+    _frozen_entries = entries;
+    _frozen_count = count;
+    *PI_PyImport_FrozenModules = _frozen_table;
+    return 0;
+}
+
+/*
+ * Path of the module within base_library.zip, as zipimport would report
+ * it. With package_dir set, the path of the directory of the package.
+ */
+static int
+_pyi_frozen_module_path(char *path, const ARCHIVE_STATUS *status, const TOC *ptoc, bool package_dir)
+{
+    const char *suffix;
+    size_t len;
+    char *p;
+
+    if (package_dir) {
+        suffix = "";
+    } else if (ptoc->typcd == ARCHIVE_ITEM_FROZENPACKAGE) {
+        suffix = PYI_SEPSTR "__init__.pyc";
+    } else {
+        suffix = ".pyc";
+    }
+    len = strlen(status->mainpath) + strlen(PYI_SEPSTR "base_library.zip" PYI_SEPSTR);
+    if (snprintf(path, PATH_MAX, "%s%sbase_library.zip%s%s%s", status->mainpath, PYI_SEPSTR, PYI_SEPSTR,
+                 ptoc->name, suffix) >= PATH_MAX) {
+        return -1;
+    }
+    /* Module name to path */
+    for (p = path + len; *p && p < path + len + strlen(ptoc->name); p++) {
+        if (*p == '.') {
+            *p = PYI_SEP;
+        }
+    }
+    return 0;
+}
+
+static PyObject *
+_pyi_frozen_decode_path(const char *path)
+{
+#ifdef _WIN32
+    return PI_PyUnicode_Decode(path, strlen(path), "utf-8", "strict");
+#else
+    return PI_PyUnicode_DecodeFSDefault(path);
+#endif
+}
+
+int
+pyi_frozen_fix_up_modules(ARCHIVE_STATUS *status)
+{
+    char path[PATH_MAX];
+    PyObject *modules;
+    PyObject *module;
+    PyObject *file;
+    PyObject *dir;
+    PyObject *dirs;
+    size_t i;
+    int rc = 0;
+
+    if (_frozen_count == 0) {
+        return 0;
+    }
+    modules = PI_PySys_GetObject("modules");  /* borrowed reference */
+    if (modules == NULL) {
+        return -1;
+    }
+    for (i = 0; i < _frozen_count && rc == 0; i++) {
+        /* Only the modules imported so far; borrowed reference */
+        module = PI_PyDict_GetItemString(modules, _frozen_entries[i]->name);
+        if (module == NULL) {
+            continue;
+        }
+        if (_pyi_frozen_module_path(path, status, _frozen_entries[i], false) != 0) {
+            FATALERROR("Path of frozen module %s exceeds PATH_MAX.\n", _frozen_entries[i]->name);
+            return -1;
+        }
+        file = _pyi_frozen_decode_path(path);
+        if (file == NULL || PI_PyObject_SetAttrString(module, "__file__", file) != 0) {
+            rc = -1;
+        }
+        if (file) {
+            PI_Py_DecRef(file);
+        }
+        if (rc != 0 || _frozen_entries[i]->typcd != ARCHIVE_ITEM_FROZENPACKAGE) {
+            continue;
+        }
+
+        _pyi_frozen_module_path(path, status, _frozen_entries[i], true);
+        dir = _pyi_frozen_decode_path(path);
+        dirs = PI_PyList_New(0);
+        if (dir == NULL || dirs == NULL || PI_PyList_Append(dirs, dir) != 0 ||
+            PI_PyObject_SetAttrString(module, "__path__", dirs) != 0) {
+            rc = -1;
+        }
+        if (dir) {
+            PI_Py_DecRef(dir);
+        }
+        if (dirs) {
+            PI_Py_DecRef(dirs);
+        }
+    }
+    if (rc != 0) {
+        FATALERROR("Failed to set up frozen modules.\n");
+    }
+    return rc;
+}
+
+void
+pyi_frozen_finalize(void)
+{
+    size_t i;
+
+    if (_frozen_buffers != NULL) {
+        for (i = 0; i < _frozen_count; i++) {
+            free(_frozen_buffers[i]);
+        }
+    }
+    free(_frozen_buffers);
+    _frozen_buffers = NULL;
+    /* The table stays installed in the Python library, which is not used
+     * anymore; it is not freed. */
+    _frozen_entries = NULL;
+    _frozen_count = 0;
+}
@@ -0,0 +1,45 @@
+/*
+ * ****************************************************************************
+ * Copyright (c) 2013-2022, PyInstaller Development Team.
+ *
+ * Distributed under the terms of the GNU General Public License (version 2
+ * or later) with exception for distributing the bootloader.
+ *
+ * The full license is in the file COPYING.txt, distributed with this software.
+ *
+ * SPDX-License-Identifier: (GPL-2.0-or-later WITH Bootloader-exception)
+ * ****************************************************************************
+ */
+
+/*
+ * Stdlib modules needed by the initialization of Python, registered as
+ * frozen modules.
+ */
+
+#ifndef PYI_FROZEN_H
+#define PYI_FROZEN_H
+
+#include "pyi_global.h"
+#include "pyi_archive.h"
+
+/*
+ * Register the 'f' and 'F' entries of the archive as frozen modules. Must
+ * be called before Python is initialized. Returns 0 on success (including
+ * when there are no such entries), -1 on error.
+ */
+int pyi_frozen_install(ARCHIVE_STATUS *status);
+
+/*
+ * Set __file__ (and __path__ for packages) of the frozen modules imported
+ * during the initialization of Python to their location within
+ * base_library.zip. Must be called right after Python is initialized.
+ * Returns 0 on success, -1 on error.
+ */
+int pyi_frozen_fix_up_modules(ARCHIVE_STATUS *status);
+
+/*
+ * Release the frozen modules; must be called after Py_Finalize().
+ */
+void pyi_frozen_finalize(void);
+
+#endif  /* PYI_FROZEN_H */
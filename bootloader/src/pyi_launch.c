@@ -21,10 +21,13 @@
 
 #ifdef _WIN32
     #include <windows.h>
+    #include <process.h>  /* _beginthreadex */
 #else
     #include <langinfo.h> /* CODESET, nl_langinfo */
-    #include <stdlib.h>   /* malloc */
+    #include <pthread.h>  /* pthread_create, pthread_mutex_lock */
+    #include <unistd.h>   /* sysconf */
 #endif
+#include <stdlib.h>   /* malloc, qsort */
 #include <locale.h>  /* setlocale */
 #include <stdarg.h>
 #include <stddef.h>   /* ptrdiff_t */
@@ -37,15 +40,36 @@
 #include "pyi_global.h"
 #include "pyi_path.h"
 #include "pyi_archive.h"
+#include "pyi_arena.h"
 #include "pyi_utils.h"
 #include "pyi_splash.h"
 #include "pyi_python.h"
 #include "pyi_pythonlib.h"
 #include "pyi_win32_utils.h"  /* CreateActContext */
 #include "pyi_exception_dialog.h"
+#include "pyi_layout.h"
+#include "pyi_lazy.h"
+#include "pyi_mapped.h"
+#include "pyi_pipeline.h"
+#include "pyi_memfd.h"
+#include "pyi_store.h"
+#include "pyi_preload.h"
+#include "pyi_pyz.h"
+#include "pyi_zygote.h"
+#include "pyi_trace.h"
+
+/* Initial size of the pool of archives opened in multipackage mode. */
+#define _ARCHIVE_POOL_INITIAL_SIZE 8
+
+/* Max count of worker threads used to extract binaries in onefile mode. */
+#define _MAX_EXTRACTION_WORKERS 8
 
-/* Max count of possible opened archives in multipackage mode. */
-#define _MAX_ARCHIVE_POOL_LEN 20
+/*
+ * Minimal total (uncompressed) size of the entries to extract, for which
+ * parallel extraction is used. For smaller archives, the overhead of
+ * starting the worker threads outweighs the gain.
+ */
+#define _MIN_PARALLEL_EXTRACTION_SIZE (4 * 1024 * 1024)
 
 /*
  * The functions in this file defined in reverse order so that forward
@@ -91,7 +115,10 @@ splitName(char *path, char *filename, const char *item)
     return 0;
 }
 
-/* Copy the dependencies file from a directory to the tempdir */
+/*
+ * Make the dependency file from a directory available in the tempdir:
+ * hard-linked where possible, otherwise cloned or copied.
+ */
 static int
 copyDependencyFromDir(ARCHIVE_STATUS *status, const char *srcpath, const char *filename)
 {
@@ -99,16 +126,114 @@ copyDependencyFromDir(ARCHIVE_STATUS *status, const char *srcpath, const char *f
         return -1;
     }
 
+    if (pyi_link_file(srcpath, status->temppath, filename) == 0) {
+        VS("LOADER: Linked file %s into %s\n", srcpath, status->temppath);
+        return 0;
+    }
+
     VS("LOADER: Coping file %s to %s\n", srcpath, status->temppath);
 
-    if (pyi_copy_file(srcpath, status->temppath, filename) == -1) {
+    if (pyi_copy_file(srcpath, status->temppath, filename, pyi_arch_has_temporary_files(status)) == -1) {
         return -1;
     }
     return 0;
 }
 
 /*
- * Look for the archive identified by path into the ARCHIVE_STATUS pool archive_pool.
+ * Pool of the archives opened in multipackage mode, hashed by their path.
+ * Open addressing with linear probing; the size is a power of two, and
+ * the pool is grown once it is half full.
+ */
+typedef struct _archive_pool {
+    ARCHIVE_STATUS *self;  /* The archive of the current process; not owned */
+    ARCHIVE_STATUS **slots;
+    size_t size;
+    size_t count;
+    /*
+     * Where the dependencies with the path last_path are found: in the
+     * directory last_dir (onedir), or else in the archive last_archive.
+     * The dependencies are listed by executable, so this is only
+     * resolved once per executable.
+     */
+    const char *last_path;
+    const char *last_dir;
+    ARCHIVE_STATUS *last_archive;
+} ARCHIVE_POOL;
+
+/* Insert the archive into the slots, which must have a free slot. */
+static void
+_archive_pool_insert(ARCHIVE_STATUS **slots, size_t size, ARCHIVE_STATUS *archive)
+{
+    size_t mask = size - 1;
+    size_t slot = pyi_arch_hash(archive->archivename, strlen(archive->archivename)) & mask;
+
+    while (slots[slot] != NULL) {
+        slot = (slot + 1) & mask;
+    }
+    slots[slot] = archive;
+}
+
+static int
+_archive_pool_add(ARCHIVE_POOL *pool, ARCHIVE_STATUS *archive)
+{
+    if (2 * (pool->count + 1) > pool->size) {
+        size_t new_size = pool->size ? 2 * pool->size : _ARCHIVE_POOL_INITIAL_SIZE;
+        ARCHIVE_STATUS **new_slots = (ARCHIVE_STATUS **)calloc(new_size, sizeof(ARCHIVE_STATUS *));
+        size_t i;
+
+        if (new_slots == NULL) {
+            return -1;
+        }
+        for (i = 0; i < pool->size; i++) {
+            if (pool->slots[i] != NULL) {
+                _archive_pool_insert(new_slots, new_size, pool->slots[i]);
+            }
+        }
+        free(pool->slots);
+        pool->slots = new_slots;
+        pool->size = new_size;
+    }
+    _archive_pool_insert(pool->slots, pool->size, archive);
+    pool->count++;
+    return 0;
+}
+
+static ARCHIVE_STATUS *
+_archive_pool_find(const ARCHIVE_POOL *pool, const char *path)
+{
+    size_t mask = pool->size - 1;
+    size_t slot;
+
+    if (pool->size == 0) {
+        return NULL;
+    }
+    slot = pyi_arch_hash(path, strlen(path)) & mask;
+    while (pool->slots[slot] != NULL) {
+        if (strcmp(pool->slots[slot]->archivename, path) == 0) {
+            return pool->slots[slot];
+        }
+        slot = (slot + 1) & mask;
+    }
+    return NULL;
+}
+
+/* Free the archives in the pool (except for the archive of the current process). */
+static void
+_archive_pool_free(ARCHIVE_POOL *pool)
+{
+    size_t i;
+
+    for (i = 0; i < pool->size; i++) {
+        pyi_arch_status_free(pool->slots[i]);
+    }
+    free(pool->slots);
+    pool->slots = NULL;
+    pool->size = 0;
+    pool->count = 0;
+}
+
+/*
+ * Look for the archive identified by path in the pool of archives.
  * If the archive is found, a pointer to the associated ARCHIVE_STATUS is returned
  * otherwise the needed archive is opened and added to the pool and then returned.
  * If an error occurs, returns NULL.
@@ -117,24 +242,20 @@ copyDependencyFromDir(ARCHIVE_STATUS *status, const char *srcpath, const char *f
  * executables (multipackage feature).
  */
 static ARCHIVE_STATUS *
-_get_archive(ARCHIVE_STATUS *archive_pool[], const char *path)
+_get_archive(ARCHIVE_POOL *pool, const char *path)
 {
     ARCHIVE_STATUS *archive = NULL;
-    int index = 0;
-    int SELF = 0;
 
     VS("LOADER: Getting file from archive.\n");
 
-    if (pyi_create_temp_path(archive_pool[SELF]) == -1) {
+    if (pyi_create_temp_path(pool->self) == -1) {
         return NULL;
     }
 
-    for (index = 1; archive_pool[index] != NULL; index++) {
-        if (strcmp(archive_pool[index]->archivename, path) == 0) {
-            VS("LOADER: Archive found: %s\n", path);
-            return archive_pool[index];
-        }
-        VS("LOADER: Checking next archive in the list...\n");
+    archive = _archive_pool_find(pool, path);
+    if (archive != NULL) {
+        VS("LOADER: Archive found: %s\n", path);
+        return archive;
     }
 
     archive = pyi_arch_status_new();
@@ -142,21 +263,19 @@ _get_archive(ARCHIVE_STATUS *archive_pool[], const char *path)
         return NULL;
     }
 
-    if ((snprintf(archive->archivename, PATH_MAX, "%s", path) >= PATH_MAX) ||
-        (snprintf(archive->homepath, PATH_MAX, "%s",
-                  archive_pool[SELF]->homepath) >= PATH_MAX) ||
-        (snprintf(archive->temppath, PATH_MAX, "%s",
-                  archive_pool[SELF]->temppath) >= PATH_MAX)) {
-        FATALERROR("Archive path exceeds PATH_MAX\n");
+    /* The paths of the main archive status are shared, not copied. */
+    if (pyi_arch_set_path(&archive->archivename, path) != 0) {
         pyi_arch_status_free(archive);
         return NULL;
     }
+    archive->homepath = pool->self->homepath;
+    archive->temppath = pool->self->temppath;
 
     /*
      * Setting this flag prevents creating another temp directory and
      * the directory from the main archive status is used.
      */
-    archive->has_temp_directory = archive_pool[SELF]->has_temp_directory;
+    archive->has_temp_directory = pool->self->has_temp_directory;
 
     if (pyi_arch_open(archive)) {
         FATAL_PERROR("malloc", "Error opening archive %s\n", path);
@@ -164,49 +283,63 @@ _get_archive(ARCHIVE_STATUS *archive_pool[], const char *path)
         return NULL;
     }
 
-    archive_pool[index] = archive;
+    /* Files already extracted by the other executable are reused. */
+    if (pyi_find_cache_path(archive) == 0) {
+        VS("LOADER: Using extraction cache %s of archive %s\n", archive->cachepath, path);
+    }
+
+    if (_archive_pool_add(pool, archive) != 0) {
+        FATAL_PERROR("calloc", "Could not allocate memory for pool of archives.\n");
+        pyi_arch_status_free(archive);
+        return NULL;
+    }
     return archive;
 }
 
-/* Extract a file identifed by filename from the archive associated to status. */
+/*
+ * Extract a file identifed by filename from the archive associated to status
+ * into the tempdir of self. If the file is in the persistent extraction cache
+ * of the archive, it is linked or copied from there instead.
+ */
 static int
-extractDependencyFromArchive(ARCHIVE_STATUS *status, const char *filename)
+extractDependencyFromArchive(ARCHIVE_STATUS *self, ARCHIVE_STATUS *status, const char *filename)
 {
-    TOC * ptoc = status->tocbuff;
+    TOC * ptoc;
+    char srcpath[PATH_MAX];
+    struct stat sbuf;
 
     VS("LOADER: Extracting dependencies from archive\n");
 
-    while (ptoc < status->tocend) {
-        if (strcmp(ptoc->name, filename) == 0) {
-            if (pyi_arch_extract2fs(status, ptoc)) {
-                return -1;
-            }
-        }
-        ptoc = pyi_arch_increment_toc_ptr(status, ptoc);
+    ptoc = pyi_arch_find_by_name(status, filename);
+    if (ptoc == NULL) {
+        return 0;
+    }
+    if (status->cachepath[0] != PYI_NULLCHAR &&
+        pyi_path_join(srcpath, status->cachepath, filename) != NULL &&
+        stat(srcpath, &sbuf) == 0) {
+        return copyDependencyFromDir(self, srcpath, filename);
+    }
+    if (pyi_arch_extract2fs(status, ptoc)) {
+        return -1;
     }
     return 0;
 }
 
-/* Decide if the dependency identified by item is in a onedir or onfile archive
- * then call the appropriate function.
+/*
+ * Resolve where the dependencies with the given path are, from the location
+ * of the given file: in a onedir directory, or in an archive (onefile).
  */
 static int
-_extract_dependency(ARCHIVE_STATUS *archive_pool[], const char *item)
+_resolve_dependency(ARCHIVE_POOL *archive_pool, const char *path, const char *filename)
 {
-    ARCHIVE_STATUS *status = NULL;
-    ARCHIVE_STATUS *archive_status = archive_pool[0];
-    char path[PATH_MAX];
-    char filename[PATH_MAX];
+    ARCHIVE_STATUS *archive_status = archive_pool->self;
     char srcpath[PATH_MAX];
     char archive_path[PATH_MAX];
-
     char dirname[PATH_MAX];
 
-    VS("LOADER: Extracting dependencies\n");
-
-    if (splitName(path, filename, item) == -1) {
-        return -1;
-    }
+    archive_pool->last_path = NULL;
+    archive_pool->last_dir = NULL;
+    archive_pool->last_archive = NULL;
 
     pyi_path_dirname(dirname, path);
 
@@ -221,20 +354,18 @@ _extract_dependency(ARCHIVE_STATUS *archive_pool[], const char *item)
     if (checkFile(srcpath, "%s%s%s%s%s", archive_status->homepath, PYI_SEPSTR, dirname,
                   PYI_SEPSTR, filename) == 0) {
         VS("LOADER: File %s found, assuming is onedir\n", srcpath);
-
-        if (copyDependencyFromDir(archive_status, srcpath, filename) == -1) {
-            FATALERROR("Error copying %s\n", filename);
-            return -1;
+        if (snprintf(srcpath, PATH_MAX, "%s%s%s", archive_status->homepath, PYI_SEPSTR,
+                     dirname) < PATH_MAX) {
+            archive_pool->last_dir = pyi_arena_strdup(srcpath);
         }
         /* TODO implement pyi_path_join to accept variable length of arguments for this case. */
     }
     else if (checkFile(srcpath, "%s%s%s%s%s%s%s", archive_status->homepath, PYI_SEPSTR,
                        "..", PYI_SEPSTR, dirname, PYI_SEPSTR, filename) == 0) {
         VS("LOADER: File %s found, assuming is onedir\n", srcpath);
-
-        if (copyDependencyFromDir(archive_status, srcpath, filename) == -1) {
-            FATALERROR("Error copying %s\n", filename);
-            return -1;
+        if (snprintf(srcpath, PATH_MAX, "%s%s%s%s%s", archive_status->homepath, PYI_SEPSTR,
+                     "..", PYI_SEPSTR, dirname) < PATH_MAX) {
+            archive_pool->last_dir = pyi_arena_strdup(srcpath);
         }
     }
     else {
@@ -251,18 +382,55 @@ _extract_dependency(ARCHIVE_STATUS *archive_pool[], const char *item)
             return -1;
         }
 
-        if ((status = _get_archive(archive_pool, archive_path)) == NULL) {
+        if ((archive_pool->last_archive = _get_archive(archive_pool, archive_path)) == NULL) {
             FATALERROR("Archive not found: %s\n", archive_path);
             return -1;
         }
+    }
 
-        if (extractDependencyFromArchive(status, filename) == -1) {
-            FATALERROR("Error extracting %s\n", filename);
-            pyi_arch_status_free(status);
+    if (archive_pool->last_archive == NULL && archive_pool->last_dir == NULL) {
+        FATALERROR("Could not resolve the path of the dependency %s\n", filename);
+        return -1;
+    }
+    archive_pool->last_path = pyi_arena_strdup(path);
+    return 0;
+}
+
+/* Decide if the dependency identified by item is in a onedir or onfile archive
+ * then call the appropriate function.
+ */
+static int
+_extract_dependency(ARCHIVE_POOL *archive_pool, const char *item)
+{
+    char path[PATH_MAX];
+    char filename[PATH_MAX];
+    char srcpath[PATH_MAX];
+
+    VS("LOADER: Extracting dependencies\n");
+
+    if (splitName(path, filename, item) == -1) {
+        return -1;
+    }
+
+    if (archive_pool->last_path == NULL || strcmp(archive_pool->last_path, path) != 0) {
+        if (_resolve_dependency(archive_pool, path, filename) == -1) {
             return -1;
         }
     }
 
+    if (archive_pool->last_dir != NULL) {
+        if (pyi_path_join(srcpath, archive_pool->last_dir, filename) == NULL ||
+            copyDependencyFromDir(archive_pool->self, srcpath, filename) == -1) {
+            FATALERROR("Error copying %s\n", filename);
+            return -1;
+        }
+    }
+    else if (extractDependencyFromArchive(archive_pool->self, archive_pool->last_archive,
+                                          filename) == -1) {
+        FATALERROR("Error extracting %s\n", filename);
+        return -1;
+    }
+
     return 0;
 }
 
@@ -273,20 +441,218 @@ _extract_dependency(ARCHIVE_STATUS *archive_pool[], const char *item)
 int
 pyi_launch_need_to_extract_binaries(ARCHIVE_STATUS *archive_status)
 {
-    TOC * ptoc = archive_status->tocbuff;
+    int entry_class;
+    size_t count;
 
-    while (ptoc < archive_status->tocend) {
-        if (ptoc->typcd == ARCHIVE_ITEM_BINARY || ptoc->typcd == ARCHIVE_ITEM_DATA ||
-            ptoc->typcd == ARCHIVE_ITEM_ZIPFILE) {
+    for (entry_class = ARCHIVE_CLASS_BINARY; entry_class <= ARCHIVE_CLASS_DEPENDENCY; entry_class++) {
+        pyi_arch_get_entries(archive_status, (ARCHIVE_CLASS)entry_class, &count);
+        if (count > 0) {
             return true;
         }
+    }
+    return false;
+}
 
-        if (ptoc->typcd == ARCHIVE_ITEM_DEPENDENCY) {
-            return true;
+/*
+ * Parallel extraction of binaries.
+ *
+ * The entries to extract are sorted by their size (largest first) and
+ * placed into a shared queue, from which the workers keep taking the next
+ * entry until the queue is exhausted or an error occurs. Each worker uses
+ * its own copy of the ARCHIVE_STATUS, so that it has its own archive file
+ * handle (when the archive is not memory-mapped) and its own extraction
+ * context (buffers and decompression state).
+ */
+#ifdef _WIN32
+typedef CRITICAL_SECTION _extraction_mutex_t;
+#define _extraction_mutex_init(m)    InitializeCriticalSection(m)
+#define _extraction_mutex_destroy(m) DeleteCriticalSection(m)
+#define _extraction_mutex_lock(m)    EnterCriticalSection(m)
+#define _extraction_mutex_unlock(m)  LeaveCriticalSection(m)
+#else
+typedef pthread_mutex_t _extraction_mutex_t;
+#define _extraction_mutex_init(m)    pthread_mutex_init(m, NULL)
+#define _extraction_mutex_destroy(m) pthread_mutex_destroy(m)
+#define _extraction_mutex_lock(m)    pthread_mutex_lock(m)
+#define _extraction_mutex_unlock(m)  pthread_mutex_unlock(m)
+#endif
+
+typedef struct _extraction_queue {
+    TOC **entries;  /* Entries to extract, sorted by size. */
+    size_t count;
+    size_t next;    /* Index of next entry to extract. */
+    bool failed;    /* Set by the worker that failed to extract an entry. */
+    SPLASH_STATUS *splash_status;
+    _extraction_mutex_t mutex;
+} EXTRACTION_QUEUE;
+
+typedef struct _extraction_worker {
+    EXTRACTION_QUEUE *queue;
+    /* Private shallow copy of the main archive status. */
+    ARCHIVE_STATUS archive_status;
+#ifdef _WIN32
+    HANDLE thread;
+#else
+    pthread_t thread;
+#endif
+    bool thread_started;
+} EXTRACTION_WORKER;
+
+/* qsort() comparator; sorts the entries by their size, in descending order. */
+static int
+_compare_toc_size(const void *a, const void *b)
+{
+    const TOC *toc_a = *(const TOC **)a;
+    const TOC *toc_b = *(const TOC **)b;
+
+    if (toc_a->ulen > toc_b->ulen) {
+        return -1;
+    }
+    if (toc_a->ulen < toc_b->ulen) {
+        return 1;
+    }
+    return 0;
+}
+
+/* Return the number of online CPUs, or 1 if it cannot be determined. */
+static int
+_get_cpu_count()
+{
+#ifdef _WIN32
+    SYSTEM_INFO system_info;
+    GetSystemInfo(&system_info);
+    return (int)system_info.dwNumberOfProcessors;
+#else
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return (count > 0) ? (int)count : 1;
+#endif
+}
+
+/*
+ * Extraction worker loop; runs until all entries are extracted or until
+ * any of the workers fails.
+ */
+static int
+_extraction_worker_run(EXTRACTION_WORKER *worker)
+{
+    EXTRACTION_QUEUE *queue = worker->queue;
+    TOC *ptoc;
+
+    while (1) {
+        _extraction_mutex_lock(&queue->mutex);
+        if (queue->failed || queue->next >= queue->count) {
+            _extraction_mutex_unlock(&queue->mutex);
+            break;
+        }
+        ptoc = queue->entries[queue->next++];
+        /* 'Splash screen' feature; the updates are serialized by the
+         * queue mutex, and only record the latest entry. */
+        if (queue->splash_status != NULL) {
+            pyi_splash_update_prg(queue->splash_status, ptoc);
+        }
+        _extraction_mutex_unlock(&queue->mutex);
+
+        /* Extract the file to the disk */
+        if (pyi_arch_extract2fs(&worker->archive_status, ptoc)) {
+            _extraction_mutex_lock(&queue->mutex);
+            queue->failed = true;
+            _extraction_mutex_unlock(&queue->mutex);
+            return -1;
         }
-        ptoc = pyi_arch_increment_toc_ptr(archive_status, ptoc);
     }
-    return false;
+    return 0;
+}
+
+#ifdef _WIN32
+static unsigned __stdcall
+_extraction_worker_thread(void *arg)
+{
+    _extraction_worker_run((EXTRACTION_WORKER *)arg);
+    return 0;
+}
+#else
+static void *
+_extraction_worker_thread(void *arg)
+{
+    _extraction_worker_run((EXTRACTION_WORKER *)arg);
+    return NULL;
+}
+#endif
+
+/*
+ * Extract the given entries using num_workers threads; the calling thread
+ * acts as one of the workers. Falls back to extraction on fewer threads if
+ * the worker threads cannot be started.
+ */
+static int
+_extract_entries_parallel(ARCHIVE_STATUS *archive_status, SPLASH_STATUS *splash_status,
+                          TOC **entries, size_t count, int num_workers)
+{
+    EXTRACTION_QUEUE queue;
+    EXTRACTION_WORKER *workers;
+    int i;
+
+    workers = (EXTRACTION_WORKER *)calloc(num_workers, sizeof(EXTRACTION_WORKER));
+    if (workers == NULL) {
+        FATAL_PERROR("calloc", "Could not allocate memory for extraction workers.\n");
+        return -1;
+    }
+
+    qsort(entries, count, sizeof(TOC *), _compare_toc_size);
+
+    memset(&queue, 0, sizeof(queue));
+    queue.entries = entries;
+    queue.count = count;
+    queue.splash_status = splash_status;
+    _extraction_mutex_init(&queue.mutex);
+
+    /* Set up the workers, each with its own copy of the archive status
+     * (without an open file handle). */
+    for (i = 0; i < num_workers; i++) {
+        workers[i].queue = &queue;
+        memcpy(&workers[i].archive_status, archive_status, sizeof(ARCHIVE_STATUS));
+        workers[i].archive_status.fp = NULL;
+        workers[i].archive_status.extraction_context = NULL;
+    }
+
+    /* Start worker threads; the first worker runs on this thread. */
+    for (i = 1; i < num_workers; i++) {
+#ifdef _WIN32
+        workers[i].thread = (HANDLE)_beginthreadex(NULL, 0, _extraction_worker_thread, &workers[i], 0, NULL);
+        workers[i].thread_started = (workers[i].thread != 0);
+#else
+        workers[i].thread_started = (pthread_create(&workers[i].thread, NULL, _extraction_worker_thread, &workers[i]) == 0);
+#endif
+        if (!workers[i].thread_started) {
+            VS("LOADER: Could not start extraction worker thread #%d\n", i);
+            break;
+        }
+    }
+    VS("LOADER: Extracting %lu entries using %d worker thread(s)\n", (unsigned long)count, i);
+
+    _extraction_worker_run(&workers[0]);
+
+    /* Wait for the worker threads to finish */
+    for (i = 1; i < num_workers; i++) {
+        if (!workers[i].thread_started) {
+            continue;
+        }
+#ifdef _WIN32
+        WaitForSingleObject(workers[i].thread, INFINITE);
+        CloseHandle(workers[i].thread);
+#else
+        pthread_join(workers[i].thread, NULL);
+#endif
+    }
+
+    for (i = 0; i < num_workers; i++) {
+        pyi_arch_free_extraction_context(&workers[i].archive_status);
+    }
+
+    _extraction_mutex_destroy(&queue.mutex);
+    free(workers);
+
+    return queue.failed ? -1 : 0;
 }
 
 /*
@@ -300,6 +666,12 @@ pyi_launch_need_to_extract_binaries(ARCHIVE_STATUS *archive_status)
  * 'Splash screen' feature is supported by passing a SPLASH_STATUS to this
  * function. The parameter may be NULL, if not the name of the TOC is displayed
  * on the splash screen asynchronously.
+ *
+ * On multi-core systems, large archives are extracted by multiple threads.
+ *
+ * With a content-addressed store (pyi-runtime-store), the files whose data
+ * is already in the store are hard-linked from it instead of extracted,
+ * and the extracted files are added to it.
  */
 int
 pyi_launch_extract_binaries(ARCHIVE_STATUS *archive_status, SPLASH_STATUS *splash_status)
@@ -309,56 +681,177 @@ pyi_launch_extract_binaries(ARCHIVE_STATUS *archive_status, SPLASH_STATUS *splas
     /* We create this cache variable for faster execution time */
     bool update_text = (splash_status != NULL);
 
-    /*
-     * archive_pool[0] is reserved for the main process, the others for dependencies.
-     */
-    ARCHIVE_STATUS *archive_pool[_MAX_ARCHIVE_POOL_LEN];
-    TOC * ptoc = archive_status->tocbuff;
+    /* Archives of the dependencies (multipackage feature) */
+    ARCHIVE_POOL archive_pool = { archive_status, NULL, 0, 0, NULL, NULL, NULL };
+    TOC * ptoc;
+    TOC **class_entries;
+    size_t class_count;
+    size_t i;
+    int entry_class;
+
+    /* Entries to be extracted to the disk */
+    TOC **entries = NULL;
+    size_t entries_count = 0;
+    size_t entries_capacity = 0;
+    uint64_t total_size = 0;
+    int num_workers;
+    /* Lazy extraction; see pyi_lazy.c */
+    bool lazy;
+    size_t deferred_count = 0;
+    /* Pipelined extraction; see pyi_pipeline.c */
+    bool pipelined;
+    /* In-memory extraction of extension modules; see pyi_memfd.c */
+    bool memfd;
+    size_t memfd_count = 0;
+    /* Content-addressed store of extracted files; see pyi_store.c */
+    bool store;
+
+    VS("LOADER: Extracting binaries\n");
 
-    /* Clean memory for archive_pool list. */
-    memset(&archive_pool, 0, _MAX_ARCHIVE_POOL_LEN * sizeof(ARCHIVE_STATUS *));
+    /* Ensure that tmp dir _MEIPASSxxx exists; if the persistent extraction
+     * cache is enabled and already populated, there is nothing to extract. */
+    if (pyi_create_temp_path(archive_status) == -1) {
+        return -1;
+    }
+    if (archive_status->is_cached) {
+        VS("LOADER: Files already extracted in %s\n", archive_status->temppath);
+        return 0;
+    }
 
-    /* Current process is the 1st item. */
-    archive_pool[0] = archive_status;
+    lazy = pyi_lazy_is_enabled(archive_status);
+    pipelined = pyi_pipeline_is_enabled(archive_status);
+    memfd = pyi_memfd_is_enabled(archive_status);
+    store = pyi_store_open(archive_status) == 0;
 
-    VS("LOADER: Extracting binaries\n");
+    /* Collect the binaries, data files and zip files; extraction is done
+     * below */
+    for (entry_class = ARCHIVE_CLASS_BINARY; entry_class <= ARCHIVE_CLASS_ZIPFILE; entry_class++) {
+        pyi_arch_get_entries(archive_status, (ARCHIVE_CLASS)entry_class, &class_count);
+        entries_capacity += class_count;
+    }
+    if (entries_capacity > 0) {
+        entries = (TOC **)malloc(entries_capacity * sizeof(TOC *));
+        if (entries == NULL) {
+            FATAL_PERROR("malloc", "Could not allocate memory for list of entries to extract.\n");
+            return -1;
+        }
+    }
+    for (entry_class = ARCHIVE_CLASS_BINARY; entry_class <= ARCHIVE_CLASS_ZIPFILE; entry_class++) {
+        class_entries = pyi_arch_get_entries(archive_status, (ARCHIVE_CLASS)entry_class, &class_count);
+        for (i = 0; i < class_count; i++) {
+            ptoc = class_entries[i];
+#ifdef PYI_STATIC_PYTHON
+            if (strcmp(ptoc->name, archive_status->cookie.pylibname) == 0) {
+                /* The bootloader is linked with the Python library */
+                continue;
+            }
+#endif
+            if (memfd && pyi_memfd_is_deferred(ptoc)) {
+                /* Extracted into memory by the child process */
+                memfd_count++;
+            }
+            else if (lazy && pyi_lazy_is_deferred(ptoc)) {
+                /* Extracted on demand by the child process, and in the
+                 * background if pipelined */
+                deferred_count++;
+                if (pipelined && pyi_pipeline_add(archive_status, ptoc) != 0) {
+                    VS("LOADER: Could not defer %s to background extraction\n", ptoc->name);
+                }
+            }
+            else if (!pyi_arch_is_extracted(archive_status, ptoc)) {
+                /* Not yet extracted, e.g., for the splash screen */
+                entries[entries_count++] = ptoc;
+                total_size += ptoc->ulen;
+            }
+        }
+    }
+
+    /* 'Multipackage' feature - dependency is stored in different executables. */
+    class_entries = pyi_arch_get_entries(archive_status, ARCHIVE_CLASS_DEPENDENCY, &class_count);
+    for (i = 0; i < class_count; i++) {
+        if (_extract_dependency(&archive_pool, class_entries[i]->name) == -1) {
+            retcode = -1;
+            goto cleanup;  /* No need to extract other items in case of error. */
+        }
+    }
+
+    if (lazy) {
+        VS("LOADER: Deferring extraction of %lu entries%s\n", (unsigned long)deferred_count,
+           pipelined ? " to the background" : "");
+    }
+    if (memfd) {
+        VS("LOADER: Leaving %lu extension modules to in-memory extraction\n", (unsigned long)memfd_count);
+    }
+
+    if (entries_count == 0) {
+        goto cleanup;
+    }
+
+    /* Create the directory structure in advance, in a single pass. If
+     * that fails, the directories are created along with each file. */
+    archive_status->target_dirs = pyi_target_dirs_new(archive_status->temppath, entries, entries_count,
+                                                      pyi_arch_has_temporary_files(archive_status));
+
+    /* Clone or link the files whose data is already in the store; only
+     * the others are extracted below. */
+    if (store) {
+        entries_count = pyi_store_link_entries(archive_status, entries, entries_count);
+        total_size = 0;
+        for (i = 0; i < entries_count; i++) {
+            total_size += entries[i]->ulen;
+        }
+    }
+
+    /* 'Splash screen' feature; the progress is measured in bytes. */
+    if (update_text) {
+        pyi_splash_set_total(splash_status, total_size);
+    }
 
-    while (ptoc < archive_status->tocend) {
-        if (ptoc->typcd == ARCHIVE_ITEM_BINARY || ptoc->typcd == ARCHIVE_ITEM_DATA ||
-            ptoc->typcd == ARCHIVE_ITEM_ZIPFILE) {
+    num_workers = _get_cpu_count();
+    if (num_workers > _MAX_EXTRACTION_WORKERS) {
+        num_workers = _MAX_EXTRACTION_WORKERS;
+    }
+    if ((size_t)num_workers > entries_count) {
+        num_workers = (int)entries_count;
+    }
+
+    if (num_workers > 1 && total_size >= _MIN_PARALLEL_EXTRACTION_SIZE) {
+        retcode = _extract_entries_parallel(archive_status, splash_status, entries, entries_count, num_workers);
+    } else {
+        for (index = 0; (size_t)index < entries_count; index++) {
             /* 'Splash screen' feature */
             if (update_text) {
                 /* Update the text on the splash screen if one is available */
-                pyi_splash_update_prg(splash_status, ptoc);
+                pyi_splash_update_prg(splash_status, entries[index]);
             }
 
             /* Extract the file to the disk */
-            if (pyi_arch_extract2fs(archive_status, ptoc)) {
+            if (pyi_arch_extract2fs(archive_status, entries[index])) {
                 retcode = -1;
                 break;  /* No need to extract other items in case of error. */
             }
         }
+    }
 
-        else {
-            /* 'Multipackage' feature - dependency is stored in different executables. */
-            if (ptoc->typcd == ARCHIVE_ITEM_DEPENDENCY) {
-                if (_extract_dependency(archive_pool, ptoc->name) == -1) {
-                    retcode = -1;
-                    break;  /* No need to extract other items in case of error. */
-                }
+    pyi_target_dirs_free(archive_status->target_dirs);
+    archive_status->target_dirs = NULL;
 
-            }
-        }
-        ptoc = pyi_arch_increment_toc_ptr(archive_status, ptoc);
+    /* Share the newly extracted files with other programs */
+    if (retcode == 0 && store) {
+        pyi_store_add_entries(archive_status, entries, entries_count);
     }
 
-    /*
-     * Free memory allocated for archive_pool data. Do not free memory
-     * of the main process - start with 2nd item.
-     */
-    for (index = 1; archive_pool[index] != NULL; index++) {
-        pyi_arch_status_free(archive_pool[index]);
+cleanup:
+    /* Move the extracted files into the persistent extraction cache; also
+     * if there was nothing left to extract (e.g., all files are deferred
+     * or were extracted for the splash screen). */
+    if (retcode == 0) {
+        pyi_commit_cache_path(archive_status);
     }
+    free(entries);
+
+    /* Free the archives of the dependencies. */
+    _archive_pool_free(&archive_pool);
 
     return retcode;
 }
@@ -470,7 +963,10 @@ pyi_launch_run_scripts(ARCHIVE_STATUS *status)
 {
     unsigned char *data;
     char buf[PATH_MAX];
-    TOC * ptoc = status->tocbuff;
+    TOC * ptoc;
+    TOC **scripts;
+    size_t count;
+    size_t i;
     PyObject *__main__;
     PyObject *__file__;
     PyObject *main_dict;
@@ -491,113 +987,115 @@ pyi_launch_run_scripts(ARCHIVE_STATUS *status)
     }
 
     /* Iterate through toc looking for scripts (type 's') */
-    while (ptoc < status->tocend) {
-        if (ptoc->typcd == ARCHIVE_ITEM_PYSOURCE) {
-            /* Get data out of the archive.  */
-            data = pyi_arch_extract(status, ptoc);
-            /* Set the __file__ attribute within the __main__ module,
-             *  for full compatibility with normal execution. */
-            if (snprintf(buf, PATH_MAX, "%s%c%s.py", status->mainpath, PYI_SEP, ptoc->name) >= PATH_MAX) {
-                FATALERROR("Absolute path to script exceeds PATH_MAX\n");
-                return -1;
-            }
-            VS("LOADER: Running %s.py\n", ptoc->name);
-            __file__ = PI_PyUnicode_FromString(buf);
-            PI_PyObject_SetAttrString(__main__, "__file__", __file__);
-            PI_Py_DecRef(__file__);
-
-            /* Unmarshall code object */
-            code = PI_PyMarshal_ReadObjectFromString((const char *) data, ptoc->ulen);
-            if (!code) {
-                FATALERROR("Failed to unmarshal code object for %s\n", ptoc->name);
-                PI_PyErr_Print();
-                return -1;
-            }
+    scripts = pyi_arch_get_entries(status, ARCHIVE_CLASS_SCRIPT, &count);
+    for (i = 0; i < count; i++) {
+        ptoc = scripts[i];
+        /* Get data out of the archive.  */
+        data = pyi_arch_extract(status, ptoc);
+        if (data == NULL) {
+            FATALERROR("Failed to extract script %s from archive!\n", ptoc->name);
+            return -1;
+        }
+        /* Set the __file__ attribute within the __main__ module,
+         *  for full compatibility with normal execution. */
+        if (snprintf(buf, PATH_MAX, "%s%c%s.py", status->mainpath, PYI_SEP, ptoc->name) >= PATH_MAX) {
+            FATALERROR("Absolute path to script exceeds PATH_MAX\n");
+            return -1;
+        }
+        VS("LOADER: Running %s.py\n", ptoc->name);
+        __file__ = PI_PyUnicode_FromString(buf);
+        PI_PyObject_SetAttrString(__main__, "__file__", __file__);
+        PI_Py_DecRef(__file__);
+
+        /* Unmarshall code object */
+        code = PI_PyMarshal_ReadObjectFromString((const char *) data, ptoc->ulen);
+        if (!code) {
+            FATALERROR("Failed to unmarshal code object for %s\n", ptoc->name);
+            PI_PyErr_Print();
+            return -1;
+        }
 
-            /* Store the code object to __main__ module's _pyi_main_co
-             * attribute, so it can be retrieved by FrozenImporter,
-             * if necessary. */
-            PI_PyObject_SetAttrString(__main__, "_pyi_main_co", code);
-
-            /* Run it */
-            retval = PI_PyEval_EvalCode(code, main_dict, main_dict);
-
-            /* If retval is NULL, an error occurred. Otherwise, it is a Python object.
-             * (Since we evaluate module-level code, which is not allowed to return an
-             * object, the Python object returned is always None.) */
-            if (!retval) {
-                #if defined(WINDOWED)
-                    /* In windowed mode, we need to display error information
-                     * via non-console means (i.e., error dialog on Windows,
-                     * syslog on macOS). For that, we need to extract the error
-                     * indicator data before PyErr_Print() call below clears
-                     * it. But it seems that for PyErr_Print() to properly
-                     * exit on SystemExit(), we also need to restore the error
-                     * indicator via PyErr_Restore(). Therefore, we extract
-                     * deep copies of relevant strings, and release all
-                     * references to error indicator and its data.
-                     */
-                    PyObject *ptype, *pvalue, *ptraceback;
-                    char *msg_exc, *msg_tb;
-                    int fmt_mode = PYI_TB_FMT_REPR;
-
-                    #if defined(_WIN32)
-                        fmt_mode = PYI_TB_FMT_CRLF;
-                    #elif defined(__APPLE__)
-                        fmt_mode = PYI_TB_FMT_LF;
-                    #endif
-
-                    PI_PyErr_Fetch(&ptype, &pvalue, &ptraceback);
-                    PI_PyErr_NormalizeException(&ptype, &pvalue, &ptraceback);
-                    msg_exc = _pyi_extract_exception_message(pvalue);
-                    if (pyi_arch_get_option(status, "pyi-disable-windowed-traceback") != NULL) {
-                        /* Traceback is disabled via option */
-                        msg_tb = strdup("Traceback is disabled via bootloader option.");
-                    } else {
-                        msg_tb = _pyi_extract_exception_traceback(
-                            ptype, pvalue, ptraceback, fmt_mode);
-                    }
-                    PI_PyErr_Restore(ptype, pvalue, ptraceback);
+        /* Store the code object to __main__ module's _pyi_main_co
+         * attribute, so it can be retrieved by FrozenImporter,
+         * if necessary. */
+        PI_PyObject_SetAttrString(__main__, "_pyi_main_co", code);
+
+        /* Run it */
+        retval = PI_PyEval_EvalCode(code, main_dict, main_dict);
+
+        /* If retval is NULL, an error occurred. Otherwise, it is a Python object.
+         * (Since we evaluate module-level code, which is not allowed to return an
+         * object, the Python object returned is always None.) */
+        if (!retval) {
+            #if defined(WINDOWED)
+                /* In windowed mode, we need to display error information
+                 * via non-console means (i.e., error dialog on Windows,
+                 * syslog on macOS). For that, we need to extract the error
+                 * indicator data before PyErr_Print() call below clears
+                 * it. But it seems that for PyErr_Print() to properly
+                 * exit on SystemExit(), we also need to restore the error
+                 * indicator via PyErr_Restore(). Therefore, we extract
+                 * deep copies of relevant strings, and release all
+                 * references to error indicator and its data.
+                 */
+                PyObject *ptype, *pvalue, *ptraceback;
+                char *msg_exc, *msg_tb;
+                int fmt_mode = PYI_TB_FMT_REPR;
+
+                #if defined(_WIN32)
+                    fmt_mode = PYI_TB_FMT_CRLF;
+                #elif defined(__APPLE__)
+                    fmt_mode = PYI_TB_FMT_LF;
                 #endif
 
-                /* If the error was SystemExit, PyErr_Print calls exit() without
-                 * returning. This means we won't print "Failed to execute" on
-                 * normal SystemExit's.
-                 */
-                PI_PyErr_Print();
-
-                /* Display error information */
-                #if !defined(WINDOWED)
-                    /* Non-windowed mode; PyErr_print() above dumps the
-                     * traceback, so the only thing we need to do here
-                     * is provide a summary */
-                     FATALERROR("Failed to execute script '%s' due to unhandled exception!\n", ptoc->name);
-                #else
-                    #if defined(_WIN32)
-                        /* Windows; use custom dialog */
-                        pyi_unhandled_exception_dialog(ptoc->name, msg_exc, msg_tb);
-                    #elif defined(__APPLE__)
-                        /* macOS .app bundle; use FATALERROR(), which
-                         * prints to stderr (invisible) as well as sends
-                         * the message to syslog */
-                         FATALERROR("Failed to execute script '%s' due to unhandled exception: %s\n", ptoc->name, msg_exc);
-                         FATALERROR("Traceback:\n%s\n", msg_tb);
-                    #endif
-
-                    /* Clean up exception information strings */
-                    free(msg_exc);
-                    free(msg_tb);
-                #endif /* if !defined(WINDOWED) */
-
-                /* Be consistent with python interpreter, which returns
-                 * 1 if it exits due to unhandled exception.
-                 */
-                return 1;
-            }
-            free(data);
-        }
+                PI_PyErr_Fetch(&ptype, &pvalue, &ptraceback);
+                PI_PyErr_NormalizeException(&ptype, &pvalue, &ptraceback);
+                msg_exc = _pyi_extract_exception_message(pvalue);
+                if (pyi_arch_get_option(status, "pyi-disable-windowed-traceback") != NULL) {
+                    /* Traceback is disabled via option */
+                    msg_tb = strdup("Traceback is disabled via bootloader option.");
+                } else {
+                    msg_tb = _pyi_extract_exception_traceback(
+                        ptype, pvalue, ptraceback, fmt_mode);
+                }
+                PI_PyErr_Restore(ptype, pvalue, ptraceback);
+            #endif
+
+            /* If the error was SystemExit, PyErr_Print calls exit() without
+             * returning. This means we won't print "Failed to execute" on
+             * normal SystemExit's.
+             */
+            PI_PyErr_Print();
+
+            /* Display error information */
+            #if !defined(WINDOWED)
+                /* Non-windowed mode; PyErr_print() above dumps the
+                 * traceback, so the only thing we need to do here
+                 * is provide a summary */
+                 FATALERROR("Failed to execute script '%s' due to unhandled exception!\n", ptoc->name);
+            #else
+                #if defined(_WIN32)
+                    /* Windows; use custom dialog */
+                    pyi_unhandled_exception_dialog(ptoc->name, msg_exc, msg_tb);
+                #elif defined(__APPLE__)
+                    /* macOS .app bundle; use FATALERROR(), which
+                     * prints to stderr (invisible) as well as sends
+                     * the message to syslog */
+                     FATALERROR("Failed to execute script '%s' due to unhandled exception: %s\n", ptoc->name, msg_exc);
+                     FATALERROR("Traceback:\n%s\n", msg_tb);
+                #endif
+
+                /* Clean up exception information strings */
+                free(msg_exc);
+                free(msg_tb);
+            #endif /* if !defined(WINDOWED) */
 
-        ptoc = pyi_arch_increment_toc_ptr(status, ptoc);
+            /* Be consistent with python interpreter, which returns
+             * 1 if it exits due to unhandled exception.
+             */
+            return 1;
+        }
+        free(data);
     }
     return 0;
 }
@@ -605,7 +1103,8 @@ pyi_launch_run_scripts(ARCHIVE_STATUS *status)
 void
 pyi_launch_initialize(ARCHIVE_STATUS * status)
 {
-    /* Nothing to do here at the moment. */
+    /* Optionally prefetch the PYZ archive while Python is initialized. */
+    pyi_pyz_prefetch_start(status);
 }
 
 /*
@@ -619,8 +1118,10 @@ int
 pyi_launch_execute(ARCHIVE_STATUS *status)
 {
     int rc = 0;
+    uint64_t start_time;
 
     /* Load Python DLL */
+    start_time = pyi_utils_get_monotonic_time();
     if (pyi_pylib_load(status)) {
         return -1;
     }
@@ -628,21 +1129,28 @@ pyi_launch_execute(ARCHIVE_STATUS *status)
         /* With this flag Python cleanup will be called. */
         status->is_pylib_loaded = true;
     }
+    pyi_trace_add_event("pyi_pylib_load", start_time, pyi_utils_get_monotonic_time() - start_time, NULL, 0, 0);
 
     /* Start Python. */
+    start_time = pyi_utils_get_monotonic_time();
     if (pyi_pylib_start_python(status)) {
         return -1;
     }
+    pyi_trace_add_event("pyi_pylib_start_python", start_time, pyi_utils_get_monotonic_time() - start_time, NULL, 0, 0);
 
     /* Import core pyinstaller modules from the executable - bootstrap */
+    start_time = pyi_utils_get_monotonic_time();
     if (pyi_pylib_import_modules(status)) {
         return -1;
     }
+    pyi_trace_add_event("pyi_pylib_import_modules", start_time, pyi_utils_get_monotonic_time() - start_time, NULL, 0, 0);
 
     /* Install zlibs  - now all hooks in place */
+    start_time = pyi_utils_get_monotonic_time();
     if (pyi_pylib_install_zlibs(status)) {
         return -1;
     }
+    pyi_trace_add_event("pyi_pylib_install_zlibs", start_time, pyi_utils_get_monotonic_time() - start_time, NULL, 0, 0);
 
 #ifndef WIN32
 
@@ -667,8 +1175,48 @@ pyi_launch_execute(ARCHIVE_STATUS *status)
     }
 #endif     /* WIN32 */
 
-    /* Run scripts */
+    /* Expose startup trace to user's scripts */
+    pyi_trace_set_sys_attribute();
+
+    /* Expose recording of the PYZ entry accesses to the import machinery */
+    if (pyi_layout_install()) {
+        return -1;
+    }
+
+    /* Expose lazy extraction API to the import machinery, which is
+     * installed by the bootstrap script. */
+    if (pyi_lazy_install(status)) {
+        return -1;
+    }
+
+    /* Expose in-memory extraction of extension modules to the import
+     * machinery. */
+    if (pyi_memfd_install(status)) {
+        return -1;
+    }
+
+    /* Expose loading of the bundled libraries to the import machinery,
+     * when LD_LIBRARY_PATH is not set */
+    if (pyi_preload_install(status)) {
+        return -1;
+    }
+
+    /* Expose the entries of the archive */
+    if (pyi_mapped_install(status)) {
+        return -1;
+    }
+
+    /* In zygote server mode, serve launch requests; only the worker
+     * processes return here. */
+    if (pyi_zygote_serve(status)) {
+        return -1;
+    }
+
+    /* Run scripts; if they exit the process, the event is recorded at
+     * exit. */
+    pyi_trace_begin_event("pyi_launch_run_scripts");
     rc = pyi_launch_run_scripts(status);
+    pyi_trace_end_event();
 
     VS("LOADER: OK.\n");
 
@@ -679,6 +1227,8 @@ void
 pyi_launch_finalize(ARCHIVE_STATUS *status)
 {
     pyi_pylib_finalize(status);
+    pyi_pyz_prefetch_stop();
+    pyi_memfd_finalize();
 }
 
 /*
@@ -0,0 +1,146 @@
+/*
+ * ****************************************************************************
+ * Copyright (c) 2013-2022, PyInstaller Development Team.
+ *
+ * Distributed under the terms of the GNU General Public License (version 2
+ * or later) with exception for distributing the bootloader.
+ *
+ * The full license is in the file COPYING.txt, distributed with this software.
+ *
+ * SPDX-License-Identifier: (GPL-2.0-or-later WITH Bootloader-exception)
+ * ****************************************************************************
+ */
+
+/*
+ * Recording of the order of archive entry accesses.
+ *
+ * When the PYI_LAYOUT_PROFILE environment variable is set to the path of
+ * an output file, the bootloader appends a line to that file for each
+ * access to an entry of the CArchive (extraction to the disk or into
+ * memory, and use of the memory-mapped data), and the import machinery
+ * (pyimod03_importers, through sys._pyi_layout_record) for each
+ * extraction of a module or data file from the PYZ archive. Each line
+ * has the name of the archive ("pkg" or "pyz"), a tab, and the name of
+ * the entry. In onefile mode, both the parent and the child process
+ * append to the file, in the order of their accesses.
+ *
+ * The file is the profile consumed by the --layout-profile option of the
+ * build, which places the recorded entries first in the archives, in the
+ * order of their first access. Entries may be recorded several times;
+ * subsequent runs of the program may append to the same file.
+ */
+
+#ifdef _WIN32
+    #include <windows.h>
+#else
+    #include <pthread.h>  /* pthread_mutex_lock */
+#endif
+#include <stdio.h>
+#include <string.h>
+
+/* PyInstaller headers */
+#include "pyi_global.h"
+#include "pyi_layout.h"
+#include "pyi_path.h"
+#include "pyi_python.h"
+
+#ifdef _WIN32
+static CRITICAL_SECTION _layout_mutex;
+#define _layout_mutex_init()   InitializeCriticalSection(&_layout_mutex)
+#define _layout_mutex_lock()   EnterCriticalSection(&_layout_mutex)
+#define _layout_mutex_unlock() LeaveCriticalSection(&_layout_mutex)
+#else
+static pthread_mutex_t _layout_mutex = PTHREAD_MUTEX_INITIALIZER;
+#define _layout_mutex_init()
+#define _layout_mutex_lock()   pthread_mutex_lock(&_layout_mutex)
+#define _layout_mutex_unlock() pthread_mutex_unlock(&_layout_mutex)
+#endif
+
+static bool _layout_enabled = false;
+static char _layout_output_path[PATH_MAX];
+
+int
+pyi_layout_enable(const char *output_path)
+{
+    if (_layout_enabled) {
+        return 0;
+    }
+    if (output_path == NULL || output_path[0] == 0) {
+        return -1;
+    }
+    if (snprintf(_layout_output_path, PATH_MAX, "%s", output_path) >= PATH_MAX) {
+        VS("LOADER: layout profile output path exceeds PATH_MAX\n");
+        return -1;
+    }
+    _layout_mutex_init();
+    _layout_enabled = true;
+    VS("LOADER: recording archive accesses into %s\n", _layout_output_path);
+    return 0;
+}
+
+bool
+pyi_layout_is_enabled()
+{
+    return _layout_enabled;
+}
+
+void
+pyi_layout_record(const char *archive, const char *name)
+{
+    FILE *out;
+
+    if (!_layout_enabled) {
+        return;
+    }
+
+    /* The file is opened for each access, so that it is never inherited
+     * by the child process, and the lines of the processes that append
+     * to it are not interleaved. Recording is best-effort. */
+    _layout_mutex_lock();
+    out = pyi_path_fopen(_layout_output_path, "ab");
+    if (out != NULL) {
+        fprintf(out, "%s\t%s\n", archive, name);
+        fclose(out);
+    }
+    _layout_mutex_unlock();
+}
+
+/*
+ * sys._pyi_layout_record(name): record an access to the named entry of
+ * the PYZ archive.
+ */
+static PyObject *
+_pyi_layout_record_pyz(PyObject *self, PyObject *arg)
+{
+    const char *name;
+
+    (void)self;
+    name = PI_PyUnicode_AsUTF8(arg);
+    if (name == NULL) {
+        return NULL;
+    }
+    pyi_layout_record(PYI_LAYOUT_ARCHIVE_PYZ, name);
+    return PI_Py_BuildValue("");
+}
+
+static PyMethodDef _pyi_layout_record_method = {
+    "_pyi_layout_record", _pyi_layout_record_pyz, METH_O, NULL
+};
+
+int
+pyi_layout_install()
+{
+    PyObject *func;
+
+    if (!_layout_enabled) {
+        return 0;
+    }
+    func = PI_PyCFunction_NewEx(&_pyi_layout_record_method, NULL, NULL);
+    if (func == NULL) {
+        FATALERROR("Failed to set up recording of archive accesses.\n");
+        return -1;
+    }
+    PI_PySys_SetObject("_pyi_layout_record", func);
+    PI_Py_DecRef(func);
+    return 0;
+}
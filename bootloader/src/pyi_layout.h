@@ -0,0 +1,48 @@
+/*
+ * ****************************************************************************
+ * Copyright (c) 2013-2022, PyInstaller Development Team.
+ *
+ * Distributed under the terms of the GNU General Public License (version 2
+ * or later) with exception for distributing the bootloader.
+ *
+ * The full license is in the file COPYING.txt, distributed with this software.
+ *
+ * SPDX-License-Identifier: (GPL-2.0-or-later WITH Bootloader-exception)
+ * ****************************************************************************
+ */
+
+/*
+ * Recording of the order of archive entry accesses (PYI_LAYOUT_PROFILE).
+ */
+
+#ifndef PYI_LAYOUT_H
+#define PYI_LAYOUT_H
+
+#include "pyi_global.h"
+
+/* Archives, as named in the profile */
+#define PYI_LAYOUT_ARCHIVE_PKG  "pkg"
+#define PYI_LAYOUT_ARCHIVE_PYZ  "pyz"
+
+/*
+ * Enable recording, with the accesses appended to the given file.
+ * Returns 0 on success, -1 on error.
+ */
+int pyi_layout_enable(const char *output_path);
+bool pyi_layout_is_enabled();
+
+/*
+ * Record an access to the named entry of the given archive. Does nothing
+ * if recording is not enabled. Safe to call from multiple threads.
+ */
+void pyi_layout_record(const char *archive, const char *name);
+
+/*
+ * Expose the recording of PYZ entry accesses to the import machinery, as
+ * sys._pyi_layout_record(name). Must be called after Py_Initialize().
+ * Returns 0 on success (including when recording is not enabled), -1 on
+ * error.
+ */
+int pyi_layout_install();
+
+#endif  /* PYI_LAYOUT_H */
@@ -0,0 +1,261 @@
+/*
+ * ****************************************************************************
+ * Copyright (c) 2013-2022, PyInstaller Development Team.
+ *
+ * Distributed under the terms of the GNU General Public License (version 2
+ * or later) with exception for distributing the bootloader.
+ *
+ * The full license is in the file COPYING.txt, distributed with this software.
+ *
+ * SPDX-License-Identifier: (GPL-2.0-or-later WITH Bootloader-exception)
+ * ****************************************************************************
+ */
+
+/*
+ * Lazy extraction of binaries and data files.
+ *
+ * In onefile mode, the parent process normally extracts all binaries and
+ * data files before it starts the child process that runs Python. When
+ * the pyi-lazy-extract runtime option is set, the parent skips the
+ * extension modules within packages and the data files in subdirectories;
+ * the child extracts them on demand, when asked by the Python side of the
+ * import machinery (pyimod03_importers):
+ *
+ *  - an extension module, when it is imported;
+ *  - the data files in the directory of a top-level module or package,
+ *    when that module or package is imported;
+ *  - the data files in the other top-level directories, when the import
+ *    machinery is installed.
+ *
+ * The shared libraries, the extension modules of the standard library
+ * (lib-dynload), and the files at the top level (e.g., base_library.zip)
+ * are always extracted by the parent, as they may be needed before the
+ * import machinery is set up, or loaded by means other than import.
+ *
+ * With the pyi-pipelined-extract runtime option, the entries are deferred
+ * in the same way, and the parent also extracts them in the background
+ * while the child runs (see pyi_pipeline.c).
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+/* PyInstaller headers */
+#include "pyi_global.h"
+#include "pyi_archive.h"
+#include "pyi_lazy.h"
+#include "pyi_python.h"
+#include "pyi_utils.h"  /* strndup */
+
+/* Archive of the running program; set by pyi_lazy_install(). */
+static ARCHIVE_STATUS *_lazy_archive_status = NULL;
+
+bool
+pyi_lazy_is_enabled(const ARCHIVE_STATUS *status)
+{
+    return pyi_arch_get_option(status, "pyi-lazy-extract") != NULL ||
+           pyi_arch_get_option(status, "pyi-pipelined-extract") != NULL;
+}
+
+/*
+ * Check if the file name has a Python extension module suffix. On POSIX
+ * systems, only the names with an ABI tag are considered; a plain .so
+ * suffix is also used by shared libraries and plugins, which are loaded
+ * by the dynamic linker and must be always extracted.
+ */
+bool
+pyi_lazy_is_extension_module(const char *name)
+{
+    const char *basename = strrchr(name, PYI_SEP);
+    size_t len;
+
+    basename = basename ? basename + 1 : name;
+    len = strlen(basename);
+#ifdef _WIN32
+    return len > 4 && _stricmp(basename + len - 4, ".pyd") == 0;
+#else
+    if (len <= 3 || strcmp(basename + len - 3, ".so") != 0) {
+        return false;
+    }
+    return strstr(basename, ".cpython-") != NULL || strstr(basename, ".abi3.") != NULL;
+#endif
+}
+
+bool
+pyi_lazy_is_deferred(const TOC *ptoc)
+{
+    const char *sep = strchr(ptoc->name, PYI_SEP);
+
+    /* Files at the top level are always extracted. */
+    if (sep == NULL) {
+        return false;
+    }
+    if (ptoc->typcd == ARCHIVE_ITEM_DATA) {
+        return true;
+    }
+    if (ptoc->typcd == ARCHIVE_ITEM_BINARY) {
+        /* Extension modules of the standard library; some of them might
+         * be needed by the bootstrap modules. */
+        if (sep - ptoc->name == 11 && strncmp(ptoc->name, "lib-dynload", 11) == 0) {
+            return false;
+        }
+        return pyi_lazy_is_extension_module(ptoc->name);
+    }
+    return false;
+}
+
+/*
+ * Extract the entry with the given name, or if the name ends with the
+ * path separator, all deferred data files in that directory and its
+ * subdirectories, unless already extracted. Returns 1 if any matching
+ * entry was found, 0 if not, and -1 if extraction failed.
+ */
+static int
+_pyi_lazy_extract_name(ARCHIVE_STATUS *status, const char *name)
+{
+    size_t len = strlen(name);
+    TOC *ptoc;
+    TOC **entries;
+    size_t count;
+    size_t i;
+    int found = 0;
+
+    if (len > 0 && name[len - 1] == PYI_SEP) {
+        entries = pyi_arch_get_entries(status, ARCHIVE_CLASS_DATA, &count);
+        for (i = 0; i < count; i++) {
+            ptoc = entries[i];
+            if (strncmp(ptoc->name, name, len) != 0 || !pyi_lazy_is_deferred(ptoc)) {
+                continue;
+            }
+            found = 1;
+            if (pyi_arch_extract2fs_once(status, ptoc) != 0) {
+                return -1;
+            }
+        }
+        return found;
+    }
+
+    ptoc = pyi_arch_find_by_name(status, name);
+    if (ptoc == NULL || (ptoc->typcd != ARCHIVE_ITEM_BINARY && ptoc->typcd != ARCHIVE_ITEM_DATA)) {
+        return 0;
+    }
+    return pyi_arch_extract2fs_once(status, ptoc) == 0 ? 1 : -1;
+}
+
+/*
+ * sys._pyi_lazy_extract(name); see _pyi_lazy_extract_name(). The name is
+ * relative to sys._MEIPASS.
+ */
+static PyObject *
+_pyi_lazy_extract(PyObject *self, PyObject *arg)
+{
+    const char *name;
+
+    (void)self;
+    name = PI_PyUnicode_AsUTF8(arg);
+    if (name == NULL) {
+        return NULL;
+    }
+    return PI_Py_BuildValue("i", _pyi_lazy_extract_name(_lazy_archive_status, name));
+}
+
+static PyMethodDef _pyi_lazy_extract_method = {
+    "_pyi_lazy_extract", _pyi_lazy_extract, METH_O, NULL
+};
+
+/*
+ * Build the list of top-level directories that contain deferred data
+ * files.
+ */
+static PyObject *
+_pyi_lazy_get_data_dirs(ARCHIVE_STATUS *status)
+{
+    PyObject *list;
+    PyObject *item;
+    char **dirs = NULL;
+    size_t count = 0;
+    size_t i;
+    TOC **entries;
+    size_t entry_count;
+    size_t j;
+    TOC *ptoc;
+
+    list = PI_PyList_New(0);
+    if (list == NULL) {
+        return NULL;
+    }
+    entries = pyi_arch_get_entries(status, ARCHIVE_CLASS_DATA, &entry_count);
+    for (j = 0; j < entry_count; j++) {
+        size_t len;
+
+        ptoc = entries[j];
+        if (!pyi_lazy_is_deferred(ptoc)) {
+            continue;
+        }
+        len = strchr(ptoc->name, PYI_SEP) - ptoc->name;
+        /* The number of top-level directories is small. */
+        for (i = 0; i < count; i++) {
+            if (strncmp(dirs[i], ptoc->name, len) == 0 && dirs[i][len] == 0) {
+                break;
+            }
+        }
+        if (i < count) {
+            continue;
+        }
+        if (count % 64 == 0) {
+            char **new_dirs = (char **)realloc(dirs, (count + 64) * sizeof(char *));
+            if (new_dirs == NULL) {
+                break;
+            }
+            dirs = new_dirs;
+        }
+        dirs[count] = strndup(ptoc->name, len);
+        if (dirs[count] == NULL) {
+            break;
+        }
+        item = PI_PyUnicode_FromString(dirs[count]);
+        count++;
+        if (item == NULL) {
+            PI_PyErr_Clear();
+            continue;
+        }
+        PI_PyList_Append(list, item);
+        PI_Py_DecRef(item);
+    }
+    for (i = 0; i < count; i++) {
+        free(dirs[i]);
+    }
+    free(dirs);
+    return list;
+}
+
+int
+pyi_lazy_install(ARCHIVE_STATUS *status)
+{
+    PyObject *func;
+    PyObject *dirs;
+
+    if (!status->has_temp_directory || !pyi_lazy_is_enabled(status)) {
+        return 0;
+    }
+    VS("LOADER: Enabling lazy extraction into %s\n", status->temppath);
+    _lazy_archive_status = status;
+
+    func = PI_PyCFunction_NewEx(&_pyi_lazy_extract_method, NULL, NULL);
+    dirs = _pyi_lazy_get_data_dirs(status);
+    if (func == NULL || dirs == NULL) {
+        FATALERROR("Failed to set up lazy extraction.\n");
+        if (func) {
+            PI_Py_DecRef(func);
+        }
+        if (dirs) {
+            PI_Py_DecRef(dirs);
+        }
+        return -1;
+    }
+    PI_PySys_SetObject("_pyi_lazy_data_dirs", dirs);
+    PI_PySys_SetObject("_pyi_lazy_extract", func);
+    PI_Py_DecRef(dirs);
+    PI_Py_DecRef(func);
+    return 0;
+}
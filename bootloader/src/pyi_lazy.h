@@ -0,0 +1,50 @@
+/*
+ * ****************************************************************************
+ * Copyright (c) 2013-2022, PyInstaller Development Team.
+ *
+ * Distributed under the terms of the GNU General Public License (version 2
+ * or later) with exception for distributing the bootloader.
+ *
+ * The full license is in the file COPYING.txt, distributed with this software.
+ *
+ * SPDX-License-Identifier: (GPL-2.0-or-later WITH Bootloader-exception)
+ * ****************************************************************************
+ */
+
+/*
+ * Lazy extraction of binaries and data files (pyi-lazy-extract).
+ */
+
+#ifndef PYI_LAZY_H
+#define PYI_LAZY_H
+
+#include "pyi_global.h"
+#include "pyi_archive.h"
+
+/*
+ * Return true if lazy extraction is enabled for the archive, also as part
+ * of pipelined extraction.
+ */
+bool pyi_lazy_is_enabled(const ARCHIVE_STATUS *status);
+
+/*
+ * Return true if the file name has a Python extension module suffix (with
+ * an ABI tag on POSIX systems).
+ */
+bool pyi_lazy_is_extension_module(const char *name);
+
+/*
+ * Return true if the extraction of the entry is deferred until it is
+ * requested by the Python side, when lazy extraction is enabled.
+ */
+bool pyi_lazy_is_deferred(const TOC *ptoc);
+
+/*
+ * Expose the lazy extraction API to Python, as sys._pyi_lazy_extract()
+ * and sys._pyi_lazy_data_dirs. Does nothing if lazy extraction is not
+ * enabled or the files are not extracted into a temporary directory.
+ * Must be called after Py_Initialize(). Returns 0 on success, -1 on error.
+ */
+int pyi_lazy_install(ARCHIVE_STATUS *status);
+
+#endif  /* PYI_LAZY_H */
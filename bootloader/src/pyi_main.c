@@ -39,12 +39,19 @@
 #include "pyi_global.h"  /* PATH_MAX */
 #include "pyi_path.h"
 #include "pyi_archive.h"
+#include "pyi_arena.h"
 #include "pyi_utils.h"
 #include "pyi_pythonlib.h"
 #include "pyi_launch.h"
+#include "pyi_preload.h"
+#include "pyi_pipeline.h"
+#include "pyi_store.h"
+#include "pyi_zygote.h"
 #include "pyi_win32_utils.h"
 #include "pyi_splash.h"
 #include "pyi_apple_events.h"
+#include "pyi_layout.h"
+#include "pyi_trace.h"
 
 
 static int
@@ -79,6 +86,19 @@ _pyi_allow_pkg_sideload(const char *executable)
     return 0;
 }
 
+/*
+ * Environment variable that passes the path of the application (i.e.,
+ * sys._MEIPASS) of the running program to the copies of the program that
+ * it launches as workers (pyi-worker-relaunch option). A launched process
+ * is a worker if it runs the same archive file, which is the case if it
+ * can use the location of the COOKIE passed by the program (see
+ * pyi_arch_export_cookie()). Workers skip the extraction in onefile mode,
+ * the restart in onedir mode on Linux, and the search for the cookie, and
+ * go straight to the initialization of Python. In onefile mode, they must
+ * not outlive the program, which removes the extracted files on exit.
+ */
+#define _PYI_WORKER_PATH_ENV "_PYI_WORKER_PATH"
+
 int
 pyi_main(int argc, char * argv[])
 {
@@ -91,6 +111,10 @@ pyi_main(int argc, char * argv[])
     int rc = 0;
     int in_child = 0;
     char *extractionpath = NULL;
+    char *worker_path = NULL;
+    char *trace_path = NULL;
+    char *layout_path = NULL;
+    uint64_t start_time;
 
 #ifdef _MSC_VER
     /* Visual C runtime incorrectly buffers stderr */
@@ -99,6 +123,23 @@ pyi_main(int argc, char * argv[])
 
     VS("PyInstaller Bootloader 5.x\n");
 
+    /* Startup tracing; the environment variable takes precedence over
+     * the runtime option, which can be checked only once the archive is
+     * opened. */
+    trace_path = pyi_getenv("PYI_STARTUP_TRACE");
+    if (trace_path) {
+        pyi_trace_enable(trace_path);
+        free(trace_path);
+    }
+
+    /* Recording of the archive accesses, for the layout of the archives;
+     * see pyi_layout.c */
+    layout_path = pyi_getenv("PYI_LAYOUT_PROFILE");
+    if (layout_path) {
+        pyi_layout_enable(layout_path);
+        free(layout_path);
+    }
+
     archive_status = pyi_arch_status_new();
     if (archive_status == NULL) {
         return -1;
@@ -151,9 +192,14 @@ pyi_main(int argc, char * argv[])
 
     VS("LOADER: _MEIPASS2 is %s\n", (extractionpath ? extractionpath : "NULL"));
 
+    /* Only used if this process turns out to be a worker, see below. */
+    worker_path = pyi_getenv(_PYI_WORKER_PATH_ENV);
+    pyi_unsetenv(_PYI_WORKER_PATH_ENV);
+
     /* Try opening the archive; first attempt to read it from executable
      * itself (embedded mode), then from a stand-alone pkg file (sideload mode)
      */
+    start_time = pyi_utils_get_monotonic_time();
     if (!pyi_arch_setup(archive_status, executable, executable)) {
         if (!pyi_arch_setup(archive_status, archivefile, executable)) {
             FATALERROR("Cannot open PyInstaller archive from executable (%s) or external archive (%s)\n",
@@ -171,6 +217,28 @@ pyi_main(int argc, char * argv[])
         }
     }
 
+    /* Relaunched by the running program as a worker */
+    if (worker_path != NULL) {
+        if (extractionpath == NULL && archive_status->cookie_passed) {
+            VS("LOADER: Running as worker with application path %s\n", worker_path);
+            /* Still owned by worker_path, which is freed before returning */
+            extractionpath = worker_path;
+            in_child = 1;
+        } else {
+            free(worker_path);
+            worker_path = NULL;
+        }
+    }
+
+    /* The cookie location passed by the parent process, if any, is not
+     * meant for the processes started by this one. */
+    pyi_unsetenv(ARCHIVE_COOKIE_ENV);
+
+    if (!pyi_trace_is_enabled()) {
+        pyi_trace_enable(pyi_arch_get_option(archive_status, "pyi-startup-trace"));
+    }
+    pyi_trace_add_event("pyi_arch_open", start_time, pyi_utils_get_monotonic_time() - start_time, NULL, 0, 0);
+
 #if defined(__linux__)
     char *processname = NULL;
 
@@ -193,6 +261,15 @@ pyi_main(int argc, char * argv[])
     archive_status->argc = argc;
     archive_status->argv = argv;
 
+    /* Let the zygote server run the program, if there is one */
+    if (!extractionpath) {
+        rc = 0;
+        if (pyi_zygote_client(archive_status, argc, argv, &rc)) {
+            pyi_arch_status_free(archive_status);
+            return rc;
+        }
+    }
+
 #if defined(_WIN32) || defined(__APPLE__)
 
     /* On Windows and Mac use single-process for --onedir mode. */
@@ -208,6 +285,14 @@ pyi_main(int argc, char * argv[])
      * set environment (i.e., LD_LIBRARY_PATH) and then restart/replace the
      * process via exec() without fork() for the environment changes (library
      * search path) to take effect. */
+    /* With the pyi-onedir-no-restart option, run in this process, and
+     * load the bundled libraries by their full path instead; see
+     * pyi_preload.c */
+    if (!extractionpath && pyi_preload_is_enabled(archive_status) &&
+        !pyi_launch_need_to_extract_binaries(archive_status)) {
+        VS("LOADER: No need to extract files to run; running without restart\n");
+        extractionpath = homepath;
+    }
      if (!extractionpath && !pyi_launch_need_to_extract_binaries(archive_status)) {
         VS("LOADER: No need to extract files to run; setting up environment and restarting bootloader...\n");
 
@@ -221,6 +306,10 @@ pyi_main(int argc, char * argv[])
          * be shown. */
         pyi_setenv("_PYI_ONEDIR_MODE", "1");
 
+        /* Pass the location of the archive's cookie, so that the restarted
+         * bootloader does not need to search for it. */
+        pyi_arch_export_cookie(archive_status);
+
         /* Set up the environment, especially LD_LIBRARY_PATH. This is the
          * main reason we are going to restart the bootloader in the first
          * place. */
@@ -230,6 +319,7 @@ pyi_main(int argc, char * argv[])
 
         /* Restart the process. The helper function performs exec() without
          * fork(), so we never return from the call. */
+        pyi_trace_write();
         if (pyi_utils_replace_process(executable, argc, argv) == -1) {
             return -1;
         }
@@ -299,17 +389,19 @@ pyi_main(int argc, char * argv[])
          *  we pass it through status variable
          */
         if (strcmp(homepath, extractionpath) != 0) {
-            if (snprintf(archive_status->temppath, PATH_MAX,
-                         "%s", extractionpath) >= PATH_MAX) {
+            if (strlen(extractionpath) >= PATH_MAX) {
                 VS("LOADER: temppath exceeds PATH_MAX\n");
                 return -1;
             }
+            if (pyi_arch_set_path(&archive_status->temppath, extractionpath) != 0) {
+                return -1;
+            }
             /*
              * Temp path exits - set appropriate flag and change
              * status->mainpath to point to temppath.
              */
             archive_status->has_temp_directory = true;
-            strcpy(archive_status->mainpath, archive_status->temppath);
+            archive_status->mainpath = archive_status->temppath;
         }
 
 #if defined(__APPLE__) && defined(WINDOWED)
@@ -320,11 +412,13 @@ pyi_main(int argc, char * argv[])
             }
             /* Optional argv emulation for onedir .app bundles */
             if (pyi_arch_get_option(archive_status, "pyi-macos-argv-emulation") != NULL) {
+                int activated;
                 /* Install event handlers */
                 pyi_apple_install_event_handlers();
-                /* Process Apple events; this updates argc_pyi/argv_pyi
-                 * accordingly */
-                pyi_apple_process_events(0.25);  /* short_timeout (250 ms) */
+                /* Process Apple events until the activation event is
+                 * handled; this updates argc_pyi/argv_pyi accordingly */
+                activated = pyi_apple_process_initial_events(
+                    pyi_apple_get_argv_emulation_timeout(archive_status));
                 /* Uninstall event handlers */
                 pyi_apple_uninstall_event_handlers();
                 /* The processing of Apple events swallows up the initial
@@ -333,9 +427,12 @@ pyi_main(int argc, char * argv[])
                  * launched in response to request to open file/URL).
                  * This seems to cause issues with some UI frameworks
                  * (Tcl/Tk, in particular); so we submit a new oapp event
-                 * to ourselves...
+                 * to ourselves... If the activation event has not arrived
+                 * yet, it is left to the UI framework.
                  */
-                 pyi_apple_submit_oapp_event();
+                if (activated) {
+                    pyi_apple_submit_oapp_event();
+                }
             }
             /* Update pointer to arguments; regardless of argv-emulation,
              * because pyi_utils_initialize_args() also filters out
@@ -345,6 +442,19 @@ pyi_main(int argc, char * argv[])
         }
 #endif
 
+        /* Let the program relaunch itself as a worker; the variables are
+         * inherited by the processes it starts. */
+        if (pyi_arch_get_option(archive_status, "pyi-worker-relaunch") != NULL) {
+            pyi_arch_export_cookie(archive_status);
+            pyi_setenv(_PYI_WORKER_PATH_ENV, archive_status->mainpath);
+        }
+
+        /* The splash screen starts up asynchronously; Python must not
+         * be initialized before it is up. */
+        if (splash_status != NULL) {
+            pyi_splash_wait_started(splash_status);
+        }
+
         /* Main code to initialize Python and run user's code. */
         pyi_launch_initialize(archive_status);
         rc = pyi_launch_execute(archive_status);
@@ -363,11 +473,24 @@ pyi_main(int argc, char * argv[])
     else {
 
         /* status->temppath is created if necessary. */
+        start_time = pyi_utils_get_monotonic_time();
         if (pyi_launch_extract_binaries(archive_status, splash_status)) {
             VS("LOADER: temppath is %s\n", archive_status->temppath);
             VS("LOADER: Error extracting binaries\n");
             return -1;
         }
+        pyi_trace_add_event("pyi_launch_extract_binaries", start_time,
+                            pyi_utils_get_monotonic_time() - start_time, NULL, 0, 0);
+
+        /* The splash screen starts up asynchronously, while the files are
+         * extracted; the child process must not be started before it is
+         * up, as it inherits the environment set by the splash screen. */
+        if (splash_status != NULL) {
+            start_time = pyi_utils_get_monotonic_time();
+            pyi_splash_wait_started(splash_status);
+            pyi_trace_add_event("pyi_splash_wait_started", start_time,
+                                pyi_utils_get_monotonic_time() - start_time, NULL, 0, 0);
+        }
 
         /* Run the 'child' process, then clean up. */
 
@@ -378,6 +501,10 @@ pyi_main(int argc, char * argv[])
 
         VS("LOADER: set _MEIPASS2 to %s\n", pyi_getenv("_MEIPASS2"));
 
+        /* Pass the location of the archive's cookie, so that the child
+         * does not need to search for it. */
+        pyi_arch_export_cookie(archive_status);
+
 #if defined(__linux__)
         char tmp_processname[16]; /* 16 bytes as per prctl() man page */
 
@@ -397,10 +524,14 @@ pyi_main(int argc, char * argv[])
         pyi_parent_to_background();
 
         /* Run user's code in a subprocess and pass command line arguments to it. */
-        rc = pyi_utils_create_child(executable, archive_status, argc, argv);
+        rc = pyi_utils_create_child(executable, archive_status, &splash_status, argc, argv);
 
         VS("LOADER: Back to parent (RC: %d)\n", rc);
 
+        /* Stop the background extraction, if pipelined, before the temporary
+         * directory is removed. */
+        pyi_pipeline_stop();
+
         VS("LOADER: Doing cleanup\n");
 
         /* Finalize splash screen before temp directory gets wiped, since the splash
@@ -409,11 +540,21 @@ pyi_main(int argc, char * argv[])
         pyi_splash_finalize(splash_status);
         pyi_splash_status_free(&splash_status);
 
-        if (archive_status->has_temp_directory == true) {
+        /* Files in the persistent extraction cache are kept. */
+        if (archive_status->has_temp_directory == true && !archive_status->is_cached) {
             pyi_remove_temp_path(archive_status->temppath);
         }
+        /* Now that the extracted files are removed, drop the objects of the
+         * content-addressed store that are no longer used. */
+        pyi_store_collect(archive_status);
         pyi_arch_status_free(archive_status);
 
     }
+
+    pyi_trace_write();
+    /* The archive status has been freed (or is no longer used); release
+     * the strings it pointed to. */
+    pyi_arena_free();
+    free(worker_path);
     return rc;
 }
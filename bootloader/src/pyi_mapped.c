@@ -0,0 +1,223 @@
+/*
+ * ****************************************************************************
+ * Copyright (c) 2013-2022, PyInstaller Development Team.
+ *
+ * Distributed under the terms of the GNU General Public License (version 2
+ * or later) with exception for distributing the bootloader.
+ *
+ * The full license is in the file COPYING.txt, distributed with this software.
+ *
+ * SPDX-License-Identifier: (GPL-2.0-or-later WITH Bootloader-exception)
+ * ****************************************************************************
+ */
+
+/*
+ * Direct access to the entries of the archive.
+ *
+ * Binaries and data files that are stored uncompressed in the archive can
+ * be used in place, without reading the copies extracted into
+ * sys._MEIPASS. The bootloader exposes them as the built-in module
+ * _pyi_archive:
+ *
+ *  - map_entry(name): read-only memoryview of the entry's data within the
+ *    memory-mapped archive, or None if there is no such entry, the entry
+ *    is compressed, or the archive could not be mapped. The pages are
+ *    shared with the page cache, and thus between processes;
+ *  - locate_entry(name): (path, offset, length) tuple that locates the
+ *    entry's data within the archive file, for use with functions that
+ *    map or read files themselves (e.g., mmap.mmap() or numpy.memmap()),
+ *    or None if there is no such uncompressed entry;
+ *  - read_entry(name): bytes object with the (decompressed) data of the
+ *    binary or data file entry, compressed or not, or None if there is no
+ *    such entry. The GIL is released while the data is read and inflated,
+ *    so that threads can read entries in parallel. The data is taken from
+ *    the mapped archive or read from a shared read-only handle of the
+ *    archive file with positional reads, and never via the FILE of the
+ *    ARCHIVE_STATUS (see pyi_arch_read_entry()). Raises OSError if the
+ *    entry cannot be read, and ValueError if its data is corrupted.
+ *
+ * The name is the name of the entry as it is extracted, i.e., relative to
+ * sys._MEIPASS, with os.sep as the separator. If the executable was built
+ * with entry alignment (the entry_alignment option of EXE), the offset of
+ * the uncompressed entries is a multiple of the alignment; with 64 KB
+ * alignment, it is suitable for mapping on all platforms.
+ *
+ * Like _pyi_pyz, the module is a plain module object created with
+ * PyImport_AddModule() after Py_Initialize().
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+/* PyInstaller headers */
+#include "pyi_global.h"
+#include "pyi_archive.h"
+#include "pyi_mapped.h"
+#include "pyi_python.h"
+
+/* Archive of the running program; set by pyi_mapped_install(). */
+static ARCHIVE_STATUS *_mapped_archive_status = NULL;
+static PyObject *_mapped_archive_path = NULL;
+
+/*
+ * Find the binary or data file with the name given by the Python object,
+ * which must be uncompressed if so requested. Returns NULL if there is no
+ * such entry, or if the name is not a string (with a Python exception
+ * set).
+ */
+static TOC *
+_pyi_mapped_find(PyObject *arg, bool uncompressed)
+{
+    const char *name = PI_PyUnicode_AsUTF8(arg);
+    TOC *ptoc;
+
+    if (name == NULL) {
+        return NULL;
+    }
+    ptoc = pyi_arch_find_by_name(_mapped_archive_status, name);
+    if (ptoc == NULL || (uncompressed && ptoc->cflag != ARCHIVE_COMPRESSION_NONE) ||
+        (ptoc->typcd != ARCHIVE_ITEM_BINARY && ptoc->typcd != ARCHIVE_ITEM_DATA)) {
+        return NULL;
+    }
+    return ptoc;
+}
+
+/*
+ * _pyi_archive.map_entry(name)
+ */
+static PyObject *
+_pyi_mapped_map_entry(PyObject *self, PyObject *arg)
+{
+    const unsigned char *data;
+    TOC *ptoc;
+
+    (void)self;
+    ptoc = _pyi_mapped_find(arg, true);
+    if (ptoc == NULL) {
+        return PI_PyErr_Occurred() ? NULL : PI_Py_BuildValue("");
+    }
+    data = pyi_arch_get_entry_data(_mapped_archive_status, ptoc);
+    if (data == NULL) {
+        return PI_Py_BuildValue("");
+    }
+    return PI_PyMemoryView_FromMemory((char *)data, (size_t)ptoc->ulen, PyBUF_READ);
+}
+
+static PyMethodDef _pyi_mapped_map_entry_method = {
+    "map_entry", _pyi_mapped_map_entry, METH_O, NULL
+};
+
+/*
+ * _pyi_archive.locate_entry(name)
+ */
+static PyObject *
+_pyi_mapped_locate_entry(PyObject *self, PyObject *arg)
+{
+    TOC *ptoc;
+
+    (void)self;
+    ptoc = _pyi_mapped_find(arg, true);
+    if (ptoc == NULL) {
+        return PI_PyErr_Occurred() ? NULL : PI_Py_BuildValue("");
+    }
+    return PI_Py_BuildValue("(OKK)", _mapped_archive_path,
+                            (unsigned long long)(_mapped_archive_status->pkgstart + ptoc->pos),
+                            (unsigned long long)ptoc->ulen);
+}
+
+static PyMethodDef _pyi_mapped_locate_entry_method = {
+    "locate_entry", _pyi_mapped_locate_entry, METH_O, NULL
+};
+
+/*
+ * _pyi_archive.read_entry(name)
+ */
+static PyObject *
+_pyi_mapped_read_entry(PyObject *self, PyObject *arg)
+{
+    PyObject *bytes;
+    PyThreadState *thread_state;
+    TOC *ptoc;
+    int rc;
+
+    (void)self;
+    ptoc = _pyi_mapped_find(arg, false);
+    if (ptoc == NULL) {
+        return PI_PyErr_Occurred() ? NULL : PI_Py_BuildValue("");
+    }
+    if ((uint64_t)(size_t)ptoc->ulen != ptoc->ulen) {
+        return PI_PyErr_NoMemory();
+    }
+    /* The data is read straight into the new bytes object, which is not
+     * visible to other threads until it is returned. */
+    bytes = PI_PyBytes_FromStringAndSize(NULL, (size_t)ptoc->ulen);
+    if (bytes == NULL) {
+        return NULL;
+    }
+    thread_state = PI_PyEval_SaveThread();
+    rc = pyi_arch_read_entry(_mapped_archive_status, ptoc, (unsigned char *)PI_PyBytes_AsString(bytes));
+    PI_PyEval_RestoreThread(thread_state);
+    if (rc == 0) {
+        return bytes;
+    }
+    PI_Py_DecRef(bytes);
+    switch (rc) {
+        case ARCHIVE_READ_ERROR_MEMORY:
+            return PI_PyErr_NoMemory();
+        case ARCHIVE_READ_ERROR_DATA:
+            return PI_PyErr_Format(*PI_PyExc_ValueError, "Archive entry '%s' is corrupted", ptoc->name);
+        case ARCHIVE_READ_ERROR_UNSUPPORTED:
+            return PI_PyErr_Format(*PI_PyExc_OSError, "Archive entry '%s' is compressed with an unsupported method",
+                                   ptoc->name);
+        default:
+            return PI_PyErr_Format(*PI_PyExc_OSError, "Failed to read archive entry '%s'", ptoc->name);
+    }
+}
+
+static PyMethodDef _pyi_mapped_read_entry_method = {
+    "read_entry", _pyi_mapped_read_entry, METH_O, NULL
+};
+
+int
+pyi_mapped_install(ARCHIVE_STATUS *status)
+{
+    PyObject *module;
+    PyObject *map_func;
+    PyObject *locate_func;
+    PyObject *read_func;
+    int rc = 0;
+
+    _mapped_archive_status = status;
+    /* Without the mapped archive, read_entry() reads from the file. */
+    if (pyi_arch_open_shared_handle(status) != 0) {
+        VS("LOADER: Failed to open shared handle of archive %s\n", status->archivename);
+    }
+#ifdef _WIN32
+    _mapped_archive_path = PI_PyUnicode_Decode(status->archivename, strlen(status->archivename), "utf-8", "strict");
+#else
+    _mapped_archive_path = PI_PyUnicode_DecodeFSDefault(status->archivename);
+#endif
+
+    module = PI_PyImport_AddModule("_pyi_archive");  /* borrowed reference */
+    map_func = PI_PyCFunction_NewEx(&_pyi_mapped_map_entry_method, NULL, NULL);
+    locate_func = PI_PyCFunction_NewEx(&_pyi_mapped_locate_entry_method, NULL, NULL);
+    read_func = PI_PyCFunction_NewEx(&_pyi_mapped_read_entry_method, NULL, NULL);
+    if (module == NULL || _mapped_archive_path == NULL || map_func == NULL || locate_func == NULL ||
+        read_func == NULL ||
+        PI_PyObject_SetAttrString(module, "map_entry", map_func) != 0 ||
+        PI_PyObject_SetAttrString(module, "locate_entry", locate_func) != 0 ||
+        PI_PyObject_SetAttrString(module, "read_entry", read_func) != 0) {
+        FATALERROR("Failed to expose archive entries to Python.\n");
+        rc = -1;
+    }
+    if (map_func) {
+        PI_Py_DecRef(map_func);
+    }
+    if (locate_func) {
+        PI_Py_DecRef(locate_func);
+    }
+    if (read_func) {
+        PI_Py_DecRef(read_func);
+    }
+    return rc;
+}
@@ -0,0 +1,31 @@
+/*
+ * ****************************************************************************
+ * Copyright (c) 2013-2022, PyInstaller Development Team.
+ *
+ * Distributed under the terms of the GNU General Public License (version 2
+ * or later) with exception for distributing the bootloader.
+ *
+ * The full license is in the file COPYING.txt, distributed with this software.
+ *
+ * SPDX-License-Identifier: (GPL-2.0-or-later WITH Bootloader-exception)
+ * ****************************************************************************
+ */
+
+/*
+ * Direct access to the entries of the archive (_pyi_archive).
+ */
+
+#ifndef PYI_MAPPED_H
+#define PYI_MAPPED_H
+
+#include "pyi_global.h"
+#include "pyi_archive.h"
+
+/*
+ * Expose the binaries and data files of the archive to Python, as the
+ * built-in module _pyi_archive. Must be called after
+ * Py_Initialize(). Returns 0 on success, -1 on error.
+ */
+int pyi_mapped_install(ARCHIVE_STATUS *status);
+
+#endif  /* PYI_MAPPED_H */
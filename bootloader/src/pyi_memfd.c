@@ -0,0 +1,244 @@
+/*
+ * ****************************************************************************
+ * Copyright (c) 2013-2022, PyInstaller Development Team.
+ *
+ * Distributed under the terms of the GNU General Public License (version 2
+ * or later) with exception for distributing the bootloader.
+ *
+ * The full license is in the file COPYING.txt, distributed with this software.
+ *
+ * SPDX-License-Identifier: (GPL-2.0-or-later WITH Bootloader-exception)
+ * ****************************************************************************
+ */
+
+/*
+ * In-memory extraction of extension modules.
+ *
+ * In onefile mode on Linux, when the pyi-memfd-extensions runtime option
+ * is set, the parent process does not extract the Python extension
+ * modules into the temporary directory. Instead, the child process
+ * inflates each of them into an anonymous memory file (memfd_create())
+ * when it is first imported, and the import machinery (pyimod03_importers)
+ * loads it from /proc/self/fd/N. The extension modules then take no space
+ * in the temporary directory, and are not held in memory twice on systems
+ * where the temporary directory is a tmpfs.
+ *
+ * The shared libraries and the extension modules of the standard library
+ * (lib-dynload) are always extracted, as they are loaded by the dynamic
+ * linker or may be needed before the import machinery is set up. If an
+ * anonymous memory file cannot be created (e.g., on kernels older than
+ * 3.17), the extension module is extracted into the temporary directory.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#ifdef __linux__
+    #include <sys/syscall.h>  /* SYS_memfd_create */
+    #include <unistd.h>  /* syscall, close */
+#endif
+
+/* PyInstaller headers */
+#include "pyi_global.h"
+#include "pyi_archive.h"
+#include "pyi_lazy.h"  /* pyi_lazy_is_extension_module */
+#include "pyi_memfd.h"
+#include "pyi_python.h"
+
+#if defined(__linux__) && defined(SYS_memfd_create)
+    #define _PYI_MEMFD_SUPPORTED
+
+    #ifndef MFD_CLOEXEC
+        #define MFD_CLOEXEC 0x0001U
+    #endif
+#endif
+
+/* Anonymous memory file of an extracted entry. */
+typedef struct _memfd_entry {
+    const TOC *ptoc;
+    int fd;
+} MEMFD_ENTRY;
+
+/* Archive of the running program; set by pyi_memfd_install(). */
+static ARCHIVE_STATUS *_memfd_archive_status = NULL;
+
+/* Entries extracted so far; the number of imported extension modules is
+ * small, so they are looked up linearly. */
+static MEMFD_ENTRY *_memfd_entries = NULL;
+static size_t _memfd_count = 0;
+
+bool
+pyi_memfd_is_enabled(const ARCHIVE_STATUS *status)
+{
+#ifdef _PYI_MEMFD_SUPPORTED
+    return pyi_arch_get_option(status, "pyi-memfd-extensions") != NULL;
+#else
+    (void)status;
+    return false;
+#endif
+}
+
+bool
+pyi_memfd_is_deferred(const TOC *ptoc)
+{
+    if (ptoc->typcd != ARCHIVE_ITEM_BINARY || !pyi_lazy_is_extension_module(ptoc->name)) {
+        return false;
+    }
+    /* Extension modules of the standard library; some of them might be
+     * needed by the bootstrap modules. */
+    return strncmp(ptoc->name, "lib-dynload" PYI_SEPSTR, 12) != 0;
+}
+
+#ifdef _PYI_MEMFD_SUPPORTED
+
+/*
+ * Inflate the entry into a new anonymous memory file. Returns the file
+ * descriptor, or -1 on error.
+ */
+static int
+_pyi_memfd_extract(ARCHIVE_STATUS *status, TOC *ptoc)
+{
+    const char *basename = strrchr(ptoc->name, PYI_SEP);
+    FILE *out;
+    int fd;
+    int out_fd;
+    int rc;
+
+    basename = basename ? basename + 1 : ptoc->name;
+    fd = (int)syscall(SYS_memfd_create, basename, MFD_CLOEXEC);
+    if (fd < 0) {
+        VS("LOADER: Could not create anonymous memory file for %s\n", ptoc->name);
+        return -1;
+    }
+    /* The FILE gets its own descriptor, which is closed with it. */
+    out_fd = dup(fd);
+    out = (out_fd >= 0) ? fdopen(out_fd, "wb") : NULL;
+    if (out == NULL) {
+        if (out_fd >= 0) {
+            close(out_fd);
+        }
+        close(fd);
+        return -1;
+    }
+    rc = pyi_arch_extract2fp(status, ptoc, out);
+    if (fclose(out) != 0) {
+        rc = -1;
+    }
+    if (rc != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/*
+ * Return a new reference to the path that the entry can be loaded from:
+ * /proc/self/fd/N for an anonymous memory file or, if that cannot be
+ * created, the path of the file extracted into the temporary directory.
+ */
+static PyObject *
+_pyi_memfd_get_path(ARCHIVE_STATUS *status, TOC *ptoc)
+{
+    MEMFD_ENTRY *new_entries;
+    char path[PATH_MAX];
+    size_t i;
+    int fd;
+
+    for (i = 0; i < _memfd_count; i++) {
+        if (_memfd_entries[i].ptoc == ptoc) {
+            return PI_PyUnicode_FromFormat("/proc/self/fd/%d", _memfd_entries[i].fd);
+        }
+    }
+
+    fd = _pyi_memfd_extract(status, ptoc);
+    if (fd >= 0) {
+        new_entries = (MEMFD_ENTRY *)realloc(_memfd_entries, (_memfd_count + 1) * sizeof(MEMFD_ENTRY));
+        if (new_entries != NULL) {
+            _memfd_entries = new_entries;
+            _memfd_entries[_memfd_count].ptoc = ptoc;
+            _memfd_entries[_memfd_count].fd = fd;
+            _memfd_count++;
+            VS("LOADER: Extracted %s into anonymous memory file %d\n", ptoc->name, fd);
+            return PI_PyUnicode_FromFormat("/proc/self/fd/%d", fd);
+        }
+        close(fd);
+    }
+
+    /* Fall back to the temporary directory */
+    if (pyi_arch_extract2fs_once(status, ptoc) != 0) {
+        return PI_PyErr_Format(*PI_PyExc_ImportError, "Failed to extract %s", ptoc->name);
+    }
+    if (snprintf(path, PATH_MAX, "%s%s%s", status->temppath, PYI_SEPSTR, ptoc->name) >= PATH_MAX) {
+        return PI_PyErr_Format(*PI_PyExc_ImportError, "Failed to extract %s: path exceeds PATH_MAX", ptoc->name);
+    }
+    return PI_PyUnicode_DecodeFSDefault(path);
+}
+
+/*
+ * sys._pyi_memfd_open(name): return the path that the extension module
+ * with the given name (relative to sys._MEIPASS) can be loaded from, or
+ * None if there is no such deferred extension module.
+ */
+static PyObject *
+_pyi_memfd_open(PyObject *self, PyObject *arg)
+{
+    const char *name;
+    TOC *ptoc;
+
+    (void)self;
+    name = PI_PyUnicode_AsUTF8(arg);
+    if (name == NULL) {
+        return NULL;
+    }
+    ptoc = pyi_arch_find_by_name(_memfd_archive_status, name);
+    if (ptoc == NULL || !pyi_memfd_is_deferred(ptoc)) {
+        return PI_Py_BuildValue("");
+    }
+    return _pyi_memfd_get_path(_memfd_archive_status, ptoc);
+}
+
+static PyMethodDef _pyi_memfd_open_method = {
+    "_pyi_memfd_open", _pyi_memfd_open, METH_O, NULL
+};
+
+#endif  /* _PYI_MEMFD_SUPPORTED */
+
+int
+pyi_memfd_install(ARCHIVE_STATUS *status)
+{
+#ifdef _PYI_MEMFD_SUPPORTED
+    PyObject *func;
+
+    if (!status->has_temp_directory || !pyi_memfd_is_enabled(status)) {
+        return 0;
+    }
+    VS("LOADER: Enabling in-memory extraction of extension modules\n");
+    _memfd_archive_status = status;
+
+    func = PI_PyCFunction_NewEx(&_pyi_memfd_open_method, NULL, NULL);
+    if (func == NULL) {
+        FATALERROR("Failed to set up in-memory extraction.\n");
+        return -1;
+    }
+    PI_PySys_SetObject("_pyi_memfd_open", func);
+    PI_Py_DecRef(func);
+#else
+    (void)status;
+#endif
+    return 0;
+}
+
+void
+pyi_memfd_finalize(void)
+{
+#ifdef _PYI_MEMFD_SUPPORTED
+    size_t i;
+
+    for (i = 0; i < _memfd_count; i++) {
+        close(_memfd_entries[i].fd);
+    }
+#endif
+    free(_memfd_entries);
+    _memfd_entries = NULL;
+    _memfd_count = 0;
+    _memfd_archive_status = NULL;
+}
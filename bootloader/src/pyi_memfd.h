@@ -0,0 +1,49 @@
+/*
+ * ****************************************************************************
+ * Copyright (c) 2013-2022, PyInstaller Development Team.
+ *
+ * Distributed under the terms of the GNU General Public License (version 2
+ * or later) with exception for distributing the bootloader.
+ *
+ * The full license is in the file COPYING.txt, distributed with this software.
+ *
+ * SPDX-License-Identifier: (GPL-2.0-or-later WITH Bootloader-exception)
+ * ****************************************************************************
+ */
+
+/*
+ * In-memory extraction of extension modules (pyi-memfd-extensions).
+ */
+
+#ifndef PYI_MEMFD_H
+#define PYI_MEMFD_H
+
+#include "pyi_global.h"
+#include "pyi_archive.h"
+
+/*
+ * Return true if the extension modules of the archive are extracted into
+ * anonymous memory files instead of the temporary directory. Only
+ * supported on Linux, in onefile mode.
+ */
+bool pyi_memfd_is_enabled(const ARCHIVE_STATUS *status);
+
+/*
+ * Return true if the entry is extracted into an anonymous memory file by
+ * the child process, when in-memory extraction is enabled.
+ */
+bool pyi_memfd_is_deferred(const TOC *ptoc);
+
+/*
+ * Expose the in-memory extraction API to Python, as sys._pyi_memfd_open().
+ * Does nothing if in-memory extraction is not enabled. Must be called
+ * after Py_Initialize(). Returns 0 on success, -1 on error.
+ */
+int pyi_memfd_install(ARCHIVE_STATUS *status);
+
+/*
+ * Close the anonymous memory files. Must be called after Py_Finalize().
+ */
+void pyi_memfd_finalize(void);
+
+#endif  /* PYI_MEMFD_H */
@@ -0,0 +1,226 @@
+/*
+ * ****************************************************************************
+ * Copyright (c) 2013-2022, PyInstaller Development Team.
+ *
+ * Distributed under the terms of the GNU General Public License (version 2
+ * or later) with exception for distributing the bootloader.
+ *
+ * The full license is in the file COPYING.txt, distributed with this software.
+ *
+ * SPDX-License-Identifier: (GPL-2.0-or-later WITH Bootloader-exception)
+ * ****************************************************************************
+ */
+
+/*
+ * Pipelined extraction in onefile mode.
+ *
+ * When the pyi-pipelined-extract runtime option is set, the parent
+ * process extracts only the entries that lazy extraction would extract
+ * before the start (the shared libraries, the extension modules of the
+ * standard library, and the files at the top level, e.g.,
+ * base_library.zip), and starts the child process right away. The
+ * remaining entries are then extracted by a background thread of the
+ * parent process, in archive order, while the child process initializes
+ * Python and imports the program's modules.
+ *
+ * The child process uses the lazy extraction machinery (see pyi_lazy.c)
+ * to access the entries: when it needs an entry that the parent process
+ * has not extracted yet, it extracts the entry itself. The entries are
+ * extracted by pyi_arch_extract2fs_once(), which writes a temporary file
+ * and renames it, so that the presence of the file marks its completion
+ * and whichever process extracts it first wins; the child process never
+ * waits for the parent process, nor sees a partially written file.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+    #include <windows.h>
+    #include <process.h>  /* _beginthreadex */
+#else
+    #include <pthread.h>  /* pthread_create, pthread_mutex_lock */
+#endif
+
+/* PyInstaller headers */
+#include "pyi_global.h"
+#include "pyi_archive.h"
+#include "pyi_pipeline.h"
+
+#ifdef _WIN32
+typedef CRITICAL_SECTION _pipeline_mutex_t;
+#define _pipeline_mutex_init(m)    InitializeCriticalSection(m)
+#define _pipeline_mutex_destroy(m) DeleteCriticalSection(m)
+#define _pipeline_mutex_lock(m)    EnterCriticalSection(m)
+#define _pipeline_mutex_unlock(m)  LeaveCriticalSection(m)
+#else
+typedef pthread_mutex_t _pipeline_mutex_t;
+#define _pipeline_mutex_init(m)    pthread_mutex_init(m, NULL)
+#define _pipeline_mutex_destroy(m) pthread_mutex_destroy(m)
+#define _pipeline_mutex_lock(m)    pthread_mutex_lock(m)
+#define _pipeline_mutex_unlock(m)  pthread_mutex_unlock(m)
+#endif
+
+/* The archive and the entries to extract in the background. */
+static ARCHIVE_STATUS *_pipeline_archive_status = NULL;
+static TOC **_pipeline_entries = NULL;
+static size_t _pipeline_count = 0;
+static size_t _pipeline_capacity = 0;
+
+/* Copy of the archive status used by the thread, with its own file
+ * handle and extraction buffers. */
+static ARCHIVE_STATUS _pipeline_thread_status;
+static _pipeline_mutex_t _pipeline_mutex;
+static bool _pipeline_stop = false;
+static bool _pipeline_done = false;
+#ifdef _WIN32
+static HANDLE _pipeline_thread;
+#else
+static pthread_t _pipeline_thread;
+#endif
+static bool _pipeline_thread_started = false;
+
+bool
+pyi_pipeline_is_enabled(const ARCHIVE_STATUS *status)
+{
+    return pyi_arch_get_option(status, "pyi-pipelined-extract") != NULL;
+}
+
+int
+pyi_pipeline_add(ARCHIVE_STATUS *status, TOC *ptoc)
+{
+    if (_pipeline_count == _pipeline_capacity) {
+        size_t new_capacity = _pipeline_capacity ? _pipeline_capacity * 2 : 256;
+        TOC **new_entries = (TOC **)realloc(_pipeline_entries, new_capacity * sizeof(TOC *));
+        if (new_entries == NULL) {
+            return -1;
+        }
+        _pipeline_entries = new_entries;
+        _pipeline_capacity = new_capacity;
+    }
+    _pipeline_archive_status = status;
+    _pipeline_entries[_pipeline_count++] = ptoc;
+    return 0;
+}
+
+/*
+ * Extract the entries until all are extracted, or the thread is asked to
+ * stop. Failures are not fatal; the child process extracts (or fails to
+ * extract) the entry again when it needs it.
+ */
+static void
+_pyi_pipeline_run(void)
+{
+    size_t done = 0;
+    size_t i;
+
+    for (i = 0; i < _pipeline_count; i++) {
+        bool stop;
+
+        _pipeline_mutex_lock(&_pipeline_mutex);
+        stop = _pipeline_stop;
+        _pipeline_mutex_unlock(&_pipeline_mutex);
+        if (stop) {
+            break;
+        }
+        if (pyi_arch_extract2fs_once(&_pipeline_thread_status, _pipeline_entries[i]) == 0) {
+            done++;
+        }
+    }
+    pyi_arch_free_extraction_context(&_pipeline_thread_status);
+    VS("LOADER: Background extraction finished (%lu of %lu entries extracted)\n",
+       (unsigned long)done, (unsigned long)_pipeline_count);
+
+    _pipeline_mutex_lock(&_pipeline_mutex);
+    _pipeline_done = true;
+    _pipeline_mutex_unlock(&_pipeline_mutex);
+}
+
+#ifdef _WIN32
+static unsigned __stdcall
+_pyi_pipeline_thread(void *arg)
+{
+    (void)arg;
+    _pyi_pipeline_run();
+    return 0;
+}
+#else
+static void *
+_pyi_pipeline_thread(void *arg)
+{
+    (void)arg;
+    _pyi_pipeline_run();
+    return NULL;
+}
+#endif
+
+void
+pyi_pipeline_start(void)
+{
+    if (_pipeline_count == 0 || _pipeline_thread_started) {
+        return;
+    }
+    memcpy(&_pipeline_thread_status, _pipeline_archive_status, sizeof(ARCHIVE_STATUS));
+    _pipeline_thread_status.fp = NULL;
+    _pipeline_thread_status.extraction_context = NULL;
+    _pipeline_thread_status.target_dirs = NULL;
+    _pipeline_stop = false;
+    _pipeline_done = false;
+    _pipeline_mutex_init(&_pipeline_mutex);
+
+#ifdef _WIN32
+    _pipeline_thread = (HANDLE)_beginthreadex(NULL, 0, _pyi_pipeline_thread, NULL, 0, NULL);
+    _pipeline_thread_started = (_pipeline_thread != 0);
+#else
+    _pipeline_thread_started = (pthread_create(&_pipeline_thread, NULL, _pyi_pipeline_thread, NULL) == 0);
+#endif
+    if (!_pipeline_thread_started) {
+        /* The child process extracts the entries on demand. */
+        VS("LOADER: Could not start background extraction thread\n");
+        _pipeline_mutex_destroy(&_pipeline_mutex);
+        return;
+    }
+    VS("LOADER: Extracting %lu entries in the background\n", (unsigned long)_pipeline_count);
+}
+
+bool
+pyi_pipeline_is_running(void)
+{
+    bool done;
+
+    if (!_pipeline_thread_started) {
+        return false;
+    }
+    _pipeline_mutex_lock(&_pipeline_mutex);
+    done = _pipeline_done;
+    _pipeline_mutex_unlock(&_pipeline_mutex);
+    if (!done) {
+        return true;
+    }
+    /* Finished; join the thread and release the list of entries. */
+    pyi_pipeline_stop();
+    return false;
+}
+
+void
+pyi_pipeline_stop(void)
+{
+    if (_pipeline_thread_started) {
+        _pipeline_mutex_lock(&_pipeline_mutex);
+        _pipeline_stop = true;
+        _pipeline_mutex_unlock(&_pipeline_mutex);
+#ifdef _WIN32
+        WaitForSingleObject(_pipeline_thread, INFINITE);
+        CloseHandle(_pipeline_thread);
+#else
+        pthread_join(_pipeline_thread, NULL);
+#endif
+        _pipeline_mutex_destroy(&_pipeline_mutex);
+        _pipeline_thread_started = false;
+    }
+    free(_pipeline_entries);
+    _pipeline_entries = NULL;
+    _pipeline_count = 0;
+    _pipeline_capacity = 0;
+    _pipeline_archive_status = NULL;
+}
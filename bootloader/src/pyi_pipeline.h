@@ -0,0 +1,58 @@
+/*
+ * ****************************************************************************
+ * Copyright (c) 2013-2022, PyInstaller Development Team.
+ *
+ * Distributed under the terms of the GNU General Public License (version 2
+ * or later) with exception for distributing the bootloader.
+ *
+ * The full license is in the file COPYING.txt, distributed with this software.
+ *
+ * SPDX-License-Identifier: (GPL-2.0-or-later WITH Bootloader-exception)
+ * ****************************************************************************
+ */
+
+/*
+ * Pipelined extraction in onefile mode (pyi-pipelined-extract).
+ */
+
+#ifndef PYI_PIPELINE_H
+#define PYI_PIPELINE_H
+
+#include "pyi_global.h"
+#include "pyi_archive.h"
+
+/*
+ * Return true if the parent process extracts the deferred entries in the
+ * background while the child process runs.
+ */
+bool pyi_pipeline_is_enabled(const ARCHIVE_STATUS *status);
+
+/*
+ * Add the entry to the ones extracted in the background. The archive
+ * status must be the same for all entries. Returns 0 on success, -1 if
+ * out of memory; the entry is then left to on-demand extraction by the
+ * child process.
+ */
+int pyi_pipeline_add(ARCHIVE_STATUS *status, TOC *ptoc);
+
+/*
+ * Start extracting the added entries in a background thread of the
+ * parent process; called once the child process has been started.
+ */
+void pyi_pipeline_start(void);
+
+/*
+ * Return true if the background extraction is still running. Once it
+ * has finished, the thread is joined and the list of entries released,
+ * as by pyi_pipeline_stop(), so that the TOC can be freed.
+ */
+bool pyi_pipeline_is_running(void);
+
+/*
+ * Stop the background extraction and wait for the thread to finish;
+ * called once the child process has exited, before the temporary
+ * directory is removed.
+ */
+void pyi_pipeline_stop(void);
+
+#endif  /* PYI_PIPELINE_H */
@@ -0,0 +1,264 @@
+/*
+ * ****************************************************************************
+ * Copyright (c) 2013-2022, PyInstaller Development Team.
+ *
+ * Distributed under the terms of the GNU General Public License (version 2
+ * or later) with exception for distributing the bootloader.
+ *
+ * The full license is in the file COPYING.txt, distributed with this software.
+ *
+ * SPDX-License-Identifier: (GPL-2.0-or-later WITH Bootloader-exception)
+ * ****************************************************************************
+ */
+
+/*
+ * Loading of the bundled shared libraries without a library search path.
+ *
+ * On Linux, the bootloader of a onedir program normally sets
+ * LD_LIBRARY_PATH to the directory of the program, and restarts itself
+ * with exec() for the dynamic linker to pick it up. When the
+ * pyi-onedir-no-restart runtime option is set, the program runs in the
+ * first process instead. The bundled shared libraries are then found by
+ * loading them ahead of the libraries that need them: before the Python
+ * library and the extension modules are loaded, the DT_NEEDED entries of
+ * their dynamic sections are read, and the dependencies found in the
+ * program directory are loaded by their full path, dependencies first.
+ * The dynamic linker then uses the already loaded libraries, which it
+ * matches by their soname, instead of searching for them.
+ *
+ * The extension modules are handled by the import machinery
+ * (pyimod03_importers), through sys._pyi_preload_deps(). Shared libraries
+ * that are loaded with dlopen() by name from native code, without their
+ * full path, are not found in the program directory.
+ */
+
+#include <stdint.h>  /* UINTPTR_MAX */
+#include <stdlib.h>
+#include <string.h>
+#ifdef __linux__
+    #include <dlfcn.h>
+    #include <fcntl.h>
+    #include <link.h>  /* ElfW */
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+/* PyInstaller headers */
+#include "pyi_global.h"
+#include "pyi_archive.h"
+#include "pyi_path.h"
+#include "pyi_preload.h"
+#include "pyi_python.h"
+
+#ifdef __linux__
+    #if UINTPTR_MAX > 0xffffffff
+        #define _PYI_PRELOAD_ELFCLASS ELFCLASS64
+    #else
+        #define _PYI_PRELOAD_ELFCLASS ELFCLASS32
+    #endif
+#endif
+
+/* Maximal depth of the dependency chains that are followed; also ends
+ * (rare) dependency cycles. */
+#define _PYI_PRELOAD_MAX_DEPTH 8
+
+bool
+pyi_preload_is_enabled(const ARCHIVE_STATUS *status)
+{
+#ifdef __linux__
+    return pyi_arch_get_option(status, "pyi-onedir-no-restart") != NULL;
+#else
+    (void)status;
+    return false;
+#endif
+}
+
+#ifdef __linux__
+
+/*
+ * Translate a virtual address of the ELF file to its file offset, using
+ * the PT_LOAD segments. Returns 0 if the address is not within the file.
+ */
+static size_t
+_pyi_preload_vaddr_to_offset(const ElfW(Phdr) *phdrs, size_t phnum, ElfW(Addr) vaddr)
+{
+    size_t i;
+
+    for (i = 0; i < phnum; i++) {
+        if (phdrs[i].p_type == PT_LOAD && vaddr >= phdrs[i].p_vaddr &&
+            vaddr - phdrs[i].p_vaddr < phdrs[i].p_filesz) {
+            return (size_t)(vaddr - phdrs[i].p_vaddr + phdrs[i].p_offset);
+        }
+    }
+    return 0;
+}
+
+static void _pyi_preload_deps(const char *path, const char *libdir, int depth);
+
+/*
+ * Load the dependency with the given (DT_NEEDED) name, if it is bundled
+ * and not loaded yet, after its own bundled dependencies.
+ */
+static void
+_pyi_preload_dep(const char *name, const char *libdir, int depth)
+{
+    char dep_path[PATH_MAX];
+    void *handle;
+
+    if (strchr(name, '/') != NULL) {
+        return;
+    }
+    /* Already loaded (e.g., by an earlier extension module, or as a
+     * dependency of the bootloader)? */
+    handle = dlopen(name, RTLD_LAZY | RTLD_NOLOAD);
+    if (handle != NULL) {
+        dlclose(handle);
+        return;
+    }
+    if (pyi_path_join(dep_path, libdir, name) == NULL || !pyi_path_exists(dep_path)) {
+        return;
+    }
+    if (depth < _PYI_PRELOAD_MAX_DEPTH) {
+        _pyi_preload_deps(dep_path, libdir, depth + 1);
+    }
+    /* The handle is intentionally kept for the lifetime of the process */
+    if (dlopen(dep_path, RTLD_NOW | RTLD_GLOBAL) == NULL) {
+        VS("LOADER: Could not preload %s: %s\n", dep_path, dlerror());
+    } else {
+        VS("LOADER: Preloaded %s\n", dep_path);
+    }
+}
+
+static void
+_pyi_preload_deps(const char *path, const char *libdir, int depth)
+{
+    const unsigned char *data;
+    const ElfW(Ehdr) *ehdr;
+    const ElfW(Phdr) *phdrs;
+    const ElfW(Dyn) *dyn = NULL;
+    size_t dyn_count = 0;
+    size_t strtab_offset = 0;
+    size_t strtab_size = 0;
+    size_t size;
+    size_t i;
+    struct stat st;
+    int fd;
+
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return;
+    }
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(ElfW(Ehdr))) {
+        close(fd);
+        return;
+    }
+    size = (size_t)st.st_size;
+    data = (const unsigned char *)mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        return;
+    }
+
+    /* Only the libraries of the same class as the bootloader can be
+     * loaded into it. */
+    ehdr = (const ElfW(Ehdr) *)data;
+    if (memcmp(ehdr->e_ident, ELFMAG, SELFMAG) != 0 || ehdr->e_ident[EI_CLASS] != _PYI_PRELOAD_ELFCLASS ||
+        ehdr->e_phentsize != sizeof(ElfW(Phdr)) || ehdr->e_phoff > size ||
+        ehdr->e_phnum > (size - ehdr->e_phoff) / sizeof(ElfW(Phdr))) {
+        goto cleanup;
+    }
+    phdrs = (const ElfW(Phdr) *)(data + ehdr->e_phoff);
+    for (i = 0; i < ehdr->e_phnum; i++) {
+        if (phdrs[i].p_type == PT_DYNAMIC && phdrs[i].p_offset <= size &&
+            phdrs[i].p_filesz <= size - phdrs[i].p_offset) {
+            dyn = (const ElfW(Dyn) *)(data + phdrs[i].p_offset);
+            dyn_count = phdrs[i].p_filesz / sizeof(ElfW(Dyn));
+            break;
+        }
+    }
+    for (i = 0; i < dyn_count && dyn[i].d_tag != DT_NULL; i++) {
+        if (dyn[i].d_tag == DT_STRTAB) {
+            strtab_offset = _pyi_preload_vaddr_to_offset(phdrs, ehdr->e_phnum, dyn[i].d_un.d_ptr);
+        } else if (dyn[i].d_tag == DT_STRSZ) {
+            strtab_size = (size_t)dyn[i].d_un.d_val;
+        }
+    }
+    if (strtab_offset == 0 || strtab_offset > size || strtab_size > size - strtab_offset) {
+        goto cleanup;
+    }
+
+    for (i = 0; i < dyn_count && dyn[i].d_tag != DT_NULL; i++) {
+        const char *name;
+
+        if (dyn[i].d_tag != DT_NEEDED || dyn[i].d_un.d_val >= strtab_size) {
+            continue;
+        }
+        name = (const char *)data + strtab_offset + dyn[i].d_un.d_val;
+        if (memchr(name, 0, strtab_size - dyn[i].d_un.d_val) == NULL) {
+            continue;
+        }
+        _pyi_preload_dep(name, libdir, depth);
+    }
+
+cleanup:
+    munmap((void *)data, size);
+}
+
+#endif  /* __linux__ */
+
+void
+pyi_preload_deps(const char *path, const char *libdir)
+{
+#ifdef __linux__
+    _pyi_preload_deps(path, libdir, 0);
+#else
+    (void)path;
+    (void)libdir;
+#endif
+}
+
+/* Directory of the program; set by pyi_preload_install(). */
+static const char *_preload_libdir = NULL;
+
+/*
+ * sys._pyi_preload_deps(path); the bundled dependencies are looked up
+ * in sys._MEIPASS.
+ */
+static PyObject *
+_pyi_preload_deps_func(PyObject *self, PyObject *arg)
+{
+    const char *path;
+
+    (void)self;
+    path = PI_PyUnicode_AsUTF8(arg);
+    if (path == NULL) {
+        return NULL;
+    }
+    pyi_preload_deps(path, _preload_libdir);
+    return PI_Py_BuildValue("");
+}
+
+static PyMethodDef _pyi_preload_deps_method = {
+    "_pyi_preload_deps", _pyi_preload_deps_func, METH_O, NULL
+};
+
+int
+pyi_preload_install(ARCHIVE_STATUS *status)
+{
+    PyObject *func;
+
+    if (status->has_temp_directory || !pyi_preload_is_enabled(status)) {
+        return 0;
+    }
+    _preload_libdir = status->mainpath;
+
+    func = PI_PyCFunction_NewEx(&_pyi_preload_deps_method, NULL, NULL);
+    if (func == NULL) {
+        FATALERROR("Failed to set up loading of bundled libraries.\n");
+        return -1;
+    }
+    PI_PySys_SetObject("_pyi_preload_deps", func);
+    PI_Py_DecRef(func);
+    return 0;
+}
@@ -0,0 +1,48 @@
+/*
+ * ****************************************************************************
+ * Copyright (c) 2013-2022, PyInstaller Development Team.
+ *
+ * Distributed under the terms of the GNU General Public License (version 2
+ * or later) with exception for distributing the bootloader.
+ *
+ * The full license is in the file COPYING.txt, distributed with this software.
+ *
+ * SPDX-License-Identifier: (GPL-2.0-or-later WITH Bootloader-exception)
+ * ****************************************************************************
+ */
+
+/*
+ * Loading of the bundled shared libraries without a library search path
+ * (pyi-onedir-no-restart).
+ */
+
+#ifndef PYI_PRELOAD_H
+#define PYI_PRELOAD_H
+
+#include "pyi_global.h"
+#include "pyi_archive.h"
+
+/*
+ * Return true if the onedir program is run without restarting the
+ * bootloader, i.e., without setting LD_LIBRARY_PATH. Only supported on
+ * Linux.
+ */
+bool pyi_preload_is_enabled(const ARCHIVE_STATUS *status);
+
+/*
+ * Load the bundled shared libraries (in libdir) that the shared library or
+ * extension module at the given path depends on, directly or indirectly,
+ * by their full path, so that the dynamic linker uses them instead of
+ * searching for them. Errors are not fatal; the dependencies that cannot
+ * be loaded are left to the dynamic linker.
+ */
+void pyi_preload_deps(const char *path, const char *libdir);
+
+/*
+ * Expose pyi_preload_deps() to Python, as sys._pyi_preload_deps(). Does
+ * nothing if not enabled, or in onefile mode. Must be called after
+ * Py_Initialize(). Returns 0 on success, -1 on error.
+ */
+int pyi_preload_install(ARCHIVE_STATUS *status);
+
+#endif  /* PYI_PRELOAD_H */
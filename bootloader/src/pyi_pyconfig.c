@@ -0,0 +1,497 @@
+/*
+ * ****************************************************************************
+ * Copyright (c) 2013-2022, PyInstaller Development Team.
+ *
+ * Distributed under the terms of the GNU General Public License (version 2
+ * or later) with exception for distributing the bootloader.
+ *
+ * The full license is in the file COPYING.txt, distributed with this software.
+ *
+ * SPDX-License-Identifier: (GPL-2.0-or-later WITH Bootloader-exception)
+ * ****************************************************************************
+ */
+
+/*
+ * PEP 587 initialization of the Python interpreter.
+ *
+ * With Python >= 3.8, the interpreter is initialized in one step from a
+ * PyConfig structure that holds the final configuration: the program
+ * name, home, executable and module search path are all given, so Python
+ * does not compute its path configuration, and does not replace sys.path
+ * afterwards; sys.argv is set by the initialization as well.
+ *
+ * As the bootloader does not include Python.h (see pyi_python.h), the
+ * layout of PyConfig is defined below for each supported version of
+ * Python, as in Include/cpython/initconfig.h of that version. The fields
+ * are accessed through the structure of the version of the loaded Python
+ * library. With other versions, the bootloader falls back to the legacy
+ * initialization (Py_SetPath(), Py_Initialize()).
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+/* PyInstaller headers */
+#include "pyi_global.h"
+#include "pyi_archive.h"
+#include "pyi_pyconfig.h"
+#include "pyi_python.h"
+
+/*
+ * PyConfig structures of the supported Python versions.
+ */
+
+/* Python 3.8 */
+typedef struct _pyconfig_v38 {
+    int _config_init;
+    int isolated;
+    int use_environment;
+    int dev_mode;
+    int install_signal_handlers;
+    int use_hash_seed;
+    unsigned long hash_seed;
+    int faulthandler;
+    int tracemalloc;
+    int import_time;
+    int show_ref_count;
+    int show_alloc_count;
+    int dump_refs;
+    int malloc_stats;
+    wchar_t *filesystem_encoding;
+    wchar_t *filesystem_errors;
+    wchar_t *pycache_prefix;
+    int parse_argv;
+    PyWideStringList argv;
+    wchar_t *program_name;
+    PyWideStringList xoptions;
+    PyWideStringList warnoptions;
+    int site_import;
+    int bytes_warning;
+    int inspect;
+    int interactive;
+    int optimization_level;
+    int parser_debug;
+    int write_bytecode;
+    int verbose;
+    int quiet;
+    int user_site_directory;
+    int configure_c_stdio;
+    int buffered_stdio;
+    wchar_t *stdio_encoding;
+    wchar_t *stdio_errors;
+#ifdef _WIN32
+    int legacy_windows_stdio;
+#endif
+    wchar_t *check_hash_pycs_mode;
+    int pathconfig_warnings;
+    wchar_t *pythonpath_env;
+    wchar_t *home;
+    int module_search_paths_set;
+    PyWideStringList module_search_paths;
+    wchar_t *executable;
+    wchar_t *base_executable;
+    wchar_t *prefix;
+    wchar_t *base_prefix;
+    wchar_t *exec_prefix;
+    wchar_t *base_exec_prefix;
+    int skip_source_first_line;
+    wchar_t *run_command;
+    wchar_t *run_module;
+    wchar_t *run_filename;
+    int _install_importlib;
+    int _init_main;
+} PyConfig_v38;
+
+/* Python 3.9 */
+typedef struct _pyconfig_v39 {
+    int _config_init;
+    int isolated;
+    int use_environment;
+    int dev_mode;
+    int install_signal_handlers;
+    int use_hash_seed;
+    unsigned long hash_seed;
+    int faulthandler;
+    int _use_peg_parser;
+    int tracemalloc;
+    int import_time;
+    int show_ref_count;
+    int dump_refs;
+    int malloc_stats;
+    wchar_t *filesystem_encoding;
+    wchar_t *filesystem_errors;
+    wchar_t *pycache_prefix;
+    int parse_argv;
+    PyWideStringList argv;
+    wchar_t *program_name;
+    PyWideStringList xoptions;
+    PyWideStringList warnoptions;
+    int site_import;
+    int bytes_warning;
+    int inspect;
+    int interactive;
+    int optimization_level;
+    int parser_debug;
+    int write_bytecode;
+    int verbose;
+    int quiet;
+    int user_site_directory;
+    int configure_c_stdio;
+    int buffered_stdio;
+    wchar_t *stdio_encoding;
+    wchar_t *stdio_errors;
+#ifdef _WIN32
+    int legacy_windows_stdio;
+#endif
+    wchar_t *check_hash_pycs_mode;
+    int pathconfig_warnings;
+    wchar_t *pythonpath_env;
+    wchar_t *home;
+    int module_search_paths_set;
+    PyWideStringList module_search_paths;
+    wchar_t *executable;
+    wchar_t *base_executable;
+    wchar_t *prefix;
+    wchar_t *base_prefix;
+    wchar_t *exec_prefix;
+    wchar_t *base_exec_prefix;
+    wchar_t *platlibdir;
+    int skip_source_first_line;
+    wchar_t *run_command;
+    wchar_t *run_module;
+    wchar_t *run_filename;
+    int _install_importlib;
+    int _init_main;
+    int _isolated_interpreter;
+    PyWideStringList _orig_argv;
+} PyConfig_v39;
+
+/* Python 3.10 */
+typedef struct _pyconfig_v310 {
+    int _config_init;
+    int isolated;
+    int use_environment;
+    int dev_mode;
+    int install_signal_handlers;
+    int use_hash_seed;
+    unsigned long hash_seed;
+    int faulthandler;
+    int tracemalloc;
+    int import_time;
+    int show_ref_count;
+    int dump_refs;
+    int malloc_stats;
+    wchar_t *filesystem_encoding;
+    wchar_t *filesystem_errors;
+    wchar_t *pycache_prefix;
+    int parse_argv;
+    PyWideStringList orig_argv;
+    PyWideStringList argv;
+    PyWideStringList xoptions;
+    PyWideStringList warnoptions;
+    int site_import;
+    int bytes_warning;
+    int warn_default_encoding;
+    int inspect;
+    int interactive;
+    int optimization_level;
+    int parser_debug;
+    int write_bytecode;
+    int verbose;
+    int quiet;
+    int user_site_directory;
+    int configure_c_stdio;
+    int buffered_stdio;
+    wchar_t *stdio_encoding;
+    wchar_t *stdio_errors;
+#ifdef _WIN32
+    int legacy_windows_stdio;
+#endif
+    wchar_t *check_hash_pycs_mode;
+    int pathconfig_warnings;
+    wchar_t *program_name;
+    wchar_t *pythonpath_env;
+    wchar_t *home;
+    wchar_t *platlibdir;
+    int module_search_paths_set;
+    PyWideStringList module_search_paths;
+    wchar_t *executable;
+    wchar_t *base_executable;
+    wchar_t *prefix;
+    wchar_t *base_prefix;
+    wchar_t *exec_prefix;
+    wchar_t *base_exec_prefix;
+    int skip_source_first_line;
+    wchar_t *run_command;
+    wchar_t *run_module;
+    wchar_t *run_filename;
+    int _install_importlib;
+    int _init_main;
+    int _isolated_interpreter;
+} PyConfig_v310;
+
+/* Python 3.11 */
+typedef struct _pyconfig_v311 {
+    int _config_init;
+    int isolated;
+    int use_environment;
+    int dev_mode;
+    int install_signal_handlers;
+    int use_hash_seed;
+    unsigned long hash_seed;
+    int faulthandler;
+    int tracemalloc;
+    int import_time;
+    int code_debug_ranges;
+    int show_ref_count;
+    int dump_refs;
+    wchar_t *dump_refs_file;
+    int malloc_stats;
+    wchar_t *filesystem_encoding;
+    wchar_t *filesystem_errors;
+    wchar_t *pycache_prefix;
+    int parse_argv;
+    PyWideStringList orig_argv;
+    PyWideStringList argv;
+    PyWideStringList xoptions;
+    PyWideStringList warnoptions;
+    int site_import;
+    int bytes_warning;
+    int warn_default_encoding;
+    int inspect;
+    int interactive;
+    int optimization_level;
+    int parser_debug;
+    int write_bytecode;
+    int verbose;
+    int quiet;
+    int user_site_directory;
+    int configure_c_stdio;
+    int buffered_stdio;
+    wchar_t *stdio_encoding;
+    wchar_t *stdio_errors;
+#ifdef _WIN32
+    int legacy_windows_stdio;
+#endif
+    wchar_t *check_hash_pycs_mode;
+    int use_frozen_modules;
+    int safe_path;
+    int pathconfig_warnings;
+    wchar_t *program_name;
+    wchar_t *pythonpath_env;
+    wchar_t *home;
+    wchar_t *platlibdir;
+    int module_search_paths_set;
+    PyWideStringList module_search_paths;
+    wchar_t *stdlib_dir;
+    wchar_t *executable;
+    wchar_t *base_executable;
+    wchar_t *prefix;
+    wchar_t *base_prefix;
+    wchar_t *exec_prefix;
+    wchar_t *base_exec_prefix;
+    int skip_source_first_line;
+    wchar_t *run_command;
+    wchar_t *run_module;
+    wchar_t *run_filename;
+    int _install_importlib;
+    int _init_main;
+    int _isolated_interpreter;
+    int _is_python_build;
+} PyConfig_v311;
+
+/* Large enough for the PyConfig of any supported version */
+typedef union _pyconfig_storage {
+    PyConfig_v38 v38;
+    PyConfig_v39 v39;
+    PyConfig_v310 v310;
+    PyConfig_v311 v311;
+} PYCONFIG_STORAGE;
+
+/* Address of the given field of the PyConfig of the loaded Python version. */
+#define _PYI_PYCONFIG_FIELD(config, type, field) \
+    ((pyvers == 308) ? (type *)&((PyConfig_v38 *)(config))->field : \
+     (pyvers == 309) ? (type *)&((PyConfig_v39 *)(config))->field : \
+     (pyvers == 310) ? (type *)&((PyConfig_v310 *)(config))->field : \
+     (type *)&((PyConfig_v311 *)(config))->field)
+
+#define _PYI_PYCONFIG_INT(config, field) (*_PYI_PYCONFIG_FIELD(config, int, field))
+
+/*
+ * Report a failed PyConfig function. Returns true if the status is an
+ * error (or an exit request).
+ */
+static bool
+_pyi_pyconfig_failed(PyStatus status, const char *what)
+{
+    if (!PI_PyStatus_Exception(status)) {
+        return false;
+    }
+    if (status._type == _PyStatus_TYPE_EXIT) {
+        FATALERROR("Failed to %s: exit code %d\n", what, status.exitcode);
+    } else {
+        FATALERROR("Failed to %s: %s%s%s\n", what, status.func ? status.func : "",
+                   status.func ? ": " : "", status.err_msg ? status.err_msg : "unknown error");
+    }
+    return true;
+}
+
+bool
+pyi_pyconfig_is_supported(void)
+{
+    return pyvers >= 308 && pyvers <= 311 && PI_PyPreConfig_InitIsolatedConfig && PI_Py_PreInitialize &&
+           PI_PyConfig_InitIsolatedConfig && PI_PyConfig_Clear && PI_PyConfig_SetString && PI_PyConfig_SetArgv &&
+           PI_PyWideStringList_Append && PI_PyStatus_Exception && PI_Py_InitializeFromConfig;
+}
+
+int
+pyi_pyconfig_preinitialize(int utf8_mode)
+{
+    PyPreConfig preconfig;
+
+    PI_PyPreConfig_InitIsolatedConfig(&preconfig);
+    /* As with Py_Initialize(): the environment variables are ignored, the
+     * sys.flags are not those of an isolated interpreter (-I), and Python
+     * sets LC_CTYPE to the user's preferred locale. */
+    preconfig.isolated = 0;
+    preconfig.configure_locale = 1;
+    preconfig.utf8_mode = utf8_mode;
+    if (_pyi_pyconfig_failed(PI_Py_PreInitialize(&preconfig), "pre-initialize Python")) {
+        return -1;
+    }
+    return 0;
+}
+
+PyConfig *
+pyi_pyconfig_create(void)
+{
+    PyConfig *config;
+
+    /* Zeroed, so that any version-specific padding is deterministic */
+    config = (PyConfig *)calloc(1, sizeof(PYCONFIG_STORAGE));
+    if (config == NULL) {
+        FATALERROR("Failed to allocate PyConfig structure.\n");
+        return NULL;
+    }
+    PI_PyConfig_InitIsolatedConfig(config);
+    return config;
+}
+
+int
+pyi_pyconfig_set_paths(PyConfig *config, const wchar_t *program_name, const wchar_t *home,
+                       const wchar_t **search_paths, int num_search_paths)
+{
+    PyWideStringList *module_search_paths;
+    int i;
+
+    if (_pyi_pyconfig_failed(PI_PyConfig_SetString(config, _PYI_PYCONFIG_FIELD(config, wchar_t *, program_name),
+                                                   program_name), "set program name") ||
+        _pyi_pyconfig_failed(PI_PyConfig_SetString(config, _PYI_PYCONFIG_FIELD(config, wchar_t *, executable),
+                                                   program_name), "set sys.executable") ||
+        _pyi_pyconfig_failed(PI_PyConfig_SetString(config, _PYI_PYCONFIG_FIELD(config, wchar_t *, home), home),
+                             "set Python home") ||
+        _pyi_pyconfig_failed(PI_PyConfig_SetString(config, _PYI_PYCONFIG_FIELD(config, wchar_t *, prefix), home),
+                             "set sys.prefix") ||
+        _pyi_pyconfig_failed(PI_PyConfig_SetString(config, _PYI_PYCONFIG_FIELD(config, wchar_t *, exec_prefix),
+                                                   home), "set sys.exec_prefix")) {
+        return -1;
+    }
+
+    /* With the module search path set explicitly, Python uses it as is for
+     * sys.path. */
+    module_search_paths = _PYI_PYCONFIG_FIELD(config, PyWideStringList, module_search_paths);
+    for (i = 0; i < num_search_paths; i++) {
+        if (_pyi_pyconfig_failed(PI_PyWideStringList_Append(module_search_paths, search_paths[i]),
+                                 "set sys.path")) {
+            return -1;
+        }
+    }
+    _PYI_PYCONFIG_INT(config, module_search_paths_set) = 1;
+    return 0;
+}
+
+int
+pyi_pyconfig_set_argv(PyConfig *config, int argc, wchar_t **argv)
+{
+    _PYI_PYCONFIG_INT(config, parse_argv) = 0;
+    if (_pyi_pyconfig_failed(PI_PyConfig_SetArgv(config, (size_t)argc, argv), "set sys.argv")) {
+        return -1;
+    }
+    return 0;
+}
+
+int
+pyi_pyconfig_set_runtime_options(PyConfig *config, ARCHIVE_STATUS *status, int *unbuffered)
+{
+    PyWideStringList *warnoptions;
+    wchar_t wchar_tmp[PATH_MAX + 1];
+    TOC **options;
+    TOC *ptoc;
+    size_t count;
+    size_t i;
+
+    /* The same options as with the legacy flags; see
+     * pyi_pylib_set_runtime_opts() */
+    _PYI_PYCONFIG_INT(config, isolated) = 0;
+    _PYI_PYCONFIG_INT(config, use_environment) = 0;
+    _PYI_PYCONFIG_INT(config, site_import) = 0;
+    _PYI_PYCONFIG_INT(config, user_site_directory) = 0;
+    _PYI_PYCONFIG_INT(config, write_bytecode) = 0;
+    _PYI_PYCONFIG_INT(config, pathconfig_warnings) = 0;
+    _PYI_PYCONFIG_INT(config, verbose) = 0;
+    /* Handle SIGINT (KeyboardInterrupt), as Py_Initialize() does */
+    _PYI_PYCONFIG_INT(config, install_signal_handlers) = 1;
+
+    *unbuffered = 0;
+    warnoptions = _PYI_PYCONFIG_FIELD(config, PyWideStringList, warnoptions);
+    options = pyi_arch_get_entries(status, ARCHIVE_CLASS_RUNTIME_OPTION, &count);
+    for (i = 0; i < count; i++) {
+        ptoc = options[i];
+        if (0 == strncmp(ptoc->name, "pyi-", 4)) {
+            continue;
+        }
+        VS("LOADER: Runtime option: %s\n", ptoc->name);
+
+        switch (ptoc->name[0]) {
+        case 'v':
+            _PYI_PYCONFIG_INT(config, verbose) = 1;
+            break;
+        case 'u':
+            *unbuffered = 1;
+            _PYI_PYCONFIG_INT(config, buffered_stdio) = 0;
+            break;
+        case 'W':
+            if ((size_t)-1 == mbstowcs(wchar_tmp, &ptoc->name[2], PATH_MAX)) {
+                FATALERROR("Failed to convert Wflag %s using mbstowcs "
+                           "(invalid multibyte string)\n", &ptoc->name[2]);
+                return -1;
+            }
+            if (_pyi_pyconfig_failed(PI_PyWideStringList_Append(warnoptions, wchar_tmp), "set warning options")) {
+                return -1;
+            }
+            break;
+        case 'O':
+            _PYI_PYCONFIG_INT(config, optimization_level) = 1;
+            break;
+        }
+    }
+    return 0;
+}
+
+int
+pyi_pyconfig_initialize(const PyConfig *config)
+{
+    if (_pyi_pyconfig_failed(PI_Py_InitializeFromConfig(config), "initialize Python")) {
+        return -1;
+    }
+    return 0;
+}
+
+void
+pyi_pyconfig_free(PyConfig *config)
+{
+    if (config != NULL) {
+        PI_PyConfig_Clear(config);
+        free(config);
+    }
+}
@@ -0,0 +1,81 @@
+/*
+ * ****************************************************************************
+ * Copyright (c) 2013-2022, PyInstaller Development Team.
+ *
+ * Distributed under the terms of the GNU General Public License (version 2
+ * or later) with exception for distributing the bootloader.
+ *
+ * The full license is in the file COPYING.txt, distributed with this software.
+ *
+ * SPDX-License-Identifier: (GPL-2.0-or-later WITH Bootloader-exception)
+ * ****************************************************************************
+ */
+
+/*
+ * PEP 587 initialization of the Python interpreter (PyConfig).
+ */
+
+#ifndef PYI_PYCONFIG_H
+#define PYI_PYCONFIG_H
+
+#include "pyi_global.h"
+#include "pyi_archive.h"
+#include "pyi_python.h"
+
+/*
+ * Whether the interpreter of the loaded Python library can be initialized
+ * through PyConfig, i.e., its version is known and it exports the PEP 587
+ * functions.
+ */
+bool pyi_pyconfig_is_supported(void);
+
+/*
+ * Pre-initialize Python with the isolated configuration, the locale
+ * configured by Python, and the UTF-8 mode enabled or disabled. Must be
+ * called before any string is decoded with Py_DecodeLocale(). Returns 0
+ * on success, -1 on error.
+ */
+int pyi_pyconfig_preinitialize(int utf8_mode);
+
+/*
+ * Allocate a new configuration, initialized to the isolated
+ * configuration. Returns NULL on error.
+ */
+PyConfig *pyi_pyconfig_create(void);
+
+/*
+ * Set the program name, sys.prefix and sys.exec_prefix (home),
+ * sys.executable, and the complete module search path (sys.path), so that
+ * Python does not need to compute any of them. Returns 0 on success, -1 on
+ * error.
+ */
+int pyi_pyconfig_set_paths(PyConfig *config, const wchar_t *program_name, const wchar_t *home,
+                           const wchar_t **search_paths, int num_search_paths);
+
+/*
+ * Set sys.argv; the arguments are not parsed. Returns 0 on success, -1 on
+ * error.
+ */
+int pyi_pyconfig_set_argv(PyConfig *config, int argc, wchar_t **argv);
+
+/*
+ * Apply the fixed runtime options of frozen programs, and the Python
+ * runtime options (v, u, W, O) stored in the archive. Sets *unbuffered if
+ * the standard streams must be unbuffered. Returns 0 on success, -1 on
+ * error.
+ */
+int pyi_pyconfig_set_runtime_options(PyConfig *config, ARCHIVE_STATUS *status, int *unbuffered);
+
+/*
+ * Initialize Python from the configuration. Returns 0 on success, -1 on
+ * error.
+ */
+int pyi_pyconfig_initialize(const PyConfig *config);
+
+/*
+ * Free the configuration; may be called right after
+ * pyi_pyconfig_initialize(), as Python copies it.
+ */
+void pyi_pyconfig_free(PyConfig *config);
+
+#endif  /* PYI_PYCONFIG_H */
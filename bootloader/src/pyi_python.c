@@ -27,6 +27,20 @@
 #include "pyi_global.h"
 #include "pyi_python.h"
 
+#ifdef PYI_STATIC_PYTHON
+/* The entry points are resolved by the linker (see pyi_python.h). */
+    #undef DECLPROC
+    #undef DECLVAR
+    #undef GETPROCOPT
+    #undef GETPROC
+    #undef GETVAR
+    #define DECLPROC(name)
+    #define DECLVAR(name)
+    #define GETPROCOPT(dll, name, sym)
+    #define GETPROC(dll, name)
+    #define GETVAR(dll, name)
+#endif
+
 /*
  * Python Entry point declarations (see macros in pyi_python.h).
  */
@@ -41,6 +55,8 @@ DECLVAR(Py_OptimizeFlag);
 DECLVAR(Py_VerboseFlag);
 DECLVAR(Py_UnbufferedStdioFlag);
 DECLVAR(Py_UTF8Mode);
+DECLVAR(PyExc_ImportError);
+DECLVAR(PyImport_FrozenModules);
 
 /* functions with prefix `Py_` */
 DECLPROC(Py_BuildValue);
@@ -90,10 +106,40 @@ DECLPROC(PyUnicode_Decode);
 DECLPROC(PyUnicode_AsUTF8);
 DECLPROC(PyUnicode_Join);
 DECLPROC(PyUnicode_Replace);
+DECLPROC(PyCFunction_NewEx);
+
+DECLPROC(PyArg_Parse);
+DECLPROC(PyBytes_FromStringAndSize);
+DECLPROC(PyDict_GetItem);
+DECLPROC(PyErr_Format);
+DECLPROC(PyErr_NoMemory);
+DECLPROC(PyMemoryView_FromMemory);
+
+DECLPROC(PyBytes_AsString);
+DECLPROC(PyEval_SaveThread);
+DECLPROC(PyEval_RestoreThread);
+DECLVAR(PyExc_OSError);
+DECLVAR(PyExc_ValueError);
 
 DECLPROC(PyEval_EvalCode);
 DECLPROC(PyMarshal_ReadObjectFromString);
 
+DECLPROC(PyPreConfig_InitIsolatedConfig);
+DECLPROC(Py_PreInitialize);
+DECLPROC(PyConfig_InitIsolatedConfig);
+DECLPROC(PyConfig_Clear);
+DECLPROC(PyConfig_SetString);
+DECLPROC(PyConfig_SetArgv);
+DECLPROC(PyWideStringList_Append);
+DECLPROC(PyStatus_Exception);
+DECLPROC(Py_InitializeFromConfig);
+
+#ifndef _WIN32
+DECLPROC(PyOS_BeforeFork);
+DECLPROC(PyOS_AfterFork_Parent);
+DECLPROC(PyOS_AfterFork_Child);
+#endif
+
 /*
  * Get all of the entry points from libpython
  * that we are interested in.
@@ -168,6 +214,42 @@ pyi_python_map_names(HMODULE dll, int pyvers)
     GETPROC(dll, PyUnicode_AsUTF8);
     GETPROC(dll, PyUnicode_Join);
     GETPROC(dll, PyUnicode_Replace);
+    GETPROC(dll, PyCFunction_NewEx);
+
+    GETVAR(dll, PyExc_ImportError);
+    GETVAR(dll, PyImport_FrozenModules);
+    GETPROC(dll, PyArg_Parse);
+    GETPROC(dll, PyBytes_FromStringAndSize);
+    GETPROC(dll, PyDict_GetItem);
+    GETPROC(dll, PyErr_Format);
+    GETPROC(dll, PyErr_NoMemory);
+    GETPROC(dll, PyMemoryView_FromMemory);
+
+    GETPROC(dll, PyBytes_AsString);
+    GETPROC(dll, PyEval_SaveThread);
+    GETPROC(dll, PyEval_RestoreThread);
+    GETVAR(dll, PyExc_OSError);
+    GETVAR(dll, PyExc_ValueError);
+
+    /* PEP 587 initialization; pyi_pyconfig_is_supported() falls back to
+     * the legacy initialization if any of them is missing. */
+    if (pyvers >= 308) {
+        GETPROCOPT(dll, PyPreConfig_InitIsolatedConfig, PyPreConfig_InitIsolatedConfig);
+        GETPROCOPT(dll, Py_PreInitialize, Py_PreInitialize);
+        GETPROCOPT(dll, PyConfig_InitIsolatedConfig, PyConfig_InitIsolatedConfig);
+        GETPROCOPT(dll, PyConfig_Clear, PyConfig_Clear);
+        GETPROCOPT(dll, PyConfig_SetString, PyConfig_SetString);
+        GETPROCOPT(dll, PyConfig_SetArgv, PyConfig_SetArgv);
+        GETPROCOPT(dll, PyWideStringList_Append, PyWideStringList_Append);
+        GETPROCOPT(dll, PyStatus_Exception, PyStatus_Exception);
+        GETPROCOPT(dll, Py_InitializeFromConfig, Py_InitializeFromConfig);
+    }
+
+#ifndef _WIN32
+    GETPROC(dll, PyOS_BeforeFork);
+    GETPROC(dll, PyOS_AfterFork_Parent);
+    GETPROC(dll, PyOS_AfterFork_Child);
+#endif
 
     VS("LOADER: Loaded functions from Python library.\n");
 
@@ -46,6 +46,36 @@
  * fully compatible if the Python data structure layouts change.
  */
 
+/*
+ * Declarations of the Python entry points, as PI_ prefixed pointers (see
+ * EXTDECLPROC and EXTDECLVAR in pyi_global.h), which pyi_python_map_names()
+ * looks up in the loaded Python library.
+ *
+ * If the bootloader is linked with a static Python library (waf option
+ * --static-python, which defines PYI_STATIC_PYTHON as the version of that
+ * Python), the entry points are the Python symbols themselves, and the
+ * PI_ names are constant pointers to them, so that calls through them are
+ * compiled to direct calls and nothing needs to be looked up at run time.
+ */
+#ifdef PYI_STATIC_PYTHON
+
+    #define EXTDECLPYPROC(result, name, args) \
+    typedef result (*__PROC__ ## name) args; \
+    extern result name args; \
+    static __PROC__ ## name const PI_ ## name = name;
+
+    #define EXTDECLPYVAR(vartyp, name) \
+    typedef vartyp __VAR__ ## name; \
+    extern __VAR__ ## name name; \
+    static __VAR__ ## name * const PI_ ## name = &name;
+
+#else
+
+    #define EXTDECLPYPROC(result, name, args) EXTDECLPROC(result, name, args)
+    #define EXTDECLPYVAR(vartyp, name) EXTDECLVAR(vartyp, name)
+
+#endif  /* ifdef PYI_STATIC_PYTHON */
+
 /* Forward declarations of opaque Python types. */
 struct _PyObject;
 typedef struct _PyObject PyObject;
@@ -54,92 +84,184 @@ typedef struct _PyThreadState PyThreadState;
 struct _PyCompilerFlags;
 typedef struct _PyCompilerFlags PyCompilerFlags;
 
+/*
+ * Definition of a function implemented in C and callable from Python. The
+ * layout of this structure is part of the stable ABI.
+ */
+typedef PyObject *(*PyCFunction)(PyObject *, PyObject *);
+typedef struct _PyMethodDef {
+    const char *ml_name;
+    PyCFunction ml_meth;
+    int ml_flags;
+    const char *ml_doc;
+} PyMethodDef;
+#define METH_O 0x0008
+
 /* The actual declarations of var & function entry points used. */
 
 /* Flags. */
-EXTDECLVAR(int, Py_FrozenFlag);
-EXTDECLVAR(int, Py_NoSiteFlag);
-EXTDECLVAR(int, Py_OptimizeFlag);
-EXTDECLVAR(const char*, Py_FileSystemDefaultEncoding);
-EXTDECLVAR(int, Py_VerboseFlag);
-EXTDECLVAR(int, Py_IgnoreEnvironmentFlag);
-EXTDECLVAR(int, Py_DontWriteBytecodeFlag);
-EXTDECLVAR(int, Py_NoUserSiteDirectory);
-EXTDECLVAR(int, Py_UnbufferedStdioFlag);
-EXTDECLVAR(int, Py_UTF8Mode);
+EXTDECLPYVAR(int, Py_FrozenFlag);
+EXTDECLPYVAR(int, Py_NoSiteFlag);
+EXTDECLPYVAR(int, Py_OptimizeFlag);
+EXTDECLPYVAR(const char*, Py_FileSystemDefaultEncoding);
+EXTDECLPYVAR(int, Py_VerboseFlag);
+EXTDECLPYVAR(int, Py_IgnoreEnvironmentFlag);
+EXTDECLPYVAR(int, Py_DontWriteBytecodeFlag);
+EXTDECLPYVAR(int, Py_NoUserSiteDirectory);
+EXTDECLPYVAR(int, Py_UnbufferedStdioFlag);
+EXTDECLPYVAR(int, Py_UTF8Mode);
+EXTDECLPYVAR(PyObject *, PyExc_ImportError);
+/* Table of frozen modules; the layout of its entries depends on the Python version */
+EXTDECLPYVAR(const void *, PyImport_FrozenModules);
 
 /* This initializes the table of loaded modules (sys.modules), and creates the fundamental modules builtins, __main__ and sys. It also initializes the module search path (sys.path). It does not set sys.argv; */
-EXTDECLPROC(int, Py_Initialize, (void));
+EXTDECLPYPROC(int, Py_Initialize, (void));
 /* Undo all initializations made by Py_Initialize() and subsequent use of Python/C API functions, and destroy all sub-interpreters. */
-EXTDECLPROC(int, Py_Finalize, (void));
+EXTDECLPYPROC(int, Py_Finalize, (void));
 
-EXTDECLPROC(void, Py_IncRef, (PyObject *));
-EXTDECLPROC(void, Py_DecRef, (PyObject *));
+EXTDECLPYPROC(void, Py_IncRef, (PyObject *));
+EXTDECLPYPROC(void, Py_DecRef, (PyObject *));
 
 /*
  * These functions have to be called before Py_Initialize()
  */
-EXTDECLPROC(void, Py_SetProgramName, (wchar_t *));
-EXTDECLPROC(void, Py_SetPythonHome, (wchar_t *));
-EXTDECLPROC(void, Py_SetPath, (wchar_t *));  /* new in Python 3 */
-EXTDECLPROC(wchar_t *, Py_GetPath, (void));  /* new in Python 3 */
+EXTDECLPYPROC(void, Py_SetProgramName, (wchar_t *));
+EXTDECLPYPROC(void, Py_SetPythonHome, (wchar_t *));
+EXTDECLPYPROC(void, Py_SetPath, (wchar_t *));  /* new in Python 3 */
+EXTDECLPYPROC(wchar_t *, Py_GetPath, (void));  /* new in Python 3 */
 
-EXTDECLPROC(void, PySys_SetPath, (wchar_t *));
-EXTDECLPROC(int, PySys_SetArgvEx, (int, wchar_t **, int));
-EXTDECLPROC(int, PyRun_SimpleStringFlags, (const char *, PyCompilerFlags *));  /* Py3: UTF-8 encoded string */
+EXTDECLPYPROC(void, PySys_SetPath, (wchar_t *));
+EXTDECLPYPROC(int, PySys_SetArgvEx, (int, wchar_t **, int));
+EXTDECLPYPROC(int, PyRun_SimpleStringFlags, (const char *, PyCompilerFlags *));  /* Py3: UTF-8 encoded string */
 
 /* In Python 3 for these the first argument has to be a UTF-8 encoded string: */
-EXTDECLPROC(PyObject *, PyImport_ExecCodeModule, (char *, PyObject *));
-EXTDECLPROC(PyObject *, PyImport_ImportModule, (char *));
-EXTDECLPROC(PyObject *, PyImport_AddModule, (char *));
+EXTDECLPYPROC(PyObject *, PyImport_ExecCodeModule, (char *, PyObject *));
+EXTDECLPYPROC(PyObject *, PyImport_ImportModule, (char *));
+EXTDECLPYPROC(PyObject *, PyImport_AddModule, (char *));
 
-EXTDECLPROC(int, PyObject_SetAttrString, (PyObject *, char *, PyObject *));
-EXTDECLPROC(PyObject *, PyList_New, (int));
-EXTDECLPROC(int, PyList_Append, (PyObject *, PyObject *));
+EXTDECLPYPROC(int, PyObject_SetAttrString, (PyObject *, char *, PyObject *));
+EXTDECLPYPROC(PyObject *, PyList_New, (int));
+EXTDECLPYPROC(int, PyList_Append, (PyObject *, PyObject *));
 /* Create a new value based on a format string similar to those accepted by the PyArg_Parse*() */
-EXTDECLPROC(PyObject *, Py_BuildValue, (char *, ...));
+EXTDECLPYPROC(PyObject *, Py_BuildValue, (char *, ...));
 /* Create a Unicode object from the char buffer. The bytes will be interpreted as being UTF-8 encoded. */
-EXTDECLPROC(PyObject *, PyUnicode_FromString, (const char *));
-EXTDECLPROC(PyObject *, PyObject_CallFunction, (PyObject *, char *, ...));
-EXTDECLPROC(PyObject *, PyObject_CallFunctionObjArgs, (PyObject *, ...));
-EXTDECLPROC(PyObject *, PyModule_GetDict, (PyObject *));
-EXTDECLPROC(PyObject *, PyDict_GetItemString, (PyObject *, char *));
-EXTDECLPROC(void, PyErr_Clear, (void) );
-EXTDECLPROC(PyObject *, PyErr_Occurred, (void) );
-EXTDECLPROC(void, PyErr_Print, (void) );
-EXTDECLPROC(void, PySys_AddWarnOption, (wchar_t *));
+EXTDECLPYPROC(PyObject *, PyUnicode_FromString, (const char *));
+EXTDECLPYPROC(PyObject *, PyObject_CallFunction, (PyObject *, char *, ...));
+EXTDECLPYPROC(PyObject *, PyObject_CallFunctionObjArgs, (PyObject *, ...));
+EXTDECLPYPROC(PyObject *, PyModule_GetDict, (PyObject *));
+EXTDECLPYPROC(PyObject *, PyDict_GetItemString, (PyObject *, char *));
+EXTDECLPYPROC(void, PyErr_Clear, (void) );
+EXTDECLPYPROC(PyObject *, PyErr_Occurred, (void) );
+EXTDECLPYPROC(void, PyErr_Print, (void) );
+EXTDECLPYPROC(void, PySys_AddWarnOption, (wchar_t *));
 /* Return a C long representation of the contents of pylong. */
-EXTDECLPROC(long, PyLong_AsLong, (PyObject *) );
+EXTDECLPYPROC(long, PyLong_AsLong, (PyObject *) );
 
-EXTDECLPROC(int, PySys_SetObject, (char *, PyObject *));
+EXTDECLPYPROC(int, PySys_SetObject, (char *, PyObject *));
 
 /*
  * Used to convert argv to wchar_t on Linux/OS X
  * On Python 3.0-3.4, this function was called _Py_char2wchar
  */
-EXTDECLPROC(wchar_t *, Py_DecodeLocale, (char *, size_t *));
-EXTDECLPROC(void, PyMem_RawFree, (void *));
+EXTDECLPYPROC(wchar_t *, Py_DecodeLocale, (const char *, size_t *));
+EXTDECLPYPROC(void, PyMem_RawFree, (void *));
 
 /* Used to add PYZ to sys.path */
-EXTDECLPROC(PyObject *, PySys_GetObject, (const char *));
-EXTDECLPROC(PyObject *, PyUnicode_FromFormat, (const char *, ...));
-EXTDECLPROC(PyObject *, PyUnicode_DecodeFSDefault, (const char *));
-EXTDECLPROC(PyObject *, PyUnicode_Decode,
+EXTDECLPYPROC(PyObject *, PySys_GetObject, (const char *));
+EXTDECLPYPROC(PyObject *, PyUnicode_FromFormat, (const char *, ...));
+EXTDECLPYPROC(PyObject *, PyUnicode_DecodeFSDefault, (const char *));
+EXTDECLPYPROC(PyObject *, PyUnicode_Decode,
             (const char *, size_t, const char *, const char *));                               /* Py_ssize_t */
 
 /* Used to load and execute marshalled code objects */
-EXTDECLPROC(PyObject *, PyEval_EvalCode, (PyObject *, PyObject *, PyObject *));
-EXTDECLPROC(PyObject *, PyMarshal_ReadObjectFromString, (const char *, size_t));  /* Py_ssize_t */
+EXTDECLPYPROC(PyObject *, PyEval_EvalCode, (PyObject *, PyObject *, PyObject *));
+EXTDECLPYPROC(PyObject *, PyMarshal_ReadObjectFromString, (const char *, size_t));  /* Py_ssize_t */
 
 /* Used to get traceback information while launching run scripts */
-EXTDECLPROC(void, PyErr_Fetch, (PyObject **, PyObject **, PyObject **));
-EXTDECLPROC(void, PyErr_Restore, (PyObject *, PyObject *, PyObject *));
-EXTDECLPROC(void, PyErr_NormalizeException, (PyObject **, PyObject **, PyObject **));
-EXTDECLPROC(PyObject *, PyObject_Str, (PyObject *));
-EXTDECLPROC(PyObject *, PyObject_GetAttrString, (PyObject *, const char *));
-EXTDECLPROC(const char *, PyUnicode_AsUTF8, (PyObject *));
-EXTDECLPROC(PyObject *, PyUnicode_Join, (PyObject *, PyObject *));
-EXTDECLPROC(PyObject *, PyUnicode_Replace, (PyObject *, PyObject *, PyObject *, size_t));  /* Py_ssize_t */
+EXTDECLPYPROC(void, PyErr_Fetch, (PyObject **, PyObject **, PyObject **));
+EXTDECLPYPROC(void, PyErr_Restore, (PyObject *, PyObject *, PyObject *));
+EXTDECLPYPROC(void, PyErr_NormalizeException, (PyObject **, PyObject **, PyObject **));
+EXTDECLPYPROC(PyObject *, PyObject_Str, (PyObject *));
+EXTDECLPYPROC(PyObject *, PyObject_GetAttrString, (PyObject *, const char *));
+EXTDECLPYPROC(const char *, PyUnicode_AsUTF8, (PyObject *));
+EXTDECLPYPROC(PyObject *, PyUnicode_Join, (PyObject *, PyObject *));
+EXTDECLPYPROC(PyObject *, PyUnicode_Replace, (PyObject *, PyObject *, PyObject *, size_t));  /* Py_ssize_t */
+EXTDECLPYPROC(PyObject *, PyCFunction_NewEx, (PyMethodDef *, PyObject *, PyObject *));
+
+/* Used to expose the PYZ archive to the bootstrap modules */
+EXTDECLPYPROC(int, PyArg_Parse, (PyObject *, const char *, ...));
+EXTDECLPYPROC(PyObject *, PyBytes_FromStringAndSize, (const char *, size_t));  /* Py_ssize_t */
+EXTDECLPYPROC(PyObject *, PyDict_GetItem, (PyObject *, PyObject *));
+EXTDECLPYPROC(PyObject *, PyErr_Format, (PyObject *, const char *, ...));
+EXTDECLPYPROC(PyObject *, PyErr_NoMemory, (void));
+EXTDECLPYPROC(PyObject *, PyMemoryView_FromMemory, (char *, size_t, int));  /* Py_ssize_t */
+#define PyBUF_READ 0x100
+
+/* Used by _pyi_archive to read entries without holding the GIL */
+EXTDECLPYPROC(char *, PyBytes_AsString, (PyObject *));
+EXTDECLPYPROC(PyThreadState *, PyEval_SaveThread, (void));
+EXTDECLPYPROC(void, PyEval_RestoreThread, (PyThreadState *));
+EXTDECLPYVAR(PyObject *, PyExc_OSError);
+EXTDECLPYVAR(PyObject *, PyExc_ValueError);
+
+#ifndef _WIN32
+/* Used by the zygote server mode to fork pre-initialized interpreters */
+EXTDECLPYPROC(void, PyOS_BeforeFork, (void));
+EXTDECLPYPROC(void, PyOS_AfterFork_Parent, (void));
+EXTDECLPYPROC(void, PyOS_AfterFork_Child, (void));
+#endif
+
+/*
+ * PEP 587 initialization configuration (Python >= 3.8). The layouts of
+ * PyStatus, PyWideStringList and PyPreConfig are the same in all the
+ * supported versions; PyConfig is opaque here, as its layout changes with
+ * every version (see pyi_pyconfig.c).
+ */
+typedef struct {
+    enum {
+        _PyStatus_TYPE_OK = 0,
+        _PyStatus_TYPE_ERROR = 1,
+        _PyStatus_TYPE_EXIT = 2
+    } _type;
+    const char *func;
+    const char *err_msg;
+    int exitcode;
+} PyStatus;
+
+typedef struct {
+    size_t length;  /* Py_ssize_t */
+    wchar_t **items;
+} PyWideStringList;
+
+typedef struct {
+    int _config_init;
+    int parse_argv;
+    int isolated;
+    int use_environment;
+    int configure_locale;
+    int coerce_c_locale;
+    int coerce_c_locale_warn;
+#ifdef _WIN32
+    int legacy_windows_fs_encoding;
+#endif
+    int utf8_mode;
+    int dev_mode;
+    int allocator;
+} PyPreConfig;
+
+struct _PyConfig;
+typedef struct _PyConfig PyConfig;
+
+/* Optional; NULL with Python 3.7 */
+EXTDECLPYPROC(void, PyPreConfig_InitIsolatedConfig, (PyPreConfig *));
+EXTDECLPYPROC(PyStatus, Py_PreInitialize, (const PyPreConfig *));
+EXTDECLPYPROC(void, PyConfig_InitIsolatedConfig, (PyConfig *));
+EXTDECLPYPROC(void, PyConfig_Clear, (PyConfig *));
+EXTDECLPYPROC(PyStatus, PyConfig_SetString, (PyConfig *, wchar_t **, const wchar_t *));
+EXTDECLPYPROC(PyStatus, PyConfig_SetArgv, (PyConfig *, size_t, wchar_t * const *));  /* Py_ssize_t */
+EXTDECLPYPROC(PyStatus, PyWideStringList_Append, (PyWideStringList *, const wchar_t *));
+EXTDECLPYPROC(int, PyStatus_Exception, (PyStatus));
+EXTDECLPYPROC(PyStatus, Py_InitializeFromConfig, (const PyConfig *));
 
 int pyi_python_map_names(HMODULE dll, int pyvers);
 
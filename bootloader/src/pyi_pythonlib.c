@@ -36,7 +36,11 @@
 #include "pyi_path.h"
 #include "pyi_archive.h"
 #include "pyi_utils.h"
+#include "pyi_frozen.h"
+#include "pyi_preload.h"
+#include "pyi_pyconfig.h"
 #include "pyi_python.h"
+#include "pyi_pyz.h"
 #include "pyi_win32_utils.h"
 
 /*
@@ -45,6 +49,17 @@
 int
 pyi_pylib_load(ARCHIVE_STATUS *status)
 {
+#ifdef PYI_STATIC_PYTHON
+    /* The Python library is linked into the bootloader, so there is
+     * nothing to load; it must be the version the program was built for. */
+    if (pyvers != PYI_STATIC_PYTHON) {
+        FATALERROR("The bootloader is linked with Python %d.%d, but the program requires Python %d.%d!\n",
+                   PYI_STATIC_PYTHON / 100, PYI_STATIC_PYTHON % 100, pyvers / 100, pyvers % 100);
+        return -1;
+    }
+    VS("LOADER: Python library is linked statically\n");
+    return pyi_python_map_names(NULL, pyvers);
+#else
     dylib_t dll;
     char dllpath[PATH_MAX];
     char dllname[DLLNAME_LEN];
@@ -122,6 +137,12 @@ pyi_pylib_load(ARCHIVE_STATUS *status)
 
     VS("LOADER: Python library: %s\n", dllpath);
 
+    /* Without LD_LIBRARY_PATH, load the bundled libraries that the Python
+     * library depends on first (pyi-onedir-no-restart option) */
+    if (!status->has_temp_directory && pyi_preload_is_enabled(status)) {
+        pyi_preload_deps(dllpath, status->mainpath);
+    }
+
     /* Load the DLL */
     dll = pyi_utils_dlopen(dllpath);
 
@@ -137,6 +158,7 @@ pyi_pylib_load(ARCHIVE_STATUS *status)
     }
 
     return pyi_python_map_names(dll, pyvers);
+#endif  /* ifdef PYI_STATIC_PYTHON */
 }
 
 /*
@@ -173,11 +195,30 @@ pyi_pylib_attach(ARCHIVE_STATUS *status, int *loadedNew)
  * toc->name is the arg
  * this is so you can freeze in command line args to Python
  */
+/* Make the C standard streams unbuffered (the u runtime option). */
+static void
+pyi_pylib_set_unbuffered_stdio(void)
+{
+#ifdef _WIN32
+    _setmode(fileno(stdin), _O_BINARY);
+    _setmode(fileno(stdout), _O_BINARY);
+#endif
+    fflush(stdout);
+    fflush(stderr);
+
+    setbuf(stdin, (char *)NULL);
+    setbuf(stdout, (char *)NULL);
+    setbuf(stderr, (char *)NULL);
+}
+
 static int
 pyi_pylib_set_runtime_opts(ARCHIVE_STATUS *status)
 {
     int unbuffered = 0;
-    TOC *ptoc = status->tocbuff;
+    TOC *ptoc;
+    TOC **options;
+    size_t count;
+    size_t i;
     wchar_t wchar_tmp[PATH_MAX + 1];
 
     /*
@@ -198,49 +239,40 @@ pyi_pylib_set_runtime_opts(ARCHIVE_STATUS *status)
 
     /* Override some runtime options by custom values from PKG archive.
      * User is allowed to changes these options. */
-    for (; ptoc < status->tocend; ptoc = pyi_arch_increment_toc_ptr(status, ptoc)) {
-        if (ptoc->typcd == ARCHIVE_ITEM_RUNTIME_OPTION) {
-            if (0 == strncmp(ptoc->name, "pyi-", 4)) {
-                VS("LOADER: Bootloader option: %s\n", ptoc->name);
-                continue;  /* Not handled here - use pyi_arch_get_option(status, ...) */
-            }
-            VS("LOADER: Runtime option: %s\n", ptoc->name);
-
-            switch (ptoc->name[0]) {
-            case 'v':
-                *PI_Py_VerboseFlag = 1;
-                break;
-            case 'u':
-                unbuffered = 1;
-                break;
-            case 'W':
-                /* TODO: what encoding is ptoc->name? May not be important */
-                /* as all known Wflags are ASCII. */
-                if ((size_t)-1 == mbstowcs(wchar_tmp, &ptoc->name[2], PATH_MAX)) {
-                    FATALERROR("Failed to convert Wflag %s using mbstowcs "
-                               "(invalid multibyte string)\n", &ptoc->name[2]);
-                    return -1;
-                }
-                PI_PySys_AddWarnOption(wchar_tmp);
-                break;
-            case 'O':
-                *PI_Py_OptimizeFlag = 1;
-                break;
+    options = pyi_arch_get_entries(status, ARCHIVE_CLASS_RUNTIME_OPTION, &count);
+    for (i = 0; i < count; i++) {
+        ptoc = options[i];
+        if (0 == strncmp(ptoc->name, "pyi-", 4)) {
+            VS("LOADER: Bootloader option: %s\n", ptoc->name);
+            continue;  /* Not handled here - use pyi_arch_get_option(status, ...) */
+        }
+        VS("LOADER: Runtime option: %s\n", ptoc->name);
+
+        switch (ptoc->name[0]) {
+        case 'v':
+            *PI_Py_VerboseFlag = 1;
+            break;
+        case 'u':
+            unbuffered = 1;
+            break;
+        case 'W':
+            /* TODO: what encoding is ptoc->name? May not be important */
+            /* as all known Wflags are ASCII. */
+            if ((size_t)-1 == mbstowcs(wchar_tmp, &ptoc->name[2], PATH_MAX)) {
+                FATALERROR("Failed to convert Wflag %s using mbstowcs "
+                           "(invalid multibyte string)\n", &ptoc->name[2]);
+                return -1;
             }
+            PI_PySys_AddWarnOption(wchar_tmp);
+            break;
+        case 'O':
+            *PI_Py_OptimizeFlag = 1;
+            break;
         }
     }
 
     if (unbuffered) {
-#ifdef _WIN32
-        _setmode(fileno(stdin), _O_BINARY);
-        _setmode(fileno(stdout), _O_BINARY);
-#endif
-        fflush(stdout);
-        fflush(stderr);
-
-        setbuf(stdin, (char *)NULL);
-        setbuf(stdout, (char *)NULL);
-        setbuf(stderr, (char *)NULL);
+        pyi_pylib_set_unbuffered_stdio();
 
         /* Enable unbuffered mode via Py_UnbufferedStdioFlag */
         *PI_Py_UnbufferedStdioFlag = 1;
@@ -248,13 +280,13 @@ pyi_pylib_set_runtime_opts(ARCHIVE_STATUS *status)
     return 0;
 }
 
-/* Enable UTF-8 mode as per PEP540.
+/* Determine whether to enable UTF-8 mode as per PEP540.
  * It seems Py_UTF8Mode must be set before Py_SetPath is called, but
  * in practice, it is probably a good idea to call it before any
  * Py_* functions are used
  */
-static void
-pyi_pylib_set_pep540_utf8_mode()
+static int
+pyi_pylib_get_pep540_utf8_mode()
 {
     int enable_utf8_mode = -1;
     char *env_utf8 = NULL;
@@ -303,10 +335,9 @@ pyi_pylib_set_pep540_utf8_mode()
     /* Enable/disable UTF-8 mode */
     if (enable_utf8_mode > 0) {
         VS("LOADER: Enabling UTF-8 mode\n");
-        *PI_Py_UTF8Mode = 1;
-    } else {
-        *PI_Py_UTF8Mode = 0;
+        return 1;
     }
+    return 0;
 }
 
 
@@ -385,21 +416,26 @@ pyi_wargv_from_argv(int argc, char ** argv)
  * sys.argv[0] should be full absolute path to the executable (Derived from
  * status->archivename).
  */
-static int
-pyi_pylib_set_sys_argv(ARCHIVE_STATUS *status)
+static wchar_t **
+pyi_pylib_get_wargv(ARCHIVE_STATUS *status)
 {
-    wchar_t ** wargv;
-
-    VS("LOADER: Setting sys.argv\n");
-
 #ifdef _WIN32
     /* Convert UTF-8 argv back to wargv */
-    wargv = pyi_win32_wargv_from_utf8(status->argc, status->argv);
+    return pyi_win32_wargv_from_utf8(status->argc, status->argv);
 #else
     /* Convert argv to wargv using Python's Py_DecodeLocale */
-    wargv = pyi_wargv_from_argv(status->argc, status->argv);
+    return pyi_wargv_from_argv(status->argc, status->argv);
 #endif
+}
 
+int
+pyi_pylib_set_sys_argv(ARCHIVE_STATUS *status)
+{
+    wchar_t ** wargv;
+
+    VS("LOADER: Setting sys.argv\n");
+
+    wargv = pyi_pylib_get_wargv(status);
     if (wargv) {
         /* last parameter '0' to PySys_SetArgv means do not update sys.path. */
         PI_PySys_SetArgvEx(status->argc, wargv, 0);
@@ -419,7 +455,7 @@ pyi_pylib_set_sys_argv(ARCHIVE_STATUS *status)
  * Python 3's consumption
  */
 wchar_t *
-pyi_locale_char2wchar(wchar_t * dst, char * src, size_t len)
+pyi_locale_char2wchar(wchar_t * dst, const char * src, size_t len)
 {
 #ifdef _WIN32
     return pyi_win32_utils_from_utf8(dst, src, len);
@@ -441,6 +477,87 @@ pyi_locale_char2wchar(wchar_t * dst, char * src, size_t len)
 #endif /* ifdef _WIN32 */
 }
 
+/*
+ * Start python through the PEP 587 initialization configuration, which
+ * gives the final sys.path, sys.prefix, sys.executable and sys.argv at
+ * once - return 0 on success
+ */
+static int
+pyi_pylib_start_python_from_config(ARCHIVE_STATUS *status, const wchar_t *progname_w, const wchar_t *pyhome_w)
+{
+    /* sys.path = [mainpath/base_library.zip, mainpath/lib-dynload, mainpath] */
+    static const char *subdirs[] = { "base_library.zip", "lib-dynload", NULL };
+    static wchar_t search_paths_w[3][PATH_MAX + 1];
+    const wchar_t *search_paths[3];
+    char path[PATH_MAX];
+    PyConfig *config = NULL;
+    wchar_t **wargv = NULL;
+    int unbuffered = 0;
+    int rc = -1;
+    int i;
+
+    for (i = 0; i < 3; i++) {
+        if (subdirs[i] != NULL) {
+            if (snprintf(path, PATH_MAX, "%s%c%s", status->mainpath, PYI_SEP, subdirs[i]) >= PATH_MAX) {
+                FATALERROR("sys.path (based on %s) exceeds buffer[%d] space\n", status->mainpath, PATH_MAX);
+                return -1;
+            }
+        } else {
+            snprintf(path, PATH_MAX, "%s", status->mainpath);
+        }
+        if (!pyi_locale_char2wchar(search_paths_w[i], path, PATH_MAX)) {
+            FATALERROR("Failed to convert pypath to wchar_t\n");
+            return -1;
+        }
+        VS("LOADER: sys.path[%d] is %s\n", i, path);
+        search_paths[i] = search_paths_w[i];
+    }
+
+    wargv = pyi_pylib_get_wargv(status);
+    if (wargv == NULL) {
+        FATALERROR("Failed to convert argv to wchar_t\n");
+        return -1;
+    }
+
+    VS("LOADER: Setting runtime options\n");
+    config = pyi_pyconfig_create();
+    if (config == NULL ||
+        pyi_pyconfig_set_paths(config, progname_w, pyhome_w, search_paths, 3) != 0 ||
+        pyi_pyconfig_set_argv(config, status->argc, wargv) != 0 ||
+        pyi_pyconfig_set_runtime_options(config, status, &unbuffered) != 0) {
+        goto cleanup;
+    }
+    if (unbuffered) {
+        pyi_pylib_set_unbuffered_stdio();
+    }
+
+    /* See pyi_pylib_start_python() */
+#if defined(_WIN32) && defined(LAUNCH_DEBUG)
+    SetErrorMode(SEM_FAILCRITICALERRORS | SEM_NOGPFAULTERRORBOX);
+#endif
+
+    VS("LOADER: Initializing python from PyConfig\n");
+    rc = pyi_pyconfig_initialize(config);
+
+#if defined(_WIN32) && defined(LAUNCH_DEBUG)
+    SetErrorMode(0);
+#endif
+
+    if (rc == 0 && pyi_frozen_fix_up_modules(status) != 0) {
+        rc = -1;
+    }
+
+    if (rc == 0 && PI_PyErr_Occurred()) {
+        FATALERROR("Error detected starting Python VM.\n");
+        rc = -1;
+    }
+
+cleanup:
+    pyi_pyconfig_free(config);
+    pyi_free_wargv(wargv);
+    return rc;
+}
+
 /*
  * Start python - return 0 on success
  */
@@ -463,18 +580,26 @@ pyi_pylib_start_python(ARCHIVE_STATUS *status)
     static wchar_t pyhome_w[PATH_MAX + 1];
     static wchar_t progname_w[PATH_MAX + 1];
 
+    /* Use the PEP 587 initialization, if available */
+    bool use_pyconfig = pyi_pyconfig_is_supported();
+
     /* Enable PEP540 UTF-8 mode, if necessary. Must be done before Py_SetPath()
      * is called for the setting to take effect (but we should probably also
-     * set it before pyi_locale_char2wchar() calls). */
-    pyi_pylib_set_pep540_utf8_mode();
+     * set it before pyi_locale_char2wchar() calls). With PyConfig, it is set
+     * by the pre-initialization, which must also come before decoding. */
+    if (use_pyconfig) {
+        if (pyi_pyconfig_preinitialize(pyi_pylib_get_pep540_utf8_mode()) != 0) {
+            return -1;
+        }
+    } else {
+        *PI_Py_UTF8Mode = pyi_pylib_get_pep540_utf8_mode();
+    }
 
     /* Decode using current locale */
     if (!pyi_locale_char2wchar(progname_w, status->executablename, PATH_MAX)) {
         FATALERROR("Failed to convert progname to wchar_t\n");
         return -1;
     }
-    /* Py_SetProgramName() should be called before Py_SetPath(). */
-    PI_Py_SetProgramName(progname_w);
 
     VS("LOADER: Manipulating environment (sys.path, sys.prefix)\n");
 
@@ -485,6 +610,18 @@ pyi_pylib_start_python(ARCHIVE_STATUS *status)
         return -1;
     }
     VS("LOADER: sys.prefix is %s\n", status->mainpath);
+
+    /* Serve the modules imported by the initialization as frozen modules */
+    if (pyi_frozen_install(status) != 0) {
+        return -1;
+    }
+
+    if (use_pyconfig) {
+        return pyi_pylib_start_python_from_config(status, progname_w, pyhome_w);
+    }
+
+    /* Py_SetProgramName() should be called before Py_SetPath(). */
+    PI_Py_SetProgramName(progname_w);
     PI_Py_SetPythonHome(pyhome_w);
 
     /* Set sys.path */
@@ -559,6 +696,10 @@ pyi_pylib_start_python(ARCHIVE_STATUS *status)
     VS("LOADER: Post-init sys.path is %s\n", pypath);
     PI_PySys_SetPath(pypath_w);
 
+    if (pyi_frozen_fix_up_modules(status) != 0) {
+        return -1;
+    }
+
     /* Setting sys.argv should be after Py_Initialize() call. */
     if (pyi_pylib_set_sys_argv(status)) {
         return -1;
@@ -580,6 +721,9 @@ int
 pyi_pylib_import_modules(ARCHIVE_STATUS *status)
 {
     TOC *ptoc;
+    TOC **modules;
+    size_t count;
+    size_t i;
     PyObject *co;
     PyObject *mod;
     PyObject *meipass_obj;
@@ -608,41 +752,49 @@ pyi_pylib_import_modules(ARCHIVE_STATUS *status)
     /* Iterate through toc looking for module entries (type 'm')
      * this is normally just bootstrap stuff (archive and iu)
      */
-    ptoc = status->tocbuff;
-
-    while (ptoc < status->tocend) {
-        if (ptoc->typcd == ARCHIVE_ITEM_PYMODULE ||
-            ptoc->typcd == ARCHIVE_ITEM_PYPACKAGE) {
-            unsigned char *modbuf = pyi_arch_extract(status, ptoc);
-
+    modules = pyi_arch_get_entries(status, ARCHIVE_CLASS_MODULE, &count);
+    for (i = 0; i < count; i++) {
+        ptoc = modules[i];
+        /* The modules are stored uncompressed, so they can be
+         * unmarshalled directly from the memory-mapped archive;
+         * extract them only if that is not possible. */
+        const unsigned char *modbuf = pyi_arch_get_entry_data(status, ptoc);
+        unsigned char *extracted = NULL;
+
+        if (modbuf == NULL) {
+            extracted = pyi_arch_extract(status, ptoc);
+            if (extracted == NULL) {
+                FATALERROR("Failed to extract %s from archive!\n", ptoc->name);
+                return -1;
+            }
+            modbuf = extracted;
             VS("LOADER: extracted %s\n", ptoc->name);
+        }
 
-            /* Unmarshall code object for module; we need to skip
-               the pyc header */
-            co = PI_PyMarshal_ReadObjectFromString((const char *) modbuf + 16, ptoc->ulen - 16);
-
-            if (co != NULL) {
-                VS("LOADER: running unmarshalled code object for %s...\n", ptoc->name);
-                mod = PI_PyImport_ExecCodeModule(ptoc->name, co);
-            }
-            else {
-                VS("LOADER: failed to unmarshall code object for %s!\n", ptoc->name);
-                mod = NULL;
-            }
+        /* Unmarshall code object for module; we need to skip
+           the pyc header */
+        co = PI_PyMarshal_ReadObjectFromString((const char *) modbuf + 16, ptoc->ulen - 16);
 
-            /* Check for errors in loading */
-            if (mod == NULL) {
-                FATALERROR("Module object for %s is NULL!\n", ptoc->name);
-            }
+        if (co != NULL) {
+            VS("LOADER: running unmarshalled code object for %s...\n", ptoc->name);
+            mod = PI_PyImport_ExecCodeModule(ptoc->name, co);
+        }
+        else {
+            VS("LOADER: failed to unmarshall code object for %s!\n", ptoc->name);
+            mod = NULL;
+        }
 
-            if (PI_PyErr_Occurred()) {
-                PI_PyErr_Print();
-                PI_PyErr_Clear();
-            }
+        /* Check for errors in loading */
+        if (mod == NULL) {
+            FATALERROR("Module object for %s is NULL!\n", ptoc->name);
+        }
 
-            free(modbuf);
+        if (PI_PyErr_Occurred()) {
+            PI_PyErr_Print();
+            PI_PyErr_Clear();
         }
-        ptoc = pyi_arch_increment_toc_ptr(status, ptoc);
+
+        free(extracted);
     }
 
     return 0;
@@ -657,6 +809,8 @@ pyi_pylib_import_modules(ARCHIVE_STATUS *status)
  *    absolute_path/dist/hello_world/hello_world?123456
  * to sys.path. The end number is the offset where the
  * Python bootstrap code should read the zip data.
+ * If the archive is memory-mapped, the PYZ is also exposed to the
+ * bootstrap code as the _pyi_pyz module (see pyi_pyz.c).
  * Return non zero on failure.
  * NB: This entry is removed from sys.path by the bootstrap scripts.
  */
@@ -683,7 +837,14 @@ pyi_pylib_install_zlib(ARCHIVE_STATUS *status, TOC *ptoc)
     archivename_obj = PI_PyUnicode_DecodeFSDefault(status->archivename);
 #endif
     zlib_entry = PI_PyUnicode_FromFormat("%U?%llu", archivename_obj, zlibpos);
+
+    /* Let the bootstrap modules read the PYZ from the mapped archive */
+    rc = pyi_pyz_install(status, ptoc, archivename_obj);
     PI_Py_DecRef(archivename_obj);
+    if (rc) {
+        PI_Py_DecRef(zlib_entry);
+        return rc;
+    }
 
     sys_path = PI_PySys_GetObject("path");
 
@@ -710,19 +871,18 @@ int
 pyi_pylib_install_zlibs(ARCHIVE_STATUS *status)
 {
     TOC * ptoc;
+    TOC **pyzs;
+    size_t count;
+    size_t i;
 
     VS("LOADER: Installing PYZ archive with Python modules.\n");
 
     /* Iterate through toc looking for zlibs (PYZ, type 'z') */
-    ptoc = status->tocbuff;
-
-    while (ptoc < status->tocend) {
-        if (ptoc->typcd == ARCHIVE_ITEM_PYZ) {
-            VS("LOADER: PYZ archive: %s\n", ptoc->name);
-            pyi_pylib_install_zlib(status, ptoc);
-        }
-
-        ptoc = pyi_arch_increment_toc_ptr(status, ptoc);
+    pyzs = pyi_arch_get_entries(status, ARCHIVE_CLASS_PYZ, &count);
+    for (i = 0; i < count; i++) {
+        ptoc = pyzs[i];
+        VS("LOADER: PYZ archive: %s\n", ptoc->name);
+        pyi_pylib_install_zlib(status, ptoc);
     }
     return 0;
 }
@@ -763,5 +923,6 @@ pyi_pylib_finalize(ARCHIVE_STATUS *status)
         /* Finalize the interpreter. This function call calls all of the atexit functions. */
         VS("LOADER: Cleaning up Python interpreter.\n");
         PI_Py_Finalize();
+        pyi_frozen_finalize();
     }
 }
@@ -26,6 +26,7 @@ int pyi_pylib_start_python(ARCHIVE_STATUS *status);
 int pyi_pylib_import_modules(ARCHIVE_STATUS *status);
 int pyi_pylib_install_zlibs(ARCHIVE_STATUS *status);
 int pyi_pylib_run_scripts(ARCHIVE_STATUS *status);
+int pyi_pylib_set_sys_argv(ARCHIVE_STATUS *status);
 
 void pyi_pylib_finalize(ARCHIVE_STATUS *status);
 
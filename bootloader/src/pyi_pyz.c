@@ -0,0 +1,776 @@
+/*
+ * ****************************************************************************
+ * Copyright (c) 2013-2022, PyInstaller Development Team.
+ *
+ * Distributed under the terms of the GNU General Public License (version 2
+ * or later) with exception for distributing the bootloader.
+ *
+ * The full license is in the file COPYING.txt, distributed with this software.
+ *
+ * SPDX-License-Identifier: (GPL-2.0-or-later WITH Bootloader-exception)
+ * ****************************************************************************
+ */
+
+/*
+ * Native access to the PYZ archive for the bootstrap modules.
+ *
+ * The PYZ archive with the Python modules is an uncompressed entry of the
+ * CArchive, which the bootloader has already memory-mapped. Rather than
+ * having ZlibArchiveReader (pyimod02_archive) re-open the executable and
+ * read every module with Python-level file I/O, the bootloader exposes the
+ * mapped PYZ archive as the built-in module _pyi_pyz:
+ *
+ *  - path, offset: the archive name and the offset of the PYZ archive, as
+ *    put on sys.path by pyi_pylib_install_zlib();
+ *  - data: read-only memoryview of the PYZ archive;
+ *  - toc: None if the archive has an indexed TOC (see ZlibArchiveIndex in
+ *    pyimod02_archive); otherwise the TOC, as a dict that maps entry names
+ *    to (type, position, length) tuples;
+ *  - lookup(name): return the (type, position, length) tuple of the entry,
+ *    or None if there is no such entry. The indexed TOC is binary-searched
+ *    in place, so that the entries are only decoded when looked up;
+ *  - extract(name): decompress the entry straight from the mapped archive
+ *    and, for modules and packages, unmarshal its code object. Returns a
+ *    (type, object) tuple, or None if there is no such entry. Entries
+ *    compressed with the shared compression dictionary of the archive are
+ *    inflated with the dictionary in place as zlib preset dictionary.
+ *
+ * With the pyi-prefetch option, pyi_pyz_prefetch_start() starts a
+ * background thread before Python is initialized. The thread asks the
+ * operating system to read ahead the PYZ archive and the bootstrap
+ * modules, and inflates the entries flagged for prefetching at build time
+ * (the modules imported by the entry-point scripts and run-time hooks;
+ * see PYZ_INDEX_FLAG_PREFETCH in pyimod02_archive). extract() then takes
+ * the decompressed data from there, instead of inflating it again.
+ *
+ * The module is a plain module object created with PyImport_AddModule()
+ * after Py_Initialize(), so that the bootloader does not depend on the
+ * layout of Python's module definition structures. It is not created if
+ * the archive could not be mapped; the PYZ archive is then read from the
+ * file, as before.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+    #include <windows.h>
+    #include <process.h>  /* _beginthreadex */
+#else
+    #include <pthread.h>  /* pthread_create, pthread_mutex_lock */
+#endif
+
+/* PyInstaller headers */
+#include "zlib.h"
+#include "pyi_global.h"
+#include "pyi_archive.h"
+#include "pyi_python.h"
+#include "pyi_pyz.h"
+
+/* Types of PYZ entries; see PYZ_TYPE_* in pyimod02_archive. */
+#define PYZ_TYPE_MODULE 0
+#define PYZ_TYPE_PKG 1
+#define PYZ_TYPE_DATA 2
+#define PYZ_TYPE_NSPKG 3
+
+/* Size of PYZ archive header: magic, Python's magic, TOC position. */
+#define _PYZ_HEADER_SIZE 12
+
+/* Indexed TOC; see PYZ_INDEX_* in pyimod02_archive. The header consists
+ * of the magic, the number of entries, and the position and length of the
+ * shared compression dictionary; each entry of the name offset, position,
+ * length, name length, type and flags. */
+#define _PYZ_INDEX_MAGIC "PYZI"
+#define _PYZ_INDEX_HEADER_SIZE 16
+#define _PYZ_INDEX_ENTRY_SIZE 16
+#define _PYZ_INDEX_FLAG_PREFETCH 0x01
+
+typedef struct _pyz_entry {
+    int typ;
+    uint32_t pos;
+    uint32_t length;
+    uint32_t index;  /* Position in the indexed TOC; UINT32_MAX if not indexed. */
+} PYZ_ENTRY;
+
+/* The decompression buffer is kept between calls of extract(), unless it
+ * grew larger than this. */
+#define _PYZ_MAX_RETAINED_BUFFER_SIZE (1024 * 1024)
+
+/* The prefetched data is limited to this size. */
+#define _PYZ_MAX_PREFETCH_SIZE (64 * 1024 * 1024)
+
+/* The mapped PYZ archive. */
+static const TOC *_pyz_ptoc = NULL;
+static bool _pyz_installed = false;
+static const unsigned char *_pyz_data = NULL;
+static uint64_t _pyz_size = 0;
+static PyObject *_pyz_toc = NULL;  /* TOC dict, if not indexed */
+static const unsigned char *_pyz_index = NULL;  /* indexed TOC */
+static uint64_t _pyz_index_size = 0;
+static uint32_t _pyz_index_count = 0;
+static const unsigned char *_pyz_zdict = NULL;  /* shared compression dictionary */
+static uint32_t _pyz_zdict_size = 0;
+
+/* Decompression state, reused for all entries; extract() is only called
+ * with the GIL held. */
+static z_stream _pyz_zstream;
+static bool _pyz_zstream_initialized = false;
+static unsigned char *_pyz_buffer = NULL;
+static size_t _pyz_buffer_size = 0;
+
+/*
+ * Prefetching. The entries are sorted by their position in the indexed
+ * TOC; the thread processes them in that order, skipping the ones that
+ * extract() has already taken. The states and data of the entries are
+ * protected by the mutex.
+ */
+#ifdef _WIN32
+typedef CRITICAL_SECTION _prefetch_mutex_t;
+#define _prefetch_mutex_init(m)    InitializeCriticalSection(m)
+#define _prefetch_mutex_destroy(m) DeleteCriticalSection(m)
+#define _prefetch_mutex_lock(m)    EnterCriticalSection(m)
+#define _prefetch_mutex_unlock(m)  LeaveCriticalSection(m)
+#else
+typedef pthread_mutex_t _prefetch_mutex_t;
+#define _prefetch_mutex_init(m)    pthread_mutex_init(m, NULL)
+#define _prefetch_mutex_destroy(m) pthread_mutex_destroy(m)
+#define _prefetch_mutex_lock(m)    pthread_mutex_lock(m)
+#define _prefetch_mutex_unlock(m)  pthread_mutex_unlock(m)
+#endif
+
+enum _prefetch_state {
+    PREFETCH_PENDING,  /* Not processed yet. */
+    PREFETCH_BUSY,     /* Being inflated by the thread. */
+    PREFETCH_READY,    /* Inflated; data is available. */
+    PREFETCH_TAKEN     /* Taken by extract(), or failed to inflate. */
+};
+
+typedef struct _prefetch_entry {
+    PYZ_ENTRY entry;
+    enum _prefetch_state state;
+    unsigned char *data;
+    size_t size;
+} PREFETCH_ENTRY;
+
+static PREFETCH_ENTRY *_prefetch_entries = NULL;
+static size_t _prefetch_count = 0;
+static ARCHIVE_STATUS *_prefetch_archive_status = NULL;
+static _prefetch_mutex_t _prefetch_mutex;
+static bool _prefetch_stop = false;
+#ifdef _WIN32
+static HANDLE _prefetch_thread;
+#else
+static pthread_t _prefetch_thread;
+#endif
+static bool _prefetch_thread_started = false;
+
+/*
+ * Inflate the given zlib stream into *buffer of *buffer_size bytes, which
+ * is (re)allocated as needed, and store the size of the decompressed data
+ * into *size. The stream state is initialized on first use and reset
+ * afterwards. If the stream needs a preset dictionary, the shared
+ * compression dictionary of the archive is used. Returns Z_OK on success,
+ * or Z_MEM_ERROR or Z_DATA_ERROR on error.
+ */
+static int
+_pyi_pyz_inflate(z_stream *zstream, bool *zstream_initialized, const unsigned char *data, size_t length,
+                 unsigned char **buffer, size_t *buffer_size, size_t *size)
+{
+    size_t total = 0;
+    int rc;
+
+    if (*zstream_initialized) {
+        rc = inflateReset(zstream);
+    } else {
+        memset(zstream, 0, sizeof(*zstream));
+        rc = inflateInit(zstream);
+        *zstream_initialized = (rc == Z_OK);
+    }
+    if (rc != Z_OK) {
+        return Z_MEM_ERROR;
+    }
+
+    zstream->next_in = (Bytef *)data;
+    zstream->avail_in = (uInt)length;
+    do {
+        if (total == *buffer_size) {
+            /* Marshalled code objects typically compress 3 to 4 times. */
+            size_t new_size = *buffer_size ? *buffer_size * 2 : 4 * length + 4096;
+            unsigned char *new_buffer = (unsigned char *)realloc(*buffer, new_size);
+            if (new_buffer == NULL) {
+                return Z_MEM_ERROR;
+            }
+            *buffer = new_buffer;
+            *buffer_size = new_size;
+        }
+        zstream->next_out = *buffer + total;
+        zstream->avail_out = (uInt)(*buffer_size - total);
+        rc = inflate(zstream, Z_NO_FLUSH);
+        if (rc == Z_NEED_DICT) {
+            if (_pyz_zdict == NULL || inflateSetDictionary(zstream, _pyz_zdict, _pyz_zdict_size) != Z_OK) {
+                return Z_DATA_ERROR;
+            }
+            rc = Z_OK;
+        }
+        total = *buffer_size - zstream->avail_out;
+    } while (rc == Z_OK || (rc == Z_BUF_ERROR && zstream->avail_out == 0));
+
+    if (rc == Z_MEM_ERROR) {
+        return Z_MEM_ERROR;
+    }
+    if (rc != Z_STREAM_END) {
+        return Z_DATA_ERROR;  /* Corrupted or truncated stream */
+    }
+    *size = total;
+    return Z_OK;
+}
+
+static uint32_t
+_pyi_pyz_get_uint32(const unsigned char *p)
+{
+    uint32_t value;
+
+    memcpy(&value, p, sizeof(value));
+    return pyi_be32toh(value);
+}
+
+/*
+ * Binary-search the indexed TOC for the entry with the given UTF-8 encoded
+ * name. Returns true if found.
+ */
+static bool
+_pyi_pyz_index_find(const char *name, PYZ_ENTRY *entry)
+{
+    size_t name_len = strlen(name);
+    uint32_t lo = 0;
+    uint32_t hi = _pyz_index_count;
+
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        const unsigned char *p = _pyz_index + _PYZ_INDEX_HEADER_SIZE + (uint64_t)mid * _PYZ_INDEX_ENTRY_SIZE;
+        uint32_t mid_offset = _pyi_pyz_get_uint32(p);
+        size_t mid_len = ((size_t)p[12] << 8) | p[13];
+        int cmp;
+
+        if (mid_offset > _pyz_index_size || mid_len > _pyz_index_size - mid_offset) {
+            return false;  /* Corrupted index */
+        }
+        cmp = memcmp(_pyz_index + mid_offset, name, mid_len < name_len ? mid_len : name_len);
+        if (cmp == 0) {
+            cmp = (mid_len > name_len) - (mid_len < name_len);
+        }
+        if (cmp < 0) {
+            lo = mid + 1;
+        } else if (cmp > 0) {
+            hi = mid;
+        } else {
+            entry->pos = _pyi_pyz_get_uint32(p + 4);
+            entry->length = _pyi_pyz_get_uint32(p + 8);
+            entry->typ = p[14];
+            entry->index = mid;
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+ * Look up the PYZ entry with the given name. Returns 1 if found, 0 if not,
+ * and -1 on error, with Python exception set.
+ */
+static int
+_pyi_pyz_find(PyObject *name, PYZ_ENTRY *entry)
+{
+    PyObject *item;
+    long long pos;
+    long long length;
+
+    if (_pyz_index != NULL) {
+        const char *name_utf8 = PI_PyUnicode_AsUTF8(name);
+        if (name_utf8 == NULL) {
+            /* Not a string, or not encodable; cannot be in the archive */
+            PI_PyErr_Clear();
+            return 0;
+        }
+        return _pyi_pyz_index_find(name_utf8, entry) ? 1 : 0;
+    }
+
+    item = PI_PyDict_GetItem(_pyz_toc, name);  /* borrowed reference */
+    if (item == NULL) {
+        return 0;
+    }
+    if (!PI_PyArg_Parse(item, "(iLL)", &entry->typ, &pos, &length)) {
+        return -1;
+    }
+    if (pos < 0 || pos > UINT32_MAX || length < 0 || length > UINT32_MAX) {
+        PI_PyErr_Format(*PI_PyExc_ImportError, "PYZ entry '%S' is out of bounds", name);
+        return -1;
+    }
+    entry->pos = (uint32_t)pos;
+    entry->length = (uint32_t)length;
+    entry->index = UINT32_MAX;
+    return 1;
+}
+
+/* bsearch() comparator for prefetched entries. */
+static int
+_pyi_pyz_compare_prefetch_entry(const void *key, const void *item)
+{
+    uint32_t index = *(const uint32_t *)key;
+    uint32_t item_index = ((const PREFETCH_ENTRY *)item)->entry.index;
+
+    return (index > item_index) - (index < item_index);
+}
+
+/*
+ * Take the prefetched data of the entry, if available, and store it into
+ * *data and *size; the caller must free it. Otherwise, make sure that the
+ * prefetch thread skips the entry. Returns true if the data was taken.
+ */
+static bool
+_pyi_pyz_prefetch_take(const PYZ_ENTRY *entry, unsigned char **data, size_t *size)
+{
+    PREFETCH_ENTRY *item;
+    bool taken = false;
+
+    if (_prefetch_count == 0 || entry->index == UINT32_MAX) {
+        return false;
+    }
+    item = (PREFETCH_ENTRY *)bsearch(&entry->index, _prefetch_entries, _prefetch_count,
+                                     sizeof(PREFETCH_ENTRY), _pyi_pyz_compare_prefetch_entry);
+    if (item == NULL) {
+        return false;
+    }
+    _prefetch_mutex_lock(&_prefetch_mutex);
+    if (item->state == PREFETCH_READY) {
+        *data = item->data;
+        *size = item->size;
+        item->data = NULL;
+        taken = true;
+    }
+    item->state = PREFETCH_TAKEN;
+    _prefetch_mutex_unlock(&_prefetch_mutex);
+    return taken;
+}
+
+/*
+ * _pyi_pyz.lookup(name); see the description of the module.
+ */
+static PyObject *
+_pyi_pyz_lookup(PyObject *self, PyObject *name)
+{
+    PYZ_ENTRY entry;
+
+    (void)self;
+    switch (_pyi_pyz_find(name, &entry)) {
+        case 1:
+            return PI_Py_BuildValue("(iII)", entry.typ, entry.pos, entry.length);
+        case 0:
+            return PI_Py_BuildValue("");  /* None */
+        default:
+            return NULL;
+    }
+}
+
+static PyMethodDef _pyi_pyz_lookup_method = {
+    "lookup", _pyi_pyz_lookup, METH_O, NULL
+};
+
+/*
+ * _pyi_pyz.extract(name); see the description of the module.
+ */
+static PyObject *
+_pyi_pyz_extract(PyObject *self, PyObject *name)
+{
+    PYZ_ENTRY entry;
+    PyObject *obj;
+    unsigned char *prefetched = NULL;
+    const unsigned char *data;
+    size_t size;
+
+    (void)self;
+    switch (_pyi_pyz_find(name, &entry)) {
+        case 1:
+            break;
+        case 0:
+            return PI_Py_BuildValue("");  /* None */
+        default:
+            return NULL;
+    }
+    if (entry.pos > _pyz_size || entry.length > _pyz_size - entry.pos) {
+        return PI_PyErr_Format(*PI_PyExc_ImportError, "PYZ entry '%S' is out of bounds", name);
+    }
+
+    if (!_pyi_pyz_prefetch_take(&entry, &prefetched, &size)) {
+        switch (_pyi_pyz_inflate(&_pyz_zstream, &_pyz_zstream_initialized, _pyz_data + entry.pos, entry.length,
+                                 &_pyz_buffer, &_pyz_buffer_size, &size)) {
+            case Z_OK:
+                break;
+            case Z_MEM_ERROR:
+                return PI_PyErr_NoMemory();
+            default:
+                return PI_PyErr_Format(*PI_PyExc_ImportError, "PYZ entry '%S' failed to decompress", name);
+        }
+    }
+    data = prefetched ? prefetched : _pyz_buffer;
+    if (entry.typ == PYZ_TYPE_MODULE || entry.typ == PYZ_TYPE_PKG || entry.typ == PYZ_TYPE_NSPKG) {
+        obj = PI_PyMarshal_ReadObjectFromString((const char *)data, size);
+    } else {
+        obj = PI_PyBytes_FromStringAndSize((const char *)data, size);
+    }
+
+    free(prefetched);
+    if (_pyz_buffer_size > _PYZ_MAX_RETAINED_BUFFER_SIZE) {
+        free(_pyz_buffer);
+        _pyz_buffer = NULL;
+        _pyz_buffer_size = 0;
+    }
+    if (obj == NULL) {
+        return NULL;
+    }
+    return PI_Py_BuildValue("(iN)", entry.typ, obj);
+}
+
+static PyMethodDef _pyi_pyz_extract_method = {
+    "extract", _pyi_pyz_extract, METH_O, NULL
+};
+
+/*
+ * Set up access to the given PYZ archive entry of the memory-mapped
+ * archive. If the archive has an indexed TOC, it is checked and used in
+ * place. Does not call into Python. Returns 0 on success, -1 if the entry
+ * is not mapped or is not a valid PYZ archive.
+ */
+static int
+_pyi_pyz_open(ARCHIVE_STATUS *status, const TOC *ptoc)
+{
+    const unsigned char *data = pyi_arch_get_entry_data(status, ptoc);
+    uint32_t toc_pos;
+
+    if (data == NULL || ptoc->ulen < _PYZ_HEADER_SIZE || memcmp(data, "PYZ\0", 4) != 0) {
+        return -1;
+    }
+    toc_pos = _pyi_pyz_get_uint32(data + 8);
+    if (toc_pos < _PYZ_HEADER_SIZE || toc_pos >= ptoc->ulen) {
+        return -1;
+    }
+
+    _pyz_ptoc = ptoc;
+    _pyz_data = data;
+    _pyz_size = ptoc->ulen;
+    if (_pyz_size - toc_pos >= _PYZ_INDEX_HEADER_SIZE && memcmp(_pyz_data + toc_pos, _PYZ_INDEX_MAGIC, 4) == 0) {
+        uint32_t count = _pyi_pyz_get_uint32(_pyz_data + toc_pos + 4);
+        uint32_t zdict_pos = _pyi_pyz_get_uint32(_pyz_data + toc_pos + 8);
+        uint32_t zdict_size = _pyi_pyz_get_uint32(_pyz_data + toc_pos + 12);
+        if (_PYZ_INDEX_HEADER_SIZE + (uint64_t)count * _PYZ_INDEX_ENTRY_SIZE > _pyz_size - toc_pos ||
+            (uint64_t)zdict_pos + zdict_size > toc_pos) {
+            return -1;
+        }
+        _pyz_index = _pyz_data + toc_pos;
+        _pyz_index_size = _pyz_size - toc_pos;
+        _pyz_index_count = count;
+        if (zdict_size > 0) {
+            _pyz_zdict = _pyz_data + zdict_pos;
+            _pyz_zdict_size = zdict_size;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Load the TOC written by older versions of PyInstaller, and convert it
+ * from the list of (name, (type, position, length)) tuples into a dict.
+ * Returns 0 on success, -1 on error.
+ */
+static int
+_pyi_pyz_load_toc_dict(void)
+{
+    uint32_t toc_pos = _pyi_pyz_get_uint32(_pyz_data + 8);
+    PyObject *toc_list;
+    PyObject *builtins;
+    PyObject *dict_type;
+
+    toc_list = PI_PyMarshal_ReadObjectFromString((const char *)_pyz_data + toc_pos,
+                                                 (size_t)(_pyz_size - toc_pos));
+    if (toc_list == NULL) {
+        return -1;
+    }
+    builtins = PI_PyImport_ImportModule("builtins");
+    if (builtins != NULL) {
+        dict_type = PI_PyObject_GetAttrString(builtins, "dict");
+        if (dict_type != NULL) {
+            _pyz_toc = PI_PyObject_CallFunctionObjArgs(dict_type, toc_list, NULL);
+            PI_Py_DecRef(dict_type);
+        }
+        PI_Py_DecRef(builtins);
+    }
+    PI_Py_DecRef(toc_list);
+    return _pyz_toc ? 0 : -1;
+}
+
+int
+pyi_pyz_install(ARCHIVE_STATUS *status, TOC *ptoc, PyObject *path)
+{
+    PyObject *module;
+    PyObject *data;
+    PyObject *offset;
+    PyObject *lookup_func;
+    PyObject *extract_func;
+    PyObject *toc;
+    int rc = 0;
+
+    /* Only the first PYZ archive is exposed; it may have been set up for
+     * prefetching already. */
+    if (_pyz_installed || (_pyz_ptoc != NULL && _pyz_ptoc != ptoc)) {
+        return 0;
+    }
+    if (_pyz_ptoc == NULL && _pyi_pyz_open(status, ptoc) != 0) {
+        /* Let the Python side detect and report broken archive. */
+        VS("LOADER: PYZ archive %s is not mapped or not valid; it is read from file.\n", ptoc->name);
+        return 0;
+    }
+    if (_pyz_index == NULL && _pyi_pyz_load_toc_dict() != 0) {
+        VS("LOADER: Failed to load TOC of PYZ archive %s; it is read from file.\n", ptoc->name);
+        PI_PyErr_Clear();
+        return 0;
+    }
+    _pyz_installed = true;
+
+    module = PI_PyImport_AddModule("_pyi_pyz");  /* borrowed reference */
+    data = PI_PyMemoryView_FromMemory((char *)_pyz_data, (size_t)_pyz_size, PyBUF_READ);
+    offset = PI_Py_BuildValue("K", (unsigned long long)(status->pkgstart + ptoc->pos));
+    lookup_func = PI_PyCFunction_NewEx(&_pyi_pyz_lookup_method, NULL, NULL);
+    extract_func = PI_PyCFunction_NewEx(&_pyi_pyz_extract_method, NULL, NULL);
+    toc = _pyz_toc ? _pyz_toc : PI_Py_BuildValue("");  /* new reference to None */
+    if (_pyz_toc) {
+        PI_Py_IncRef(toc);
+    }
+    if (module == NULL || data == NULL || offset == NULL || lookup_func == NULL || extract_func == NULL ||
+        toc == NULL ||
+        PI_PyObject_SetAttrString(module, "path", path) != 0 ||
+        PI_PyObject_SetAttrString(module, "offset", offset) != 0 ||
+        PI_PyObject_SetAttrString(module, "data", data) != 0 ||
+        PI_PyObject_SetAttrString(module, "toc", toc) != 0 ||
+        PI_PyObject_SetAttrString(module, "lookup", lookup_func) != 0 ||
+        PI_PyObject_SetAttrString(module, "extract", extract_func) != 0) {
+        FATALERROR("Failed to expose PYZ archive %s to Python.\n", ptoc->name);
+        rc = -1;
+    } else {
+        VS("LOADER: PYZ archive %s is read from the mapped archive.\n", ptoc->name);
+    }
+    if (data) {
+        PI_Py_DecRef(data);
+    }
+    if (offset) {
+        PI_Py_DecRef(offset);
+    }
+    if (lookup_func) {
+        PI_Py_DecRef(lookup_func);
+    }
+    if (extract_func) {
+        PI_Py_DecRef(extract_func);
+    }
+    if (toc) {
+        PI_Py_DecRef(toc);
+    }
+    return rc;
+}
+
+/*
+ * Prefetch thread: read ahead the PYZ archive and the bootstrap modules,
+ * then inflate the flagged entries until all are processed, the size
+ * limit is reached, or the thread is asked to stop.
+ */
+static void
+_pyi_pyz_prefetch_run(void)
+{
+    ARCHIVE_STATUS *status = _prefetch_archive_status;
+    z_stream zstream;
+    bool zstream_initialized = false;
+    size_t total_size = 0;
+    size_t i;
+    TOC **entries;
+    size_t count;
+
+    pyi_arch_prefetch(status, _pyz_ptoc);
+    entries = pyi_arch_get_entries(status, ARCHIVE_CLASS_MODULE, &count);
+    for (i = 0; i < count; i++) {
+        pyi_arch_prefetch(status, entries[i]);
+    }
+    entries = pyi_arch_get_entries(status, ARCHIVE_CLASS_SCRIPT, &count);
+    for (i = 0; i < count; i++) {
+        pyi_arch_prefetch(status, entries[i]);
+    }
+
+    for (i = 0; i < _prefetch_count && total_size < _PYZ_MAX_PREFETCH_SIZE; i++) {
+        PREFETCH_ENTRY *item = &_prefetch_entries[i];
+        unsigned char *data = NULL;
+        size_t data_size = 0;
+        size_t size = 0;
+        int rc;
+
+        _prefetch_mutex_lock(&_prefetch_mutex);
+        if (_prefetch_stop) {
+            _prefetch_mutex_unlock(&_prefetch_mutex);
+            break;
+        }
+        if (item->state != PREFETCH_PENDING) {
+            _prefetch_mutex_unlock(&_prefetch_mutex);
+            continue;
+        }
+        item->state = PREFETCH_BUSY;
+        _prefetch_mutex_unlock(&_prefetch_mutex);
+
+        rc = _pyi_pyz_inflate(&zstream, &zstream_initialized, _pyz_data + item->entry.pos, item->entry.length,
+                              &data, &data_size, &size);
+
+        _prefetch_mutex_lock(&_prefetch_mutex);
+        if (item->state == PREFETCH_BUSY && rc == Z_OK) {
+            item->data = data;
+            item->size = size;
+            item->state = PREFETCH_READY;
+            data = NULL;
+            total_size += data_size;
+        } else {
+            /* Taken by extract() in the meantime, or failed; extract()
+             * inflates (or fails to inflate) it on its own. */
+            item->state = PREFETCH_TAKEN;
+        }
+        _prefetch_mutex_unlock(&_prefetch_mutex);
+        free(data);
+    }
+
+    if (zstream_initialized) {
+        inflateEnd(&zstream);
+    }
+    VS("LOADER: Prefetch thread finished (%lu bytes of PYZ entries inflated)\n", (unsigned long)total_size);
+}
+
+#ifdef _WIN32
+static unsigned __stdcall
+_pyi_pyz_prefetch_thread(void *arg)
+{
+    (void)arg;
+    _pyi_pyz_prefetch_run();
+    return 0;
+}
+#else
+static void *
+_pyi_pyz_prefetch_thread(void *arg)
+{
+    (void)arg;
+    _pyi_pyz_prefetch_run();
+    return NULL;
+}
+#endif
+
+/*
+ * Collect the entries of the indexed TOC that are flagged for prefetching,
+ * in the order of the index.
+ */
+static int
+_pyi_pyz_collect_prefetch_entries(void)
+{
+    uint32_t i;
+    size_t count = 0;
+
+    for (i = 0; i < _pyz_index_count; i++) {
+        const unsigned char *p = _pyz_index + _PYZ_INDEX_HEADER_SIZE + (uint64_t)i * _PYZ_INDEX_ENTRY_SIZE;
+        if (p[15] & _PYZ_INDEX_FLAG_PREFETCH) {
+            count++;
+        }
+    }
+    if (count == 0) {
+        return 0;
+    }
+    _prefetch_entries = (PREFETCH_ENTRY *)calloc(count, sizeof(PREFETCH_ENTRY));
+    if (_prefetch_entries == NULL) {
+        return -1;
+    }
+    for (i = 0; i < _pyz_index_count; i++) {
+        const unsigned char *p = _pyz_index + _PYZ_INDEX_HEADER_SIZE + (uint64_t)i * _PYZ_INDEX_ENTRY_SIZE;
+        PYZ_ENTRY *entry;
+        if (!(p[15] & _PYZ_INDEX_FLAG_PREFETCH)) {
+            continue;
+        }
+        entry = &_prefetch_entries[_prefetch_count].entry;
+        entry->pos = _pyi_pyz_get_uint32(p + 4);
+        entry->length = _pyi_pyz_get_uint32(p + 8);
+        entry->typ = p[14];
+        entry->index = i;
+        /* Skip invalid entries; extract() reports them. */
+        if (entry->pos > _pyz_size || entry->length > _pyz_size - entry->pos) {
+            continue;
+        }
+        _prefetch_count++;
+    }
+    return 0;
+}
+
+int
+pyi_pyz_prefetch_start(ARCHIVE_STATUS *status)
+{
+    TOC **pyzs;
+    size_t count;
+
+    if (pyi_arch_get_option(status, "pyi-prefetch") == NULL) {
+        return 0;
+    }
+    pyzs = pyi_arch_get_entries(status, ARCHIVE_CLASS_PYZ, &count);
+    if (count == 0 || _pyi_pyz_open(status, pyzs[0]) != 0) {
+        VS("LOADER: No mapped PYZ archive to prefetch\n");
+        return 0;
+    }
+    if (_pyz_index != NULL && _pyi_pyz_collect_prefetch_entries() != 0) {
+        VS("LOADER: Could not allocate memory for prefetching\n");
+        return 0;
+    }
+
+    _prefetch_archive_status = status;
+    _prefetch_stop = false;
+    _prefetch_mutex_init(&_prefetch_mutex);
+#ifdef _WIN32
+    _prefetch_thread = (HANDLE)_beginthreadex(NULL, 0, _pyi_pyz_prefetch_thread, NULL, 0, NULL);
+    _prefetch_thread_started = (_prefetch_thread != 0);
+#else
+    _prefetch_thread_started = (pthread_create(&_prefetch_thread, NULL, _pyi_pyz_prefetch_thread, NULL) == 0);
+#endif
+    if (!_prefetch_thread_started) {
+        VS("LOADER: Could not start prefetch thread\n");
+        _prefetch_mutex_destroy(&_prefetch_mutex);
+        free(_prefetch_entries);
+        _prefetch_entries = NULL;
+        _prefetch_count = 0;
+        return 0;
+    }
+    VS("LOADER: Started prefetch thread for %s (%lu entries)\n", pyzs[0]->name, (unsigned long)_prefetch_count);
+    return 0;
+}
+
+void
+pyi_pyz_prefetch_stop(void)
+{
+    size_t i;
+
+    if (!_prefetch_thread_started) {
+        return;
+    }
+    _prefetch_mutex_lock(&_prefetch_mutex);
+    _prefetch_stop = true;
+    _prefetch_mutex_unlock(&_prefetch_mutex);
+#ifdef _WIN32
+    WaitForSingleObject(_prefetch_thread, INFINITE);
+    CloseHandle(_prefetch_thread);
+#else
+    pthread_join(_prefetch_thread, NULL);
+#endif
+    _prefetch_thread_started = false;
+    _prefetch_mutex_destroy(&_prefetch_mutex);
+
+    for (i = 0; i < _prefetch_count; i++) {
+        free(_prefetch_entries[i].data);
+    }
+    free(_prefetch_entries);
+    _prefetch_entries = NULL;
+    _prefetch_count = 0;
+}
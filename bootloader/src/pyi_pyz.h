@@ -0,0 +1,49 @@
+/*
+ * ****************************************************************************
+ * Copyright (c) 2013-2022, PyInstaller Development Team.
+ *
+ * Distributed under the terms of the GNU General Public License (version 2
+ * or later) with exception for distributing the bootloader.
+ *
+ * The full license is in the file COPYING.txt, distributed with this software.
+ *
+ * SPDX-License-Identifier: (GPL-2.0-or-later WITH Bootloader-exception)
+ * ****************************************************************************
+ */
+
+/*
+ * Native access to the PYZ archive for the bootstrap modules.
+ */
+
+#ifndef PYI_PYZ_H
+#define PYI_PYZ_H
+
+#include "pyi_global.h"
+#include "pyi_archive.h"
+#include "pyi_python.h"
+
+/*
+ * Expose the given PYZ archive entry of the memory-mapped archive as the
+ * built-in module _pyi_pyz; path is the archive name as put on sys.path.
+ * Does nothing if the archive is not mapped, or if a PYZ archive was
+ * already exposed. Must be called after Py_Initialize(). Returns 0 on
+ * success (including when nothing was done), -1 on error.
+ */
+int pyi_pyz_install(ARCHIVE_STATUS *status, TOC *ptoc, PyObject *path);
+
+/*
+ * If the pyi-prefetch option is set, start a background thread that reads
+ * ahead the first PYZ archive of the memory-mapped archive, and inflates
+ * its entries flagged for prefetching, for use by the _pyi_pyz module.
+ * Must be called before pyi_pyz_install(). Failure to start prefetching
+ * is not an error; returns 0.
+ */
+int pyi_pyz_prefetch_start(ARCHIVE_STATUS *status);
+
+/*
+ * Stop the prefetch thread, and free the prefetched data. Must be called
+ * after Py_Finalize(), before the archive is closed.
+ */
+void pyi_pyz_prefetch_stop(void);
+
+#endif  /* PYI_PYZ_H */
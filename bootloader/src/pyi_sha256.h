@@ -0,0 +1,43 @@
+/*
+ * ****************************************************************************
+ * Copyright (c) 2013-2022, PyInstaller Development Team.
+ *
+ * Distributed under the terms of the GNU General Public License (version 2
+ * or later) with exception for distributing the bootloader.
+ *
+ * The full license is in the file COPYING.txt, distributed with this software.
+ *
+ * SPDX-License-Identifier: (GPL-2.0-or-later WITH Bootloader-exception)
+ * ****************************************************************************
+ */
+
+/*
+ * SHA-256 (FIPS 180-4), used to verify the objects of the content-addressed
+ * store against the digests in the TOC.
+ */
+
+#ifndef PYI_SHA256_H
+#define PYI_SHA256_H
+
+#include <stddef.h>  /* size_t */
+#include <stdint.h>
+
+#define PYI_SHA256_DIGEST_SIZE 32
+
+typedef struct _pyi_sha256 {
+    uint32_t state[8];
+    uint64_t length;            /* Number of bytes hashed so far */
+    unsigned char block[64];    /* Pending input, length % 64 bytes */
+} PYI_SHA256;
+
+void pyi_sha256_init(PYI_SHA256 *ctx);
+
+void pyi_sha256_update(PYI_SHA256 *ctx, const void *data, size_t size);
+
+/*
+ * Finish the computation and store the digest. The context must be
+ * initialized again before it is reused.
+ */
+void pyi_sha256_final(PYI_SHA256 *ctx, unsigned char digest[PYI_SHA256_DIGEST_SIZE]);
+
+#endif  /* PYI_SHA256_H */
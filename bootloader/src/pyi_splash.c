@@ -63,8 +63,8 @@
 static Tcl_Mutex status_mutex;
 static Tcl_Mutex call_mutex;
 
-/* This mutex/condition is to hold the bootloader until the
- * splash screen has been started */
+/* This mutex/condition is to hold the bootloader, where needed, until
+ * the splash screen has been started (see pyi_splash_wait_started) */
 static Tcl_Mutex start_mutex;
 static Tcl_Condition start_cond;
 
@@ -73,6 +73,8 @@ static Tcl_Condition start_cond;
 static Tcl_Condition exit_wait;
 static Tcl_Mutex exit_mutex;
 static bool exitMainLoop;
+/* Set (under exit_mutex) once the interpreter thread has exited */
+static bool threadExited;
 
 /* Forward declarations */
 static Tcl_ThreadCreateProc _splash_init;
@@ -114,7 +116,6 @@ pyi_splash_setup(SPLASH_STATUS *splash_status,
      */
     strncpy(splash_status->tcl_libpath, data_header->tcl_libname, 16);
     strncpy(splash_status->tk_libpath, data_header->tk_libname, 16);
-    strncpy(splash_status->rundir, data_header->rundir, 16);
 
     /* Tcl requires a full path to the tk library. Since we expect at
      * this moment that we are in a onedir application the tk library is in
@@ -173,6 +174,15 @@ pyi_splash_setup(SPLASH_STATUS *splash_status,
  * the internal function _splash_init is called. This function will setup
  * the environment for the splash screen.
  *
+ * The function does not wait for Tcl/Tk to be initialized and for the
+ * splash screen script to run, so that the extraction proceeds in the
+ * meantime; the progress published in the meantime is applied once the
+ * splash screen is up (see pyi_splash_update_prg). The bootloader waits by
+ * calling pyi_splash_wait_started only before it starts the Python
+ * interpreter or the child process, which communicate with the splash
+ * screen (through the _PYIBoot_SPLASH environment variable set by the
+ * splash screen script).
+ *
  * If the thread was created successfully, the return value will be 0,
  * otherwise a non zero number is returned. Note that a return code of
  * 0 does not necessarily mean, that Tcl/Tk was successfully initialized.
@@ -184,6 +194,7 @@ pyi_splash_start(SPLASH_STATUS *status, const char *executable)
 
     if (status->dll_tcl == NULL || status->dll_tk == NULL) {
         /* Make sure the libraries are attached */
+        PI_Tcl_MutexUnlock(&status_mutex);
         return -1;
     }
 
@@ -191,6 +202,9 @@ pyi_splash_start(SPLASH_STATUS *status, const char *executable)
      * with Tcl, otherwise the behavior of tcl is undefined. */
     PI_Tcl_FindExecutable(executable);
 
+    status->startup_state = SPLASH_STARTUP_PENDING;
+    threadExited = false;
+
     /* We try to create a new thread (in which the tcl interpreter will run) with
      * a methods provided by tcl. This function will return TCL_ERROR if it is
      * either not implemented (tcl is not threaded) or an error occurs.
@@ -201,27 +215,75 @@ pyi_splash_start(SPLASH_STATUS *status, const char *executable)
                             0,                    /* Use default stack size */
                             0) != TCL_OK) {       /* no flags */
         FATALERROR("SPLASH: Tcl is not threaded. Only threaded tcl is supported.\n");
+        status->startup_state = SPLASH_STARTUP_NONE;
         PI_Tcl_MutexUnlock(&status_mutex);
         pyi_splash_finalize(status);
         return -1;
     }
-    PI_Tcl_MutexLock(&start_mutex);
     PI_Tcl_MutexUnlock(&status_mutex);
 
     VS("SPLASH: Created thread for tcl interpreter.\n");
+    return 0;
+}
 
-    /* To avoid a race condition between the tcl and python interpreter
-     * we need to wait until the splash screen has been started. We lock
-     * here until the tcl thread notified us, that it has finished starting up.
-     * See discarded idea in pyi_splash python module */
-    PI_Tcl_ConditionWait(&start_cond, &start_mutex, NULL);
+/*
+ * Wait until the splash screen has been started, i.e., Tcl/Tk has been
+ * initialized and the splash screen script has run, or failed to. To avoid
+ * a race condition between the tcl and python interpreter, this must be
+ * called before Python is initialized or the child process is started
+ * (see discarded idea in pyi_splash python module). Returns immediately
+ * if the splash screen was not started. Returns 0 if the splash screen is
+ * up, and -1 if it could not be started.
+ */
+int
+pyi_splash_wait_started(SPLASH_STATUS *status)
+{
+    int state;
+    bool waited = false;
+
+    /* The state only changes from (and to) SPLASH_STARTUP_NONE on the
+     * bootloader thread. */
+    if (status == NULL || status->startup_state == SPLASH_STARTUP_NONE) {
+        return -1;
+    }
+    PI_Tcl_MutexLock(&start_mutex);
+    while (status->startup_state == SPLASH_STARTUP_PENDING) {
+        waited = true;
+        PI_Tcl_ConditionWait(&start_cond, &start_mutex, NULL);
+    }
+    state = status->startup_state;
     PI_Tcl_MutexUnlock(&start_mutex);
-    PI_Tcl_ConditionFinalize(&start_cond);
-    VS("SPLASH: Splash screen started.\n");
 
+    if (state != SPLASH_STARTUP_DONE) {
+        return -1;
+    }
+    if (waited) {
+        VS("SPLASH: Splash screen started.\n");
+    }
     return 0;
 }
 
+/*
+ * Return true if the splash screen is not running (anymore), i.e., it was
+ * never started, or the interpreter thread has exited, e.g., because the
+ * python program closed the splash screen. The splash screen can then be
+ * finalized without waiting. Must be called from the bootloader thread,
+ * after pyi_splash_wait_started().
+ */
+bool
+pyi_splash_is_closed(SPLASH_STATUS *status)
+{
+    bool exited;
+
+    if (status->startup_state == SPLASH_STARTUP_NONE) {
+        return true;
+    }
+    PI_Tcl_MutexLock(&exit_mutex);
+    exited = threadExited;
+    PI_Tcl_MutexUnlock(&exit_mutex);
+    return exited;
+}
+
 /*
  * Searches the CArchive for splash screen resources and returns a pointer
  * to its header. The fields inside the SPLASH_DATA_HEADER define the
@@ -241,15 +303,13 @@ SPLASH_DATA_HEADER *
 pyi_splash_find(ARCHIVE_STATUS *status)
 {
     SPLASH_DATA_HEADER *header = NULL;
-    TOC *ptoc = status->tocbuff;
+    TOC **entries;
+    size_t count;
 
-    while (ptoc < status->tocend) {
-        if (ptoc->typcd == ARCHIVE_ITEM_SPLASH) {
-            header = (SPLASH_DATA_HEADER *) pyi_arch_extract(status, ptoc);
-            VS("SPLASH: Found splash screen resources.\n");
-            break;
-        }
-        ptoc = pyi_arch_increment_toc_ptr(status, ptoc);
+    entries = pyi_arch_get_entries(status, ARCHIVE_CLASS_SPLASH, &count);
+    if (count > 0) {
+        header = (SPLASH_DATA_HEADER *) pyi_arch_extract(status, entries[0]);
+        VS("SPLASH: Found splash screen resources.\n");
     }
 
     return header;
@@ -261,42 +321,19 @@ pyi_splash_find(ARCHIVE_STATUS *status)
  * be on the filesystem. If no dependencies are in the archive, this function
  * does nothing.
  *
- * Since these extracted files would collide with the files the loop inside
- * pyi_launch_extract_binaries extracts, we put the splash screen files into
- * a subdirectory inside archive_status->temppath. The name of the subdirectory
- * is provided by the SPLASH_DATA_HEADER "rundir" field, which is ensured to not
- * collide with any custom directory the users program includes.
- *
- * Unpacking into a subdirectory creates a small inefficiency, because
- * the loop in pyi_launch_extract_binaries unpacks these files again later.
+ * The files are extracted into their final location in
+ * archive_status->temppath, and marked as extracted in the archive status,
+ * so that the loop inside pyi_launch_extract_binaries skips them.
  */
 int
 pyi_splash_extract(ARCHIVE_STATUS *archive_status, SPLASH_STATUS *splash_status)
 {
-    /*
-     * Alternative implementations considered:
-     *    - Implementing a check in pyi_launch_extract_binaries if an already extracted
-     *      and therefore in temppath existing file belongs to the splash screen.
-     *      -> Discarded this idea, because SPLASH_STATUS would need to be passed
-     *         down to pyi_open_target and for every file already extracted a loop
-     *         through the archive would need to check if it belongs to the splash screen
-     *    - Implementing a "prioritized" TOC, which starts at a specific level to extract
-     *      files. If splash resources are appended these would be extracted, because they
-     *      would get the level e.g. 0 assigned. After this extracting those resources only
-     *      files with levels >0 would be extracted.
-     *      -> Discarded this idea, because it would need a huge rewrite of the current TOC
-     *         system in PyInstaller and the bootloader
-     */
     size_t pos;
-    TOC *tmp_toc, *ptoc;
-    int rc = 0;
+    TOC *ptoc;
     bool extracted = false;
     char *filename;
     char tmp[PATH_MAX];
-    char run_dir[PATH_MAX];
-
-    /* The last item in TOC is a path, so limit it is at PATH_MAX */
-    tmp_toc = (TOC*) calloc(1, sizeof(TOC) + PATH_MAX);
+    const char *run_dir;
 
     /* Iterate over the requirements array */
     for (pos = 0; pos < splash_status->requirements_len; pos += strlen(filename) + 1) {
@@ -307,45 +344,40 @@ pyi_splash_extract(ARCHIVE_STATUS *archive_status, SPLASH_STATUS *splash_status)
              * a onefile archive, so we try to extract all dependencies and update
              * the paths */
             extracted = true;
-            /*
-             * Copy the TOC into a new buffer, because we need to modify
-             * the TOCs name in order to change its extractionpath.
-             * The name is changed to move the file into a directory named
-             * after the value of rundir. This is necessary, since the extraction
-             * of the rest of the files would collide with these files.
-             */
-            memcpy(tmp_toc, ptoc, ptoc->structlen);
-            pyi_path_join(tmp_toc->name, splash_status->rundir, ptoc->name);
-            tmp_toc->structlen = ptoc->structlen - (int) strlen(ptoc->name) + (int) strlen(tmp_toc->name);
-
-            /* Extract file into the rundir */
-            if (pyi_arch_extract2fs(archive_status, tmp_toc)) {
+            if (pyi_arch_is_extracted(archive_status, ptoc)) {
+                continue;
+            }
+
+            /* Extract file into temppath; files in the populated
+             * persistent extraction cache are already there. */
+            if (pyi_create_temp_path(archive_status) == -1) {
+                return -2;
+            }
+            if (!archive_status->is_cached && pyi_arch_extract2fs(archive_status, ptoc)) {
                 FATALERROR("SPLASH: Cannot extract requirement %s.\n", ptoc->name);
-                rc = -2;
-                goto cleanup;
+                return -2;
             }
+            pyi_arch_mark_extracted(archive_status, ptoc);
         }
         else if (extracted) {
             /* We extracted previously some files but we didn't find this one, so
              * the dependency is not available */
             FATALERROR("SPLASH: Cannot find requirement %s in archive.\n", filename);
-            rc = -1;
-            goto cleanup;
+            return -1;
         }
     }
 
     /* Alter the paths inside SPLASH_STATUS to load the the libraries from the
      * correct place */
     if (extracted) {
-        /* Onefile mode; the libraries were extracted into a sub-directory of
-         * temppath */
-        pyi_path_join(run_dir, archive_status->temppath, splash_status->rundir);
+        /* Onefile mode; the libraries were extracted into temppath */
+        run_dir = archive_status->temppath;
     } else {
         /* Onedir mode; we also need to adjust the paths to shared libraries so that
          * the absolute paths are used. On Windows, we could seemingly get away with
          * using just library base name, but not so on Linux, where we would end up
          * trying to load system-wide library instead of the bundled one. */
-        strncpy(run_dir, archive_status->homepath, PATH_MAX);
+        run_dir = archive_status->homepath;
     }
 
     strncpy(tmp, splash_status->tcl_libpath, PATH_MAX);
@@ -357,9 +389,7 @@ pyi_splash_extract(ARCHIVE_STATUS *archive_status, SPLASH_STATUS *splash_status)
     pyi_path_basename(tmp, splash_status->tk_lib);
     pyi_path_join(splash_status->tk_lib, run_dir, tmp);
 
-cleanup:
-    free(tmp_toc);
-    return rc;
+    return 0;
 }
 
 /*
@@ -395,6 +425,10 @@ pyi_splash_finalize(SPLASH_STATUS *status)
     if (status != NULL) {
         if (status->thread_id == PI_Tcl_GetCurrentThread()) {
             /* We are in the interpreter thread */
+            if (status->progress_timer != NULL) {
+                PI_Tcl_DeleteTimerHandler(status->progress_timer);
+                status->progress_timer = NULL;
+            }
             if (status->interp != NULL) {
                 /* We can only call this function safely, if we are
                  * in the tcl interpreter thread */
@@ -404,7 +438,9 @@ pyi_splash_finalize(SPLASH_STATUS *status)
             }
         }
         else {
-            /* We run in the bootloader thread */
+            /* We run in the bootloader thread; let the startup of the
+             * splash screen complete first, if still in progress. */
+            pyi_splash_wait_started(status);
             if (status->interp != NULL) {
                 /* We notify the tcl thread, if it still exists
                  * to exit and wait for it */
@@ -417,6 +453,10 @@ pyi_splash_finalize(SPLASH_STATUS *status)
                 PI_Tcl_MutexUnlock(&exit_mutex);
                 PI_Tcl_ConditionFinalize(&exit_wait);
             }
+            if (status->startup_state != SPLASH_STARTUP_NONE) {
+                PI_Tcl_ConditionFinalize(&start_cond);
+                status->startup_state = SPLASH_STARTUP_NONE;
+            }
             /* This function should only be called after python has been
              * destroyed with Py_Finalize. Tcl/Tk/tkinter do **not** support
              * multiple instances of themselves due to restrictions of Tcl
@@ -575,43 +615,117 @@ _splash_event_proc(Tcl_Event *ev, int flags)
     return 1;  /* Not an error code, this indicates, that the event is satisfied */
 }
 
+/* Interval (in milliseconds) at which the interpreter thread polls the
+ * progress of the extraction; about 30 updates per second. */
+#define _SPLASH_PROGRESS_INTERVAL 33
+
 /*
- * To update the text on the splash screen with the current item unpacking
- * we schedule a Splash_Event into the tcl interpreters event queue.
- *
- * This function will update the variable "status_text", which updated the label
- * on the splash screen. We schedule this function in async mode, meaning we
- * the main (bootloader) thread does not wait until this function executed.
+ * Timer handler that copies the progress of the extraction, as published
+ * by pyi_splash_update_prg, into the variables "status_text" (the name of
+ * the latest entry) and "status_progress" (the percentage of bytes
+ * extracted) of the splash screen script. Only the changes are applied,
+ * however many entries were extracted in between. The handler re-arms
+ * itself until the extraction is complete.
  *
  * Note: This function is executed inside the tcl interpreter thread
  */
-int
-_pyi_splash_progress_update(SPLASH_STATUS *status, void *user_data)
+static void
+_pyi_splash_progress_poll(ClientData client_data)
 {
-    TOC *ptoc;
-
-    ptoc = (TOC *) user_data;
-
-    PI_Tcl_SetVar2(status->interp, "status_text", NULL, ptoc->name, TCL_GLOBAL_ONLY);
+    SPLASH_STATUS *status = (SPLASH_STATUS *) client_data;
+    int percent = status->progress_percent;
+    TOC *ptoc = status->progress_entry;
+    char buffer[8];
+
+    status->progress_timer = NULL;
+    if (status->interp == NULL) {
+        return;
+    }
+    if (ptoc != NULL && ptoc != status->progress_shown_entry) {
+        PI_Tcl_SetVar2(status->interp, "status_text", NULL, ptoc->name, TCL_GLOBAL_ONLY);
+        status->progress_shown_entry = ptoc;
+    }
+    if (percent != status->progress_shown_percent) {
+        snprintf(buffer, sizeof(buffer), "%d", percent);
+        PI_Tcl_SetVar2(status->interp, "status_progress", NULL, buffer, TCL_GLOBAL_ONLY);
+        status->progress_shown_percent = percent;
+    }
+    if (percent < 100) {
+        status->progress_timer = PI_Tcl_CreateTimerHandler(_SPLASH_PROGRESS_INTERVAL,
+                                                           _pyi_splash_progress_poll, status);
+    }
+}
 
+/*
+ * Start polling the progress of the extraction.
+ *
+ * Note: This function is executed inside the tcl interpreter thread
+ */
+static int
+_pyi_splash_progress_start(SPLASH_STATUS *status, void *user_data)
+{
+    (void)user_data;
+    if (status->interp != NULL && status->progress_timer == NULL) {
+        status->progress_shown_percent = -1;
+        _pyi_splash_progress_poll(status);
+    }
     return 0;
 }
 
 /*
- * To update the text on the splash screen (optionally) we provide
- * this function, which enqueues an event for the tcl interpreter
- * thread to service. We update the text based on the name gave by ptoc
+ * Set the total size of the entries to be extracted, against which the
+ * progress is measured. Must be called before the first call to
+ * pyi_splash_update_prg.
+ */
+void
+pyi_splash_set_total(SPLASH_STATUS *status, uint64_t total_size)
+{
+    status->progress_done = 0;
+    status->progress_total = total_size;
+}
+
+/*
+ * To update the text and the progress on the splash screen (optionally)
+ * we provide this function, which records the entry as the latest one
+ * being unpacked, and adds its size to the bytes extracted. The
+ * interpreter thread picks up the latest values at its own pace (see
+ * _pyi_splash_progress_poll), so the cost on the extraction path is
+ * constant and no event is posted per entry; only the first call
+ * enqueues an event to start polling. If the splash screen is still
+ * starting up, no event is posted; the interpreter thread starts polling
+ * once the splash screen script has run, so the progress made until then
+ * is not lost.
  *
  * This function is called from within pyi_launch_extract_binaries to
- * update which file is currently in the progress of being
- * unpacked.
+ * update which file is currently in the progress of being unpacked.
+ * The calls must be serialized by the caller.
  */
 int
 pyi_splash_update_prg(SPLASH_STATUS *status, TOC *ptoc)
 {
-    /* We enqueue the _pyi_splash_progress_update function into the tcl
-     * interpreter event queue in async mode, ignoring the return value. */
-    return pyi_splash_send(status, true, ptoc, _pyi_splash_progress_update);
+    uint64_t percent = 100;
+
+    status->progress_done += ptoc->ulen;
+    if (status->progress_done < status->progress_total) {
+        percent = status->progress_done * 100 / status->progress_total;
+    }
+    status->progress_entry = ptoc;
+    status->progress_percent = (int)percent;
+
+    if (!status->progress_polling) {
+        int state;
+
+        PI_Tcl_MutexLock(&start_mutex);
+        status->progress_polling = true;
+        state = status->startup_state;
+        PI_Tcl_MutexUnlock(&start_mutex);
+        if (state == SPLASH_STARTUP_DONE) {
+            /* We enqueue the _pyi_splash_progress_start function into the tcl
+             * interpreter event queue in async mode, ignoring the return value. */
+            return pyi_splash_send(status, true, NULL, _pyi_splash_progress_start);
+        }
+    }
+    return 0;
 }
 
 /*
@@ -837,6 +951,7 @@ _splash_init(ClientData client_data)
     int err = 0;
     SPLASH_STATUS *status;
     Tcl_Obj *image_data_obj;
+    bool poll_progress;
 
     PI_Tcl_MutexLock(&status_mutex);
 
@@ -939,10 +1054,16 @@ _splash_init(ClientData client_data)
     }
 
     /* We need to notify the bootloader main thread that the splash screen
-     * has been started and fully setup */
+     * has been started and fully setup, and start polling the progress if
+     * the extraction has published any in the meantime */
     PI_Tcl_MutexLock(&start_mutex);
+    status->startup_state = SPLASH_STARTUP_DONE;
+    poll_progress = status->progress_polling;
     PI_Tcl_ConditionNotify(&start_cond);
     PI_Tcl_MutexUnlock(&start_mutex);
+    if (poll_progress) {
+        _pyi_splash_progress_start(status, NULL);
+    }
 
     /* Main loop.
      * we exit this loop from within tcl. */
@@ -961,6 +1082,9 @@ _splash_init(ClientData client_data)
     /* In case the startup fails the main thread should continue,
      * in normal startup this segment will notify no waiting condition */
     PI_Tcl_MutexLock(&start_mutex);
+    if (status->startup_state == SPLASH_STARTUP_PENDING) {
+        status->startup_state = SPLASH_STARTUP_FAILED;
+    }
     PI_Tcl_ConditionNotify(&start_cond);
     PI_Tcl_MutexUnlock(&start_mutex);
 
@@ -974,6 +1098,7 @@ _splash_init(ClientData client_data)
     /* We notify all conditions waiting for this thread to exit,
      * if there are any */
     PI_Tcl_MutexLock(&exit_mutex);
+    threadExited = true;
     PI_Tcl_ConditionNotify(&exit_wait);
     PI_Tcl_MutexUnlock(&exit_mutex);
 
@@ -23,15 +23,16 @@
  * This struct is a header describing the rest of this archive item */
 typedef struct _splash_data_header {
     /*
-     * The filenames of the tcl and tk dynamic libraries. These
-     * files are extracted into a subdirectory named after the name in
-     * "rundir". This prevents the an error of "file already exists".
+     * The filenames of the tcl and tk dynamic libraries. In onefile
+     * mode, these files are extracted into the temp folder ahead of
+     * the other files.
      */
     char tcl_libname[16];  /* Filename of tcl library, e.g. tcl86t.dll */
     char tk_libname[16];   /* Filename of tk library, e.g. tk86t.dll */
     char tk_lib[16];       /* Tk library root , e.g. "tk/" */
-    char rundir[16];       /* temp folder inside extraction path
-                            * in which the dependencies are extracted */
+    char rundir[16];       /* Formerly the folder inside the temp folder
+                            * in which the dependencies were extracted;
+                            * no longer used by the bootloader */
 
     int script_len;        /* Length of the script */
     int script_offset;     /* Offset (rel to start) of the script */
@@ -95,7 +96,6 @@ typedef struct _splash_status {
     char tcl_libpath[PATH_MAX];
     char tk_libpath[PATH_MAX];
     char tk_lib[PATH_MAX];
-    char rundir[PATH_MAX];
     /*
      * The Tcl script to be executed to create the splash screen
      * and IPC mechanism
@@ -132,9 +132,41 @@ typedef struct _splash_status {
      */
     dylib_t dll_tcl;
     dylib_t dll_tk;
+    /*
+     * Progress of the extraction. The extracting thread only stores the
+     * latest entry and the percentage of bytes extracted in the
+     * progress_entry and progress_percent slots; the interpreter thread
+     * polls them at a fixed rate and updates the variables status_text
+     * and status_progress of the splash screen script if they changed.
+     * Both slots are written and read as a whole by a single thread each,
+     * so no lock is needed.
+     */
+    TOC *volatile progress_entry;
+    volatile int  progress_percent;
+    /* Written only by the extracting thread */
+    uint64_t progress_done;
+    uint64_t progress_total;
+    bool     progress_polling;
+    /* Used only by the interpreter thread */
+    Tcl_TimerToken progress_timer;
+    TOC *          progress_shown_entry;
+    int            progress_shown_percent;
+    /*
+     * State of the startup of the splash screen (see SPLASH_STARTUP_*),
+     * which runs asynchronously in the interpreter thread. Accessed under
+     * the start mutex; together with progress_polling, once the startup
+     * may have begun.
+     */
+    int startup_state;
 
 } SPLASH_STATUS;
 
+/* Values of SPLASH_STATUS.startup_state */
+#define SPLASH_STARTUP_NONE 0     /* The interpreter thread was not created */
+#define SPLASH_STARTUP_PENDING 1  /* Tcl/Tk and the script are being initialized */
+#define SPLASH_STARTUP_DONE 2     /* The splash screen script has run */
+#define SPLASH_STARTUP_FAILED 3   /* Tcl/Tk could not be initialized */
+
 typedef int (pyi_splash_event_proc)(SPLASH_STATUS *, void *);
 
 /**
@@ -145,6 +177,8 @@ int pyi_splash_setup(SPLASH_STATUS *splash_status, ARCHIVE_STATUS *archive_statu
 int pyi_splash_attach(SPLASH_STATUS *status);
 int pyi_splash_finalize(SPLASH_STATUS *status);
 int pyi_splash_start(SPLASH_STATUS *status, const char *executable);
+int pyi_splash_wait_started(SPLASH_STATUS *status);
+bool pyi_splash_is_closed(SPLASH_STATUS *status);
 
 /* Archive helper functions */
 SPLASH_DATA_HEADER *pyi_splash_find(ARCHIVE_STATUS *status);
@@ -152,6 +186,7 @@ int pyi_splash_extract(ARCHIVE_STATUS *archive_status, SPLASH_STATUS *splash_sta
 
 int pyi_splash_send(SPLASH_STATUS *status, bool async, void *user_data,
                     pyi_splash_event_proc proc);
+void pyi_splash_set_total(SPLASH_STATUS *status, uint64_t total_size);
 int pyi_splash_update_prg(SPLASH_STATUS *status, TOC *ptoc);
 
 /* Memory allocation functions */
@@ -45,6 +45,8 @@ DECLPROC(Tcl_ConditionNotify);
 DECLPROC(Tcl_ConditionWait);
 DECLPROC(Tcl_ThreadQueueEvent);
 DECLPROC(Tcl_ThreadAlert);
+DECLPROC(Tcl_CreateTimerHandler);
+DECLPROC(Tcl_DeleteTimerHandler);
 
 /* Tcl interpreter manipulation */
 DECLPROC(Tcl_GetVar2);
@@ -94,6 +96,8 @@ pyi_splashlib_attach(dylib_t dll_tcl, dylib_t dll_tk)
     GETPROC(dll_tcl, Tcl_ConditionWait);
     GETPROC(dll_tcl, Tcl_ThreadQueueEvent);
     GETPROC(dll_tcl, Tcl_ThreadAlert);
+    GETPROC(dll_tcl, Tcl_CreateTimerHandler);
+    GETPROC(dll_tcl, Tcl_DeleteTimerHandler);
 
     /* Tcl interpreter manipulation */
     GETPROC(dll_tcl, Tcl_GetVar2);
@@ -40,12 +40,14 @@ typedef struct Tcl_Obj_ Tcl_Obj;
 typedef struct Tcl_Condition_ *Tcl_Condition;
 typedef struct Tcl_Mutex_ *Tcl_Mutex;
 typedef struct Tcl_Time_ Tcl_Time;
+typedef struct Tcl_TimerToken_ *Tcl_TimerToken;
 typedef void* ClientData;
 
 /* Function prototypes */
 typedef int (Tcl_ObjCmdProc)(ClientData, Tcl_Interp *, int, Tcl_Obj *const[]);
 typedef int (Tcl_CmdDeleteProc)(ClientData);
 typedef int (Tcl_EventProc) (Tcl_Event *, int);
+typedef void (Tcl_TimerProc) (ClientData);
 #ifdef _WIN32
 typedef unsigned (__stdcall Tcl_ThreadCreateProc)(ClientData clientData);
     #define Tcl_ThreadCreateType        unsigned __stdcall
@@ -91,6 +93,8 @@ EXTDECLPROC(void, Tcl_ConditionNotify, (Tcl_Condition *));
 EXTDECLPROC(void, Tcl_ConditionWait, (Tcl_Condition *, Tcl_Mutex *, const Tcl_Time *));
 EXTDECLPROC(void, Tcl_ThreadQueueEvent, (Tcl_ThreadId, Tcl_Event *, Tcl_QueuePosition));
 EXTDECLPROC(void, Tcl_ThreadAlert, (Tcl_ThreadId threadId));
+EXTDECLPROC(Tcl_TimerToken, Tcl_CreateTimerHandler, (int, Tcl_TimerProc *, ClientData));
+EXTDECLPROC(void, Tcl_DeleteTimerHandler, (Tcl_TimerToken));
 
 /* Tcl interpreter manipulation */
 EXTDECLPROC(const char*, Tcl_GetVar2, (Tcl_Interp *, const char *, const char *, int));
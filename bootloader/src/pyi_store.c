@@ -0,0 +1,432 @@
+/*
+ * ****************************************************************************
+ * Copyright (c) 2013-2022, PyInstaller Development Team.
+ *
+ * Distributed under the terms of the GNU General Public License (version 2
+ * or later) with exception for distributing the bootloader.
+ *
+ * The full license is in the file COPYING.txt, distributed with this software.
+ *
+ * SPDX-License-Identifier: (GPL-2.0-or-later WITH Bootloader-exception)
+ * ****************************************************************************
+ */
+
+/*
+ * Content-addressed store of extracted files.
+ *
+ * When the pyi-runtime-store runtime option is set (to a directory; a
+ * leading ~ stands for the user's home directory), the onefile parent
+ * process materializes the extracted files from the objects of a store
+ * that is shared by all the programs of the user, and by all their
+ * versions. Only the files whose data is not in the store yet are
+ * written; they are then added to the store. A shared library bundled by
+ * several programs is thus written to the disk only once.
+ *
+ * The objects are stored as <store>/objects/<xx>/<digest>, where the
+ * digest is the SHA-256 of the uncompressed data, which the builder stores
+ * in the TOC (see pyi_arch_get_entry_digest()); the entries without one
+ * are extracted as usual.
+ *
+ * Where the filesystem supports it, the extracted files are cloned
+ * (reflinked) from the objects, and new objects are cloned from the
+ * extracted files, so that a program that modifies its files cannot modify
+ * the store. Otherwise, the extracted files are hard links to the objects,
+ * which also keeps them in the page cache only once. The objects are then
+ * read-only, but a program can still make its file writable and modify
+ * it, and with it the object; hence an object is verified against the
+ * digest of the entry before it is hard-linked, and removed (so that it is
+ * replaced by the extracted file) if it does not match. If a file can be
+ * neither cloned nor linked (e.g., the store is on another filesystem),
+ * it is extracted.
+ *
+ * An object is referenced as long as extracted files link to it, i.e., its
+ * link count is larger than one. After the program exits, the parent
+ * removes the objects that are not referenced and have not been used
+ * for _STORE_RETENTION seconds (linking, unlinking and cloning update the
+ * change time of the object). This is done at most once per
+ * _STORE_GC_INTERVAL seconds, as recorded by the modification time of
+ * <store>/gc-stamp.
+ *
+ * Objects are added by linking a complete file into the store, so other
+ * processes never see partially written objects; if two processes add the
+ * same object, the second link fails and is ignored. The store is only
+ * used if it is owned by the current user and not writable by other users.
+ * Only supported on POSIX systems.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifndef _WIN32
+    #include <dirent.h>  /* opendir */
+    #include <errno.h>
+    #include <fcntl.h>  /* open */
+    #include <sys/stat.h>
+    #include <time.h>
+    #include <unistd.h>  /* link, unlink */
+    #include <utime.h>
+    #if defined(__linux__)
+        #include <sys/ioctl.h>
+        #include <linux/fs.h>  /* FICLONE */
+    #endif
+    #if defined(HAVE_CLONEFILE)
+        #include <sys/clonefile.h>
+    #endif
+#endif
+
+/* PyInstaller headers */
+#include "pyi_global.h"
+#include "pyi_archive.h"
+#include "pyi_path.h"
+#include "pyi_sha256.h"
+#include "pyi_store.h"
+#include "pyi_utils.h"  /* pyi_getenv */
+
+/* Objects that are not referenced are kept for a week, and the store is
+ * collected at most once a day. */
+#define _STORE_RETENTION (7 * 24 * 3600)
+#define _STORE_GC_INTERVAL (24 * 3600)
+
+/* Size of the chunks in which objects are read to verify them. */
+#define _STORE_READ_CHUNK_SIZE (64 * 1024)
+
+#ifndef _WIN32
+
+/*
+ * Compute the path of the object of the entry in the store, and of the
+ * directory that contains it. Returns 0 on success, -1 if the entry has
+ * no digest.
+ */
+static int
+_pyi_store_get_object_path(const ARCHIVE_STATUS *status, const TOC *ptoc, char *dirpath, char *path)
+{
+    char name[2 * ARCHIVE_DIGEST_SIZE + 16];
+    const unsigned char *digest;
+    int i;
+
+    digest = pyi_arch_get_entry_digest(ptoc);
+    if (digest == NULL) {
+        return -1;
+    }
+    snprintf(name, sizeof(name), "objects/%02x", (unsigned int)digest[0]);
+    if (pyi_path_join(dirpath, status->storepath, name) == NULL) {
+        return -1;
+    }
+    for (i = 0; i < ARCHIVE_DIGEST_SIZE; i++) {
+        snprintf(name + 2 * i, 3, "%02x", (unsigned int)digest[i]);
+    }
+    if (pyi_path_join(path, dirpath, name) == NULL) {
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Verify that the object has the size and the digest of the entry, before
+ * it is hard-linked. An object that does not match was modified through
+ * one of its links; it is removed, so that the entry is extracted and
+ * added to the store again. Returns 0 if the object is intact, -1 if it
+ * is missing or was removed.
+ */
+static int
+_pyi_store_verify_object(const char *path, const TOC *ptoc)
+{
+    unsigned char digest[PYI_SHA256_DIGEST_SIZE];
+    unsigned char *buffer;
+    PYI_SHA256 sha256;
+    struct stat sbuf;
+    ssize_t count = 0;
+    bool intact = false;
+    int fd;
+
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+    buffer = (unsigned char *)malloc(_STORE_READ_CHUNK_SIZE);
+    if (buffer == NULL) {
+        close(fd);
+        return -1;
+    }
+    if (fstat(fd, &sbuf) == 0 && S_ISREG(sbuf.st_mode) && (uint64_t)sbuf.st_size == ptoc->ulen) {
+        pyi_sha256_init(&sha256);
+        do {
+            count = read(fd, buffer, _STORE_READ_CHUNK_SIZE);
+            if (count > 0) {
+                pyi_sha256_update(&sha256, buffer, (size_t)count);
+            }
+        } while (count > 0 || (count < 0 && errno == EINTR));
+        pyi_sha256_final(&sha256, digest);
+        intact = memcmp(digest, pyi_arch_get_entry_digest(ptoc), ARCHIVE_DIGEST_SIZE) == 0;
+    }
+    free(buffer);
+    close(fd);
+
+    if (count < 0) {
+        return -1;  /* Read error; leave the object alone */
+    }
+    if (!intact) {
+        VS("LOADER: Removing modified object %s from content-addressed store\n", path);
+        unlink(path);
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Create the file path as a copy of the object src that shares its data
+ * blocks, on filesystems that support it. Returns 0 on success, -1 if the
+ * file cannot be cloned.
+ */
+static int
+_pyi_store_clone(const char *src, const char *path)
+{
+#if defined(__linux__) && defined(FICLONE)
+    int in_fd;
+    int out_fd;
+    int rc;
+
+    in_fd = open(src, O_RDONLY | O_CLOEXEC);
+    if (in_fd < 0) {
+        return -1;
+    }
+    out_fd = open(path, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0700);
+    if (out_fd < 0) {
+        close(in_fd);
+        return -1;
+    }
+    rc = ioctl(out_fd, FICLONE, in_fd);
+    close(out_fd);
+    close(in_fd);
+    if (rc != 0) {
+        unlink(path);
+        return -1;
+    }
+    return 0;
+#elif defined(HAVE_CLONEFILE)
+    if (clonefile(src, path, 0) != 0) {
+        return -1;
+    }
+    chmod(path, S_IRUSR | S_IWUSR | S_IXUSR);
+    return 0;
+#else
+    (void)src;
+    (void)path;
+    return -1;
+#endif
+}
+
+/*
+ * Add the extracted file path to the store as object_path, whose directory
+ * is dirpath. The object is a clone of the file where the filesystem
+ * supports it, and the file itself otherwise. Returns 0 if the object was
+ * added, -1 if it is already in the store or cannot be added.
+ */
+static int
+_pyi_store_add_object(const char *path, const char *dirpath, const char *object_path)
+{
+    char temp_path[PATH_MAX];
+    int rc;
+
+    if (access(object_path, F_OK) == 0) {
+        return -1;
+    }
+    mkdir(dirpath, 0700);
+    /* The clone is made under a temporary name, and linked into place once
+     * it is complete. */
+    if (snprintf(temp_path, PATH_MAX, "%s.%ld", object_path, (long)getpid()) < PATH_MAX &&
+        _pyi_store_clone(path, temp_path) == 0) {
+        chmod(temp_path, S_IRUSR | S_IXUSR);
+        rc = link(temp_path, object_path);
+        unlink(temp_path);
+        return rc;
+    }
+    if (link(path, object_path) != 0) {
+        return -1;  /* Already in the store, or on another filesystem */
+    }
+    /* Shared with the store from now on. */
+    chmod(object_path, S_IRUSR | S_IXUSR);
+    return 0;
+}
+
+#endif  /* ifndef _WIN32 */
+
+int
+pyi_store_open(ARCHIVE_STATUS *status)
+{
+#ifdef _WIN32
+    (void)status;
+    return -1;
+#else
+    char storepath[PATH_MAX];
+    char path[PATH_MAX];
+    char *runtime_store;
+    char *home;
+    struct stat sbuf;
+    int len;
+
+    runtime_store = pyi_arch_get_option(status, "pyi-runtime-store");
+    if (runtime_store == NULL) {
+        return -1;
+    }
+    if (runtime_store[0] == '~' && (runtime_store[1] == PYI_SEP || runtime_store[1] == PYI_NULLCHAR)) {
+        home = pyi_getenv("HOME");
+        if (home == NULL) {
+            VS("LOADER: Cannot expand runtime-store %s without HOME\n", runtime_store);
+            return -1;
+        }
+        len = snprintf(storepath, PATH_MAX, "%s%s", home, runtime_store + 1);
+        free(home);
+    } else {
+        len = snprintf(storepath, PATH_MAX, "%s", runtime_store);
+    }
+    if (len < 0 || len >= PATH_MAX) {
+        return -1;
+    }
+
+    /* Create the directories if they do not exist yet. */
+    mkdir(storepath, 0700);
+    if (stat(storepath, &sbuf) != 0 || !S_ISDIR(sbuf.st_mode)) {
+        VS("LOADER: Content-addressed store %s is not available\n", storepath);
+        return -1;
+    }
+    if (sbuf.st_uid != geteuid() || (sbuf.st_mode & (S_IWGRP | S_IWOTH))) {
+        VS("LOADER: Ignoring content-addressed store %s with unsafe ownership or permissions\n", storepath);
+        return -1;
+    }
+    if (pyi_path_join(path, storepath, "objects") == NULL) {
+        return -1;
+    }
+    mkdir(path, 0700);
+    if (pyi_arch_set_path(&status->storepath, storepath) != 0) {
+        return -1;
+    }
+    VS("LOADER: Using content-addressed store %s\n", status->storepath);
+    return 0;
+#endif
+}
+
+size_t
+pyi_store_link_entries(ARCHIVE_STATUS *status, TOC **entries, size_t count)
+{
+#ifdef _WIN32
+    (void)status;
+    (void)entries;
+    return count;
+#else
+    char dirpath[PATH_MAX];
+    char object_path[PATH_MAX];
+    char path[PATH_MAX];
+    size_t remaining = 0;
+    size_t i;
+
+    for (i = 0; i < count; i++) {
+        TOC *ptoc = entries[i];
+
+        if (_pyi_store_get_object_path(status, ptoc, dirpath, object_path) != 0 ||
+            pyi_path_join(path, status->temppath, ptoc->name) == NULL) {
+            entries[remaining++] = ptoc;
+            continue;
+        }
+        if (_pyi_store_clone(object_path, path) == 0) {
+            /* Record the use of the object for pyi_store_collect() */
+            utime(object_path, NULL);
+        } else if (_pyi_store_verify_object(object_path, ptoc) != 0 || link(object_path, path) != 0) {
+            entries[remaining++] = ptoc;
+            continue;
+        }
+        pyi_arch_mark_extracted(status, ptoc);
+    }
+    VS("LOADER: Took %lu of %lu files from content-addressed store\n", (unsigned long)(count - remaining),
+       (unsigned long)count);
+    return remaining;
+#endif
+}
+
+void
+pyi_store_add_entries(const ARCHIVE_STATUS *status, TOC **entries, size_t count)
+{
+#ifdef _WIN32
+    (void)status;
+    (void)entries;
+    (void)count;
+#else
+    char dirpath[PATH_MAX];
+    char object_path[PATH_MAX];
+    char path[PATH_MAX];
+    size_t added = 0;
+    size_t i;
+
+    for (i = 0; i < count; i++) {
+        if (_pyi_store_get_object_path(status, entries[i], dirpath, object_path) == 0 &&
+            pyi_path_join(path, status->temppath, entries[i]->name) != NULL &&
+            _pyi_store_add_object(path, dirpath, object_path) == 0) {
+            added++;
+        }
+    }
+    VS("LOADER: Added %lu files to content-addressed store\n", (unsigned long)added);
+#endif
+}
+
+void
+pyi_store_collect(const ARCHIVE_STATUS *status)
+{
+#ifdef _WIN32
+    (void)status;
+#else
+    char path[PATH_MAX];
+    char dirpath[PATH_MAX];
+    char object_path[PATH_MAX];
+    struct stat sbuf;
+    struct dirent *entry;
+    struct dirent *object;
+    DIR *objects_dir;
+    DIR *dir;
+    time_t now = time(NULL);
+    unsigned long removed = 0;
+    int fd;
+
+    if (status->storepath[0] == PYI_NULLCHAR || pyi_path_join(path, status->storepath, "gc-stamp") == NULL) {
+        return;
+    }
+    if (stat(path, &sbuf) == 0 && now - sbuf.st_mtime < _STORE_GC_INTERVAL) {
+        return;
+    }
+    fd = open(path, O_WRONLY | O_CREAT | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        return;
+    }
+    close(fd);
+    utime(path, NULL);
+
+    if (pyi_path_join(path, status->storepath, "objects") == NULL) {
+        return;
+    }
+    objects_dir = opendir(path);
+    if (objects_dir == NULL) {
+        return;
+    }
+    while ((entry = readdir(objects_dir)) != NULL) {
+        if (entry->d_name[0] == '.' || pyi_path_join(dirpath, path, entry->d_name) == NULL) {
+            continue;
+        }
+        dir = opendir(dirpath);
+        if (dir == NULL) {
+            continue;
+        }
+        while ((object = readdir(dir)) != NULL) {
+            if (object->d_name[0] == '.' || pyi_path_join(object_path, dirpath, object->d_name) == NULL) {
+                continue;
+            }
+            /* Not linked from any extracted file, and not for a while */
+            if (lstat(object_path, &sbuf) == 0 && S_ISREG(sbuf.st_mode) && sbuf.st_nlink == 1 &&
+                now - sbuf.st_ctime >= _STORE_RETENTION && unlink(object_path) == 0) {
+                removed++;
+            }
+        }
+        closedir(dir);
+    }
+    closedir(objects_dir);
+    VS("LOADER: Removed %lu unreferenced objects from content-addressed store\n", removed);
+#endif
+}
@@ -0,0 +1,55 @@
+/*
+ * ****************************************************************************
+ * Copyright (c) 2013-2022, PyInstaller Development Team.
+ *
+ * Distributed under the terms of the GNU General Public License (version 2
+ * or later) with exception for distributing the bootloader.
+ *
+ * The full license is in the file COPYING.txt, distributed with this software.
+ *
+ * SPDX-License-Identifier: (GPL-2.0-or-later WITH Bootloader-exception)
+ * ****************************************************************************
+ */
+
+/*
+ * Content-addressed store of extracted files (pyi-runtime-store).
+ */
+
+#ifndef PYI_STORE_H
+#define PYI_STORE_H
+
+#include "pyi_global.h"
+#include "pyi_archive.h"
+
+/*
+ * Set up the content-addressed store given by the pyi-runtime-store
+ * option, and set status->storepath to it. Only supported on POSIX
+ * systems. Returns 0 if the store is used, -1 if it is not enabled or not
+ * available (the files are then extracted as usual).
+ */
+int pyi_store_open(ARCHIVE_STATUS *status);
+
+/*
+ * Clone or link the entries whose data is already in the store into the
+ * temporary directory, whose subdirectories must exist, and mark them as
+ * extracted. Objects are verified against the digests of the entries
+ * before they are hard-linked.
+ * The remaining entries are moved to the front of the array, in the same
+ * order; returns their number.
+ */
+size_t pyi_store_link_entries(ARCHIVE_STATUS *status, TOC **entries, size_t count);
+
+/*
+ * Add the entries that were extracted into the temporary directory to the
+ * store, unless their data is already there.
+ */
+void pyi_store_add_entries(const ARCHIVE_STATUS *status, TOC **entries, size_t count);
+
+/*
+ * Remove the objects of the store that no extracted file refers to and
+ * that have not been used for a while. Does nothing if the store is not
+ * used, or if it was collected recently.
+ */
+void pyi_store_collect(const ARCHIVE_STATUS *status);
+
+#endif  /* PYI_STORE_H */
@@ -0,0 +1,397 @@
+/*
+ * ****************************************************************************
+ * Copyright (c) 2013-2022, PyInstaller Development Team.
+ *
+ * Distributed under the terms of the GNU General Public License (version 2
+ * or later) with exception for distributing the bootloader.
+ *
+ * The full license is in the file COPYING.txt, distributed with this software.
+ *
+ * SPDX-License-Identifier: (GPL-2.0-or-later WITH Bootloader-exception)
+ * ****************************************************************************
+ */
+
+/*
+ * Startup phase timing.
+ *
+ * When enabled via the PYI_STARTUP_TRACE environment variable or the
+ * pyi-startup-trace runtime option (both specifying the path to the output
+ * file), the bootloader records the start time and duration of the main
+ * startup phases (opening the archive, extracting the files, loading and
+ * initializing Python, running the scripts), as well as of the extraction
+ * of each individual archive entry.
+ *
+ * The events are appended to the output file in the Chrome trace event
+ * format (JSON array of complete events), which can be loaded into
+ * chrome://tracing or Perfetto. Each process - in onefile mode, both the
+ * parent that extracts the files and the child that runs Python - adds
+ * its own events, identified by the process ID. The timestamps come from
+ * the system's monotonic clock, so the events of both processes can be
+ * shown on the same timeline. The events recorded before the user's
+ * scripts are run are also available in Python, as the list of dicts in
+ * sys._pyi_startup_trace.
+ *
+ * The first process of a launch that enables tracing truncates the output
+ * file, and marks its environment (_PYI_STARTUP_TRACE_ACTIVE) so that the
+ * processes it starts append to the file instead. The events are written
+ * when the process exits, also if Python exits the process (e.g., on
+ * sys.exit()) while the scripts are running.
+ */
+
+#ifdef _WIN32
+    #include <windows.h>
+#else
+    #include <pthread.h>  /* pthread_mutex_lock, pthread_self */
+    #include <unistd.h>   /* getpid */
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* PyInstaller headers */
+#include "pyi_global.h"
+#include "pyi_path.h"
+#include "pyi_python.h"
+#include "pyi_trace.h"
+#include "pyi_utils.h"
+
+typedef struct _trace_event {
+    const char *name;
+    uint64_t start_time;
+    uint64_t duration;
+    uint64_t thread_id;
+    /* Archive entry, for extraction events; NULL otherwise */
+    char *entry_name;
+    uint64_t bytes;
+    uint64_t inflate_time;
+    /* Counter event, with the value in bytes; duration is 0 */
+    bool is_counter;
+} TRACE_EVENT;
+
+#ifdef _WIN32
+static CRITICAL_SECTION _trace_mutex;
+#define _trace_mutex_init()   InitializeCriticalSection(&_trace_mutex)
+#define _trace_mutex_lock()   EnterCriticalSection(&_trace_mutex)
+#define _trace_mutex_unlock() LeaveCriticalSection(&_trace_mutex)
+#else
+static pthread_mutex_t _trace_mutex = PTHREAD_MUTEX_INITIALIZER;
+#define _trace_mutex_init()
+#define _trace_mutex_lock()   pthread_mutex_lock(&_trace_mutex)
+#define _trace_mutex_unlock() pthread_mutex_unlock(&_trace_mutex)
+#endif
+
+/* Set for the processes started by the process that truncated the
+ * output file. */
+#define _TRACE_ACTIVE_ENV "_PYI_STARTUP_TRACE_ACTIVE"
+
+static bool _trace_enabled = false;
+static char _trace_output_path[PATH_MAX];
+static TRACE_EVENT *_trace_events = NULL;
+static size_t _trace_events_count = 0;
+static size_t _trace_events_capacity = 0;
+/* Event begun by pyi_trace_begin_event(), if any */
+static const char *_trace_pending_name = NULL;
+static uint64_t _trace_pending_start_time = 0;
+
+static uint64_t
+_pyi_trace_get_thread_id()
+{
+#ifdef _WIN32
+    return (uint64_t)GetCurrentThreadId();
+#else
+    return (uint64_t)(uintptr_t)pthread_self();
+#endif
+}
+
+static unsigned long
+_pyi_trace_get_process_id()
+{
+#ifdef _WIN32
+    return (unsigned long)GetCurrentProcessId();
+#else
+    return (unsigned long)getpid();
+#endif
+}
+
+/*
+ * Write the events at exit, including the pending event, if any.
+ */
+static void
+_pyi_trace_atexit(void)
+{
+    pyi_trace_end_event();
+    pyi_trace_write();
+}
+
+int
+pyi_trace_enable(const char *output_path)
+{
+    char *active;
+    FILE *fp;
+
+    if (_trace_enabled) {
+        return 0;
+    }
+    if (output_path == NULL || output_path[0] == 0) {
+        return -1;
+    }
+    if (snprintf(_trace_output_path, PATH_MAX, "%s", output_path) >= PATH_MAX) {
+        VS("LOADER: startup trace output path exceeds PATH_MAX\n");
+        return -1;
+    }
+    active = pyi_getenv(_TRACE_ACTIVE_ENV);
+    if (active == NULL) {
+        /* Start a new trace */
+        fp = pyi_path_fopen(_trace_output_path, "wb");
+        if (fp != NULL) {
+            fclose(fp);
+        }
+        pyi_setenv(_TRACE_ACTIVE_ENV, "1");
+    }
+    free(active);
+    _trace_mutex_init();
+    _trace_enabled = true;
+    atexit(_pyi_trace_atexit);
+    VS("LOADER: startup trace enabled; output: %s\n", _trace_output_path);
+    return 0;
+}
+
+bool
+pyi_trace_is_enabled()
+{
+    return _trace_enabled;
+}
+
+/*
+ * Append a new event; must be called with the mutex held. Returns NULL if
+ * out of memory.
+ */
+static TRACE_EVENT *
+_pyi_trace_append_event(const char *name, uint64_t start_time, uint64_t duration)
+{
+    TRACE_EVENT *event;
+
+    if (_trace_events_count == _trace_events_capacity) {
+        size_t new_capacity = _trace_events_capacity ? 2 * _trace_events_capacity : 64;
+        TRACE_EVENT *new_events = (TRACE_EVENT *)realloc(_trace_events, new_capacity * sizeof(TRACE_EVENT));
+        if (new_events == NULL) {
+            return NULL;
+        }
+        _trace_events = new_events;
+        _trace_events_capacity = new_capacity;
+    }
+    event = &_trace_events[_trace_events_count++];
+    memset(event, 0, sizeof(TRACE_EVENT));
+    event->name = name;
+    event->start_time = start_time;
+    event->duration = duration;
+    event->thread_id = _pyi_trace_get_thread_id();
+    return event;
+}
+
+void
+pyi_trace_add_event(const char *name, uint64_t start_time, uint64_t duration,
+                    const char *entry_name, uint64_t bytes, uint64_t inflate_time)
+{
+    TRACE_EVENT *event;
+
+    if (!_trace_enabled) {
+        return;
+    }
+
+    _trace_mutex_lock();
+    /* Tracing is best-effort; drop the event if out of memory */
+    event = _pyi_trace_append_event(name, start_time, duration);
+    if (event != NULL) {
+        event->entry_name = entry_name ? strdup(entry_name) : NULL;
+        event->bytes = bytes;
+        event->inflate_time = inflate_time;
+    }
+    _trace_mutex_unlock();
+}
+
+void
+pyi_trace_begin_event(const char *name)
+{
+    if (!_trace_enabled) {
+        return;
+    }
+    _trace_pending_name = name;
+    _trace_pending_start_time = pyi_utils_get_monotonic_time();
+}
+
+void
+pyi_trace_end_event()
+{
+    const char *name = _trace_pending_name;
+
+    if (name == NULL) {
+        return;
+    }
+    _trace_pending_name = NULL;
+    pyi_trace_add_event(name, _trace_pending_start_time,
+                        pyi_utils_get_monotonic_time() - _trace_pending_start_time, NULL, 0, 0);
+}
+
+void
+pyi_trace_add_counter(const char *name, uint64_t bytes)
+{
+    TRACE_EVENT *event;
+
+    if (!_trace_enabled) {
+        return;
+    }
+
+    _trace_mutex_lock();
+    event = _pyi_trace_append_event(name, pyi_utils_get_monotonic_time(), 0);
+    if (event != NULL) {
+        event->is_counter = true;
+        event->bytes = bytes;
+    }
+    _trace_mutex_unlock();
+}
+
+int
+pyi_trace_set_sys_attribute()
+{
+    PyObject *list;
+    size_t i;
+
+    if (!_trace_enabled) {
+        return 0;
+    }
+
+    list = PI_PyList_New(0);
+    if (list == NULL) {
+        PI_PyErr_Clear();
+        return -1;
+    }
+
+    _trace_mutex_lock();
+    for (i = 0; i < _trace_events_count; i++) {
+        const TRACE_EVENT *event = &_trace_events[i];
+        PyObject *item;
+
+        if (event->entry_name) {
+            item = PI_Py_BuildValue("{s:s,s:K,s:K,s:s,s:K,s:K}",
+                                    "name", event->name,
+                                    "ts", (unsigned long long)event->start_time,
+                                    "dur", (unsigned long long)event->duration,
+                                    "entry", event->entry_name,
+                                    "bytes", (unsigned long long)event->bytes,
+                                    "inflate_us", (unsigned long long)event->inflate_time);
+        } else if (event->is_counter) {
+            item = PI_Py_BuildValue("{s:s,s:K,s:K}",
+                                    "name", event->name,
+                                    "ts", (unsigned long long)event->start_time,
+                                    "bytes", (unsigned long long)event->bytes);
+        } else {
+            item = PI_Py_BuildValue("{s:s,s:K,s:K}",
+                                    "name", event->name,
+                                    "ts", (unsigned long long)event->start_time,
+                                    "dur", (unsigned long long)event->duration);
+        }
+        if (item == NULL) {
+            /* E.g., entry name that is not valid UTF-8 */
+            PI_PyErr_Clear();
+            continue;
+        }
+        PI_PyList_Append(list, item);
+        PI_Py_DecRef(item);
+    }
+    _trace_mutex_unlock();
+
+    PI_PySys_SetObject("_pyi_startup_trace", list);
+    PI_Py_DecRef(list);
+    return 0;
+}
+
+/*
+ * Write string as JSON string literal.
+ */
+static void
+_pyi_trace_write_json_string(FILE *fp, const char *str)
+{
+    const unsigned char *ptr;
+
+    fputc('"', fp);
+    for (ptr = (const unsigned char *)str; *ptr; ptr++) {
+        if (*ptr == '"' || *ptr == '\\') {
+            fputc('\\', fp);
+            fputc(*ptr, fp);
+        } else if (*ptr < 0x20) {
+            fprintf(fp, "\\u%04x", *ptr);
+        } else {
+            fputc(*ptr, fp);
+        }
+    }
+    fputc('"', fp);
+}
+
+int
+pyi_trace_write()
+{
+    FILE *fp;
+    unsigned long pid;
+    size_t i;
+
+    if (!_trace_enabled || _trace_events_count == 0) {
+        return 0;
+    }
+
+    /* If the file already contains events (e.g., from the other process
+     * in onefile mode), replace the closing bracket of the JSON array and
+     * append the events to it; otherwise start a new array. */
+    fp = pyi_path_fopen(_trace_output_path, "r+b");
+    if (fp != NULL) {
+        char tail[2];
+        if (fseek(fp, -2, SEEK_END) != 0 || fread(tail, 1, 2, fp) != 2 ||
+            tail[0] != ']' || tail[1] != '\n') {
+            fclose(fp);
+            fp = NULL;
+        } else {
+            fseek(fp, -2, SEEK_END);
+            fputs(",\n", fp);
+        }
+    }
+    if (fp == NULL) {
+        fp = pyi_path_fopen(_trace_output_path, "wb");
+        if (fp == NULL) {
+            VS("LOADER: failed to open startup trace output file %s\n", _trace_output_path);
+            return -1;
+        }
+        fputs("[\n", fp);
+    }
+
+    pid = _pyi_trace_get_process_id();
+
+    _trace_mutex_lock();
+    for (i = 0; i < _trace_events_count; i++) {
+        TRACE_EVENT *event = &_trace_events[i];
+
+        if (event->is_counter) {
+            fprintf(fp, "{\"name\":\"%s\",\"cat\":\"startup\",\"ph\":\"C\""
+                    ",\"ts\":%" PRIu64 ",\"pid\":%lu,\"tid\":%" PRIu64 ",\"args\":{\"bytes\":%" PRIu64 "}",
+                    event->name, event->start_time, pid, event->thread_id, event->bytes);
+            fputs((i + 1 < _trace_events_count) ? "},\n" : "}\n", fp);
+            continue;
+        }
+        fprintf(fp, "{\"name\":\"%s\",\"cat\":\"startup\",\"ph\":\"X\""
+                ",\"ts\":%" PRIu64 ",\"dur\":%" PRIu64 ",\"pid\":%lu,\"tid\":%" PRIu64,
+                event->name, event->start_time, event->duration, pid, event->thread_id);
+        if (event->entry_name) {
+            fputs(",\"args\":{\"entry\":", fp);
+            _pyi_trace_write_json_string(fp, event->entry_name);
+            fprintf(fp, ",\"bytes\":%" PRIu64 ",\"inflate_us\":%" PRIu64 "}",
+                    event->bytes, event->inflate_time);
+            free(event->entry_name);
+        }
+        fputs((i + 1 < _trace_events_count) ? "},\n" : "}\n", fp);
+    }
+    _trace_events_count = 0;
+    _trace_mutex_unlock();
+
+    fputs("]\n", fp);
+    fclose(fp);
+    return 0;
+}
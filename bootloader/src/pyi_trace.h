@@ -0,0 +1,69 @@
+/*
+ * ****************************************************************************
+ * Copyright (c) 2013-2022, PyInstaller Development Team.
+ *
+ * Distributed under the terms of the GNU General Public License (version 2
+ * or later) with exception for distributing the bootloader.
+ *
+ * The full license is in the file COPYING.txt, distributed with this software.
+ *
+ * SPDX-License-Identifier: (GPL-2.0-or-later WITH Bootloader-exception)
+ * ****************************************************************************
+ */
+
+/*
+ * Startup phase timing (PYI_STARTUP_TRACE).
+ */
+
+#ifndef PYI_TRACE_H
+#define PYI_TRACE_H
+
+#include "pyi_global.h"
+#include <inttypes.h>  /* uint64_t */
+
+/*
+ * Enable tracing, with the events written to the given file by
+ * pyi_trace_write(), and at exit. Unless enabled in a process that was
+ * started by a traced process, the file is truncated. Returns 0 on
+ * success, -1 on error.
+ */
+int pyi_trace_enable(const char *output_path);
+bool pyi_trace_is_enabled();
+
+/*
+ * Record a completed event. Start time and duration are in microseconds,
+ * as returned by pyi_utils_get_monotonic_time(). If entry_name is not
+ * NULL, the event describes extraction of an archive entry, with the
+ * given (uncompressed) size and time spent decompressing it. Does nothing
+ * if tracing is not enabled. Safe to call from multiple threads.
+ */
+void pyi_trace_add_event(const char *name, uint64_t start_time, uint64_t duration,
+                         const char *entry_name, uint64_t bytes, uint64_t inflate_time);
+
+/*
+ * Begin an event that is recorded by pyi_trace_end_event(), or when the
+ * process exits before (e.g., the process that runs the scripts exits on
+ * sys.exit()). Only one event may be pending at a time.
+ */
+void pyi_trace_begin_event(const char *name);
+void pyi_trace_end_event();
+
+/*
+ * Record the current value of a counter, in bytes (e.g., the resident
+ * size of the process). Does nothing if tracing is not enabled.
+ */
+void pyi_trace_add_counter(const char *name, uint64_t bytes);
+
+/*
+ * Expose the events recorded so far to Python as sys._pyi_startup_trace.
+ * Must be called after Py_Initialize().
+ */
+int pyi_trace_set_sys_attribute();
+
+/*
+ * Append the recorded events to the output file, in Chrome trace event
+ * format, and discard them.
+ */
+int pyi_trace_write();
+
+#endif  /* PYI_TRACE_H */
@@ -16,14 +16,23 @@
  * file path manipulation and other shared data types or functions.
  */
 
+/* memrchr() is a GNU extension. */
+#if (defined(HAVE_MEMRCHR) || defined(HAVE_FALLOCATE)) && !defined(_GNU_SOURCE)
+    #define _GNU_SOURCE
+#endif
+
 #ifdef _WIN32
     #include <windows.h>
     #include <direct.h>  /* _rmdir */
-    #include <io.h>      /* _finddata_t */
+    #include <fcntl.h>   /* _O_CREAT, _O_EXCL */
+    #include <io.h>      /* _finddata_t, _wopen */
     #include <process.h> /* getpid */
+    #include <psapi.h>   /* GetProcessMemoryInfo */
     #include <signal.h>  /* signal */
 #else
     #include <dirent.h>
+    #include <fcntl.h>   /* openat, O_DIRECTORY */
+    #include <pthread.h>
 /*
  * On AIX  RTLD_MEMBER  flag is only visible when _ALL_SOURCE flag is defined.
  *
@@ -40,9 +49,31 @@
         #include <dlfcn.h>
     #endif
     #include <signal.h>  /* kill, */
+    #include <sys/resource.h>  /* getrlimit */
     #include <sys/wait.h>
     #include <unistd.h>  /* rmdir, unlink, mkdtemp */
+    #if defined(__linux__)
+        #include <sys/ioctl.h>
+        #include <sys/syscall.h>  /* __NR_copy_file_range */
+        #include <linux/fs.h>     /* FICLONERANGE */
+    #endif
+    #if defined(HAVE_SENDFILE)
+        #include <sys/sendfile.h>
+    #endif
+    #if defined(HAVE_FCOPYFILE)
+        #include <copyfile.h>
+    #endif
+    #if defined(HAVE_CLONEFILE)
+        #include <sys/clonefile.h>
+    #endif
+    #if defined(__APPLE__)
+        #include <mach/mach.h>  /* task_info */
+    #endif
 #endif /* ifdef _WIN32 */
+#if !defined(_WIN32) && defined(HAVE_OPENAT) && defined(HAVE_MKDIRAT)
+    /* Files are created relative to cached directory descriptors. */
+    #define _PYI_TARGET_DIR_FDS
+#endif
 #ifndef SIGCLD
 #define SIGCLD SIGCHLD /* not defined on OS X */
 #endif
@@ -55,6 +86,7 @@ typedef void (*sighandler_t)(int);
 #include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h> /* struct stat */
+#include <time.h>     /* clock_gettime */
 #include <wchar.h>    /* wchar_t */
 
 /*
@@ -76,6 +108,9 @@ typedef void (*sighandler_t)(int);
 #include "pyi_utils.h"
 #include "pyi_win32_utils.h"
 #include "pyi_apple_events.h"
+#include "pyi_pipeline.h"
+#include "pyi_splash.h"
+#include "pyi_trace.h"
 
 /*
  *  global variables that are used to copy argc/argv, so that PyIstaller can manipulate them
@@ -439,6 +474,261 @@ pyi_get_temp_path(char *buff, char *runtime_tmpdir)
 
 #endif /* ifdef _WIN32 */
 
+/*
+ * Name of the manifest of the persistent extraction cache directory. It
+ * is written last into the staging directory, so that a cache directory
+ * with a matching manifest is known to be completely populated.
+ */
+#define _CACHE_MANIFEST_NAME "pyi-cache-manifest"
+
+/*
+ * Format the manifest of the archive's cache directory: the number and
+ * the total size of the files that the archive extracts, from the TOC.
+ */
+static void
+_pyi_format_cache_manifest(const ARCHIVE_STATUS *status, char *buffer, size_t size)
+{
+    const TOC *ptoc;
+    unsigned long long count = 0;
+    unsigned long long total_size = 0;
+
+    for (ptoc = status->tocbuff; ptoc < status->tocend; ptoc = pyi_arch_increment_toc_ptr(status, ptoc)) {
+        if (ptoc->typcd == ARCHIVE_ITEM_BINARY || ptoc->typcd == ARCHIVE_ITEM_DATA ||
+            ptoc->typcd == ARCHIVE_ITEM_ZIPFILE) {
+            count++;
+            total_size += ptoc->ulen;
+        }
+    }
+    snprintf(buffer, size, "%llu %llu\n", count, total_size);
+}
+
+/*
+ * Check that the directory holds the manifest of the archive.
+ */
+static bool
+_pyi_check_cache_manifest(const ARCHIVE_STATUS *status, const char *path)
+{
+    char manifest_path[PATH_MAX];
+    char expected[64];
+    char manifest[64];
+    size_t size;
+    FILE *fp;
+
+    if (pyi_path_join(manifest_path, path, _CACHE_MANIFEST_NAME) == NULL) {
+        return false;
+    }
+    fp = pyi_path_fopen(manifest_path, "rb");
+    if (fp == NULL) {
+        return false;
+    }
+    size = fread(manifest, 1, sizeof(manifest) - 1, fp);
+    fclose(fp);
+    manifest[size] = PYI_NULLCHAR;
+
+    _pyi_format_cache_manifest(status, expected, sizeof(expected));
+    return strcmp(manifest, expected) == 0;
+}
+
+/*
+ * Write the manifest of the archive into the staging directory.
+ */
+static int
+_pyi_write_cache_manifest(const ARCHIVE_STATUS *status)
+{
+    char manifest_path[PATH_MAX];
+    char manifest[64];
+    FILE *fp;
+    int rc;
+
+    if (pyi_path_join(manifest_path, status->temppath, _CACHE_MANIFEST_NAME) == NULL) {
+        return -1;
+    }
+    fp = pyi_path_fopen(manifest_path, "wb");
+    if (fp == NULL) {
+        return -1;
+    }
+    _pyi_format_cache_manifest(status, manifest, sizeof(manifest));
+    rc = fputs(manifest, fp) < 0 ? -1 : 0;
+    if (fclose(fp) != 0) {
+        rc = -1;
+    }
+    return rc;
+}
+
+/*
+ * Check if path is an existing directory that can be trusted as the
+ * persistent extraction cache directory of the archive. The directory
+ * must be owned by the current user; on POSIX systems, it must also not
+ * be writable by others (on Windows, the directories are created with an
+ * ACL that only grants access to their owner, see pyi_win32_mkdir()).
+ * It must also hold the manifest of the archive, which is missing if
+ * the directory was not populated by pyi_commit_cache_path().
+ */
+static bool
+_pyi_is_cache_directory(const ARCHIVE_STATUS *status, const char *path)
+{
+#ifdef _WIN32
+    wchar_t wpath[PATH_MAX];
+    struct _stat sbuf;
+
+    if (pyi_win32_utils_from_utf8(wpath, path, PATH_MAX) == NULL) {
+        return false;
+    }
+    if (_wstat(wpath, &sbuf) != 0 || !(sbuf.st_mode & _S_IFDIR)) {
+        return false;
+    }
+    if (!pyi_win32_is_owned_by_user(wpath)) {
+        VS("LOADER: Ignoring extraction cache %s with unsafe ownership\n", path);
+        return false;
+    }
+#else
+    struct stat sbuf;
+
+    if (stat(path, &sbuf) != 0 || !S_ISDIR(sbuf.st_mode)) {
+        return false;
+    }
+    if (sbuf.st_uid != geteuid() || (sbuf.st_mode & (S_IWGRP | S_IWOTH))) {
+        VS("LOADER: Ignoring extraction cache %s with unsafe ownership or permissions\n", path);
+        return false;
+    }
+#endif
+    if (!_pyi_check_cache_manifest(status, path)) {
+        VS("LOADER: Ignoring extraction cache %s without matching manifest\n", path);
+        return false;
+    }
+    return true;
+}
+
+/*
+ * Resolve the directory given by the pyi-runtime-cachedir option (with
+ * environment variables expanded on Windows) and create it if necessary.
+ */
+static int
+_pyi_resolve_cache_dir(char *buffer, char *runtime_cachedir)
+{
+#ifdef _WIN32
+    wchar_t *wcachedir_abspath;
+
+    wcachedir_abspath = pyi_build_temp_folder(runtime_cachedir);
+    if (wcachedir_abspath == NULL) {
+        return -1;
+    }
+    if (pyi_win32_utils_to_utf8(buffer, wcachedir_abspath, PATH_MAX) == NULL) {
+        free(wcachedir_abspath);
+        return -1;
+    }
+    free(wcachedir_abspath);
+#else
+    if (snprintf(buffer, PATH_MAX, "%s", runtime_cachedir) >= PATH_MAX) {
+        return -1;
+    }
+    /* Create the directory if it does not exist yet. */
+    if (mkdir(buffer, 0700) != 0 && errno != EEXIST) {
+        return -1;
+    }
+#endif
+    return 0;
+}
+
+/*
+ * Compute the directory of the persistent extraction cache for the
+ * archive (from its digest) into cachepath, and its parent directory
+ * into cachedir. The directory is named after the first half of the
+ * digest, which keeps the paths of the extracted files short.
+ */
+static int
+_pyi_get_cache_path(const ARCHIVE_STATUS *status, char *runtime_cachedir, char *cachedir, char *cachepath)
+{
+    char dirname[ARCHIVE_DIGEST_SIZE + 8];
+    unsigned char digest[ARCHIVE_DIGEST_SIZE];
+    int i;
+
+    if (pyi_arch_get_digest(status, digest) != 0) {
+        VS("LOADER: Cannot compute archive digest for extraction cache\n");
+        return -1;
+    }
+    if (_pyi_resolve_cache_dir(cachedir, runtime_cachedir) != 0) {
+        VS("LOADER: Cannot resolve extraction cache directory\n");
+        return -1;
+    }
+    strcpy(dirname, "_MEI");
+    for (i = 0; i < ARCHIVE_DIGEST_SIZE / 2; i++) {
+        snprintf(dirname + 4 + 2 * i, 3, "%02x", (unsigned int)digest[i]);
+    }
+    if (pyi_path_join(cachepath, cachedir, dirname) == NULL) {
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Set up the persistent extraction cache for the archive. If the cache
+ * directory for the archive already exists and holds its manifest, use it
+ * as temppath. Otherwise, create a staging directory next to it, which is
+ * moved into place by pyi_commit_cache_path() once all files are
+ * extracted. Every process uses its own staging directory, so concurrent
+ * launches do not interfere with each other. If an incomplete cache
+ * directory is in the way, the move fails, and the files are extracted
+ * into the staging directory on every launch.
+ */
+static int
+_pyi_create_cache_path(ARCHIVE_STATUS *status, char *runtime_cachedir)
+{
+    char cachedir[PATH_MAX];
+    char cachepath[PATH_MAX];
+    char temppath[PATH_MAX];
+
+    if (_pyi_get_cache_path(status, runtime_cachedir, cachedir, cachepath) != 0) {
+        return -1;
+    }
+
+    if (_pyi_is_cache_directory(status, cachepath)) {
+        VS("LOADER: Using populated extraction cache %s\n", cachepath);
+        if (pyi_arch_set_path(&status->cachepath, cachepath) != 0) {
+            return -1;
+        }
+        status->temppath = status->cachepath;
+        status->is_cached = true;
+        return 0;
+    }
+
+    if (!pyi_get_temp_path(temppath, cachedir)) {
+        return -1;
+    }
+    if (pyi_arch_set_path(&status->cachepath, cachepath) != 0 ||
+        pyi_arch_set_path(&status->temppath, temppath) != 0) {
+        status->cachepath = "";
+        return -1;
+    }
+    VS("LOADER: Populating extraction cache %s via %s\n", status->cachepath, status->temppath);
+    return 0;
+}
+
+/*
+ * Look up the populated persistent extraction cache of the archive (that
+ * is not the archive of the current process, e.g., of another executable
+ * in multipackage mode), without creating it. On success, sets
+ * status->cachepath and returns 0; returns -1 if the archive does not use
+ * the extraction cache, or if the cache is not populated.
+ */
+int
+pyi_find_cache_path(ARCHIVE_STATUS *status)
+{
+    char *runtime_cachedir;
+    char cachedir[PATH_MAX];
+    char cachepath[PATH_MAX];
+
+    runtime_cachedir = pyi_arch_get_option(status, "pyi-runtime-cachedir");
+    if (runtime_cachedir == NULL) {
+        return -1;
+    }
+    if (_pyi_get_cache_path(status, runtime_cachedir, cachedir, cachepath) != 0 ||
+        !_pyi_is_cache_directory(status, cachepath)) {
+        return -1;
+    }
+    return pyi_arch_set_path(&status->cachepath, cachepath);
+}
+
 /*
  * Creates a temporany directory if it doesn't exists
  * and properly sets the ARCHIVE_STATUS members.
@@ -447,226 +737,1134 @@ int
 pyi_create_temp_path(ARCHIVE_STATUS *status)
 {
     char *runtime_tmpdir = NULL;
+    char *runtime_cachedir = NULL;
+    char temppath[PATH_MAX];
 
     if (status->has_temp_directory != true) {
+        runtime_cachedir = pyi_arch_get_option(status, "pyi-runtime-cachedir");
+        if (runtime_cachedir != NULL) {
+            VS("LOADER: Found runtime-cachedir %s\n", runtime_cachedir);
+            if (_pyi_create_cache_path(status, runtime_cachedir) == 0) {
+                status->has_temp_directory = true;
+                return 0;
+            }
+            VS("LOADER: Extraction cache not available; using temporary directory\n");
+        }
+
         runtime_tmpdir = pyi_arch_get_option(status, "pyi-runtime-tmpdir");
         if(runtime_tmpdir != NULL) {
           VS("LOADER: Found runtime-tmpdir %s\n", runtime_tmpdir);
         }
 
-        if (!pyi_get_temp_path(status->temppath, runtime_tmpdir)) {
-            FATALERROR("INTERNAL ERROR: cannot create temporary directory!\n");
-            return -1;
+        if (!pyi_get_temp_path(temppath, runtime_tmpdir)) {
+            FATALERROR("INTERNAL ERROR: cannot create temporary directory!\n");
+            return -1;
+        }
+        if (pyi_arch_set_path(&status->temppath, temppath) != 0) {
+            return -1;
+        }
+        /* Set flag that temp directory is created and available. */
+        status->has_temp_directory = true;
+    }
+    return 0;
+}
+
+/*
+ * Write the manifest into the fully-populated staging directory, and move
+ * the directory to its place in the persistent extraction cache. If that
+ * fails (e.g., because a concurrently
+ * launched process populated the cache first, or because files in the
+ * staging directory are in use on Windows), the staging directory is kept
+ * and used as a regular temporary directory, which is removed on exit.
+ */
+void
+pyi_commit_cache_path(ARCHIVE_STATUS *status)
+{
+    int rc;
+#ifdef _WIN32
+    wchar_t wsrc[PATH_MAX];
+    wchar_t wdst[PATH_MAX];
+#endif
+
+    if (status->cachepath[0] == PYI_NULLCHAR || status->is_cached) {
+        return;
+    }
+
+    if (_pyi_write_cache_manifest(status) != 0) {
+        VS("LOADER: Could not write manifest of extraction cache; using %s as temporary directory\n",
+           status->temppath);
+        status->cachepath = "";
+        return;
+    }
+
+#ifdef _WIN32
+    rc = -1;
+    if (pyi_win32_utils_from_utf8(wsrc, status->temppath, PATH_MAX) != NULL &&
+        pyi_win32_utils_from_utf8(wdst, status->cachepath, PATH_MAX) != NULL &&
+        MoveFileExW(wsrc, wdst, 0)) {
+        rc = 0;
+    }
+#else
+    /* Fails with EEXIST/ENOTEMPTY if the cache directory was populated
+     * in the meantime. */
+    rc = rename(status->temppath, status->cachepath);
+#endif
+
+    if (rc != 0) {
+        VS("LOADER: Could not move %s to extraction cache; using it as temporary directory\n", status->temppath);
+        status->cachepath = "";
+        return;
+    }
+    VS("LOADER: Populated extraction cache %s\n", status->cachepath);
+    status->temppath = status->cachepath;
+    status->is_cached = true;
+}
+
+/*
+ * Removal of the temporary directory.
+ *
+ * The directory is removed after the child process exits, and the parent
+ * process cannot return the child's exit code until that is done, so the
+ * removal of (potentially tens of thousands of) extracted files should be
+ * as fast as possible.
+ */
+#ifdef _WIN32
+
+/* Definitions from Windows 10 SDK; not available in older SDKs and MinGW. */
+typedef struct _PYI_FILE_DISPOSITION_INFO_EX {
+    DWORD Flags;
+} PYI_FILE_DISPOSITION_INFO_EX;
+#define PYI_FILE_DISPOSITION_INFO_EX_CLASS              ((FILE_INFO_BY_HANDLE_CLASS)21)
+#define PYI_FILE_DISPOSITION_FLAG_DELETE                0x00000001
+#define PYI_FILE_DISPOSITION_FLAG_POSIX_SEMANTICS       0x00000002
+#define PYI_FILE_DISPOSITION_FLAG_IGNORE_READONLY_ATTRIBUTE 0x00000010
+
+/* Cleared when POSIX-semantics delete is found to be unsupported (Windows
+ * older than 10 1607, or file system other than NTFS). */
+static bool _posix_delete_supported = true;
+
+/*
+ * Delete the file, empty directory or directory link using POSIX
+ * semantics: the name is removed immediately, even if the file is still
+ * open in another process (e.g., an anti-virus scanner), so the parent
+ * directory can be removed right away instead of after a retry. Falls back
+ * to the standard delete if POSIX semantics are not supported.
+ */
+static void
+_pyi_win32_delete_one(const wchar_t *wpath, bool is_dir)
+{
+    PYI_FILE_DISPOSITION_INFO_EX info;
+    HANDLE handle;
+    BOOL deleted = FALSE;
+
+    if (_posix_delete_supported) {
+        handle = CreateFileW(wpath, DELETE, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                             NULL, OPEN_EXISTING,
+                             FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OPEN_REPARSE_POINT, NULL);
+        if (handle != INVALID_HANDLE_VALUE) {
+            info.Flags = PYI_FILE_DISPOSITION_FLAG_DELETE |
+                         PYI_FILE_DISPOSITION_FLAG_POSIX_SEMANTICS |
+                         PYI_FILE_DISPOSITION_FLAG_IGNORE_READONLY_ATTRIBUTE;
+            deleted = SetFileInformationByHandle(handle, PYI_FILE_DISPOSITION_INFO_EX_CLASS,
+                                                 &info, sizeof(info));
+            if (!deleted) {
+                DWORD error = GetLastError();
+                if (error == ERROR_INVALID_PARAMETER || error == ERROR_NOT_SUPPORTED ||
+                    error == ERROR_INVALID_FUNCTION) {
+                    _posix_delete_supported = false;
+                }
+            }
+            CloseHandle(handle);
+        }
+    }
+    if (!deleted) {
+        if (is_dir) {
+            _wrmdir(wpath);
+        } else {
+            _wremove(wpath);
+        }
+    }
+}
+
+/*
+ * Remove the contents of the directory wpath (of length pathlen, with a
+ * trailing separator and room for PATH_MAX characters). The directory
+ * entries are fetched in large batches, and directory links (symbolic
+ * links and junctions) are removed without descending into them.
+ */
+static void
+_pyi_win32_remove_contents(wchar_t *wpath, size_t pathlen)
+{
+    WIN32_FIND_DATAW info;
+    HANDLE handle;
+    size_t namelen;
+
+    if (pathlen + 1 > PATH_MAX) {
+        return;
+    }
+    wcscpy(wpath + pathlen, L"*");
+    handle = FindFirstFileExW(wpath, FindExInfoBasic, &info, FindExSearchNameMatch,
+                              NULL, FIND_FIRST_EX_LARGE_FETCH);
+    if (handle == INVALID_HANDLE_VALUE) {
+        return;
+    }
+    do {
+        if (wcscmp(info.cFileName, L".") == 0 || wcscmp(info.cFileName, L"..") == 0) {
+            continue;
+        }
+        namelen = wcslen(info.cFileName);
+        if (pathlen + namelen + 1 > PATH_MAX) {
+            continue;
+        }
+        wcscpy(wpath + pathlen, info.cFileName);
+
+        if ((info.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) &&
+            !(info.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT)) {
+            /* Use recursion to remove subdirectories. */
+            wcscpy(wpath + pathlen + namelen, L"\\");
+            _pyi_win32_remove_contents(wpath, pathlen + namelen + 1);
+            wpath[pathlen + namelen] = PYI_NULLCHAR;
+            _pyi_win32_delete_one(wpath, true);
+        }
+        else {
+            _pyi_win32_delete_one(wpath, (info.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0);
+        }
+    } while (FindNextFileW(handle, &info));
+    FindClose(handle);
+}
+
+void
+pyi_remove_temp_path(const char *dir)
+{
+    wchar_t wpath[PATH_MAX + 1];
+    wchar_t wdir[PATH_MAX + 1];
+    size_t dirnmlen;
+
+    if (!pyi_win32_utils_from_utf8(wdir, dir, PATH_MAX)) {
+        return;
+    }
+    dirnmlen = wcslen(wdir);
+    if (dirnmlen == 0) {
+        return;
+    }
+    wcscpy(wpath, wdir);
+    if (wpath[dirnmlen - 1] != L'/' && wpath[dirnmlen - 1] != L'\\') {
+        if (dirnmlen + 1 > PATH_MAX) {
+            return;
+        }
+        wcscat(wpath, L"\\");
+        dirnmlen++;
+    }
+
+    _pyi_win32_remove_contents(wpath, dirnmlen);
+    if (_wrmdir(wdir) != 0) {
+        /* HACK: Possible concurrency issue (e.g., files still locked by the
+         * exiting child process or by an anti-virus scanner) when POSIX
+         * semantics are not available... Spin a little while, and retry
+         * once for the whole tree instead of once for each file. */
+        Sleep(100);
+        _pyi_win32_remove_contents(wpath, dirnmlen);
+        _wrmdir(wdir);
+    }
+}
+#else /* ifdef _WIN32 */
+    #if defined(HAVE_OPENAT) && defined(HAVE_UNLINKAT) && defined(HAVE_FDOPENDIR)
+
+/*
+ * The files are removed with calls relative to the file descriptor of
+ * their directory (which avoids resolving the full path of each file
+ * in the kernel), and the directory entry type from readdir() is used to
+ * tell the subdirectories apart (which avoids lstat() of each file). The
+ * subdirectories of the temporary directory are removed in parallel by
+ * a small pool of threads.
+ */
+        #define _MAX_REMOVAL_WORKERS 4
+
+        #ifndef O_CLOEXEC
+            #define O_CLOEXEC 0
+        #endif
+
+static bool
+_pyi_dirent_is_dir(int dir_fd, const struct dirent *finfo)
+{
+    struct stat sbuf;
+
+        #ifdef DT_DIR
+    if (finfo->d_type != DT_UNKNOWN) {
+        return finfo->d_type == DT_DIR;
+    }
+        #endif
+    /* Do not follow symlinks, to prevent recursion into symlinked
+     * directories */
+    if (fstatat(dir_fd, finfo->d_name, &sbuf, AT_SYMLINK_NOFOLLOW) != 0) {
+        return false;
+    }
+    return S_ISDIR(sbuf.st_mode);
+}
+
+static bool
+_pyi_is_dot_entry(const char *name)
+{
+    return name[0] == '.' && (name[1] == 0 || (name[1] == '.' && name[2] == 0));
+}
+
+/* Remove the directory with given name from the directory parent_fd,
+ * including all its contents. */
+static void
+_pyi_remove_dir_at(int parent_fd, const char *name)
+{
+    struct dirent *finfo;
+    DIR *ds;
+    int fd;
+
+    fd = openat(parent_fd, name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    if (fd < 0) {
+        return;
+    }
+    ds = fdopendir(fd);
+    if (!ds) {
+        close(fd);
+        return;
+    }
+    while ((finfo = readdir(ds)) != NULL) {
+        if (_pyi_is_dot_entry(finfo->d_name)) {
+            continue;
+        }
+        if (_pyi_dirent_is_dir(fd, finfo)) {
+            /* Use recursion to remove subdirectories. */
+            _pyi_remove_dir_at(fd, finfo->d_name);
+        }
+        else {
+            unlinkat(fd, finfo->d_name, 0);
+        }
+    }
+    closedir(ds);  /* Closes fd as well. */
+    unlinkat(parent_fd, name, AT_REMOVEDIR);
+}
+
+typedef struct _removal_queue {
+    int dir_fd;
+    char **names;  /* Names of the subdirectories to remove. */
+    size_t count;
+    size_t next;   /* Index of next subdirectory to remove. */
+    pthread_mutex_t mutex;
+} REMOVAL_QUEUE;
+
+static void *
+_pyi_removal_worker_thread(void *arg)
+{
+    REMOVAL_QUEUE *queue = (REMOVAL_QUEUE *)arg;
+    const char *name;
+
+    while (1) {
+        pthread_mutex_lock(&queue->mutex);
+        if (queue->next >= queue->count) {
+            pthread_mutex_unlock(&queue->mutex);
+            break;
+        }
+        name = queue->names[queue->next++];
+        pthread_mutex_unlock(&queue->mutex);
+
+        _pyi_remove_dir_at(queue->dir_fd, name);
+    }
+    return NULL;
+}
+
+/* Remove the given subdirectories of dir_fd; the calling thread acts as
+ * one of the workers. */
+static void
+_pyi_remove_subdirs(int dir_fd, char **names, size_t count)
+{
+    pthread_t threads[_MAX_REMOVAL_WORKERS - 1];
+    bool started[_MAX_REMOVAL_WORKERS - 1];
+    REMOVAL_QUEUE queue;
+    long num_workers;
+    long i;
+
+    num_workers = sysconf(_SC_NPROCESSORS_ONLN);
+    if (num_workers > _MAX_REMOVAL_WORKERS) {
+        num_workers = _MAX_REMOVAL_WORKERS;
+    }
+    if (num_workers > (long)count) {
+        num_workers = (long)count;
+    }
+
+    queue.dir_fd = dir_fd;
+    queue.names = names;
+    queue.count = count;
+    queue.next = 0;
+    pthread_mutex_init(&queue.mutex, NULL);
+
+    for (i = 0; i < num_workers - 1; i++) {
+        started[i] = (pthread_create(&threads[i], NULL, _pyi_removal_worker_thread, &queue) == 0);
+    }
+    _pyi_removal_worker_thread(&queue);
+    for (i = 0; i < num_workers - 1; i++) {
+        if (started[i]) {
+            pthread_join(threads[i], NULL);
+        }
+    }
+
+    pthread_mutex_destroy(&queue.mutex);
+}
+
+void
+pyi_remove_temp_path(const char *dir)
+{
+    struct dirent *finfo;
+    DIR *ds;
+    char **subdirs = NULL;
+    size_t count = 0;
+    size_t capacity = 0;
+    size_t i;
+    int fd;
+
+    fd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) {
+        return;
+    }
+    ds = fdopendir(fd);
+    if (!ds) {
+        close(fd);
+        return;
+    }
+
+    /* Remove the files right away, and collect the subdirectories. */
+    while ((finfo = readdir(ds)) != NULL) {
+        if (_pyi_is_dot_entry(finfo->d_name)) {
+            continue;
+        }
+        if (!_pyi_dirent_is_dir(fd, finfo)) {
+            unlinkat(fd, finfo->d_name, 0);
+            continue;
+        }
+        if (count == capacity) {
+            size_t new_capacity = capacity ? 2 * capacity : 32;
+            char **new_subdirs = (char **)realloc(subdirs, new_capacity * sizeof(char *));
+            if (new_subdirs != NULL) {
+                subdirs = new_subdirs;
+                capacity = new_capacity;
+            }
+        }
+        if (count < capacity && (subdirs[count] = strdup(finfo->d_name)) != NULL) {
+            count++;
+        }
+        else {
+            /* Out of memory; remove the directory right away. */
+            _pyi_remove_dir_at(fd, finfo->d_name);
+        }
+    }
+
+    if (count > 0) {
+        _pyi_remove_subdirs(fd, subdirs, count);
+    }
+    for (i = 0; i < count; i++) {
+        free(subdirs[i]);
+    }
+    free(subdirs);
+
+    closedir(ds);  /* Closes fd as well. */
+    rmdir(dir);
+}
+    #else /* if defined(HAVE_OPENAT) && defined(HAVE_UNLINKAT) && defined(HAVE_FDOPENDIR) */
+static void
+remove_one(char *pnm, int pos, const char *fnm)
+{
+    struct stat sbuf;
+
+    if (strcmp(fnm, ".") == 0  || strcmp(fnm, "..") == 0) {
+        return;
+    }
+    pnm[pos] = PYI_NULLCHAR;
+    strcat(pnm, fnm);
+
+    /* Use lstat() instead of stat() to prevent recursion into
+     * symlinked directories */
+    if (lstat(pnm, &sbuf) == 0) {
+        if (S_ISDIR(sbuf.st_mode) ) {
+            /* Use recursion to remove subdirectories. */
+            pyi_remove_temp_path(pnm);
+        }
+        else {
+            unlink(pnm);
+        }
+    }
+}
+
+void
+pyi_remove_temp_path(const char *dir)
+{
+    char fnm[PATH_MAX + 1];
+    DIR *ds;
+    struct dirent *finfo;
+    int dirnmlen;
+
+    /* Leave 1 char for PY_SEP if needed */
+    strncpy(fnm, dir, PATH_MAX);
+    dirnmlen = strlen(fnm);
+
+    if (fnm[dirnmlen - 1] != PYI_SEP) {
+        strcat(fnm, PYI_SEPSTR);
+        dirnmlen++;
+    }
+    ds = opendir(dir);
+    if (!ds) {
+        return;
+    }
+    finfo = readdir(ds);
+
+    while (finfo) {
+        remove_one(fnm, dirnmlen, finfo->d_name);
+        finfo = readdir(ds);
+    }
+    closedir(ds);
+    rmdir(dir);
+}
+    #endif /* if defined(HAVE_OPENAT) && defined(HAVE_UNLINKAT) && defined(HAVE_FDOPENDIR) */
+#endif /* ifdef _WIN32 */
+
+/*
+ * Create the directory (and ignore the error if it already exists).
+ */
+static int
+_pyi_mkdir(const char *fnm)
+{
+#ifdef _WIN32
+    wchar_t wchar_buffer[PATH_MAX];
+
+    if (!pyi_win32_utils_from_utf8(wchar_buffer, fnm, PATH_MAX)) {
+        return -1;
+    }
+    if (pyi_win32_mkdir(wchar_buffer) != 0 && GetLastError() != ERROR_ALREADY_EXISTS) {
+        return -1;
+    }
+#else
+    if (mkdir(fnm, 0700) != 0 && errno != EEXIST) {
+        return -1;
+    }
+#endif
+    return 0;
+}
+
+/*
+ * Join path and name_ into fnm and create the missing parent directories
+ * of the resulting path. Returns 0 on success, -1 if the resulting path
+ * exceeds PATH_MAX.
+ */
+static int
+_pyi_make_target_path(char *fnm, const char *path, const char *name_)
+{
+    size_t root_len = strlen(path) + strlen(PYI_SEPSTR);
+    char *sep;
+
+    if (snprintf(fnm, PATH_MAX, "%s%s%s", path, PYI_SEPSTR, name_) >= PATH_MAX) {
+        return -1;
+    }
+
+    /* Create the parent directories, by terminating the path at each
+     * separator in turn. */
+    for (sep = strchr(fnm + root_len, PYI_SEP); sep != NULL; sep = strchr(sep + 1, PYI_SEP)) {
+        if (sep[1] == PYI_SEP) {
+            /* Empty component */
+            continue;
+        }
+        *sep = PYI_NULLCHAR;
+        /* Errors surface when the file is opened. */
+        _pyi_mkdir(fnm);
+        *sep = PYI_SEP;
+    }
+    return 0;
+}
+
+/*
+ * Create the file for writing; the file is not expected to exist. If
+ * dir_fd is not -1, the name is relative to that directory. The check
+ * for existing file is done by the open call itself (O_EXCL), instead of
+ * a separate stat(); an existing file is still overwritten. If temporary
+ * is set, the file is removed when the program exits (it is not in the
+ * persistent extraction cache).
+ */
+static FILE *
+_pyi_open_new_file(int dir_fd, const char *name, const char *display_name, bool temporary)
+{
+#ifdef _WIN32
+    wchar_t wchar_buffer[PATH_MAX];
+    int flags = _O_WRONLY | _O_CREAT | _O_BINARY;
+    int fd;
+
+    (void)dir_fd;
+    if (!pyi_win32_utils_from_utf8(wchar_buffer, name, PATH_MAX)) {
+        return NULL;
+    }
+    /* _O_SHORT_LIVED sets FILE_ATTRIBUTE_TEMPORARY, which keeps the data in
+     * the cache rather than writing it back eagerly; only for files that
+     * do not outlive the program. */
+    if (temporary) {
+        flags |= _O_SHORT_LIVED;
+    }
+    fd = _wopen(wchar_buffer, flags | _O_EXCL, _S_IREAD | _S_IWRITE);
+    if (fd < 0 && errno == EEXIST) {
+        OTHERERROR("WARNING: file already exists but should not: %s\n", display_name);
+        fd = _wopen(wchar_buffer, flags | _O_TRUNC, _S_IREAD | _S_IWRITE);
+    }
+    if (fd < 0) {
+        return NULL;
+    }
+    return _fdopen(fd, "wb");
+#else
+    FILE *fp;
+    int fd;
+
+    (void)temporary;
+    #ifdef _PYI_TARGET_DIR_FDS
+    if (dir_fd != -1) {
+        fd = openat(dir_fd, name, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0700);
+        if (fd < 0 && errno == EEXIST) {
+            OTHERERROR("WARNING: file already exists but should not: %s\n", display_name);
+            fd = openat(dir_fd, name, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0700);
+        }
+    } else
+    #endif
+    {
+        (void)dir_fd;
+        fd = open(name, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0700);
+        if (fd < 0 && errno == EEXIST) {
+            OTHERERROR("WARNING: file already exists but should not: %s\n", display_name);
+            fd = open(name, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0700);
+        }
+    }
+    if (fd < 0) {
+        return NULL;
+    }
+    fp = fdopen(fd, "wb");
+    if (fp == NULL) {
+        close(fd);
+    }
+    return fp;
+#endif /* ifdef _WIN32 */
+}
+
+/*
+ * helper for extract2fs
+ * which may try multiple places
+ */
+/* TODO find better name for function. */
+FILE *
+pyi_open_target(const char *path, const char* name_, bool temporary)
+{
+    char fnm[PATH_MAX];
+
+    if (_pyi_make_target_path(fnm, path, name_) != 0) {
+        return NULL;
+    }
+    return _pyi_open_new_file(-1, fnm, fnm, temporary);
+}
+
+/*
+ * Parent directories of the files to extract.
+ *
+ * Instead of checking and creating each path component of each file, the
+ * unique directories are collected from the names of all files to be
+ * extracted, and created in a single pass (parents first). On POSIX
+ * systems, the directories are also kept open (up to a limit), and the
+ * files are created relative to their directory's file descriptor.
+ *
+ * Once created, the structure is read-only, so it can be shared by the
+ * extraction threads.
+ */
+#define _MAX_TARGET_DIR_FDS 256
+
+typedef struct _target_dir {
+    char *name;  /* Relative to the root directory. */
+    int fd;      /* -1 if the directory is not kept open. */
+} TARGET_DIR;
+
+struct _target_dirs {
+    char root[PATH_MAX];
+    int root_fd;
+    TARGET_DIR *dirs;  /* Sorted by name; parents precede their children. */
+    size_t count;
+    bool temporary;    /* See _pyi_open_new_file() */
+};
+
+static int
+_pyi_compare_target_dirs(const void *a, const void *b)
+{
+    return strcmp(((const TARGET_DIR *)a)->name, ((const TARGET_DIR *)b)->name);
+}
+
+/* Find the directory with the first len characters of name; binary search,
+ * comparing in place instead of copying the prefix. */
+static const TARGET_DIR *
+_pyi_target_dirs_find(const TARGET_DIRS *target_dirs, const char *name, size_t len)
+{
+    size_t lo = 0;
+    size_t hi = target_dirs->count;
+
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        const char *dir_name = target_dirs->dirs[mid].name;
+        int cmp = strncmp(name, dir_name, len);
+
+        if (cmp == 0 && dir_name[len] != PYI_NULLCHAR) {
+            /* The prefix sorts before the longer name */
+            cmp = -1;
+        }
+        if (cmp == 0) {
+            return &target_dirs->dirs[mid];
+        } else if (cmp < 0) {
+            hi = mid;
+        } else {
+            lo = mid + 1;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Collect the parent directories of name (and their parents), skipping
+ * the ones of the previous name. Names with empty components are
+ * skipped; pyi_target_dirs_open() falls back to pyi_open_target() for
+ * them. Returns -1 on allocation failure.
+ */
+static int
+_pyi_target_dirs_collect(TARGET_DIRS *target_dirs, size_t *capacity, const char *name, const char *prev_name)
+{
+    const char *sep = strrchr(name, PYI_SEP);
+    const char *ptr;
+
+    if (sep == NULL || name[0] == PYI_SEP || strstr(name, PYI_SEPSTR PYI_SEPSTR) != NULL) {
+        return 0;
+    }
+    /* Consecutive entries are usually in the same directory. */
+    if (prev_name != NULL && strncmp(name, prev_name, sep - name + 1) == 0 &&
+        strrchr(prev_name, PYI_SEP) == prev_name + (sep - name)) {
+        return 0;
+    }
+    for (ptr = strchr(name, PYI_SEP); ptr != NULL; ptr = strchr(ptr + 1, PYI_SEP)) {
+        if (target_dirs->count == *capacity) {
+            size_t new_capacity = *capacity ? 2 * *capacity : 64;
+            TARGET_DIR *new_dirs = (TARGET_DIR *)realloc(target_dirs->dirs, new_capacity * sizeof(TARGET_DIR));
+            if (new_dirs == NULL) {
+                return -1;
+            }
+            target_dirs->dirs = new_dirs;
+            *capacity = new_capacity;
+        }
+        target_dirs->dirs[target_dirs->count].name = strndup(name, ptr - name);
+        target_dirs->dirs[target_dirs->count].fd = -1;
+        if (target_dirs->dirs[target_dirs->count].name == NULL) {
+            return -1;
+        }
+        target_dirs->count++;
+    }
+    return 0;
+}
+
+/* Create the i-th directory; its parent has already been created. */
+static int
+_pyi_target_dirs_create_one(TARGET_DIRS *target_dirs, size_t i, size_t *num_fds, size_t max_fds)
+{
+    TARGET_DIR *dir = &target_dirs->dirs[i];
+    const char *sep = strrchr(dir->name, PYI_SEP);
+    int parent_fd = target_dirs->root_fd;
+    char fnm[PATH_MAX];
+
+    if (sep != NULL) {
+        const TARGET_DIR *parent = _pyi_target_dirs_find(target_dirs, dir->name, sep - dir->name);
+        parent_fd = parent ? parent->fd : -1;
+    }
+
+#ifdef _PYI_TARGET_DIR_FDS
+    if (parent_fd != -1) {
+        const char *basename = sep ? sep + 1 : dir->name;
+        if (mkdirat(parent_fd, basename, 0700) != 0 && errno != EEXIST) {
+            return -1;
+        }
+        if (*num_fds < max_fds) {
+            dir->fd = openat(parent_fd, basename, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+            if (dir->fd != -1) {
+                (*num_fds)++;
+            }
+        }
+        return 0;
+    }
+#else
+    (void)parent_fd;
+    (void)num_fds;
+    (void)max_fds;
+#endif
+    if (snprintf(fnm, PATH_MAX, "%s%s%s", target_dirs->root, PYI_SEPSTR, dir->name) >= PATH_MAX) {
+        return -1;
+    }
+    return _pyi_mkdir(fnm);
+}
+
+TARGET_DIRS *
+pyi_target_dirs_new(const char *root, TOC **entries, size_t count, bool temporary)
+{
+    TARGET_DIRS *target_dirs;
+    size_t capacity = 0;
+    size_t num_fds = 0;
+    size_t max_fds = 0;
+    size_t i, j;
+
+    target_dirs = (TARGET_DIRS *)calloc(1, sizeof(TARGET_DIRS));
+    if (target_dirs == NULL) {
+        return NULL;
+    }
+    target_dirs->root_fd = -1;
+    target_dirs->temporary = temporary;
+    if (snprintf(target_dirs->root, PATH_MAX, "%s", root) >= PATH_MAX) {
+        goto error;
+    }
+
+    /* Collect the unique directories */
+    for (i = 0; i < count; i++) {
+        if (_pyi_target_dirs_collect(target_dirs, &capacity, entries[i]->name,
+                                     i > 0 ? entries[i - 1]->name : NULL) != 0) {
+            goto error;
+        }
+    }
+    if (target_dirs->count > 0) {
+        qsort(target_dirs->dirs, target_dirs->count, sizeof(TARGET_DIR), _pyi_compare_target_dirs);
+        for (i = 1, j = 0; i < target_dirs->count; i++) {
+            if (strcmp(target_dirs->dirs[i].name, target_dirs->dirs[j].name) == 0) {
+                free(target_dirs->dirs[i].name);
+            } else {
+                target_dirs->dirs[++j] = target_dirs->dirs[i];
+            }
+        }
+        target_dirs->count = j + 1;
+    }
+
+#ifdef _PYI_TARGET_DIR_FDS
+    {
+        /* Leave most of the file descriptors to the rest of the program. */
+        struct rlimit limit;
+        max_fds = _MAX_TARGET_DIR_FDS;
+        if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur != RLIM_INFINITY &&
+            limit.rlim_cur / 4 < max_fds) {
+            max_fds = (size_t)(limit.rlim_cur / 4);
+        }
+    }
+    target_dirs->root_fd = open(root, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+#endif
+
+    /* Create the directories; parents precede their children. */
+    for (i = 0; i < target_dirs->count; i++) {
+        if (_pyi_target_dirs_create_one(target_dirs, i, &num_fds, max_fds) != 0) {
+            VS("LOADER: Failed to create directory %s\n", target_dirs->dirs[i].name);
+            goto error;
         }
-        /* Set flag that temp directory is created and available. */
-        status->has_temp_directory = true;
     }
-    return 0;
+    VS("LOADER: Created %lu directories (%lu kept open) for %lu files\n",
+       (unsigned long)target_dirs->count, (unsigned long)num_fds, (unsigned long)count);
+    return target_dirs;
+
+error:
+    pyi_target_dirs_free(target_dirs);
+    return NULL;
 }
 
-/* TODO merge unix/win versions of remove_one() and pyi_remove_temp_path() */
-#ifdef _WIN32
-static void
-remove_one(wchar_t *wfnm, size_t pos, struct _wfinddata_t wfinfo)
+FILE *
+pyi_target_dirs_open(const TARGET_DIRS *target_dirs, const char *name)
 {
-    char fnm[PATH_MAX + 1];
-
-    if (wcscmp(wfinfo.name, L".") == 0  || wcscmp(wfinfo.name, L"..") == 0) {
-        return;
-    }
-    wfnm[pos] = PYI_NULLCHAR;
-    wcscat(wfnm, wfinfo.name);
+    const char *sep = strrchr(name, PYI_SEP);
+    const TARGET_DIR *dir = NULL;
+    char fnm[PATH_MAX];
 
-    if ((wfinfo.attrib & _A_SUBDIR)) {
-        if (!pyi_win32_is_symlink(wfnm)) {
-            /* Use recursion to remove subdirectories. */
-            pyi_win32_utils_to_utf8(fnm, wfnm, PATH_MAX);
-            pyi_remove_temp_path(fnm);
-        } else {
-            /* Remove only directory link */
-            _wrmdir(wfnm);
+    if (sep != NULL) {
+        dir = _pyi_target_dirs_find(target_dirs, name, sep - name);
+        if (dir == NULL) {
+            /* Not collected in advance */
+            return pyi_open_target(target_dirs->root, name, target_dirs->temporary);
         }
     }
-    else if (_wremove(wfnm)) {
-        /* HACK: Possible concurrency issue... spin a little while */
-        Sleep(100);
-        _wremove(wfnm);
+    /* Relative to an open directory, the full path is not needed. */
+    if (dir == NULL && target_dirs->root_fd != -1) {
+        return _pyi_open_new_file(target_dirs->root_fd, name, name, target_dirs->temporary);
+    }
+    if (dir != NULL && dir->fd != -1) {
+        return _pyi_open_new_file(dir->fd, sep + 1, name, target_dirs->temporary);
+    }
+    if (snprintf(fnm, PATH_MAX, "%s%s%s", target_dirs->root, PYI_SEPSTR, name) >= PATH_MAX) {
+        return NULL;
     }
+    return _pyi_open_new_file(-1, fnm, fnm, target_dirs->temporary);
 }
 
-/* TODO Find easier and more portable implementation of removing directory recursively. */
-/*     e.g. */
 void
-pyi_remove_temp_path(const char *dir)
+pyi_target_dirs_free(TARGET_DIRS *target_dirs)
 {
-    wchar_t wfnm[PATH_MAX + 1];
-    wchar_t wdir[PATH_MAX + 1];
-    struct _wfinddata_t wfinfo;
-    intptr_t h;
-    size_t dirnmlen;
-
-    pyi_win32_utils_from_utf8(wdir, dir, PATH_MAX);
-    wcscpy(wfnm, wdir);
-    dirnmlen = wcslen(wfnm);
+    size_t i;
 
-    if (wfnm[dirnmlen - 1] != L'/' && wfnm[dirnmlen - 1] != L'\\') {
-        wcscat(wfnm, L"\\");
-        dirnmlen++;
+    if (target_dirs == NULL) {
+        return;
     }
-    wcscat(wfnm, L"*");
-    h = _wfindfirst(wfnm, &wfinfo);
-
-    if (h != -1) {
-        remove_one(wfnm, dirnmlen, wfinfo);
-
-        while (_wfindnext(h, &wfinfo) == 0) {
-            remove_one(wfnm, dirnmlen, wfinfo);
+    for (i = 0; i < target_dirs->count; i++) {
+#ifndef _WIN32
+        if (target_dirs->dirs[i].fd != -1) {
+            close(target_dirs->dirs[i].fd);
         }
-        _findclose(h);
+#endif
+        free(target_dirs->dirs[i].name);
+    }
+#ifndef _WIN32
+    if (target_dirs->root_fd != -1) {
+        close(target_dirs->root_fd);
     }
-    _wrmdir(wdir);
+#endif
+    free(target_dirs->dirs);
+    free(target_dirs);
 }
-#else /* ifdef _WIN32 */
-static void
-remove_one(char *pnm, int pos, const char *fnm)
-{
-    struct stat sbuf;
 
-    if (strcmp(fnm, ".") == 0  || strcmp(fnm, "..") == 0) {
+/* Smallest file for which space is allocated in advance */
+#define _PYI_PREALLOCATE_MIN_SIZE (64 * 1024)
+
+/*
+ * Prepare a newly created file for writing size bytes of data in large
+ * chunks: the stdio buffer is bypassed, so that each chunk is written
+ * to the file descriptor at once, and the space for the data is allocated
+ * in advance, so that the filesystem can allocate it in one piece instead
+ * of extending the file with every write. The allocation is only a hint;
+ * errors are ignored.
+ */
+void
+pyi_utils_prepare_target(FILE *fp, uint64_t size)
+{
+    setvbuf(fp, NULL, _IONBF, 0);
+    if (size < _PYI_PREALLOCATE_MIN_SIZE) {
         return;
     }
-    pnm[pos] = PYI_NULLCHAR;
-    strcat(pnm, fnm);
+#if defined(_WIN32)
+    {
+        HANDLE handle = (HANDLE)_get_osfhandle(_fileno(fp));
+        FILE_ALLOCATION_INFO info;
 
-    /* Use lstat() instead of stat() to prevent recursion into
-     * symlinked directories */
-    if (lstat(pnm, &sbuf) == 0) {
-        if (S_ISDIR(sbuf.st_mode) ) {
-            /* Use recursion to remove subdirectories. */
-            pyi_remove_temp_path(pnm);
+        info.AllocationSize.QuadPart = (LONGLONG)size;
+        if (handle != INVALID_HANDLE_VALUE) {
+            SetFileInformationByHandle(handle, FileAllocationInfo, &info, sizeof(info));
         }
-        else {
-            unlink(pnm);
+    }
+#elif defined(HAVE_FALLOCATE)
+    /* Keep the size, so that the file never ends with unwritten space. */
+    if (fallocate(fileno(fp), FALLOC_FL_KEEP_SIZE, 0, (off_t)size) != 0) {
+        VS("LOADER: fallocate failed: %s\n", strerror(errno));
+    }
+#elif defined(__APPLE__)
+    {
+        fstore_t store = { F_ALLOCATECONTIG | F_ALLOCATEALL, F_PEOFPOSMODE, 0, (off_t)size, 0 };
+
+        if (fcntl(fileno(fp), F_PREALLOCATE, &store) == -1) {
+            store.fst_flags = F_ALLOCATEALL;
+            fcntl(fileno(fp), F_PREALLOCATE, &store);
         }
     }
+#elif defined(HAVE_POSIX_FALLOCATE)
+    posix_fallocate(fileno(fp), 0, (off_t)size);
+#endif
 }
 
-void
-pyi_remove_temp_path(const char *dir)
-{
-    char fnm[PATH_MAX + 1];
-    DIR *ds;
-    struct dirent *finfo;
-    int dirnmlen;
+#ifndef _WIN32
 
-    /* Leave 1 char for PY_SEP if needed */
-    strncpy(fnm, dir, PATH_MAX);
-    dirnmlen = strlen(fnm);
+/* Largest chunk copied by a single system call. */
+#define _PYI_COPY_CHUNK_SIZE 0x40000000
 
-    if (fnm[dirnmlen - 1] != PYI_SEP) {
-        strcat(fnm, PYI_SEPSTR);
-        dirnmlen++;
+#ifdef FICLONERANGE
+/*
+ * Share the data blocks of the source range with the destination file,
+ * on filesystems that support it (e.g., btrfs, XFS). The source offset
+ * and the destination position must be aligned to the block size; the
+ * cloned range is rounded up to whole blocks, and the destination file
+ * is then truncated to the requested size. Returns 0 on success, -1 if
+ * the range cannot be cloned.
+ */
+static int
+_pyi_clone_fd_range(int in_fd, uint64_t offset, int out_fd, uint64_t size)
+{
+    struct file_clone_range range;
+    struct stat st;
+    off_t position;
+    uint64_t block_size;
+    uint64_t length;
+
+    if (fstat(in_fd, &st) != 0 || st.st_blksize <= 0) {
+        return -1;
     }
-    ds = opendir(dir);
-    if (!ds) {
-        return;
+    block_size = (uint64_t)st.st_blksize;
+    position = lseek(out_fd, 0, SEEK_CUR);
+    if (position < 0 || offset % block_size != 0 || (uint64_t)position % block_size != 0) {
+        return -1;
     }
-    finfo = readdir(ds);
-
-    while (finfo) {
-        remove_one(fnm, dirnmlen, finfo->d_name);
-        finfo = readdir(ds);
+    length = (size + block_size - 1) / block_size * block_size;
+    if (offset + length >= (uint64_t)st.st_size) {
+        length = 0;  /* Up to the end of the source file */
     }
-    closedir(ds);
-    rmdir(dir);
+    range.src_fd = in_fd;
+    range.src_offset = offset;
+    range.src_length = length;
+    range.dest_offset = (uint64_t)position;
+    if (ioctl(out_fd, FICLONERANGE, &range) != 0) {
+        return -1;
+    }
+    if (ftruncate(out_fd, position + (off_t)size) != 0 ||
+        lseek(out_fd, position + (off_t)size, SEEK_SET) < 0) {
+        return -1;
+    }
+    return 0;
 }
-#endif /* ifdef _WIN32 */
+#endif /* FICLONERANGE */
 
 /*
- * helper for extract2fs
- * which may try multiple places
+ * Copy size bytes at the given offset of the file in_fd to the current
+ * position of the file out_fd, without copying the data through user
+ * space where possible: by cloning the range (reflink), or else with
+ * copy_file_range() or sendfile(). If the kernel or the filesystems do
+ * not support these, or fail midway, the rest is copied with a buffered
+ * loop. The position of in_fd is not changed. Returns 0 on success, -1
+ * on error (with errno set).
  */
-/* TODO find better name for function. */
-FILE *
-pyi_open_target(const char *path, const char* name_)
+int
+pyi_utils_copy_fd_range(int in_fd, uint64_t offset, int out_fd, uint64_t size)
 {
+    const size_t BUFFER_SIZE = 256 * 1024;
+    uint64_t copied = 0;
+    char *buf;
 
-#ifdef _WIN32
-    wchar_t wchar_buffer[PATH_MAX];
-    struct _stat sbuf;
-#else
-    struct stat sbuf;
+    if (size == 0) {
+        return 0;
+    }
+#ifdef FICLONERANGE
+    if (_pyi_clone_fd_range(in_fd, offset, out_fd, size) == 0) {
+        return 0;
+    }
 #endif
-    char fnm[PATH_MAX];
-    char name[PATH_MAX];
-    char *dir;
-    size_t len;
-
-    if (snprintf(fnm, PATH_MAX, "%s", path) >= PATH_MAX ||
-        snprintf(name, PATH_MAX, "%s", name_) >= PATH_MAX) {
-        return NULL;
+#if defined(__linux__) && defined(__NR_copy_file_range)
+    /* Invoked via syscall(), as the glibc wrapper is only available in
+     * recent versions; fails with ENOSYS on kernels older than 4.5. */
+    while (copied < size) {
+        int64_t in_offset = (int64_t)(offset + copied);
+        uint64_t chunk = size - copied;
+        long count;
+
+        if (chunk > _PYI_COPY_CHUNK_SIZE) {
+            chunk = _PYI_COPY_CHUNK_SIZE;
+        }
+        count = syscall(__NR_copy_file_range, in_fd, &in_offset, out_fd, NULL, (size_t)chunk, 0);
+        if (count <= 0) {
+            break;
+        }
+        copied += (uint64_t)count;
     }
-
-    len = strlen(fnm);
-    dir = strtok(name, PYI_SEPSTR);
-
-    while (dir != NULL) {
-        len += strlen(dir) + strlen(PYI_SEPSTR);
-        /* Check if fnm does not exceed the buffer size */
-        if (len >= PATH_MAX-1) {
-            return NULL;
+#endif
+#if defined(HAVE_SENDFILE) && defined(__linux__)
+    while (copied < size && (uint64_t)(off_t)(offset + size) == offset + size) {
+        off_t in_offset = (off_t)(offset + copied);
+        uint64_t chunk = size - copied;
+        ssize_t count;
+
+        if (chunk > _PYI_COPY_CHUNK_SIZE) {
+            chunk = _PYI_COPY_CHUNK_SIZE;
         }
-        strcat(fnm, PYI_SEPSTR);
-        strcat(fnm, dir);
-        dir = strtok(NULL, PYI_SEPSTR);
-
-        if (!dir) {
+        count = sendfile(out_fd, in_fd, &in_offset, (size_t)chunk);
+        if (count <= 0) {
             break;
         }
+        copied += (uint64_t)count;
+    }
+#endif
+    if (copied == size) {
+        return 0;
+    }
 
-#ifdef _WIN32
-        pyi_win32_utils_from_utf8(wchar_buffer, fnm, PATH_MAX);
+    buf = (char *)malloc(BUFFER_SIZE);
+    if (buf == NULL) {
+        return -1;
+    }
+    while (copied < size) {
+        size_t chunk = (size - copied < BUFFER_SIZE) ? (size_t)(size - copied) : BUFFER_SIZE;
+        ssize_t count = pread(in_fd, buf, chunk, (off_t)(offset + copied));
+        ssize_t written = 0;
 
-        if (_wstat(wchar_buffer, &sbuf) < 0) {
-            pyi_win32_mkdir(wchar_buffer);
+        if (count <= 0) {
+            if (count == 0) {
+                errno = EIO;  /* Unexpected end of file */
+            }
+            free(buf);
+            return -1;
         }
-#else
-
-        if (stat(fnm, &sbuf) < 0) {
-            mkdir(fnm, 0700);
+        while (written < count) {
+            ssize_t rc = write(out_fd, buf + written, (size_t)(count - written));
+            if (rc < 0) {
+                free(buf);
+                return -1;
+            }
+            written += rc;
         }
-#endif
+        copied += (uint64_t)count;
     }
+    free(buf);
+    return 0;
+}
 
-#ifdef _WIN32
-    pyi_win32_utils_from_utf8(wchar_buffer, fnm, PATH_MAX);
+#endif /* ifndef _WIN32 */
 
-    if (_wstat(wchar_buffer, &sbuf) == 0) {
-        OTHERERROR("WARNING: file already exists but should not: %s\n", fnm);
-    }
-#else
+#if defined(HAVE_CLONEFILE)
+/*
+ * Clone the file src as filename in the directory dst, on filesystems
+ * that support it (APFS). The target file is first created by
+ * pyi_open_target(), which also creates its parent directories, and then
+ * replaced by the clone. Returns 0 on success, -1 if the file cannot be
+ * cloned.
+ */
+static int
+_pyi_clone_file(const char *src, const char *dst, const char *filename)
+{
+    char path[PATH_MAX];
+    FILE *out;
 
-    if (stat(fnm, &sbuf) == 0) {
-        OTHERERROR("WARNING: file already exists but should not: %s\n", fnm);
+    if (snprintf(path, PATH_MAX, "%s%s%s", dst, PYI_SEPSTR, filename) >= PATH_MAX) {
+        return -1;
     }
-#endif
-    /*
-     * pyi_path_fopen() wraps different fopen names. On Windows it uses
-     * wide-character version of fopen.
-     */
-    return pyi_path_fopen(fnm, "wb");
+    out = pyi_open_target(dst, filename, false);
+    if (out == NULL) {
+        return -1;
+    }
+    fclose(out);
+    unlink(path);
+    if (clonefile(src, path, 0) != 0) {
+        return -1;
+    }
+    chmod(path, S_IRUSR | S_IWUSR | S_IXUSR);
+    return 0;
 }
+#endif /* defined(HAVE_CLONEFILE) */
 
-/* Copy the file src to dst 4KB per time */
+/*
+ * Copy the file src as filename in the directory dst. On POSIX systems,
+ * the data is copied by the kernel where possible (see
+ * pyi_utils_copy_fd_range(); on macOS, by cloning the file or with
+ * fcopyfile()), otherwise 256KB per time. For temporary, see
+ * _pyi_open_new_file().
+ */
 int
-pyi_copy_file(const char *src, const char *dst, const char *filename)
+pyi_copy_file(const char *src, const char *dst, const char *filename, bool temporary)
 {
-    FILE *in = pyi_path_fopen(src, "rb");
-    FILE *out = pyi_open_target(dst, filename);
-    char buf[4096];
+    const size_t BUFFER_SIZE = 256 * 1024;
+    FILE *in;
+    FILE *out;
+    char *buf;
     size_t read_count = 0;
     int error = 0;
 
+#if defined(HAVE_CLONEFILE)
+    if (_pyi_clone_file(src, dst, filename) == 0) {
+        return 0;
+    }
+#endif
+    in = pyi_path_fopen(src, "rb");
+    out = pyi_open_target(dst, filename, temporary);
     if (in == NULL || out == NULL) {
         if (in) {
             fclose(in);
@@ -677,8 +1875,43 @@ pyi_copy_file(const char *src, const char *dst, const char *filename)
         return -1;
     }
 
+#ifndef _WIN32
+    {
+        struct stat st;
+
+        if (fstat(fileno(in), &st) == 0) {
+    #if defined(HAVE_FCOPYFILE)
+            error = (fcopyfile(fileno(in), fileno(out), NULL, COPYFILE_DATA) == 0) ? 0 : -1;
+    #else
+            error = pyi_utils_copy_fd_range(fileno(in), 0, fileno(out), (uint64_t)st.st_size);
+    #endif
+            fchmod(fileno(out), S_IRUSR | S_IWUSR | S_IXUSR);
+            fclose(in);
+            if (fclose(out) != 0) {
+                error = -1;
+            }
+            return error;
+        }
+    }
+#else
+    {
+        __int64 length = _filelengthi64(_fileno(in));
+
+        if (length > 0) {
+            pyi_utils_prepare_target(out, (uint64_t)length);
+        }
+    }
+#endif
+
+    buf = (char *)malloc(BUFFER_SIZE);
+    if (buf == NULL) {
+        fclose(in);
+        fclose(out);
+        return -1;
+    }
+
     while (!feof(in)) {
-        read_count = fread(buf, 1, 4096, in);
+        read_count = fread(buf, 1, BUFFER_SIZE, in);
         if (read_count <= 0 ) {
             if (ferror(in)) {
                 clearerr(in);
@@ -700,10 +1933,43 @@ pyi_copy_file(const char *src, const char *dst, const char *filename)
 #endif
     fclose(in);
     fclose(out);
+    free(buf);
 
     return error;
 }
 
+/*
+ * Make the file src available as filename in the directory dst without
+ * copying its data, as a hard link. Parent directories are created as
+ * needed. Returns 0 on success, -1 if the file cannot be linked (e.g., src
+ * is on another volume); pyi_copy_file() can then be used instead, which
+ * clones the file where the filesystem supports it. Symbolic links are
+ * not used, as the files must stay valid if src is later moved or removed
+ * (e.g., when dst is in the persistent extraction cache).
+ */
+int
+pyi_link_file(const char *src, const char *dst, const char *filename)
+{
+    char path[PATH_MAX];
+#ifdef _WIN32
+    wchar_t wsrc[PATH_MAX];
+    wchar_t wpath[PATH_MAX];
+#endif
+
+    if (_pyi_make_target_path(path, dst, filename) != 0) {
+        return -1;
+    }
+#ifdef _WIN32
+    if (pyi_win32_utils_from_utf8(wsrc, src, PATH_MAX) == NULL ||
+        pyi_win32_utils_from_utf8(wpath, path, PATH_MAX) == NULL) {
+        return -1;
+    }
+    return CreateHardLinkW(wpath, wsrc, NULL) ? 0 : -1;
+#else
+    return link(src, path) == 0 ? 0 : -1;
+#endif
+}
+
 /* Load the shared dynamic library (DLL) */
 dylib_t
 pyi_utils_dlopen(const char *dllpath)
@@ -754,6 +2020,48 @@ pyi_utils_dlclose(dylib_t dll)
 #endif
 }
 
+/*
+ * Release what the onefile parent process does not need while it waits
+ * for the child process, which is everything but what the signal
+ * forwarding and the removal of the temporary directory need. The archive
+ * contents are released once the background extraction (if pipelined)
+ * has finished, and the splash screen once the child process has closed
+ * it. Returns true when everything has been released; until then, the
+ * caller calls it again periodically.
+ */
+static bool
+_pyi_utils_release_parent(ARCHIVE_STATUS *status, SPLASH_STATUS **splash_status)
+{
+    bool released = true;
+
+    if (status->tocbuff != NULL) {
+        if (pyi_pipeline_is_running()) {
+            released = false;
+        } else {
+            VS("LOADER: Releasing the archive contents in parent\n");
+            pyi_arch_release_contents(status);
+        }
+    }
+    if (*splash_status != NULL) {
+        if (!pyi_splash_is_closed(*splash_status)) {
+            released = false;
+        } else {
+            VS("LOADER: Releasing the splash screen in parent\n");
+            pyi_splash_finalize(*splash_status);
+            pyi_splash_status_free(splash_status);
+        }
+    }
+    if (released) {
+        size_t resident_size = pyi_utils_get_resident_size();
+        VS("LOADER: Parent process resident size: %lu kB\n", (unsigned long)(resident_size / 1024));
+        pyi_trace_add_counter("parent_resident_size", resident_size);
+    }
+    return released;
+}
+
+/* Interval between the calls of _pyi_utils_release_parent(), in milliseconds */
+#define RELEASE_PARENT_INTERVAL 100
+
 /* ////////////////////////////////////////////////////////////////// */
 /* TODO better merging of the following platform specific functions. */
 /* ////////////////////////////////////////////////////////////////// */
@@ -767,7 +2075,7 @@ pyi_utils_set_environment(const ARCHIVE_STATUS *status)
 }
 
 int
-pyi_utils_create_child(const char *thisfile, const ARCHIVE_STATUS* status,
+pyi_utils_create_child(const char *thisfile, ARCHIVE_STATUS *status, SPLASH_STATUS **splash_status,
                        const int argc, char *const argv[])
 {
     SECURITY_ATTRIBUTES sa;
@@ -814,9 +2122,18 @@ pyi_utils_create_child(const char *thisfile, const ARCHIVE_STATUS* status,
             &si,               /* pointer to STARTUPINFO */
             &pi                /* pointer to PROCESS_INFORMATION */
             )) {
+        /* Pipelined extraction; see pyi_pipeline.c */
+        pyi_pipeline_start();
+        CloseHandle(pi.hThread);
         VS("LOADER: Waiting for child process to finish...\n");
+        while (!_pyi_utils_release_parent(status, splash_status)) {
+            if (WaitForSingleObject(pi.hProcess, RELEASE_PARENT_INTERVAL) != WAIT_TIMEOUT) {
+                break;
+            }
+        }
         WaitForSingleObject(pi.hProcess, INFINITE);
         GetExitCodeProcess(pi.hProcess, (unsigned long *)&rc);
+        CloseHandle(pi.hProcess);
     }
     else {
         FATAL_WINERROR("CreateProcessW", "Error creating child process!\n");
@@ -974,7 +2291,7 @@ _signal_handler(int signum)
  * in a subprocess.
  */
 int
-pyi_utils_create_child(const char *thisfile, const ARCHIVE_STATUS* status,
+pyi_utils_create_child(const char *thisfile, ARCHIVE_STATUS *status, SPLASH_STATUS **splash_status,
                        const int argc, char *const argv[])
 {
     pid_t pid = 0;
@@ -1002,10 +2319,11 @@ pyi_utils_create_child(const char *thisfile, const ARCHIVE_STATUS* status,
 #if defined(__APPLE__) && defined(WINDOWED)
     /* Install Apple Event handlers */
     pyi_apple_install_event_handlers();
-    /* argv emulation; do a short (250 ms) cycle of Apple Events processing
-     * before bringing up the child process */
+    /* argv emulation; process Apple Events until the activation event is
+     * handled (or a short timeout is reached) before bringing up the child
+     * process. The events that arrive later are forwarded to the child. */
     if (pyi_arch_get_option(status, "pyi-macos-argv-emulation") != NULL) {
-        pyi_apple_process_events(0.25);  /* short timeout (250 ms) */
+        pyi_apple_process_initial_events(pyi_apple_get_argv_emulation_timeout(status));
     }
 #endif
 
@@ -1034,6 +2352,10 @@ pyi_utils_create_child(const char *thisfile, const ARCHIVE_STATUS* status,
      * wait_rc is -1, so the child exit code checking is skipped. */
 
     child_pid = pid;
+
+    /* Pipelined extraction; see pyi_pipeline.c */
+    pyi_pipeline_start();
+
     ignore_signals = (pyi_arch_get_option(status, "pyi-bootloader-ignore-signals") != NULL);
     handler = ignore_signals ? &_ignoring_signal_handler : &_signal_handler;
 
@@ -1054,11 +2376,15 @@ pyi_utils_create_child(const char *thisfile, const ARCHIVE_STATUS* status,
 
 #if defined(__APPLE__) && defined(WINDOWED)
     /* macOS: forward events to child */
+    bool parent_released = false;
     do {
         /* The below loop will iterate about once every second on Apple,
          * waiting on the event queue most of that time. */
         wait_rc = waitpid(child_pid, &rc, WNOHANG);
         if (wait_rc == 0) {
+            if (!parent_released) {
+                parent_released = _pyi_utils_release_parent(status, splash_status);
+            }
             /* Check if we have a pending event that we need to forward... */
             if (pyi_apple_has_pending_event()) {
                 /* Attempt to re-send the pending event after 0.5 second delay. */
@@ -1081,7 +2407,18 @@ pyi_utils_create_child(const char *thisfile, const ARCHIVE_STATUS* status,
     /* Uninstall event handlers */
     pyi_apple_uninstall_event_handlers();
 #else
-    wait_rc = waitpid(child_pid, &rc, 0);
+    /* Check periodically, only until everything has been released. */
+    wait_rc = 0;
+    while (!_pyi_utils_release_parent(status, splash_status)) {
+        wait_rc = waitpid(child_pid, &rc, WNOHANG);
+        if (wait_rc != 0) {
+            break;
+        }
+        usleep(RELEASE_PARENT_INTERVAL * 1000);
+    }
+    if (wait_rc == 0) {
+        wait_rc = waitpid(child_pid, &rc, 0);
+    }
 #endif
     if (wait_rc < 0) {
         VS("LOADER: failed to wait for child process: %s\n", strerror(errno));
@@ -1284,6 +2621,47 @@ const unsigned char MAGIC_BASE[8] = {
     013, 012, 013, 016
 };
 
+/*
+ * Search the buffer back to front for the last occurrence of the specified
+ * MAGIC pattern. Candidate positions are located via memrchr() (if
+ * available), which is usually vectorized.
+ *
+ * Returns pointer to the pattern within the buffer, or NULL if not found.
+ */
+const unsigned char *
+pyi_utils_find_magic_pattern_in_buffer(const unsigned char *buffer, size_t size,
+                                       const unsigned char *magic, size_t magic_len)
+{
+    const unsigned char *ptr;
+    size_t remaining;
+
+    if (size < magic_len) {
+        return NULL;
+    }
+    /* Number of candidate positions, i.e., [0, size - magic_len] */
+    remaining = size - magic_len + 1;
+
+    while (remaining > 0) {
+#ifdef HAVE_MEMRCHR
+        ptr = (const unsigned char *)memrchr(buffer, magic[0], remaining);
+        if (ptr == NULL) {
+            break;
+        }
+#else
+        ptr = buffer + remaining - 1;
+        if (*ptr != magic[0]) {
+            remaining--;
+            continue;
+        }
+#endif
+        if (memcmp(ptr, magic, magic_len) == 0) {
+            return ptr;
+        }
+        remaining = (size_t)(ptr - buffer);
+    }
+    return NULL;
+}
+
 /*
  * Perform full back-to-front scan of the given file and search for the
  * specified MAGIC pattern.
@@ -1293,7 +2671,7 @@ const unsigned char MAGIC_BASE[8] = {
 uint64_t
 pyi_utils_find_magic_pattern(FILE *fp, const unsigned char *magic, size_t magic_len)
 {
-    static const int SEARCH_CHUNK_SIZE = 8192;
+    static const int SEARCH_CHUNK_SIZE = 64 * 1024;
     unsigned char *buffer = NULL;
     uint64_t start_pos, end_pos;
     uint64_t offset = 0;  /* return value */
@@ -1321,7 +2699,8 @@ pyi_utils_find_magic_pattern(FILE *fp, const unsigned char *magic, size_t magic_
     /* Search the file back to front, in overlapping SEARCH_CHUNK_SIZE
      * chunks. */
     do {
-        size_t chunk_size, i;
+        size_t chunk_size;
+        const unsigned char *match;
         start_pos = (end_pos >= SEARCH_CHUNK_SIZE) ? (end_pos - SEARCH_CHUNK_SIZE) : 0;
         chunk_size = (size_t)(end_pos - start_pos);
 
@@ -1341,11 +2720,10 @@ pyi_utils_find_magic_pattern(FILE *fp, const unsigned char *magic, size_t magic_
         }
 
         /* Scan the chunk */
-        for (i = chunk_size - magic_len + 1; i > 0; i--) {
-            if (memcmp(buffer + i -1, magic, magic_len) == 0) {
-                offset = start_pos + i - 1;
-                goto cleanup;
-            }
+        match = pyi_utils_find_magic_pattern_in_buffer(buffer, chunk_size, magic, magic_len);
+        if (match != NULL) {
+            offset = start_pos + (uint64_t)(match - buffer);
+            goto cleanup;
         }
 
         /* Adjust search location for next chunk; ensure proper overlap */
@@ -1357,3 +2735,71 @@ pyi_utils_find_magic_pattern(FILE *fp, const unsigned char *magic, size_t magic_
 
     return offset;
 }
+
+/*
+ * Return the resident set size of this process, in bytes, or 0 if it
+ * cannot be determined.
+ */
+size_t
+pyi_utils_get_resident_size()
+{
+#if defined(_WIN32)
+    PROCESS_MEMORY_COUNTERS counters;
+
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+        return 0;
+    }
+    return (size_t)counters.WorkingSetSize;
+#elif defined(__APPLE__)
+    struct mach_task_basic_info info;
+    mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+
+    if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO, (task_info_t)&info, &count) != KERN_SUCCESS) {
+        return 0;
+    }
+    return (size_t)info.resident_size;
+#elif defined(__linux__)
+    FILE *fp;
+    unsigned long size_pages = 0;
+    unsigned long resident_pages = 0;
+    int n;
+
+    fp = fopen("/proc/self/statm", "r");
+    if (fp == NULL) {
+        return 0;
+    }
+    n = fscanf(fp, "%lu %lu", &size_pages, &resident_pages);
+    fclose(fp);
+    if (n != 2) {
+        return 0;
+    }
+    return (size_t)resident_pages * (size_t)sysconf(_SC_PAGESIZE);
+#else
+    return 0;
+#endif
+}
+
+/*
+ * Return the value of a monotonic clock, in microseconds. The clock has
+ * an arbitrary starting point, so only differences are meaningful.
+ */
+uint64_t
+pyi_utils_get_monotonic_time()
+{
+#ifdef _WIN32
+    static LARGE_INTEGER frequency;
+    LARGE_INTEGER counter;
+
+    if (frequency.QuadPart == 0) {
+        QueryPerformanceFrequency(&frequency);
+    }
+    QueryPerformanceCounter(&counter);
+    return (uint64_t)(counter.QuadPart / frequency.QuadPart) * 1000000 +
+           (uint64_t)(counter.QuadPart % frequency.QuadPart) * 1000000 / frequency.QuadPart;
+#else
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
+#endif
+}
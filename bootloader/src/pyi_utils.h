@@ -20,6 +20,7 @@
 #define HEADER_PYI_UTILS_H
 
 #include "pyi_archive.h"
+#include "pyi_splash.h"
 
 #ifndef _WIN32
 #include <sys/types.h> /* pid_t */
@@ -44,16 +45,39 @@ int pyi_unsetenv(const char *variable);
 /* Temporary files. */
 
 int pyi_create_temp_path(ARCHIVE_STATUS *status);
+void pyi_commit_cache_path(ARCHIVE_STATUS *status);
+int pyi_find_cache_path(ARCHIVE_STATUS *status);
 void pyi_remove_temp_path(const char *dir);
 
 /* File manipulation. */
-FILE *pyi_open_target(const char *path, const char* name_);
-int pyi_copy_file(const char *src, const char *dst, const char *filename);
+FILE *pyi_open_target(const char *path, const char* name_, bool temporary);
+
+/*
+ * Parent directories of files to extract; created in advance by
+ * pyi_target_dirs_new() from the given entries, in the given root
+ * directory. pyi_target_dirs_open() creates the file for the given entry
+ * name. Returns NULL if the directories could not be created.
+ */
+typedef struct _target_dirs TARGET_DIRS;
+TARGET_DIRS *pyi_target_dirs_new(const char *root, TOC **entries, size_t count, bool temporary);
+FILE *pyi_target_dirs_open(const TARGET_DIRS *target_dirs, const char *name);
+void pyi_target_dirs_free(TARGET_DIRS *target_dirs);
+int pyi_copy_file(const char *src, const char *dst, const char *filename, bool temporary);
+int pyi_link_file(const char *src, const char *dst, const char *filename);
+void pyi_utils_prepare_target(FILE *fp, uint64_t size);
+#ifndef _WIN32
+int pyi_utils_copy_fd_range(int in_fd, uint64_t offset, int out_fd, uint64_t size);
+#endif
 
 /* Other routines. */
 dylib_t pyi_utils_dlopen(const char *dllpath);
 int pyi_utils_dlclose(dylib_t dll);
-int pyi_utils_create_child(const char *thisfile, const ARCHIVE_STATUS *status,
+/*
+ * Run the program in a child process and wait for it to exit. While
+ * waiting, the archive contents and the splash screen are released as
+ * soon as they are no longer needed; *splash_status is then set to NULL.
+ */
+int pyi_utils_create_child(const char *thisfile, ARCHIVE_STATUS *status, SPLASH_STATUS **splash_status,
                            const int argc, char *const argv[]);
 #ifndef _WIN32
 pid_t pyi_utils_get_child_pid();
@@ -73,5 +97,13 @@ void pyi_utils_free_args();
 /* Magic pattern matching */
 extern const unsigned char MAGIC_BASE[8];
 uint64_t pyi_utils_find_magic_pattern(FILE *fp, const unsigned char *magic, size_t magic_len);
+const unsigned char *pyi_utils_find_magic_pattern_in_buffer(const unsigned char *buffer, size_t size,
+                                                            const unsigned char *magic, size_t magic_len);
+
+/* Monotonic clock, in microseconds */
+uint64_t pyi_utils_get_monotonic_time();
+
+/* Resident set size of this process, in bytes; 0 if not available */
+size_t pyi_utils_get_resident_size();
 
 #endif  /* HEADER_PY_UTILS_H */
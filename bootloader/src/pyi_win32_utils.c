@@ -28,6 +28,7 @@
 #include <io.h>       /* _get_osfhandle */
 #include <signal.h>   /* signal */
 #include <sddl.h>     /* ConvertStringSecurityDescriptorToSecurityDescriptorW */
+#include <aclapi.h>   /* GetNamedSecurityInfoW */
 
 /* PyInstaller headers. */
 #include "pyi_global.h"  /* PATH_MAX */
@@ -387,45 +388,93 @@ pyi_win32_utf8_to_mbs(char * dst, const char * src, size_t max)
  *  Returns SID string on success, NULL on failure. The returned string must
  *  be freed using LocalFree().
  */
-static wchar_t *
-_pyi_win32_get_user_sid()
+/* Retrieve the given class of information about the access token of
+ *  the calling process.
+ *
+ *  Returns the information on success, NULL on failure. The returned
+ *  buffer must be freed using free().
+ */
+static void *
+_pyi_win32_get_token_information(TOKEN_INFORMATION_CLASS info_class)
 {
     HANDLE process_token = INVALID_HANDLE_VALUE;
-    DWORD user_info_size = 0;
-    PTOKEN_USER user_info = NULL;
-    wchar_t *sid = NULL;
+    DWORD info_size = 0;
+    void *info = NULL;
 
     // Get access token for the calling process
     if (!OpenProcessToken(GetCurrentProcess(), TOKEN_QUERY, &process_token)) {
-        goto cleanup;
+        return NULL;
     }
     // Get buffer size and allocate buffer
-    if (!GetTokenInformation(process_token, TokenUser, NULL, 0, &user_info_size)) {
+    if (!GetTokenInformation(process_token, info_class, NULL, 0, &info_size)) {
         if (GetLastError() != ERROR_INSUFFICIENT_BUFFER) {
             goto cleanup;
         }
     }
-    user_info = (PTOKEN_USER)calloc(1, user_info_size);
-    if (!user_info) {
+    info = calloc(1, info_size);
+    if (!info) {
         goto cleanup;
     }
-    // Get user information
-    if (!GetTokenInformation(process_token, TokenUser, user_info, user_info_size, &user_info_size)) {
-        goto cleanup;
+    // Get the information
+    if (!GetTokenInformation(process_token, info_class, info, info_size, &info_size)) {
+        free(info);
+        info = NULL;
     }
-    // Convert SID to string
-    ConvertSidToStringSidW(user_info->User.Sid, &sid);
 
-    // Cleanup
 cleanup:
-    free(user_info);
-    if (process_token != INVALID_HANDLE_VALUE) {
-        CloseHandle(process_token);
-    }
+    CloseHandle(process_token);
+    return info;
+}
 
+static wchar_t *
+_pyi_win32_get_user_sid()
+{
+    PTOKEN_USER user_info;
+    wchar_t *sid = NULL;
+
+    user_info = (PTOKEN_USER)_pyi_win32_get_token_information(TokenUser);
+    if (user_info) {
+        // Convert SID to string
+        ConvertSidToStringSidW(user_info->User.Sid, &sid);
+        free(user_info);
+    }
     return sid;
 }
 
+/* Check if the file or directory at path is owned by the current user,
+ *  or by the default owner of the objects created by the calling process
+ *  (e.g., the Administrators group, for elevated processes). This is the
+ *  counterpart of comparing st_uid with geteuid() on POSIX systems.
+ *
+ *  Returns 1 if it is, 0 if it is not or on error.
+ */
+int
+pyi_win32_is_owned_by_user(const wchar_t *path)
+{
+    PSECURITY_DESCRIPTOR security_desc = NULL;
+    PSID owner = NULL;
+    PTOKEN_USER user_info = NULL;
+    PTOKEN_OWNER owner_info = NULL;
+    int result = 0;
+
+    if (GetNamedSecurityInfoW((LPWSTR)path, SE_FILE_OBJECT, OWNER_SECURITY_INFORMATION, &owner, NULL, NULL, NULL,
+                              &security_desc) != ERROR_SUCCESS) {
+        return 0;
+    }
+    if (owner != NULL) {
+        user_info = (PTOKEN_USER)_pyi_win32_get_token_information(TokenUser);
+        owner_info = (PTOKEN_OWNER)_pyi_win32_get_token_information(TokenOwner);
+        if ((user_info && EqualSid(owner, user_info->User.Sid)) ||
+            (owner_info && EqualSid(owner, owner_info->Owner))) {
+            result = 1;
+        }
+    }
+    free(user_info);
+    free(owner_info);
+    LocalFree(security_desc);  // Must be freed using LocalFree()
+    return result;
+}
+
 /* Create a directory at path with restricted permissions.
  *  The directory owner will be the only one with permissions on the created
  *  dir. Calling this function is equivalent to callin chmod(path, 0700) on
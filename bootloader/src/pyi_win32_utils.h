@@ -28,6 +28,7 @@ wchar_t * pyi_win32_utils_from_utf8(wchar_t *buffer, const char *ostr, size_t n)
 char * pyi_win32_utf8_to_mbs(char * dst, const char * src, size_t max);
 
 int pyi_win32_mkdir(const wchar_t *path);
+int pyi_win32_is_owned_by_user(const wchar_t *path);
 
 int pyi_win32_is_symlink(const wchar_t *path);
 
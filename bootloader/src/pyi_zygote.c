@@ -0,0 +1,726 @@
+/*
+ * ****************************************************************************
+ * Copyright (c) 2013-2022, PyInstaller Development Team.
+ *
+ * Distributed under the terms of the GNU General Public License (version 2
+ * or later) with exception for distributing the bootloader.
+ *
+ * The full license is in the file COPYING.txt, distributed with this software.
+ *
+ * SPDX-License-Identifier: (GPL-2.0-or-later WITH Bootloader-exception)
+ * ****************************************************************************
+ */
+
+/*
+ * Zygote server mode.
+ *
+ * Programs that are launched very often may be built with the zygote
+ * option (pyi-zygote runtime option, whose value is the comma-separated
+ * list of warm-up modules). On POSIX systems, such a program then has two
+ * additional modes of operation:
+ *
+ *  - server: when PYI_ZYGOTE_SERVE is set to the path of a UNIX socket,
+ *    the program starts up as usual up to the installation of the import
+ *    machinery, imports the warm-up modules, and then listens on the
+ *    socket. For each launch request, it forks a launcher process, which
+ *    forks the worker process that runs the program's scripts, and
+ *    reports the worker's exit status back to the client;
+ *  - client: when PYI_ZYGOTE_SOCKET is set to the path of the socket, the
+ *    bootloader connects to the server right after opening the archive,
+ *    and sends it the command-line arguments, the environment, the
+ *    working directory and the standard streams (file descriptors 0 to 2)
+ *    of the process. It then forwards the signals it receives to the
+ *    worker, and exits with the worker's exit status. If no server
+ *    listens on the socket, or the server runs a different program (as
+ *    told by the archive digest), the program is run normally.
+ *
+ * Only clients running as the same user as the server are served.
+ */
+
+#ifndef _WIN32
+
+#ifdef __linux__
+    /* SO_PEERCRED, struct ucred */
+    #ifndef _GNU_SOURCE
+        #define _GNU_SOURCE
+    #endif
+#endif
+
+#include <errno.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#endif  /* _WIN32 */
+
+/* PyInstaller headers */
+#include "pyi_global.h"
+#include "pyi_archive.h"
+#include "pyi_python.h"
+#include "pyi_pythonlib.h"
+#include "pyi_pyz.h"
+#include "pyi_utils.h"
+#include "pyi_zygote.h"
+
+#ifndef _WIN32
+
+extern char **environ;  /* sent to the server by the client */
+
+#define _ZYGOTE_MAGIC "PYZ1"
+/* Maximal size of the arguments and the environment of a request. */
+#define _ZYGOTE_MAX_PAYLOAD_SIZE (16 * 1024 * 1024)
+/* Number of passed file descriptors (stdin, stdout, stderr). */
+#define _ZYGOTE_NUM_FDS 3
+
+#ifdef MSG_NOSIGNAL
+    #define _ZYGOTE_SEND_FLAGS MSG_NOSIGNAL
+#else
+    #define _ZYGOTE_SEND_FLAGS 0
+#endif
+
+/*
+ * Launch request; followed by the payload, the NUL-terminated working
+ * directory, arguments and environment strings. The file descriptors are
+ * passed along with the header.
+ */
+typedef struct _zygote_request_header {
+    char magic[4];
+    uint32_t argc;
+    uint32_t envc;
+    uint32_t payload_size;
+    unsigned char digest[ARCHIVE_DIGEST_SIZE];
+} ZYGOTE_REQUEST_HEADER;
+
+/* Worker process of the client; signals are forwarded to it. */
+static pid_t _zygote_worker_pid = 0;
+
+/*
+ * Python code run in the worker process, to replace the environment with
+ * that of the client (sys._pyi_zygote_environ), and to pick up its
+ * standard streams. Going through os.environ keeps it in sync with the
+ * environment of the process.
+ */
+static const char _zygote_worker_setup[] =
+    "import os, sys\n"
+    "os.environ.clear()\n"
+    "for _pyi_item in sys._pyi_zygote_environ:\n"
+    "    _pyi_key, _pyi_sep, _pyi_value = _pyi_item.partition('=')\n"
+    "    if _pyi_key and _pyi_sep:\n"
+    "        os.environ[_pyi_key] = _pyi_value\n"
+    "del sys._pyi_zygote_environ\n"
+    "if sys.stdout is not None:\n"
+    "    sys.stdout.reconfigure(line_buffering=sys.stdout.isatty())\n";
+
+static int
+_pyi_zygote_write_full(int fd, const void *buffer, size_t size)
+{
+    const char *ptr = (const char *)buffer;
+    ssize_t written;
+
+    while (size > 0) {
+        written = send(fd, ptr, size, _ZYGOTE_SEND_FLAGS);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        ptr += written;
+        size -= (size_t)written;
+    }
+    return 0;
+}
+
+static int
+_pyi_zygote_read_full(int fd, void *buffer, size_t size)
+{
+    char *ptr = (char *)buffer;
+    ssize_t count;
+
+    while (size > 0) {
+        count = recv(fd, ptr, size, 0);
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+        if (count <= 0) {
+            return -1;
+        }
+        ptr += count;
+        size -= (size_t)count;
+    }
+    return 0;
+}
+
+/*
+ * Fill the address of the socket with the given path. Returns -1 if the
+ * path is too long.
+ */
+static int
+_pyi_zygote_set_address(struct sockaddr_un *address, const char *path)
+{
+    memset(address, 0, sizeof(*address));
+    address->sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(address->sun_path)) {
+        return -1;
+    }
+    strcpy(address->sun_path, path);
+    return 0;
+}
+
+/*
+ * Build the payload of a launch request. Returns NULL on error.
+ */
+static char *
+_pyi_zygote_build_payload(int argc, char *argv[], uint32_t *envc, uint32_t *size)
+{
+    char cwd[PATH_MAX];
+    size_t total;
+    char *payload;
+    char *ptr;
+    size_t len;
+    int i;
+
+    if (getcwd(cwd, sizeof(cwd)) == NULL) {
+        return NULL;
+    }
+    total = strlen(cwd) + 1;
+    for (i = 0; i < argc; i++) {
+        total += strlen(argv[i]) + 1;
+    }
+    *envc = 0;
+    for (i = 0; environ[i] != NULL; i++) {
+        total += strlen(environ[i]) + 1;
+        (*envc)++;
+    }
+    if (total > _ZYGOTE_MAX_PAYLOAD_SIZE) {
+        return NULL;
+    }
+    payload = (char *)malloc(total);
+    if (payload == NULL) {
+        return NULL;
+    }
+    ptr = payload;
+    len = strlen(cwd) + 1;
+    memcpy(ptr, cwd, len);
+    ptr += len;
+    for (i = 0; i < argc; i++) {
+        len = strlen(argv[i]) + 1;
+        memcpy(ptr, argv[i], len);
+        ptr += len;
+    }
+    for (i = 0; environ[i] != NULL; i++) {
+        len = strlen(environ[i]) + 1;
+        memcpy(ptr, environ[i], len);
+        ptr += len;
+    }
+    *size = (uint32_t)total;
+    return payload;
+}
+
+static void
+_pyi_zygote_signal_handler(int signum)
+{
+    if (_zygote_worker_pid > 0) {
+        kill(_zygote_worker_pid, signum);
+    }
+}
+
+int
+pyi_zygote_client(ARCHIVE_STATUS *status, int argc, char *argv[], int *exit_code)
+{
+    /* As in pyi_utils_create_child() */
+    const int num_signals = 65;
+    ZYGOTE_REQUEST_HEADER header;
+    struct sockaddr_un address;
+    struct msghdr message;
+    struct iovec iov;
+    union {
+        char buffer[CMSG_SPACE(_ZYGOTE_NUM_FDS * sizeof(int))];
+        struct cmsghdr align;
+    } control;
+    struct cmsghdr *cmsg;
+    int fds[_ZYGOTE_NUM_FDS] = { 0, 1, 2 };
+    char *socket_path = NULL;
+    char *serve_path = NULL;
+    char *payload = NULL;
+    int32_t reply;
+    int sock = -1;
+    int rc = 0;
+    int signum;
+
+    if (pyi_arch_get_option(status, "pyi-zygote") == NULL) {
+        return 0;
+    }
+    socket_path = pyi_getenv(ZYGOTE_SOCKET_ENV);
+    serve_path = pyi_getenv(ZYGOTE_SERVE_ENV);
+    if (socket_path == NULL || serve_path != NULL) {
+        goto cleanup;
+    }
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, _ZYGOTE_MAGIC, sizeof(header.magic));
+    header.argc = (uint32_t)argc;
+    if (pyi_arch_get_digest(status, header.digest) != 0 || _pyi_zygote_set_address(&address, socket_path) != 0) {
+        goto cleanup;
+    }
+    payload = _pyi_zygote_build_payload(argc, argv, &header.envc, &header.payload_size);
+    if (payload == NULL) {
+        goto cleanup;
+    }
+    sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sock < 0 || connect(sock, (struct sockaddr *)&address, sizeof(address)) != 0) {
+        VS("LOADER: No zygote server listening on %s; running normally\n", socket_path);
+        goto cleanup;
+    }
+
+    /* Send the header along with the file descriptors, then the payload */
+    memset(&message, 0, sizeof(message));
+    memset(&control, 0, sizeof(control));
+    iov.iov_base = &header;
+    iov.iov_len = sizeof(header);
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control.buffer;
+    message.msg_controllen = sizeof(control.buffer);
+    cmsg = CMSG_FIRSTHDR(&message);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+    if (sendmsg(sock, &message, _ZYGOTE_SEND_FLAGS) != (ssize_t)sizeof(header) ||
+        _pyi_zygote_write_full(sock, payload, header.payload_size) != 0) {
+        VS("LOADER: Could not send launch request to zygote server\n");
+        goto cleanup;
+    }
+
+    /* The server replies with the worker's PID, or 0 if it refuses the
+     * request; nothing has run yet in either case. */
+    if (_pyi_zygote_read_full(sock, &reply, sizeof(reply)) != 0 || reply <= 0) {
+        VS("LOADER: Zygote server refused launch request; running normally\n");
+        goto cleanup;
+    }
+    _zygote_worker_pid = (pid_t)reply;
+    VS("LOADER: Zygote server started worker %d\n", (int)_zygote_worker_pid);
+    rc = 1;
+    *exit_code = 1;
+
+    for (signum = 0; signum < num_signals; ++signum) {
+        if (signum != SIGCHLD && signum != SIGCLD && signum != SIGTSTP && signum != SIGPIPE) {
+            signal(signum, _pyi_zygote_signal_handler);
+        }
+    }
+    if (_pyi_zygote_read_full(sock, &reply, sizeof(reply)) != 0) {
+        VS("LOADER: Lost connection to zygote server\n");
+        reply = -1;
+    }
+    for (signum = 0; signum < num_signals; ++signum) {
+        signal(signum, SIG_DFL);
+    }
+
+    if (reply >= 0 && WIFEXITED(reply)) {
+        *exit_code = WEXITSTATUS(reply);
+    } else if (reply >= 0 && WIFSIGNALED(reply)) {
+        VS("LOADER: re-raising worker signal %d\n", WTERMSIG(reply));
+        /* Mimic the signal the worker received */
+        raise(WTERMSIG(reply));
+    }
+
+cleanup:
+    if (sock >= 0) {
+        close(sock);
+    }
+    free(payload);
+    free(socket_path);
+    free(serve_path);
+    return rc;
+}
+
+/*
+ * Check that the client runs as the same user as the server.
+ */
+static bool
+_pyi_zygote_check_peer(int conn)
+{
+#if defined(__linux__) && defined(SO_PEERCRED)
+    struct ucred cred;
+    socklen_t len = sizeof(cred);
+
+    return getsockopt(conn, SOL_SOCKET, SO_PEERCRED, &cred, &len) == 0 && cred.uid == getuid();
+#else
+    uid_t uid;
+    gid_t gid;
+
+    return getpeereid(conn, &uid, &gid) == 0 && uid == getuid();
+#endif
+}
+
+/*
+ * Request received by the server.
+ */
+typedef struct _zygote_request {
+    ZYGOTE_REQUEST_HEADER header;
+    int fds[_ZYGOTE_NUM_FDS];
+    char *payload;
+    char *cwd;
+    char **argv;
+    char **envp;
+} ZYGOTE_REQUEST;
+
+/*
+ * Reset the request to hold no descriptors and no allocated data.
+ */
+static void
+_pyi_zygote_init_request(ZYGOTE_REQUEST *request)
+{
+    int i;
+
+    memset(request, 0, sizeof(*request));
+    for (i = 0; i < _ZYGOTE_NUM_FDS; i++) {
+        request->fds[i] = -1;
+    }
+}
+
+static void
+_pyi_zygote_free_request(ZYGOTE_REQUEST *request)
+{
+    int i;
+
+    for (i = 0; i < _ZYGOTE_NUM_FDS; i++) {
+        if (request->fds[i] >= 0) {
+            close(request->fds[i]);
+        }
+    }
+    free(request->payload);
+    free(request->argv);
+    free(request->envp);
+    _pyi_zygote_init_request(request);
+}
+
+/*
+ * Receive and parse a launch request. Returns 0 on success, -1 on error.
+ */
+static int
+_pyi_zygote_read_request(int conn, ZYGOTE_REQUEST *request)
+{
+    struct msghdr message;
+    struct iovec iov;
+    union {
+        char buffer[CMSG_SPACE(_ZYGOTE_NUM_FDS * sizeof(int))];
+        struct cmsghdr align;
+    } control;
+    struct cmsghdr *cmsg;
+    ssize_t count;
+    char *ptr;
+    char *end;
+    uint32_t i;
+
+    _pyi_zygote_init_request(request);
+
+    memset(&message, 0, sizeof(message));
+    iov.iov_base = &request->header;
+    iov.iov_len = sizeof(request->header);
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control.buffer;
+    message.msg_controllen = sizeof(control.buffer);
+    do {
+        count = recvmsg(conn, &message, 0);
+    } while (count < 0 && errno == EINTR);
+    cmsg = (count > 0) ? CMSG_FIRSTHDR(&message) : NULL;
+    if (cmsg != NULL && cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS &&
+        cmsg->cmsg_len == CMSG_LEN(sizeof(request->fds))) {
+        memcpy(request->fds, CMSG_DATA(cmsg), sizeof(request->fds));
+    }
+    if (count != (ssize_t)sizeof(request->header) || request->fds[_ZYGOTE_NUM_FDS - 1] < 0 ||
+        memcmp(request->header.magic, _ZYGOTE_MAGIC, sizeof(request->header.magic)) != 0 ||
+        request->header.payload_size == 0 || request->header.payload_size > _ZYGOTE_MAX_PAYLOAD_SIZE ||
+        request->header.argc == 0 || request->header.argc > request->header.payload_size ||
+        request->header.envc > request->header.payload_size) {
+        return -1;
+    }
+
+    request->payload = (char *)malloc(request->header.payload_size);
+    request->argv = (char **)calloc(request->header.argc + 1, sizeof(char *));
+    request->envp = (char **)calloc(request->header.envc + 1, sizeof(char *));
+    if (request->payload == NULL || request->argv == NULL || request->envp == NULL ||
+        _pyi_zygote_read_full(conn, request->payload, request->header.payload_size) != 0 ||
+        request->payload[request->header.payload_size - 1] != 0) {
+        return -1;
+    }
+
+    /* Split the payload into the NUL-terminated strings */
+    ptr = request->payload;
+    end = request->payload + request->header.payload_size;
+    request->cwd = ptr;
+    ptr += strlen(ptr) + 1;
+    for (i = 0; i < request->header.argc; i++) {
+        if (ptr >= end) {
+            return -1;
+        }
+        request->argv[i] = ptr;
+        ptr += strlen(ptr) + 1;
+    }
+    for (i = 0; i < request->header.envc; i++) {
+        if (ptr >= end) {
+            return -1;
+        }
+        request->envp[i] = ptr;
+        ptr += strlen(ptr) + 1;
+    }
+    return (ptr == end) ? 0 : -1;
+}
+
+/*
+ * Set up the worker process to run the program on behalf of the client.
+ * The request data stays allocated for the lifetime of the process.
+ */
+static int
+_pyi_zygote_setup_worker(ARCHIVE_STATUS *status, ZYGOTE_REQUEST *request)
+{
+    PyObject *env_list;
+    PyObject *item;
+    int rc;
+    int i;
+
+    signal(SIGCHLD, SIG_DFL);
+    for (i = 0; i < _ZYGOTE_NUM_FDS; i++) {
+        if (dup2(request->fds[i], i) < 0) {
+            return -1;
+        }
+        if (request->fds[i] >= _ZYGOTE_NUM_FDS) {
+            close(request->fds[i]);
+        }
+        request->fds[i] = -1;
+    }
+    if (chdir(request->cwd) != 0) {
+        FATAL_PERROR("chdir", "Failed to change to the working directory of the client.\n");
+        return -1;
+    }
+    status->argc = (int)request->header.argc;
+    status->argv = request->argv;
+    if (pyi_pylib_set_sys_argv(status) != 0) {
+        return -1;
+    }
+
+    env_list = PI_PyList_New(0);
+    if (env_list == NULL) {
+        return -1;
+    }
+    for (i = 0; request->envp[i] != NULL; i++) {
+        item = PI_PyUnicode_DecodeFSDefault(request->envp[i]);
+        if (item == NULL || PI_PyList_Append(env_list, item) != 0) {
+            if (item) {
+                PI_Py_DecRef(item);
+            }
+            PI_Py_DecRef(env_list);
+            return -1;
+        }
+        PI_Py_DecRef(item);
+    }
+    rc = PI_PySys_SetObject("_pyi_zygote_environ", env_list);
+    PI_Py_DecRef(env_list);
+    if (rc != 0 || PI_PyRun_SimpleStringFlags(_zygote_worker_setup, NULL) != 0) {
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Launcher process: fork the worker, and report its PID and exit status
+ * to the client. Returns 0 in the worker; does not return otherwise.
+ */
+static int
+_pyi_zygote_launch(ARCHIVE_STATUS *status, ZYGOTE_REQUEST *request, int conn)
+{
+    int32_t reply;
+    pid_t pid;
+    int wait_status;
+
+    signal(SIGCHLD, SIG_DFL);
+    signal(SIGPIPE, SIG_IGN);
+
+    PI_PyOS_BeforeFork();
+    pid = fork();
+    if (pid == 0) {
+        PI_PyOS_AfterFork_Child();
+        close(conn);
+        if (_pyi_zygote_setup_worker(status, request) != 0) {
+            _exit(1);
+        }
+        return 0;
+    }
+    PI_PyOS_AfterFork_Parent();
+
+    reply = (pid > 0) ? (int32_t)pid : 0;
+    if (_pyi_zygote_write_full(conn, &reply, sizeof(reply)) != 0 || pid <= 0) {
+        _exit(1);
+    }
+    while (waitpid(pid, &wait_status, 0) < 0) {
+        if (errno != EINTR) {
+            _exit(1);
+        }
+    }
+    reply = (int32_t)wait_status;
+    _pyi_zygote_write_full(conn, &reply, sizeof(reply));
+    _exit(0);
+}
+
+/*
+ * Import the comma-separated warm-up modules. Returns 0 on success, -1 if
+ * any of them fails to import.
+ */
+static int
+_pyi_zygote_import_modules(const char *modules)
+{
+    char name[PATH_MAX];
+    PyObject *module;
+    const char *end;
+    size_t len;
+
+    while (*modules) {
+        end = strchr(modules, ',');
+        len = end ? (size_t)(end - modules) : strlen(modules);
+        if (len > 0 && len < sizeof(name)) {
+            memcpy(name, modules, len);
+            name[len] = 0;
+            VS("LOADER: Zygote server importing %s\n", name);
+            module = PI_PyImport_ImportModule(name);
+            if (module == NULL) {
+                PI_PyErr_Print();
+                FATALERROR("Failed to import warm-up module %s.\n", name);
+                return -1;
+            }
+            PI_Py_DecRef(module);
+        }
+        modules += len;
+        if (*modules == ',') {
+            modules++;
+        }
+    }
+    return 0;
+}
+
+int
+pyi_zygote_serve(ARCHIVE_STATUS *status)
+{
+    struct sockaddr_un address;
+    struct stat st;
+    ZYGOTE_REQUEST request;
+    const char *modules;
+    char *path;
+    unsigned char digest[ARCHIVE_DIGEST_SIZE];
+    int32_t reply;
+    int sock;
+    int conn;
+
+    modules = pyi_arch_get_option(status, "pyi-zygote");
+    if (modules == NULL) {
+        return 0;
+    }
+    path = pyi_getenv(ZYGOTE_SERVE_ENV);
+    if (path == NULL) {
+        return 0;
+    }
+    /* The processes started by the program are not servers */
+    pyi_unsetenv(ZYGOTE_SERVE_ENV);
+
+    if (_pyi_zygote_set_address(&address, path) != 0) {
+        FATALERROR("Invalid zygote socket path: %s\n", path);
+        free(path);
+        return -1;
+    }
+    free(path);
+    if (pyi_arch_get_digest(status, digest) != 0) {
+        FATALERROR("Cannot compute the archive digest for the zygote server.\n");
+        return -1;
+    }
+
+    if (_pyi_zygote_import_modules(modules) != 0) {
+        return -1;
+    }
+    /* No other threads may be running when forking */
+    pyi_pyz_prefetch_stop();
+    PI_PyRun_SimpleStringFlags("import sys\nsys.stdout and sys.stdout.flush()\nsys.stderr and sys.stderr.flush()\n",
+                               NULL);
+
+    /* Replace the socket left over by a previous server */
+    if (lstat(address.sun_path, &st) == 0 && S_ISSOCK(st.st_mode)) {
+        unlink(address.sun_path);
+    }
+    sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sock < 0 || bind(sock, (struct sockaddr *)&address, sizeof(address)) != 0 ||
+        chmod(address.sun_path, S_IRUSR | S_IWUSR) != 0 || listen(sock, 64) != 0) {
+        FATAL_PERROR("bind", "Failed to listen on zygote socket %s.\n", address.sun_path);
+        if (sock >= 0) {
+            close(sock);
+        }
+        return -1;
+    }
+    VS("LOADER: Zygote server listening on %s\n", address.sun_path);
+
+    /* The launcher processes are reaped automatically */
+    signal(SIGCHLD, SIG_IGN);
+    _pyi_zygote_init_request(&request);
+
+    while (1) {
+        conn = accept(sock, NULL, NULL);
+        if (conn < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            FATAL_PERROR("accept", "Zygote server failed to accept connection.\n");
+            close(sock);
+            return -1;
+        }
+        if (!_pyi_zygote_check_peer(conn)) {
+            VS("LOADER: Zygote server rejected connection from another user\n");
+            close(conn);
+            continue;
+        }
+        if (_pyi_zygote_read_request(conn, &request) != 0) {
+            VS("LOADER: Zygote server rejected malformed request\n");
+            _pyi_zygote_free_request(&request);
+            close(conn);
+            continue;
+        }
+        if (memcmp(request.header.digest, digest, ARCHIVE_DIGEST_SIZE) != 0) {
+            VS("LOADER: Zygote server rejected request for a different program\n");
+            reply = 0;
+            _pyi_zygote_write_full(conn, &reply, sizeof(reply));
+        } else if (fork() == 0) {
+            close(sock);
+            /* Returns only in the worker */
+            return _pyi_zygote_launch(status, &request, conn);
+        }
+        _pyi_zygote_free_request(&request);
+        close(conn);
+    }
+}
+
+#else  /* _WIN32 */
+
+int
+pyi_zygote_client(ARCHIVE_STATUS *status, int argc, char *argv[], int *exit_code)
+{
+    (void)status;
+    (void)argc;
+    (void)argv;
+    (void)exit_code;
+    return 0;
+}
+
+int
+pyi_zygote_serve(ARCHIVE_STATUS *status)
+{
+    (void)status;
+    return 0;
+}
+
+#endif  /* _WIN32 */
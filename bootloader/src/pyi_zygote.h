@@ -0,0 +1,50 @@
+/*
+ * ****************************************************************************
+ * Copyright (c) 2013-2022, PyInstaller Development Team.
+ *
+ * Distributed under the terms of the GNU General Public License (version 2
+ * or later) with exception for distributing the bootloader.
+ *
+ * The full license is in the file COPYING.txt, distributed with this software.
+ *
+ * SPDX-License-Identifier: (GPL-2.0-or-later WITH Bootloader-exception)
+ * ****************************************************************************
+ */
+
+/*
+ * Zygote server mode (pyi-zygote): launching the program by forking a
+ * resident, pre-initialized process.
+ */
+
+#ifndef PYI_ZYGOTE_H
+#define PYI_ZYGOTE_H
+
+#include "pyi_global.h"
+#include "pyi_archive.h"
+
+/* Environment variable with the socket path that the server listens on. */
+#define ZYGOTE_SERVE_ENV   "PYI_ZYGOTE_SERVE"
+/* Environment variable with the socket path that the client connects to. */
+#define ZYGOTE_SOCKET_ENV  "PYI_ZYGOTE_SOCKET"
+
+/*
+ * If the program was built with the zygote option and PYI_ZYGOTE_SOCKET
+ * is set, ask the zygote server listening on that socket to run the
+ * program with the given arguments and the environment, working
+ * directory and standard streams of this process, and wait for it to
+ * finish. Returns 1 if the program was run, with its exit code stored
+ * into *exit_code, or 0 if the program must be run normally (e.g., no
+ * server is listening, or it runs a different program).
+ */
+int pyi_zygote_client(ARCHIVE_STATUS *status, int argc, char *argv[], int *exit_code);
+
+/*
+ * If the program was built with the zygote option and PYI_ZYGOTE_SERVE
+ * is set, import the warm-up modules, and serve launch requests on the
+ * socket until the process is terminated. Must be called after the
+ * import machinery is installed. Returns 0 in the forked processes that
+ * run the program (and if not in server mode), -1 on error.
+ */
+int pyi_zygote_serve(ARCHIVE_STATUS *status);
+
+#endif  /* PYI_ZYGOTE_H */
@@ -0,0 +1,237 @@
+// -----------------------------------------------------------------------------
+// Copyright (c) 2022, PyInstaller Development Team.
+//
+// Distributed under the terms of the GNU General Public License (version 2
+// or later) with exception for distributing the bootloader.
+//
+// The full license is in the file COPYING.txt, distributed with this software.
+//
+// SPDX-License-Identifier: (GPL-2.0-or-later WITH Bootloader-exception)
+// -----------------------------------------------------------------------------
+
+// Benchmark of the archive layer of the bootloader.
+//
+// Usage: benchmark_archive ARCHIVE [ITERATIONS]
+//
+// Times opening the given CArchive, looking up all of its entries by name,
+// extracting them into memory and into a temporary directory, and removing
+// that directory. Each result is written to stdout as a single-line JSON
+// object. Synthetic archives can be generated (and the benchmark run) with
+// benchmark_archive.py.
+
+#include <sys/types.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "pyi_global.h"
+#include "pyi_archive.h"
+#include "pyi_utils.h"
+
+typedef struct {
+    const char *name;
+    uint64_t iterations;
+    uint64_t operations;  // operations per iteration (e.g., extracted entries)
+    uint64_t bytes;       // bytes processed per iteration
+    uint64_t total_time;
+    uint64_t min_time;
+    uint64_t max_time;
+} BENCHMARK_RESULT;
+
+static void result_init(BENCHMARK_RESULT *result, const char *name) {
+    memset(result, 0, sizeof(BENCHMARK_RESULT));
+    result->name = name;
+    result->min_time = UINT64_MAX;
+}
+
+static void result_add(BENCHMARK_RESULT *result, uint64_t start_time) {
+    uint64_t elapsed = pyi_utils_get_monotonic_time() - start_time;
+    result->iterations++;
+    result->total_time += elapsed;
+    if (elapsed < result->min_time) {
+        result->min_time = elapsed;
+    }
+    if (elapsed > result->max_time) {
+        result->max_time = elapsed;
+    }
+}
+
+static void result_print(const BENCHMARK_RESULT *result) {
+    printf("{\"benchmark\": \"%s\", \"iterations\": %" PRIu64 ", \"operations\": %" PRIu64
+           ", \"bytes\": %" PRIu64 ", \"total_us\": %" PRIu64 ", \"mean_us\": %.3f"
+           ", \"min_us\": %" PRIu64 ", \"max_us\": %" PRIu64 "}\n",
+           result->name, result->iterations, result->operations, result->bytes,
+           result->total_time, result->iterations ? (double)result->total_time / result->iterations : 0.0,
+           result->iterations ? result->min_time : 0, result->max_time);
+    fflush(stdout);
+}
+
+// Entries that the bootloader extracts in onefile mode.
+static int is_extractable(const TOC *ptoc) {
+    return ptoc->typcd == ARCHIVE_ITEM_BINARY || ptoc->typcd == ARCHIVE_ITEM_DATA ||
+           ptoc->typcd == ARCHIVE_ITEM_ZIPFILE || ptoc->typcd == ARCHIVE_ITEM_PYZ;
+}
+
+static ARCHIVE_STATUS *open_archive(const char *path) {
+    ARCHIVE_STATUS *status = pyi_arch_status_new();
+    if (status == NULL) {
+        return NULL;
+    }
+    if (!pyi_arch_setup(status, path, path)) {
+        fprintf(stderr, "Cannot open archive %s\n", path);
+        pyi_arch_status_free(status);
+        return NULL;
+    }
+    return status;
+}
+
+static int benchmark_open(const char *path, uint64_t iterations) {
+    BENCHMARK_RESULT result;
+    uint64_t i;
+
+    result_init(&result, "pyi_arch_open");
+    result.operations = 1;
+    for (i = 0; i < iterations; i++) {
+        uint64_t start_time = pyi_utils_get_monotonic_time();
+        ARCHIVE_STATUS *status = open_archive(path);
+        result_add(&result, start_time);
+        if (status == NULL) {
+            return -1;
+        }
+        pyi_arch_status_free(status);
+    }
+    result_print(&result);
+    return 0;
+}
+
+static int benchmark_find_by_name(ARCHIVE_STATUS *status, uint64_t iterations) {
+    BENCHMARK_RESULT result;
+    uint64_t i;
+    TOC *ptoc;
+
+    result_init(&result, "pyi_arch_find_by_name");
+    for (ptoc = status->tocbuff; ptoc < status->tocend; ptoc = pyi_arch_increment_toc_ptr(status, ptoc)) {
+        result.operations++;
+    }
+    for (i = 0; i < iterations; i++) {
+        uint64_t start_time = pyi_utils_get_monotonic_time();
+        for (ptoc = status->tocbuff; ptoc < status->tocend; ptoc = pyi_arch_increment_toc_ptr(status, ptoc)) {
+            if (pyi_arch_find_by_name(status, ptoc->name) == NULL) {
+                fprintf(stderr, "Entry %s not found!\n", ptoc->name);
+                return -1;
+            }
+        }
+        result_add(&result, start_time);
+    }
+    result_print(&result);
+    return 0;
+}
+
+static int benchmark_extract(ARCHIVE_STATUS *status, uint64_t iterations) {
+    BENCHMARK_RESULT result;
+    uint64_t i;
+    TOC *ptoc;
+
+    result_init(&result, "pyi_arch_extract");
+    for (ptoc = status->tocbuff; ptoc < status->tocend; ptoc = pyi_arch_increment_toc_ptr(status, ptoc)) {
+        if (is_extractable(ptoc)) {
+            result.operations++;
+            result.bytes += ptoc->ulen;
+        }
+    }
+    for (i = 0; i < iterations; i++) {
+        uint64_t start_time = pyi_utils_get_monotonic_time();
+        for (ptoc = status->tocbuff; ptoc < status->tocend; ptoc = pyi_arch_increment_toc_ptr(status, ptoc)) {
+            unsigned char *data;
+            if (!is_extractable(ptoc)) {
+                continue;
+            }
+            data = pyi_arch_extract(status, ptoc);
+            if (data == NULL && ptoc->ulen > 0) {
+                return -1;
+            }
+            free(data);
+        }
+        result_add(&result, start_time);
+    }
+    result_print(&result);
+    return 0;
+}
+
+static int benchmark_extract2fs(ARCHIVE_STATUS *status, uint64_t iterations) {
+    BENCHMARK_RESULT extract_result;
+    BENCHMARK_RESULT remove_result;
+    uint64_t i;
+    TOC *ptoc;
+
+    result_init(&extract_result, "pyi_arch_extract2fs");
+    result_init(&remove_result, "pyi_remove_temp_path");
+    for (ptoc = status->tocbuff; ptoc < status->tocend; ptoc = pyi_arch_increment_toc_ptr(status, ptoc)) {
+        if (is_extractable(ptoc)) {
+            extract_result.operations++;
+            extract_result.bytes += ptoc->ulen;
+        }
+    }
+    remove_result.operations = extract_result.operations;
+    remove_result.bytes = extract_result.bytes;
+
+    for (i = 0; i < iterations; i++) {
+        uint64_t start_time;
+
+        // Extract into a new temporary directory in each iteration
+        status->has_temp_directory = false;
+        status->temppath = "";
+
+        start_time = pyi_utils_get_monotonic_time();
+        for (ptoc = status->tocbuff; ptoc < status->tocend; ptoc = pyi_arch_increment_toc_ptr(status, ptoc)) {
+            if (is_extractable(ptoc) && pyi_arch_extract2fs(status, ptoc) != 0) {
+                pyi_remove_temp_path(status->temppath);
+                return -1;
+            }
+        }
+        result_add(&extract_result, start_time);
+
+        start_time = pyi_utils_get_monotonic_time();
+        pyi_remove_temp_path(status->temppath);
+        result_add(&remove_result, start_time);
+    }
+    status->has_temp_directory = false;
+    status->temppath = "";
+
+    result_print(&extract_result);
+    result_print(&remove_result);
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    ARCHIVE_STATUS *status;
+    uint64_t iterations = 10;
+    int rc = 0;
+
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s ARCHIVE [ITERATIONS]\n", argv[0]);
+        return 2;
+    }
+    if (argc > 2) {
+        iterations = strtoull(argv[2], NULL, 10);
+        if (iterations == 0) {
+            iterations = 1;
+        }
+    }
+
+    if (benchmark_open(argv[1], iterations) != 0) {
+        return 1;
+    }
+
+    status = open_archive(argv[1]);
+    if (status == NULL) {
+        return 1;
+    }
+    if (benchmark_find_by_name(status, iterations) != 0 ||
+        benchmark_extract(status, iterations) != 0 ||
+        benchmark_extract2fs(status, iterations) != 0) {
+        rc = 1;
+    }
+    pyi_arch_status_free(status);
+    return rc;
+}
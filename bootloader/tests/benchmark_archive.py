@@ -0,0 +1,99 @@
+#-----------------------------------------------------------------------------
+# Copyright (c) 2022, PyInstaller Development Team.
+#
+# Distributed under the terms of the GNU General Public License (version 2
+# or later) with exception for distributing the bootloader.
+#
+# The full license is in the file COPYING.txt, distributed with this software.
+#
+# SPDX-License-Identifier: (GPL-2.0-or-later WITH Bootloader-exception)
+#-----------------------------------------------------------------------------
+"""
+Run the archive-layer benchmark of the bootloader on synthetic CArchives.
+
+The archives are generated with PyInstaller's CArchiveWriter, from a given number of entries of given size, and the
+benchmark program (built by waf as tests/benchmark_archive in the build directory of each variant) is run on each of
+them. The results are written as a JSON document, for example:
+
+    python tests/benchmark_archive.py build/release/tests/benchmark_archive --entries 100,1000 --size 4096,65536 \
+        --iterations 20 --output results.json
+"""
+
+import argparse
+import itertools
+import json
+import os
+import random
+import subprocess
+import sys
+import tempfile
+
+# Allow running from a source checkout without PyInstaller being installed.
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), '..', '..'))
+
+from PyInstaller.archive.writers import CArchiveWriter  # noqa: E402
+
+
+def _int_list(value):
+    return [int(item) for item in value.split(',')]
+
+
+def generate_archive(path, workdir, num_entries, entry_size, compress):
+    """
+    Generate CArchive with `num_entries` data entries, each `entry_size` bytes long. The content is partially random, so
+    that it compresses roughly like typical binaries.
+    """
+    rng = random.Random(num_entries * 31 + entry_size)
+    toc = []
+    for i in range(num_entries):
+        name = 'data/dir%d/file%d.dat' % (i % 16, i)
+        source = os.path.join(workdir, 'file%d.dat' % i)
+        chunk = bytes(rng.getrandbits(8) for _ in range(256)) + bytes(256)
+        with open(source, 'wb') as f:
+            f.write((chunk * (entry_size // len(chunk) + 1))[:entry_size])
+        toc.append((name, source, compress, 'x'))
+    CArchiveWriter(path, toc, pylib_name='libpython.so')
+
+
+def run_benchmark(program, archive_path, iterations):
+    output = subprocess.run([program, archive_path, str(iterations)], stdout=subprocess.PIPE, check=True).stdout
+    return [json.loads(line) for line in output.decode('utf-8').splitlines() if line.strip()]
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('program', help='Path to the benchmark_archive program.')
+    parser.add_argument(
+        '--entries', type=_int_list, default=[1000], help='Comma-separated numbers of archive entries (default: 1000).'
+    )
+    parser.add_argument(
+        '--size', type=_int_list, default=[16384], help='Comma-separated sizes of an entry in bytes (default: 16384).'
+    )
+    parser.add_argument('--iterations', type=int, default=10, help='Number of iterations (default: 10).')
+    parser.add_argument('--no-compress', action='store_true', help='Store the entries uncompressed.')
+    parser.add_argument('--output', help='Write results to this file instead of stdout.')
+    args = parser.parse_args()
+
+    runs = []
+    for num_entries, entry_size in itertools.product(args.entries, args.size):
+        with tempfile.TemporaryDirectory(prefix='pyi-benchmark-') as workdir:
+            archive_path = os.path.join(workdir, 'archive.pkg')
+            generate_archive(archive_path, workdir, num_entries, entry_size, compress=not args.no_compress)
+            runs.append({
+                'entries': num_entries,
+                'entry_size': entry_size,
+                'compressed': not args.no_compress,
+                'archive_size': os.path.getsize(archive_path),
+                'results': run_benchmark(args.program, archive_path, args.iterations),
+            })
+
+    document = json.dumps({'iterations': args.iterations, 'runs': runs}, indent=2)
+    if args.output:
+        with open(args.output, 'w') as f:
+            f.write(document + '\n')
+    else:
+        print(document)
+
+
+if __name__ == '__main__':
+    main()
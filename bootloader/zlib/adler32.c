@@ -6,6 +6,9 @@
 /* @(#) $Id$ */
 
 #include "zutil.h"
+#ifdef ADLER32_SIMD
+#  include "adler32_simd.h"
+#endif
 
 local uLong adler32_combine_ OF((uLong adler1, uLong adler2, z_off64_t len2));
 
@@ -68,6 +71,11 @@ uLong ZEXPORT adler32_z(adler, buf, len)
     unsigned long sum2;
     unsigned n;
 
+#ifdef ADLER32_SIMD_SSSE3
+    if (buf != Z_NULL && len >= ADLER32_SIMD_MIN_LEN && x86_cpu_has_ssse3())
+        return adler32_simd_(adler, buf, len);
+#endif
+
     /* split Adler-32 into component sums */
     sum2 = (adler >> 16) & 0xffff;
     adler &= 0xffff;
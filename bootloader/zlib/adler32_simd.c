@@ -0,0 +1,102 @@
+/* adler32_simd.c -- vectorized Adler-32 checksum
+ * For conditions of distribution and use, see copyright notice in zlib.h
+ */
+
+/*
+   The checksum is computed over blocks of 32 bytes: the byte sums (s1)
+   with _mm_sad_epu8(), and the position-weighted sums (s2) with
+   _mm_maddubs_epi16() (SSSE3). Per block, s2 also grows by 32 times the
+   s1 of all previous blocks, which is accumulated in v_ps and added
+   once per run of blocks. The runs are limited to NMAX bytes, so that
+   the 32-bit sums cannot overflow before they are reduced modulo BASE,
+   as in adler32_z().
+ */
+
+#include "adler32_simd.h"
+
+#ifdef ADLER32_SIMD_SSSE3
+
+#include <tmmintrin.h>
+
+#define BASE 65521U     /* largest prime smaller than 65536 */
+#define NMAX 5552
+#define BLOCK_SIZE 32
+
+#if defined(__GNUC__) || defined(__clang__)
+#  define TARGET_SSSE3 __attribute__((target("ssse3")))
+#else
+#  define TARGET_SSSE3
+#endif
+
+TARGET_SSSE3
+uLong ZLIB_INTERNAL adler32_simd_(adler, buf, len)
+    uLong adler;
+    const Bytef *buf;
+    z_size_t len;
+{
+    unsigned long s1 = adler & 0xffff;
+    unsigned long s2 = (adler >> 16) & 0xffff;
+    z_size_t blocks = len / BLOCK_SIZE;
+
+    len -= blocks * BLOCK_SIZE;
+
+    while (blocks) {
+        unsigned n = NMAX / BLOCK_SIZE;
+        const __m128i tap1 = _mm_setr_epi8(32, 31, 30, 29, 28, 27, 26, 25,
+                                           24, 23, 22, 21, 20, 19, 18, 17);
+        const __m128i tap2 = _mm_setr_epi8(16, 15, 14, 13, 12, 11, 10, 9,
+                                           8, 7, 6, 5, 4, 3, 2, 1);
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i ones = _mm_set1_epi16(1);
+        __m128i v_ps;
+        __m128i v_s1;
+        __m128i v_s2;
+
+        if (n > blocks)
+            n = (unsigned)blocks;
+        blocks -= n;
+
+        v_ps = _mm_set_epi32(0, 0, 0, (int)(s1 * n));
+        v_s2 = _mm_set_epi32(0, 0, 0, (int)s2);
+        v_s1 = _mm_setzero_si128();
+
+        do {
+            const __m128i bytes1 = _mm_loadu_si128((const __m128i *)buf);
+            const __m128i bytes2 = _mm_loadu_si128((const __m128i *)(buf + 16));
+
+            v_ps = _mm_add_epi32(v_ps, v_s1);
+            v_s1 = _mm_add_epi32(v_s1, _mm_sad_epu8(bytes1, zero));
+            v_s2 = _mm_add_epi32(v_s2, _mm_madd_epi16(
+                       _mm_maddubs_epi16(bytes1, tap1), ones));
+            v_s1 = _mm_add_epi32(v_s1, _mm_sad_epu8(bytes2, zero));
+            v_s2 = _mm_add_epi32(v_s2, _mm_madd_epi16(
+                       _mm_maddubs_epi16(bytes2, tap2), ones));
+            buf += BLOCK_SIZE;
+        } while (--n);
+
+        v_s2 = _mm_add_epi32(v_s2, _mm_slli_epi32(v_ps, 5));
+
+        /* Sum the 32-bit lanes: v_s1 only has sums in lanes 0 and 2. */
+        v_s1 = _mm_add_epi32(v_s1, _mm_shuffle_epi32(v_s1, _MM_SHUFFLE(1, 0, 3, 2)));
+        s1 += (unsigned long)(unsigned)_mm_cvtsi128_si32(v_s1);
+        v_s2 = _mm_add_epi32(v_s2, _mm_shuffle_epi32(v_s2, _MM_SHUFFLE(2, 3, 0, 1)));
+        v_s2 = _mm_add_epi32(v_s2, _mm_shuffle_epi32(v_s2, _MM_SHUFFLE(1, 0, 3, 2)));
+        s2 = (unsigned long)(unsigned)_mm_cvtsi128_si32(v_s2);
+
+        s1 %= BASE;
+        s2 %= BASE;
+    }
+
+    /* The remaining bytes, less than a block. */
+    while (len--) {
+        s1 += *buf++;
+        s2 += s1;
+    }
+    if (s1 >= BASE)
+        s1 -= BASE;
+    s2 %= BASE;
+
+    return s1 | (s2 << 16);
+}
+
+#endif /* ADLER32_SIMD_SSSE3 */
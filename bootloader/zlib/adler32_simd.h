@@ -0,0 +1,31 @@
+/* adler32_simd.h -- vectorized Adler-32 checksum
+ * For conditions of distribution and use, see copyright notice in zlib.h
+ */
+
+/* WARNING: this file should *not* be used by applications. It is
+   part of the implementation of the compression library and is
+   subject to change. Applications should only use zlib.h.
+ */
+
+/*
+   Not part of upstream zlib; added for the PyInstaller bootloader, and
+   only used when ADLER32_SIMD is defined (see the --simd-inflate option
+   of the bootloader's wscript). adler32_z() uses it for longer buffers,
+   if x86_cpu_has_ssse3() reports that the CPU supports it.
+ */
+
+#ifndef ADLER32_SIMD_H
+#define ADLER32_SIMD_H
+
+#include "zutil.h"
+#include "cpu_features.h"
+
+#if defined(ADLER32_SIMD) && defined(CPU_FEATURES_X86)
+#  define ADLER32_SIMD_SSSE3
+/* Minimum length for which the vectorized version is used. */
+#  define ADLER32_SIMD_MIN_LEN 64
+uLong ZLIB_INTERNAL adler32_simd_ OF((uLong adler, const Bytef *buf,
+                                      z_size_t len));
+#endif
+
+#endif /* ADLER32_SIMD_H */
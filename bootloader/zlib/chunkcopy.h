@@ -0,0 +1,96 @@
+/* chunkcopy.h -- fast chunk-by-chunk copies of inflate matches
+ * For conditions of distribution and use, see copyright notice in zlib.h
+ */
+
+/* WARNING: this file should *not* be used by applications. It is
+   part of the implementation of the compression library and is
+   subject to change. Applications should only use zlib.h.
+ */
+
+/*
+   Not part of upstream zlib; added for the PyInstaller bootloader, and
+   only used when INFLATE_CHUNK_SIMD is defined (see the --simd-inflate
+   option of the bootloader's wscript).
+
+   Matches are copied 16 bytes at a time instead of byte by byte, with
+   SSE2 on x86 and NEON on ARM (both part of the baseline instruction set
+   of x86_64 and arm64), or with memcpy() otherwise. A copy may write up
+   to CHUNKCOPY_CHUNK_SIZE - 1 bytes past the end of the match, so
+   inflate_fast() requires that much more output space on entry (see
+   INFLATE_FAST_MIN_OUTPUT in inffast.h).
+ */
+
+#ifndef CHUNKCOPY_H
+#define CHUNKCOPY_H
+
+#include "zutil.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#  include <emmintrin.h>
+typedef __m128i z_vec_t;
+#  define loadchunk(s) _mm_loadu_si128((const __m128i *)(s))
+#  define storechunk(d, v) _mm_storeu_si128((__m128i *)(d), (v))
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__) || defined(_M_ARM64)
+#  include <arm_neon.h>
+typedef uint8x16_t z_vec_t;
+#  define loadchunk(s) vld1q_u8((const uint8_t *)(s))
+#  define storechunk(d, v) vst1q_u8((uint8_t *)(d), (v))
+#else
+typedef struct { unsigned char b[16]; } z_vec_t;
+local z_vec_t loadchunk OF((const unsigned char FAR *s));
+local z_vec_t loadchunk(s)
+const unsigned char FAR *s;
+{
+    z_vec_t v;
+    zmemcpy((Bytef *)&v, s, sizeof(v));
+    return v;
+}
+#  define storechunk(d, v) zmemcpy((Bytef *)(d), (const Bytef *)&(v), sizeof(z_vec_t))
+#endif
+
+#define CHUNKCOPY_CHUNK_SIZE 16
+
+/*
+   Copy len bytes from out - dist to out, where the source may overlap
+   with the destination (dist < len), and return out + len. Up to
+   CHUNKCOPY_CHUNK_SIZE - 1 bytes past out + len may be overwritten.
+ */
+local unsigned char FAR *chunkcopy_lapped OF((unsigned char FAR *out,
+                                              unsigned dist, unsigned len));
+local unsigned char FAR *chunkcopy_lapped(out, dist, len)
+unsigned char FAR *out;
+unsigned dist;
+unsigned len;
+{
+    const unsigned char FAR *from;
+    unsigned char FAR *end = out + len;
+
+    if (dist == 1) {                    /* run of a single byte */
+        memset(out, out[-1], len);
+        return end;
+    }
+    /* Replicate the pattern until the distance spans a whole chunk; the
+       output preceding out is periodic with period dist, so the distance
+       can be doubled after each copy of dist bytes. */
+    while (dist < CHUNKCOPY_CHUNK_SIZE) {
+        unsigned n = dist < len ? dist : len;
+        zmemcpy(out, out - dist, n);
+        out += n;
+        len -= n;
+        if (len == 0)
+            return end;
+        dist += dist;
+    }
+    /* Only bytes that were already written are read. */
+    from = out - dist;
+    do {
+        z_vec_t v = loadchunk(from);
+        storechunk(out, v);
+        out += CHUNKCOPY_CHUNK_SIZE;
+        from += CHUNKCOPY_CHUNK_SIZE;
+    } while (out < end);
+    return end;
+}
+
+#endif /* CHUNKCOPY_H */
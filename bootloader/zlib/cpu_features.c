@@ -0,0 +1,32 @@
+/* cpu_features.c -- run-time detection of CPU features
+ * For conditions of distribution and use, see copyright notice in zlib.h
+ */
+
+#include "cpu_features.h"
+
+#if defined(ADLER32_SIMD) && defined(CPU_FEATURES_X86)
+
+#if defined(_MSC_VER)
+#  include <intrin.h>
+#endif
+
+/* -1 until detected; detection is idempotent, so a race is harmless. */
+local int ssse3_supported = -1;
+
+int ZLIB_INTERNAL x86_cpu_has_ssse3()
+{
+    if (ssse3_supported < 0) {
+#if defined(_MSC_VER)
+        int info[4];
+
+        __cpuid(info, 1);
+        ssse3_supported = (info[2] & (1 << 9)) != 0;
+#else
+        __builtin_cpu_init();
+        ssse3_supported = __builtin_cpu_supports("ssse3") != 0;
+#endif
+    }
+    return ssse3_supported;
+}
+
+#endif /* defined(ADLER32_SIMD) && defined(CPU_FEATURES_X86) */
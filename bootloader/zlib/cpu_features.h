@@ -0,0 +1,28 @@
+/* cpu_features.h -- run-time detection of CPU features
+ * For conditions of distribution and use, see copyright notice in zlib.h
+ */
+
+/* WARNING: this file should *not* be used by applications. It is
+   part of the implementation of the compression library and is
+   subject to change. Applications should only use zlib.h.
+ */
+
+/*
+   Not part of upstream zlib; added for the PyInstaller bootloader, so
+   that a single binary can use instructions beyond the baseline of the
+   target architecture when the CPU supports them.
+ */
+
+#ifndef CPU_FEATURES_H
+#define CPU_FEATURES_H
+
+#include "zutil.h"
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || \
+    defined(_M_AMD64) || defined(_M_IX86)
+#  define CPU_FEATURES_X86
+/* Nonzero if the CPU supports SSSE3; detected on first use. */
+int ZLIB_INTERNAL x86_cpu_has_ssse3 OF((void));
+#endif
+
+#endif /* CPU_FEATURES_H */
@@ -8,4 +8,12 @@
    subject to change. Applications should only use zlib.h.
  */
 
+/* Minimum output space for inflate_fast(); chunked copies of matches
+   (see chunkcopy.h) may write past the end of the match. */
+#ifdef INFLATE_CHUNK_SIMD
+#  define INFLATE_FAST_MIN_OUTPUT (258 + 16)
+#else
+#  define INFLATE_FAST_MIN_OUTPUT 258
+#endif
+
 void ZLIB_INTERNAL inflate_fast OF((z_streamp strm, unsigned start));
@@ -19,7 +19,7 @@
 
 import pytest
 
-from PyInstaller.compat import is_darwin, is_win
+from PyInstaller.compat import is_darwin, is_linux, is_win
 from PyInstaller.utils.tests import importorskip, skipif, skipif_no_compiler, xfail
 
 
@@ -615,6 +615,379 @@ def test_option_runtime_tmpdir(pyi_builder):
     )  # set runtime-tmpdir to current working dir
 
 
+def test_option_runtime_cachedir(pyi_builder, tmpdir):
+    """
+    Test that option `runtime_cachedir` extracts into a persistent cache directory.
+    """
+    if pyi_builder._mode != 'onefile':
+        pytest.skip('The test is relevant only to onefile builds.')
+    cachedir = str(tmpdir.join('cache'))
+    pyi_builder.test_source(
+        """
+        import os
+        import sys
+
+        cachedir = os.path.abspath(sys.argv[1])
+        meipass = os.path.abspath(sys._MEIPASS)
+        if os.path.dirname(meipass) != cachedir or not os.path.basename(meipass).startswith('_MEI'):
+            raise SystemExit('Expected sys._MEIPASS to be in cache directory ' + cachedir + ', got ' + meipass)
+        print('test - done')
+        """,
+        pyi_args=['--runtime-cachedir', cachedir],
+        app_args=[cachedir],
+    )
+    # The cache directory must survive the program's exit.
+    entries = os.listdir(cachedir)
+    assert len(entries) == 1 and entries[0].startswith('_MEI')
+
+
+@pytest.mark.skipif(is_win, reason='The content-addressed store is not available on Windows.')
+def test_option_runtime_store(pyi_builder, tmpdir):
+    """
+    Test that option `runtime_store` materializes the extracted files from a content-addressed store, whose objects
+    are named after the SHA-256 digests of their contents.
+    """
+    if pyi_builder._mode != 'onefile':
+        pytest.skip('The test is relevant only to onefile builds.')
+    storedir = str(tmpdir.join('store'))
+    pyi_builder.test_source(
+        """
+        import hashlib
+        import os
+        import sys
+
+        # Either extracted and then added to the store, or cloned or linked from it.
+        path = os.path.join(sys._MEIPASS, 'base_library.zip')
+        with open(path, 'rb') as f:
+            digest = hashlib.sha256(f.read()).hexdigest()
+        if not os.path.isfile(os.path.join({!r}, 'objects', digest[:2], digest)):
+            raise SystemExit('Expected ' + path + ' to be in the store')
+        print('test - done')
+        """.format(storedir),
+        pyi_args=['--runtime-store', storedir],
+    )
+    # The objects must survive the program's exit.
+    objects = [name for subdir in os.listdir(os.path.join(storedir, 'objects'))
+               for name in os.listdir(os.path.join(storedir, 'objects', subdir))]
+    assert objects
+
+
+def test_option_lazy_extract(pyi_builder, tmpdir):
+    """
+    Test that option `lazy_extract` defers extraction of data files, and extracts the ones outside packages at start.
+    """
+    if pyi_builder._mode != 'onefile':
+        pytest.skip('The test is relevant only to onefile builds.')
+    src_filename = tmpdir / 'data.txt'
+    with open(src_filename, 'w') as fp:
+        fp.write('lazy data')
+    add_data_name = str(src_filename) + os.pathsep + 'lazy_data'
+    pyi_builder.test_source(
+        """
+        import os
+        import sys
+
+        assert callable(getattr(sys, '_pyi_lazy_extract', None))
+        assert 'lazy_data' in sys._pyi_lazy_data_dirs
+        # Not a package directory, so extracted when the import machinery is installed.
+        with open(os.path.join(sys._MEIPASS, 'lazy_data', 'data.txt')) as fp:
+            assert fp.read() == 'lazy data'
+        assert sys._pyi_lazy_extract('no_such_file') == 0
+        print('test - done')
+        """,
+        pyi_args=['--lazy-extract', '--add-data', add_data_name],
+    )
+
+
+def test_option_pipelined_extract(pyi_builder, tmpdir):
+    """
+    Test that option `pipelined_extract` extracts the deferred data files in the background, and still lets the
+    program extract them on demand.
+    """
+    if pyi_builder._mode != 'onefile':
+        pytest.skip('The test is relevant only to onefile builds.')
+    for i in range(50):
+        with open(tmpdir / ('data%d.txt' % i), 'w') as fp:
+            fp.write('pipelined data %d' % i)
+    add_data_name = str(tmpdir / 'data*.txt') + os.pathsep + 'pipelined_data'
+    pyi_builder.test_source(
+        """
+        import os
+        import sys
+        import time
+
+        assert callable(getattr(sys, '_pyi_lazy_extract', None))
+        assert sys._pyi_lazy_extract(os.path.join('pipelined_data', 'data7.txt')) == 1
+        with open(os.path.join(sys._MEIPASS, 'pipelined_data', 'data7.txt')) as fp:
+            assert fp.read() == 'pipelined data 7'
+        # All files show up eventually, without partially written ones.
+        data_dir = os.path.join(sys._MEIPASS, 'pipelined_data')
+        for _ in range(600):
+            names = [name for name in os.listdir(data_dir) if name.endswith('.txt')]
+            if len(names) == 50:
+                break
+            time.sleep(0.1)
+        assert len(names) == 50, names
+        for i in range(50):
+            with open(os.path.join(data_dir, 'data%d.txt' % i)) as fp:
+                assert fp.read() == 'pipelined data %d' % i
+        print('test - done')
+        """,
+        pyi_args=['--pipelined-extract', '--add-data', add_data_name],
+    )
+
+
+@skipif(not is_linux, reason='In-memory extraction is implemented only on Linux.')
+def test_option_memfd_extensions(pyi_builder):
+    """
+    Test that option `memfd_extensions` enables in-memory extraction, and leaves the extension modules of the standard
+    library in the temporary directory.
+    """
+    if pyi_builder._mode != 'onefile':
+        pytest.skip('The test is relevant only to onefile builds.')
+    pyi_builder.test_source(
+        """
+        import os
+        import sys
+        import _json
+
+        assert callable(getattr(sys, '_pyi_memfd_open', None))
+        name = os.path.relpath(_json.__file__, sys._MEIPASS)
+        assert name.startswith('lib-dynload'), name
+        assert os.path.exists(_json.__file__)
+        assert sys._pyi_memfd_open(name) is None
+        assert sys._pyi_memfd_open('no_such_module.cpython-3-x86_64-linux-gnu.so') is None
+        print('test - done')
+        """,
+        pyi_args=['--memfd-extensions'],
+    )
+
+
+@skipif(not is_linux, reason='The bootloader restarts itself in onedir mode only on Linux.')
+def test_option_onedir_no_restart(pyi_builder):
+    """
+    Test that option `onedir_no_restart` runs the program without setting LD_LIBRARY_PATH, and that extension modules
+    are still loaded.
+    """
+    if pyi_builder._mode != 'onedir':
+        pytest.skip('The test is relevant only to onedir builds.')
+    pyi_builder.test_source(
+        """
+        import os
+        import sys
+        import ctypes
+        import ssl
+
+        assert callable(getattr(sys, '_pyi_preload_deps', None))
+        assert sys._MEIPASS not in os.environ.get('LD_LIBRARY_PATH', '').split(os.pathsep)
+        assert ssl.OPENSSL_VERSION
+        print('test - done')
+        """,
+        pyi_args=['--onedir-no-restart'],
+    )
+
+
+def test_option_worker_relaunch(pyi_builder):
+    """
+    Test that with option `worker_relaunch`, a copy of the program launched by the program shares its application
+    directory, while a copy launched without the inherited environment does not.
+    """
+    pyi_builder.test_source(
+        """
+        import os
+        import subprocess
+        import sys
+
+        if sys.argv[1:] == ['worker']:
+            print(sys._MEIPASS)
+            sys.exit(0)
+
+        worker = subprocess.run([sys.executable, 'worker'], stdout=subprocess.PIPE, check=True)
+        if worker.stdout.decode().strip() != sys._MEIPASS:
+            raise SystemExit('Worker does not share application directory ' + sys._MEIPASS)
+        if os.path.basename(sys._MEIPASS).startswith('_MEI'):  # onefile
+            env = {key: value for key, value in os.environ.items() if key != '_PYI_WORKER_PATH'}
+            other = subprocess.run([sys.executable, 'worker'], stdout=subprocess.PIPE, env=env, check=True)
+            if other.stdout.decode().strip() == sys._MEIPASS:
+                raise SystemExit('Copy launched without _PYI_WORKER_PATH shares application directory')
+        print('test - done')
+        """,
+        pyi_args=['--worker-relaunch'],
+    )
+
+
+@skipif(is_win, reason='The zygote server mode is not available on Windows.')
+def test_option_zygote(pyi_builder):
+    """
+    Test that with option `zygote`, the program started as a zygote server runs the launches of the program with
+    their arguments, environment and working directory, and relays their exit code.
+    """
+    pyi_builder.test_source(
+        """
+        import os
+        import socket
+        import subprocess
+        import sys
+        import tempfile
+        import time
+
+        if sys.argv[1:] == ['worker']:
+            cwd_ok = os.getcwd() == os.path.realpath(tempfile.gettempdir())
+            print('json' in sys.modules, cwd_ok, os.environ.get('ZYGOTE_TEST'))
+            sys.exit(3)
+
+        path = os.path.join(tempfile.mkdtemp(), 'zygote.sock')
+        server = subprocess.Popen([sys.executable], env=dict(os.environ, PYI_ZYGOTE_SERVE=path))
+        try:
+            # Wait for the server to listen on the socket
+            for _ in range(300):
+                try:
+                    with socket.socket(socket.AF_UNIX) as sock:
+                        sock.connect(path)
+                    break
+                except OSError:
+                    time.sleep(0.1)
+            result = subprocess.run([sys.executable, 'worker'],
+                                    env=dict(os.environ, PYI_ZYGOTE_SOCKET=path, ZYGOTE_TEST='yes'),
+                                    cwd=tempfile.gettempdir(),
+                                    stdout=subprocess.PIPE,
+                                    universal_newlines=True)
+            assert result.returncode == 3, result.returncode
+            preloaded, cwd_ok, value = result.stdout.split()
+            assert preloaded == 'True' and cwd_ok == 'True' and value == 'yes', result.stdout
+            assert server.poll() is None
+        finally:
+            server.terminate()
+            server.wait()
+        print('test - done')
+        """,
+        pyi_args=['--zygote-preload', 'json'],
+    )
+
+
+@skipif(sys.version_info < (3, 8), reason='Startup modules are frozen with Python 3.8 and later.')
+def test_frozen_startup_modules(pyi_builder):
+    """
+    Test that the modules imported during the initialization of Python are frozen modules, which appear to come from
+    base_library.zip, and that the codecs which are not frozen are still imported from there.
+    """
+    pyi_builder.test_source(
+        """
+        import os
+        import sys
+        import encodings
+        import codecs
+
+        assert encodings.__spec__.origin == 'frozen', encodings.__spec__
+        assert codecs.__spec__.origin == 'frozen', codecs.__spec__
+        base_library = os.path.join(sys._MEIPASS, 'base_library.zip')
+        assert codecs.__file__ == os.path.join(base_library, 'codecs.pyc'), codecs.__file__
+        assert encodings.__path__ == [os.path.join(base_library, 'encodings')], encodings.__path__
+        assert 'x'.encode('cp437') == b'x'
+        assert sys.modules['encodings.cp437'].__file__.startswith(base_library)
+        print('test - done')
+        """
+    )
+
+
+def test_layout_profile_recording(pyi_builder, tmpdir):
+    """
+    Test that with the PYI_LAYOUT_PROFILE environment variable set, the bootloader and the import machinery record the
+    accesses to the archive entries, for the --layout-profile option.
+    """
+    profile = str(tmpdir.join('profile.txt'))
+    pyi_builder.test_source(
+        """
+        import os
+        import subprocess
+        import sys
+
+        if sys.argv[1:] == ['record']:
+            import json  # noqa: F401
+            sys.exit(0)
+
+        subprocess.run([sys.executable, 'record'], env=dict(os.environ, PYI_LAYOUT_PROFILE=sys.argv[1]), check=True)
+        """,
+        app_args=[profile]
+    )
+    with open(profile, encoding='utf-8') as fp:
+        entries = [tuple(line.rstrip('\n').split('\t')) for line in fp]
+    assert ('pyz', 'json') in entries
+    assert ('pyz', 'json.decoder') in entries
+    assert any(archive == 'pkg' for archive, name in entries)
+
+
+def test_pyz_native_reader(pyi_builder):
+    """
+    Test that the bootloader exposes the PYZ archive to the frozen importer, which extracts modules through it.
+    """
+    pyi_builder.test_source(
+        """
+        import _pyi_pyz
+        import json
+
+        # The archive has an indexed TOC, which is looked up in place.
+        assert _pyi_pyz.toc is None
+        assert _pyi_pyz.lookup('json')[0] == 1
+        assert _pyi_pyz.lookup('no_such_module') is None
+        assert _pyi_pyz.data[:4] == b'PYZ\\0'
+        typ, code = _pyi_pyz.extract('json')
+        assert typ == 1 and code.co_name == '<module>'
+        assert _pyi_pyz.extract('no_such_module') is None
+        print('test - done')
+        """
+    )
+
+
+def test_option_prefetch(pyi_builder):
+    """
+    Test that option `prefetch` does not change what the frozen importer extracts.
+    """
+    pyi_builder.test_source(
+        """
+        import _pyi_pyz
+        import json
+        import email.parser
+
+        assert json.loads('[1]') == [1]
+        # Prefetched entries are handed out once; later extractions inflate them again.
+        for name in ('json', 'json', 'email', 'email.parser'):
+            typ, code = _pyi_pyz.extract(name)
+            assert code.co_name == '<module>'
+        print('test - done')
+        """,
+        pyi_args=['--prefetch'],
+    )
+
+
+def test_startup_trace(pyi_builder, tmpdir, monkeypatch):
+    """
+    Test that PYI_STARTUP_TRACE environment variable enables recording of startup phases.
+    """
+    import json
+
+    trace_file = str(tmpdir.join('startup-trace.json'))
+    monkeypatch.setenv('PYI_STARTUP_TRACE', trace_file)
+    pyi_builder.test_source(
+        """
+        import sys
+
+        names = [event['name'] for event in sys._pyi_startup_trace]
+        for name in ('pyi_arch_open', 'pyi_pylib_start_python', 'pyi_pylib_import_modules'):
+            if name not in names:
+                raise SystemExit('Missing startup trace event ' + name + ': ' + repr(names))
+        """
+    )
+    with open(trace_file, 'r') as fp:
+        events = json.load(fp)
+    names = {event['name'] for event in events}
+    assert 'pyi_launch_run_scripts' in names
+    if pyi_builder._mode == 'onefile':
+        assert 'pyi_launch_extract_binaries' in names
+        assert 'parent_resident_size' in names
+        assert len({event['pid'] for event in events}) == 2
+
+
 @xfail(reason='Issue #3037 - all scripts share the same global vars')
 def test_several_scripts1(pyi_builder_spec):
     """
@@ -0,0 +1,439 @@
+#-----------------------------------------------------------------------------
+# Copyright (c) 2022, PyInstaller Development Team.
+#
+# Distributed under the terms of the GNU General Public License (version 2
+# or later) with exception for distributing the bootloader.
+#
+# The full license is in the file COPYING.txt, distributed with this software.
+#
+# SPDX-License-Identifier: (GPL-2.0-or-later WITH Bootloader-exception)
+#-----------------------------------------------------------------------------
+"""
+Measure the startup time of frozen applications.
+
+A set of representative applications (a hello-world script, a numpy script, a Qt application, an application with a
+splash screen and a multipackage application) is built in onefile and onedir mode with the PyInstaller of this source
+checkout. Applications whose requirements (numpy, a Qt binding, tkinter) are not available to the Python running this
+script are reported as skipped. Each application is then started a number of times with a cold and with a warm page
+cache, and the wall time, the peak RSS, the number of bytes extracted into the temporary directory, the durations of
+the startup phases recorded by the bootloader (see PYI_STARTUP_TRACE) and, if strace is available, the number of
+system calls are collected. The results are written as a JSON document, for example:
+
+    python tests/speed/benchmark_startup.py --apps hello,numpy --iterations 20 --output results.json
+
+Before each cold-cache run, the files of the application are evicted from the page cache: by writing to
+/proc/sys/vm/drop_caches when running as root on Linux, with posix_fadvise(POSIX_FADV_DONTNEED) otherwise, and with
+`purge` on macOS. If none of these is available, the cold-cache runs are skipped.
+
+The layout of the document is identified by its `format` key, which is incremented whenever the meaning of an
+existing key changes; new keys may be added without doing so.
+"""
+
+import argparse
+import json
+import os
+import platform
+import re
+import shutil
+import statistics
+import subprocess
+import sys
+import tempfile
+import textwrap
+import time
+
+# Allow running from a source checkout without PyInstaller being installed.
+_CHECKOUT_DIR = os.path.normpath(os.path.join(os.path.dirname(os.path.abspath(__file__)), '..', '..'))
+sys.path.insert(0, _CHECKOUT_DIR)
+
+import PyInstaller  # noqa: E402
+
+FORMAT_VERSION = 1
+
+APPS = ('hello', 'numpy', 'qt', 'splash', 'multipackage')
+MODES = ('onefile', 'onedir')
+
+_HELLO_SCRIPT = """
+print('hello')
+"""
+
+_NUMPY_SCRIPT = """
+import numpy
+print(numpy.arange(10).sum())
+"""
+
+_QT_SCRIPT = """
+import sys
+from {binding}.QtWidgets import QApplication, QLabel
+app = QApplication(sys.argv)
+print(QLabel('hello').text())
+"""
+
+_SPLASH_SCRIPT = """
+import pyi_splash
+pyi_splash.close()
+print('hello')
+"""
+
+_SPLASH_IMAGE = os.path.join(_CHECKOUT_DIR, 'tests', 'functional', 'data', 'splash', 'image.png')
+
+# The benchmarked executable is `app_a`, which takes its shared dependencies from `app_b` at run time.
+_MULTIPACKAGE_SCRIPT = """
+import email.parser
+import json
+print(json.dumps({'hello': email.parser.__name__}))
+"""
+
+_MULTIPACKAGE_SPEC = """
+a = Analysis(['app_a.py'])
+b = Analysis(['app_b.py'])
+MERGE((b, 'app_b', 'app_b'), (a, 'app_a', {path_a!r}))
+pyz_a = PYZ(a.pure)
+pyz_b = PYZ(b.pure)
+if {onefile!r}:
+    exe_a = EXE(pyz_a, a.scripts, a.binaries, a.zipfiles, a.datas, a.dependencies, name='app_a')
+else:
+    exe_a = EXE(pyz_a, a.scripts, a.dependencies, exclude_binaries=True, name='app_a')
+    coll_a = COLLECT(exe_a, a.binaries, a.zipfiles, a.datas, name='app_a')
+exe_b = EXE(pyz_b, b.scripts, b.binaries, b.zipfiles, b.datas, b.dependencies, name='app_b')
+"""
+
+
+def _list(value):
+    return [item for item in value.split(',') if item]
+
+
+def _has_module(name):
+    result = subprocess.run([sys.executable, '-c', 'import ' + name],
+                            stdout=subprocess.DEVNULL,
+                            stderr=subprocess.DEVNULL)
+    return result.returncode == 0
+
+
+def _qt_binding():
+    for binding in ('PyQt5', 'PySide2', 'PyQt6', 'PySide6'):
+        if _has_module(binding + '.QtWidgets'):
+            return binding
+    return None
+
+
+def _write(path, content):
+    with open(path, 'w') as f:
+        f.write(textwrap.dedent(content).lstrip())
+
+
+def _run_pyinstaller(workdir, args):
+    """
+    Run PyInstaller of this checkout in `workdir`. Return None on success and the tail of its output on failure.
+    """
+    env = dict(os.environ)
+    env['PYTHONPATH'] = os.pathsep.join(filter(None, [_CHECKOUT_DIR, env.get('PYTHONPATH')]))
+    result = subprocess.run(
+        [sys.executable, '-m', 'PyInstaller', '--noconfirm', '--log-level=WARN', *args],
+        cwd=workdir,
+        env=env,
+        stdout=subprocess.PIPE,
+        stderr=subprocess.STDOUT,
+    )
+    if result.returncode != 0:
+        return result.stdout.decode('utf-8', 'replace')[-2000:]
+    return None
+
+
+def _executable_path(workdir, name, mode):
+    if sys.platform == 'win32':
+        name += '.exe'
+    if mode == 'onefile':
+        return os.path.join(workdir, 'dist', name)
+    return os.path.join(workdir, 'dist', os.path.splitext(name)[0], name)
+
+
+def build_app(app, mode, workdir):
+    """
+    Build application `app` in `mode` ('onefile' or 'onedir') in `workdir`.
+
+    Return a tuple of the path of the executable (or None) and the reason it was not built (or None).
+    """
+    os.makedirs(workdir)
+    options = ['--' + mode]
+    if app == 'hello':
+        script = _HELLO_SCRIPT
+    elif app == 'numpy':
+        if not _has_module('numpy'):
+            return None, 'numpy is not available'
+        script = _NUMPY_SCRIPT
+    elif app == 'qt':
+        binding = _qt_binding()
+        if binding is None:
+            return None, 'no Qt binding is available'
+        script = _QT_SCRIPT.format(binding=binding)
+    elif app == 'splash':
+        if sys.platform == 'darwin':
+            return None, 'splash screen is not supported on macOS'
+        if not _has_module('tkinter'):
+            return None, 'tkinter is not available'
+        script = _SPLASH_SCRIPT
+        options += ['--splash', _SPLASH_IMAGE]
+    elif app == 'multipackage':
+        _write(os.path.join(workdir, 'app_a.py'), _MULTIPACKAGE_SCRIPT)
+        _write(os.path.join(workdir, 'app_b.py'), _MULTIPACKAGE_SCRIPT)
+        path_a = 'app_a' if mode == 'onefile' else 'app_a/app_a'
+        spec = _MULTIPACKAGE_SPEC.format(onefile=(mode == 'onefile'), path_a=path_a)
+        _write(os.path.join(workdir, 'multipackage.spec'), spec)
+        error = _run_pyinstaller(workdir, ['multipackage.spec'])
+        if error:
+            return None, 'build failed:\n' + error
+        return _executable_path(workdir, 'app_a', mode), None
+    else:
+        raise ValueError('Unknown application %r' % app)
+
+    _write(os.path.join(workdir, app + '.py'), script)
+    error = _run_pyinstaller(workdir, options + [app + '.py'])
+    if error:
+        return None, 'build failed:\n' + error
+    return _executable_path(workdir, app, mode), None
+
+
+def _app_files(executable):
+    """
+    Return the files that make up the application of `executable`: the files in the dist directory in onefile mode,
+    and the files in the application directory and the executables next to it (the dependency of a multipackage
+    application) in onedir mode.
+    """
+    app_dir = os.path.dirname(executable)
+    if os.path.basename(app_dir) != os.path.splitext(os.path.basename(executable))[0]:
+        top = [app_dir]
+    else:
+        top = [app_dir, os.path.dirname(app_dir)]
+    files = []
+    for index, directory in enumerate(top):
+        for root, dirs, filenames in os.walk(directory):
+            files += [os.path.join(root, filename) for filename in filenames]
+            if index > 0:
+                break
+    return files
+
+
+def cold_cache_method():
+    """
+    Return the name of the method used to evict the page cache, or None if none is available.
+    """
+    if sys.platform.startswith('linux') and hasattr(os, 'geteuid') and os.geteuid() == 0:
+        return 'drop_caches'
+    if hasattr(os, 'posix_fadvise'):
+        return 'fadvise'
+    if sys.platform == 'darwin' and shutil.which('purge'):
+        return 'purge'
+    return None
+
+
+def evict_page_cache(method, executable):
+    if method == 'drop_caches':
+        os.sync()
+        with open('/proc/sys/vm/drop_caches', 'w') as f:
+            f.write('3\n')
+    elif method == 'fadvise':
+        for filename in _app_files(executable):
+            fd = os.open(filename, os.O_RDONLY)
+            try:
+                os.fdatasync(fd)
+                os.posix_fadvise(fd, 0, 0, os.POSIX_FADV_DONTNEED)
+            finally:
+                os.close(fd)
+    elif method == 'purge':
+        subprocess.run(['purge'], check=True)
+
+
+def _read_trace(path, parent_pid):
+    """
+    Read the startup trace written by the bootloader. Return a dictionary of the total duration of each phase (in
+    seconds) and the total number of extracted bytes; the phases of the parent process of a onefile application are
+    prefixed with 'parent:'.
+    """
+    try:
+        with open(path) as f:
+            events = json.load(f)
+    except (OSError, ValueError):
+        return {}, None
+    onefile = any(event['pid'] != parent_pid for event in events)
+    phases = {}
+    extracted = 0
+    for event in events:
+        if event.get('ph') != 'X':
+            continue
+        name = event['name']
+        if onefile and event['pid'] == parent_pid:
+            name = 'parent:' + name
+        phases[name] = phases.get(name, 0.0) + event['dur'] / 1e6
+        if event['name'] == 'extract':
+            extracted += event.get('args', {}).get('bytes', 0)
+    return phases, extracted
+
+
+def run_once(executable, env):
+    """
+    Start `executable` once and wait for it to exit. Return a dictionary with the wall time, the peak RSS, the
+    extracted bytes and the durations of the startup phases.
+    """
+    with tempfile.TemporaryDirectory(prefix='pyi-trace-') as tracedir:
+        trace_path = os.path.join(tracedir, 'trace.json')
+        env = dict(env, PYI_STARTUP_TRACE=trace_path)
+        start = time.perf_counter()
+        process = subprocess.Popen([executable], env=env, stdout=subprocess.DEVNULL, stderr=subprocess.PIPE)
+        if hasattr(os, 'wait4'):
+            # ru_maxrss also covers the waited-for children, i.e., the child process of onefile applications.
+            _, status, rusage = os.wait4(process.pid, 0)
+            wall_time = time.perf_counter() - start
+            process.returncode = os.waitstatus_to_exitcode(status)
+            stderr = process.stderr.read()
+            process.stderr.close()
+            # In kilobytes on Linux and in bytes on macOS.
+            peak_rss = rusage.ru_maxrss * (1 if sys.platform == 'darwin' else 1024)
+        else:
+            _, stderr = process.communicate()
+            wall_time = time.perf_counter() - start
+            peak_rss = None
+        if process.returncode != 0:
+            raise RuntimeError(
+                '%s exited with code %d:\n%s' % (executable, process.returncode, stderr.decode('utf-8', 'replace'))
+            )
+        phases, extracted = _read_trace(trace_path, process.pid)
+    return {'wall_time': wall_time, 'peak_rss': peak_rss, 'extracted_bytes': extracted, 'phases': phases}
+
+
+def count_syscalls(executable, env):
+    """
+    Count the system calls of one run of `executable` (and its child processes) with strace. Return None if strace
+    is not available.
+    """
+    strace = shutil.which('strace')
+    if strace is None:
+        return None
+    with tempfile.TemporaryDirectory(prefix='pyi-strace-') as tracedir:
+        output = os.path.join(tracedir, 'strace.txt')
+        subprocess.run([strace, '-f', '-c', '-o', output, executable],
+                       env=env,
+                       stdout=subprocess.DEVNULL,
+                       stderr=subprocess.DEVNULL,
+                       check=True)
+        with open(output) as f:
+            summary = f.read()
+    # Rows of the summary table: % time, seconds, usecs/call, calls, [errors,] syscall.
+    counts = {}
+    for line in summary.splitlines():
+        match = re.match(r'^\s*[\d.]+\s+[\d.]+\s+\d+\s+(\d+)\s+(?:\d+\s+)?(\w+)\s*$', line)
+        if match and match.group(2) != 'total':
+            counts[match.group(2)] = int(match.group(1))
+    return {'total': sum(counts.values()), 'calls': counts}
+
+
+def _percentile(values, fraction):
+    """
+    Return the given percentile of `values`, using linear interpolation between the closest ranks.
+    """
+    values = sorted(values)
+    position = (len(values) - 1) * fraction
+    lower = int(position)
+    upper = min(lower + 1, len(values) - 1)
+    return values[lower] + (values[upper] - values[lower]) * (position - lower)
+
+
+def _summary(values):
+    values = [value for value in values if value is not None]
+    if not values:
+        return None
+    return {
+        'min': min(values),
+        'p50': _percentile(values, 0.50),
+        'p95': _percentile(values, 0.95),
+        'max': max(values),
+        'mean': statistics.mean(values),
+    }
+
+
+def benchmark(executable, iterations, cache, env):
+    """
+    Run `executable` `iterations` times with a 'cold' or 'warm' page cache, and summarize the results.
+    """
+    method = cold_cache_method() if cache == 'cold' else None
+    if cache == 'warm':
+        # Populate the page cache.
+        run_once(executable, env)
+    samples = []
+    for _ in range(iterations):
+        if method:
+            evict_page_cache(method, executable)
+        samples.append(run_once(executable, env))
+    phase_names = sorted({name for sample in samples for name in sample['phases']})
+    return {
+        'eviction': method,
+        'wall_time': _summary([sample['wall_time'] for sample in samples]),
+        'peak_rss': _summary([sample['peak_rss'] for sample in samples]),
+        'extracted_bytes': _summary([sample['extracted_bytes'] for sample in samples]),
+        'phases': {name: _summary([sample['phases'].get(name, 0.0) for sample in samples])
+                   for name in phase_names},
+    }
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument(
+        '--apps', type=_list, default=list(APPS), help='Comma-separated applications (default: %s).' % ','.join(APPS)
+    )
+    parser.add_argument(
+        '--modes', type=_list, default=list(MODES), help='Comma-separated build modes (default: onefile,onedir).'
+    )
+    parser.add_argument('--iterations', type=int, default=10, help='Number of runs of each application (default: 10).')
+    parser.add_argument('--no-cold', action='store_true', help='Skip the cold-cache runs.')
+    parser.add_argument('--no-strace', action='store_true', help='Do not count the system calls.')
+    parser.add_argument('--workdir', help='Build the applications in this directory and keep them.')
+    parser.add_argument('--output', help='Write results to this file instead of stdout.')
+    args = parser.parse_args()
+
+    for name, choices in (('apps', APPS), ('modes', MODES)):
+        unknown = set(getattr(args, name)) - set(choices)
+        if unknown:
+            parser.error('unknown %s: %s' % (name, ', '.join(sorted(unknown))))
+
+    caches = ['warm'] if args.no_cold or cold_cache_method() is None else ['cold', 'warm']
+    # Keep the onefile applications from sharing a cache directory or leaving extracted files behind.
+    env = {key: value for key, value in os.environ.items() if not key.startswith('PYI_')}
+
+    workdir = args.workdir or tempfile.mkdtemp(prefix='pyi-startup-')
+    results = []
+    try:
+        for app in args.apps:
+            for mode in args.modes:
+                executable, skipped = build_app(app, mode, os.path.join(workdir, app + '-' + mode))
+                result = {'app': app, 'mode': mode}
+                if skipped:
+                    result['skipped'] = skipped
+                    results.append(result)
+                    continue
+                result['size'] = sum(os.path.getsize(filename) for filename in _app_files(executable))
+                result['syscalls'] = None if args.no_strace else count_syscalls(executable, env)
+                result['runs'] = {cache: benchmark(executable, args.iterations, cache, env) for cache in caches}
+                results.append(result)
+    finally:
+        if not args.workdir:
+            shutil.rmtree(workdir, ignore_errors=True)
+
+    document = {
+        'format': FORMAT_VERSION,
+        'pyinstaller': PyInstaller.__version__,
+        'python': platform.python_version(),
+        'platform': platform.platform(),
+        'machine': platform.machine(),
+        'iterations': args.iterations,
+        'results': results,
+    }
+    document = json.dumps(document, indent=2)
+    if args.output:
+        with open(args.output, 'w') as f:
+            f.write(document + '\n')
+    else:
+        print(document)
+
+
+if __name__ == '__main__':
+    main()
@@ -144,3 +144,19 @@ def test_should_include_system_binary():
         expected = case[3]
 
         assert utils._should_include_system_binary(tuple, excepts) == expected
+
+
+def test_layout_profile(tmpdir):
+    profile = tmpdir.join('profile.txt')
+    profile.write_text(
+        'pkg\tlib/b.so\npyz\tjson\npkg\tdata/a.txt\nunknown line\npyz\tjson.decoder\npyz\tjson\npkg\tlib/b.so\n',
+        encoding='utf-8'
+    )
+    # Entries are listed in the order of their first access, once.
+    order = utils.load_layout_profile(str(profile))
+    assert order == {'pkg': ['lib/b.so', 'data/a.txt'], 'pyz': ['json', 'json.decoder']}
+
+    # The recorded entries come first, the others keep their order.
+    toc = [('data/a.txt', 'a', 'DATA'), ('data/c.txt', 'c', 'DATA'), ('lib/b.so', 'b', 'BINARY'), ('z', 'z', 'PYZ')]
+    utils.sort_by_layout_profile(toc, order['pkg'])
+    assert [entry[0] for entry in toc] == ['lib/b.so', 'data/a.txt', 'data/c.txt', 'z']
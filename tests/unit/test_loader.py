@@ -9,6 +9,7 @@
 # SPDX-License-Identifier: (GPL-2.0-or-later WITH Bootloader-exception)
 #-----------------------------------------------------------------------------
 
+import os
 from threading import Thread
 from queue import Queue
 
@@ -55,3 +56,266 @@ def foo():
 
     # Wait for the other thread to finish.
     thread.join()
+
+
+def test_zlib_archive_index(tmpdir):
+    """
+    Verify that the indexed TOC written by ZlibArchiveWriter is looked up and iterated by ZlibArchiveReader.
+    """
+    from PyInstaller.archive.writers import ZlibArchiveWriter
+    from PyInstaller.loader.pyimod02_archive import PYZ_TYPE_DATA, ZlibArchiveIndex, ZlibArchiveReader
+
+    names = ['b.c', 'a', 'b', 'ab', 'zzz', 'b.a']
+    toc = []
+    for name in names:
+        path = tmpdir.join(name + '.dat')
+        path.write_binary(name.encode() * 100)
+        toc.append((name, path.strpath, 'DATA'))
+    pyz_path = tmpdir.join('test.pyz').strpath
+    ZlibArchiveWriter(pyz_path, toc)
+
+    archive = ZlibArchiveReader(pyz_path)
+    assert isinstance(archive.toc, ZlibArchiveIndex)
+    assert list(archive.toc) == sorted(names)
+    for name in names:
+        assert name in archive.toc
+        assert archive.extract(name) == (PYZ_TYPE_DATA, name.encode() * 100)
+    for name in ['', 'aa', 'b.b', 'c', 'zzzz']:
+        assert name not in archive.toc
+        assert archive.extract(name) is None
+
+
+def test_zlib_archive_shared_dictionary(tmpdir):
+    """
+    Verify that the modules compressed with the shared compression dictionary are smaller, and are extracted by
+    ZlibArchiveReader.
+    """
+    from PyInstaller.archive.writers import ZlibArchiveWriter
+    from PyInstaller.loader.pyimod02_archive import PYZ_TYPE_MODULE, ZlibArchiveReader
+
+    toc = []
+    code_dict = {}
+    for i in range(100):
+        name = 'mod%d' % i
+        source = 'import os\n\ndef func_%d(path):\n    return os.path.join(path, "%s")\n' % (i, name)
+        code_dict[name] = compile(source, name + '.py', 'exec')
+        toc.append((name, name + '.py', 'PYMODULE'))
+
+    sizes = {}
+    for shared_dictionary in (False, True):
+        pyz_path = tmpdir.join('test%d.pyz' % shared_dictionary).strpath
+        ZlibArchiveWriter(pyz_path, toc, code_dict=code_dict, shared_dictionary=shared_dictionary)
+        archive = ZlibArchiveReader(pyz_path)
+        assert bool(archive.zdict) == shared_dictionary
+        for name, code in code_dict.items():
+            typ, obj = archive.extract(name)
+            assert typ == PYZ_TYPE_MODULE and obj == code
+        sizes[shared_dictionary] = sum(archive.toc[name][2] for name in code_dict)
+    assert sizes[True] < sizes[False]
+
+
+def test_zlib_archive_package_batches(tmpdir):
+    """
+    Verify that ZlibArchiveReader reads the submodules of a package together with the package, and takes them from its
+    cache when they are extracted.
+    """
+    from PyInstaller.archive.writers import ZlibArchiveWriter
+    from PyInstaller.loader.pyimod02_archive import ZlibArchiveReader
+
+    packages = ['pkg', 'pkg.sub']
+    names = ['pkg', 'pkg.a', 'pkg.b', 'pkg.sub', 'pkg.sub.c', 'pkg.sub.d', 'pkga', 'other']
+    toc = []
+    code_dict = {}
+    for name in names:
+        code_dict[name] = compile('NAME = %r' % name, name + '.py', 'exec')
+        path = name.replace('.', '/') + ('/__init__.py' if name in packages else '.py')
+        toc.append((name, path, 'PYMODULE'))
+    pyz_path = tmpdir.join('test.pyz').strpath
+    ZlibArchiveWriter(pyz_path, toc, code_dict=code_dict)
+
+    archive = ZlibArchiveReader(pyz_path)
+    assert [name for name, entry in archive.toc.submodules('pkg')] == ['pkg.a', 'pkg.b', 'pkg.sub']
+    assert [name for name, entry in archive.toc.submodules('pkg.sub')] == ['pkg.sub.c', 'pkg.sub.d']
+    assert archive.toc.submodules('pkg.a') == []
+
+    for name in names:
+        assert archive.extract(name)[1] == code_dict[name]
+    # Every submodule is read ahead with its package, including those of the subpackage taken from the cache.
+    assert (archive.cache.hits, archive.cache.misses) == (5, 0)
+    assert archive.cache.size == 0
+
+    archive = ZlibArchiveReader(pyz_path, cache_size=0)
+    assert archive.cache is None
+    for name in names:
+        assert archive.extract(name)[1] == code_dict[name]
+
+
+def test_archives_compression_workers(tmpdir, monkeypatch):
+    """
+    Verify that the archives written with several compression workers are the same as those written with one.
+    """
+    from PyInstaller.archive.writers import CArchiveWriter, ZlibArchiveWriter
+
+    # Spool some of the compressed files to temporary files.
+    monkeypatch.setattr(CArchiveWriter, '_SPOOL_SIZE', 1024)
+    pkg_toc = [('pyi-lazy-extract', '', 0, 'o')]
+    pyz_toc = []
+    code_dict = {}
+    for i in range(40):
+        path = tmpdir.join('f%d' % i)
+        path.write_binary(b''.join(b'%d:%d\n' % (i, j) for j in range(i * 200)))
+        pkg_toc.append(('data/f%d' % i, path.strpath, i % 2, 'x'))
+        pyz_toc.append(('data%d' % i, path.strpath, 'DATA'))
+        code_dict['mod%d' % i] = compile('X = %r' % list(range(i * 10)), 'mod%d.py' % i, 'exec')
+        pyz_toc.append(('mod%d' % i, 'mod%d.py' % i, 'PYMODULE'))
+    pkg_toc.append(('lib/dep', '', 0, 'd'))
+
+    contents = []
+    for workers in (1, 4):
+        pkg_path = tmpdir.join('test%d.pkg' % workers).strpath
+        CArchiveWriter(pkg_path, pkg_toc, pylib_name='libpython.so', entry_checksums=True, compression_workers=workers)
+        pyz_path = tmpdir.join('test%d.pyz' % workers).strpath
+        ZlibArchiveWriter(pyz_path, pyz_toc, code_dict=code_dict, compression_workers=workers)
+        with open(pkg_path, 'rb') as pkg, open(pyz_path, 'rb') as pyz:
+            contents.append((pkg.read(), pyz.read()))
+    assert contents[0] == contents[1]
+
+
+def test_carchive_formats(tmpdir):
+    """
+    Verify that CArchiveReader reads both the v6 archives written by CArchiveWriter (64-bit TOC and COOKIE fields), and
+    the archives of the previous (v5) format.
+    """
+    import struct
+    from PyInstaller.archive.readers import CArchiveReader
+    from PyInstaller.archive.writers import CArchiveWriter
+
+    names = ['a.txt', 'sub/b.txt', 'name_of_sixteen_']
+    toc = []
+    for name in names:
+        path = tmpdir.join(name.replace('/', '_'))
+        path.write_binary(name.encode() * 100)
+        toc.append((name, path.strpath, 0, 'x'))
+    v6_path = tmpdir.join('v6.pkg').strpath
+    CArchiveWriter(v6_path, toc, pylib_name='libpython.so')
+
+    archive = CArchiveReader(v6_path)
+    assert archive.version == 6
+    with open(v6_path, 'rb') as f:
+        data = f.read()
+    # Entries are padded to a multiple of 16 bytes, so that the 64-bit fields are naturally aligned.
+    assert archive.toclen % 16 == 0
+
+    # Re-write the same entries in v5 format.
+    v5_toc = []
+    for dpos, dlen, ulen, flag, typcd, nm in archive.toc:
+        name = nm.encode() + b'\0'
+        name += b'\0' * (-(18 + len(name)) % 16)
+        v5_toc.append(struct.pack('!iIIIBB', 18 + len(name), dpos, dlen, ulen, flag, ord(typcd)) + name)
+    v5_toc = b''.join(v5_toc)
+    total_len = archive.tocpos + len(v5_toc) + 88
+    v5_path = tmpdir.join('v5.pkg')
+    v5_path.write_binary(
+        data[:archive.tocpos] + v5_toc +
+        struct.pack('!8sIIii64s', b'MEI\014\013\012\013\016', total_len, archive.tocpos, len(v5_toc), 308, b'libpython.so')
+    )
+
+    for path, version in ((v6_path, 6), (v5_path.strpath, 5)):
+        archive = CArchiveReader(path)
+        assert archive.version == version
+        assert [os.path.normpath(name) for name in names] == archive.contents()
+        for name in names:
+            assert archive.extract(os.path.normpath(name)) == (False, name.encode() * 100)
+
+
+def test_carchive_entry_alignment(tmpdir):
+    """
+    Verify that CArchiveWriter aligns the data of the uncompressed binaries and data files to the requested alignment.
+    """
+    from PyInstaller.archive.readers import CArchiveReader
+    from PyInstaller.archive.writers import CArchiveWriter
+
+    toc = []
+    for i, size in enumerate((1, 5000, 3)):
+        path = tmpdir.join('f%d' % i)
+        path.write_binary(b'%d' % i * size)
+        toc.append(('f%d' % i, path.strpath, 0, 'x'))
+    pkg_path = tmpdir.join('aligned.pkg').strpath
+    CArchiveWriter(pkg_path, toc, pylib_name='libpython.so', entry_alignment=4096)
+
+    archive = CArchiveReader(pkg_path)
+    for dpos, dlen, ulen, flag, typcd, nm in archive.toc:
+        assert dpos % 4096 == 0
+        assert archive.extract(nm) == (False, nm[1:].encode() * ulen)
+
+
+def test_carchive_entry_checksums(tmpdir):
+    """
+    Verify that CArchiveWriter stores the CRC-32 of the uncompressed data of the entries, and that CArchiveReader
+    refuses to extract a corrupted entry.
+    """
+    import zlib
+    import pytest
+    from PyInstaller.archive.readers import CArchiveReader
+    from PyInstaller.archive.writers import CArchiveWriter
+
+    toc = [('pyi-lazy-extract', '', 0, 'o')]
+    for i, compress in enumerate((0, 1)):
+        path = tmpdir.join('f%d' % i)
+        path.write_binary(b'checksummed %d\n' % i * 5000)
+        toc.append(('f%d' % i, path.strpath, compress, 'x'))
+    pkg_path = tmpdir.join('checksums.pkg').strpath
+    CArchiveWriter(pkg_path, toc, pylib_name='libpython.so', entry_checksums=True)
+
+    archive = CArchiveReader(pkg_path)
+    assert archive.toc.checksums[0] is None
+    for entry, checksum in list(zip(archive.toc, archive.toc.checksums))[1:]:
+        nm = entry[-1]
+        assert checksum == zlib.crc32(b'checksummed %s\n' % nm[1:].encode() * 5000)
+        assert archive.extract(nm) == (False, b'checksummed %s\n' % nm[1:].encode() * 5000)
+
+    # Flip a byte in the data of the uncompressed entry.
+    dpos = archive.toc[archive.toc.find('f0')][0]
+    with open(pkg_path, 'r+b') as f:
+        f.seek(archive.pkg_start + dpos)
+        f.write(b'C')
+    with pytest.raises(ValueError, match='Checksum mismatch'):
+        CArchiveReader(pkg_path).extract('f0')
+
+
+def test_carchive_entry_digests(tmpdir):
+    """
+    Verify that CArchiveWriter stores the SHA-256 digest of the uncompressed data of the entries after their names,
+    alongside their CRC-32, and that CArchiveReader refuses to extract an entry whose data does not match it.
+    """
+    import hashlib
+    import pytest
+    from PyInstaller.archive.readers import CArchiveReader
+    from PyInstaller.archive.writers import CArchiveWriter
+
+    toc = [('pyi-runtime-store ~/.cache/store', '', 0, 'o')]
+    for i, (name, compress) in enumerate((('f0', 0), ('name_of_sixteen_', 1), ('sub/f2', 1))):
+        path = tmpdir.join('f%d' % i)
+        path.write_binary(b'digested %d\n' % i * 5000)
+        toc.append((name, path.strpath, compress, 'x'))
+    pkg_path = tmpdir.join('digests.pkg').strpath
+    CArchiveWriter(pkg_path, toc, pylib_name='libpython.so', entry_checksums=True, entry_digests=True)
+
+    archive = CArchiveReader(pkg_path)
+    assert [entry[-1] for entry in archive.toc] == [entry[0] for entry in toc]
+    assert archive.toc.digests[0] is None
+    for i, entry in enumerate(list(archive.toc)[1:]):
+        data = b'digested %d\n' % i * 5000
+        assert archive.toc.digests[i + 1] == hashlib.sha256(data).digest()
+        assert archive.extract(entry[-1]) == (False, data)
+
+    # Flip a byte in the data of the uncompressed entry, without the CRC-32 that would catch it first.
+    pkg_path = tmpdir.join('digests-only.pkg').strpath
+    CArchiveWriter(pkg_path, toc, pylib_name='libpython.so', entry_digests=True)
+    archive = CArchiveReader(pkg_path)
+    assert archive.toc.checksums[1] is None
+    with open(pkg_path, 'r+b') as f:
+        f.seek(archive.pkg_start + archive.toc[archive.toc.find('f0')][0])
+        f.write(b'D')
+    with pytest.raises(ValueError, match='Digest mismatch'):
+        CArchiveReader(pkg_path).extract('f0')